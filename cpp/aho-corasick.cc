@@ -0,0 +1,144 @@
+// SPDX-License-Identifier: Apache 2.0
+
+#include "aho-corasick.hh"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+namespace ahocorasick {
+
+uint32_t Matcher::add_category(const std::string &name) {
+  for (size_t i = 0; i < _categories.size(); i++) {
+    if (_categories[i] == name) {
+      return uint32_t(i);
+    }
+  }
+
+  _categories.push_back(name);
+  return uint32_t(_categories.size() - 1);
+}
+
+bool Matcher::add_pattern(const std::string &pattern, uint32_t category) {
+  if (_built) {
+    std::cerr << "Matcher: add_pattern() after build().\n";
+    return false;
+  }
+
+  if (category >= _categories.size()) {
+    std::cerr << "Matcher: invalid category id " << category << "\n";
+    return false;
+  }
+
+  if (pattern.empty() || (pattern.find('\n') != std::string::npos) ||
+      (pattern.find('\0') != std::string::npos)) {
+    return false;
+  }
+
+  int &v = _da.update(pattern.c_str(), pattern.size(), 0);
+  if (v == 0) {
+    // new pattern. store pattern id + 1.
+    _patterns.push_back(pattern);
+    _pattern_categories.emplace_back();
+    v = int(_patterns.size());
+  }
+
+  std::vector<uint32_t> &cats = _pattern_categories[size_t(v - 1)];
+  if (std::find(cats.begin(), cats.end(), category) == cats.end()) {
+    cats.push_back(category);
+  }
+
+  return true;
+}
+
+bool Matcher::load_dict(const std::string &filename, const std::string &category_name) {
+  std::ifstream ifs(filename);
+  if (!ifs) {
+    std::cerr << "Failed to open dict file: " << filename << "\n";
+    return false;
+  }
+
+  uint32_t cid = add_category(category_name);
+
+  std::string line;
+  while (std::getline(ifs, line)) {
+    if (!line.empty() && (line.back() == '\r')) {
+      line.pop_back();
+    }
+    if (line.empty()) {
+      continue;
+    }
+    add_pattern(line, cid);
+  }
+
+  return true;
+}
+
+void Matcher::build() {
+  // Collect trie nodes in BFS order(by depth) by re-traversing each pattern.
+  // Node ids are stable once all patterns are inserted.
+  struct NodeInfo {
+    uint32_t depth;
+    int parent;
+    int node;
+    uint8_t label;
+  };
+
+  std::vector<NodeInfo> nodes;
+  size_t max_node = 0;
+
+  for (size_t pid = 0; pid < _patterns.size(); pid++) {
+    const std::string &pat = _patterns[pid];
+    size_t from = 0;
+    for (size_t k = 0; k < pat.size(); k++) {
+      size_t parent = from;
+      size_t pos = 0;
+      _da.traverse(&pat[k], from, pos, 1);
+      nodes.push_back({uint32_t(k + 1), int(parent), int(from), uint8_t(pat[k])});
+      max_node = (std::max)(max_node, from);
+    }
+  }
+
+  std::stable_sort(nodes.begin(), nodes.end(), [](const NodeInfo &a, const NodeInfo &b) {
+    return a.depth < b.depth;
+  });
+
+  _fail.assign(max_node + 1, 0);
+  _output.assign(max_node + 1, -1);
+  _dict_link.assign(max_node + 1, -1);
+
+  for (size_t pid = 0; pid < _patterns.size(); pid++) {
+    const std::string &pat = _patterns[pid];
+    size_t from = 0;
+    size_t pos = 0;
+    _da.traverse(pat.c_str(), from, pos, pat.size());
+    _output[from] = int(pid);
+  }
+
+  std::vector<uint8_t> visited(max_node + 1, 0);
+
+  for (const NodeInfo &ni : nodes) {
+    if (visited[size_t(ni.node)]) {
+      continue;
+    }
+    visited[size_t(ni.node)] = 1;
+
+    int f = 0;
+    if (ni.parent != 0) {
+      // follow failure links of the parent until the edge exists.
+      int s = _fail[size_t(ni.parent)];
+      int to;
+      while (((to = next(size_t(s), ni.label)) < 0) && (s != 0)) {
+        s = _fail[size_t(s)];
+      }
+      f = (to < 0) ? 0 : to;
+    }
+
+    _fail[size_t(ni.node)] = f;
+    _dict_link[size_t(ni.node)] = (_output[size_t(f)] >= 0) ? f : _dict_link[size_t(f)];
+  }
+
+  _built = true;
+}
+
+} // namespace ahocorasick
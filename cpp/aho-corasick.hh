@@ -0,0 +1,157 @@
+// SPDX-License-Identifier: Apache 2.0
+//
+// Aho-Corasick multi-pattern matcher on the ccedar double array.
+//
+// Used for NG word dictionaries(dict/*.txt) and the phrase lists of
+// 03_clean_step3_linewise/linewise_filtering.py. All patterns are matched
+// in a single pass over the text(O(text + hits)).
+//
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ccedar_core.h"
+
+namespace ahocorasick {
+
+struct Hit {
+  uint32_t pattern_id;
+  uint32_t line;   // 0-based line index('\n' separated)
+  uint32_t begin;  // byte offset in the text
+  uint32_t end;    // byte offset in the text(exclusive)
+};
+
+class Matcher {
+ public:
+  Matcher() = default;
+
+  ///
+  /// Register category and return its id.
+  /// Returns an existing id when `name` is already registered.
+  ///
+  uint32_t add_category(const std::string &name);
+
+  ///
+  /// Add `pattern` to `category`. The same pattern can belong to multiple
+  /// categories. Must be called before build().
+  /// Empty patterns and patterns containing '\n' or NUL are rejected.
+  ///
+  bool add_pattern(const std::string &pattern, uint32_t category);
+
+  ///
+  /// Load a dictionary file(one pattern per line, empty lines are ignored)
+  /// into category `category_name`.
+  ///
+  bool load_dict(const std::string &filename, const std::string &category_name);
+
+  ///
+  /// Compute failure and output links. Must be called before search().
+  ///
+  void build();
+
+  size_t num_categories() const { return _categories.size(); }
+  size_t num_patterns() const { return _patterns.size(); }
+  const std::string &category_name(uint32_t cid) const { return _categories[cid]; }
+  const std::string &pattern(uint32_t pid) const { return _patterns[pid]; }
+  const std::vector<uint32_t> &pattern_categories(uint32_t pid) const { return _pattern_categories[pid]; }
+
+  ///
+  /// Call `fn(const Hit &)` for every occurrence of every pattern in `text`
+  /// (overlapping matches included).
+  ///
+  template <typename F>
+  void scan(std::string_view text, F &&fn) const;
+
+  ///
+  /// Collect all hits.
+  ///
+  void search(std::string_view text, std::vector<Hit> &hits) const {
+    scan(text, [&hits](const Hit &h) { hits.push_back(h); });
+  }
+
+  ///
+  /// Per-category hit counts. `counts` is resized to num_categories().
+  ///
+  void count(std::string_view text, std::vector<uint32_t> &counts) const {
+    counts.assign(_categories.size(), 0);
+    scan(text, [&](const Hit &h) {
+      for (uint32_t cid : _pattern_categories[h.pattern_id]) {
+        counts[cid]++;
+      }
+    });
+  }
+
+ private:
+  typedef ccedar::da<char, int> trie_t;
+
+  // one byte transition. returns -1 when no edge.
+  inline int next(size_t from, uint8_t c) const {
+    size_t pos = 0;
+    char key = char(c);
+    int r = _da.traverse(&key, from, pos, 1);
+    return (r == trie_t::CEDAR_NO_PATH) ? -1 : int(from);
+  }
+
+  trie_t _da;
+  bool _built{false};
+
+  std::vector<std::string> _categories;
+  std::vector<std::string> _patterns;
+  std::vector<std::vector<uint32_t>> _pattern_categories;
+
+  // indexed by da node id.
+  std::vector<int> _fail;      // failure link
+  std::vector<int> _output;    // pattern id which ends at this node, or -1
+  std::vector<int> _dict_link; // nearest proper suffix node with output, or -1
+};
+
+template <typename F>
+void Matcher::scan(std::string_view text, F &&fn) const {
+  if (!_built || _patterns.empty()) {
+    return;
+  }
+
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(text.data());
+  const size_t n = text.size();
+
+  int state = 0;
+  uint32_t line = 0;
+
+  for (size_t i = 0; i < n; i++) {
+    const uint8_t c = p[i];
+
+    if (c == 0) {
+      // label 0 is used for terminals in the double array.
+      state = 0;
+      continue;
+    }
+
+    int to;
+    while (((to = next(size_t(state), c)) < 0) && (state != 0)) {
+      state = _fail[size_t(state)];
+    }
+    state = (to < 0) ? 0 : to;
+
+    for (int s = (_output[size_t(state)] >= 0) ? state : _dict_link[size_t(state)];
+         s >= 0; s = _dict_link[size_t(s)]) {
+      const uint32_t pid = uint32_t(_output[size_t(s)]);
+      Hit h;
+      h.pattern_id = pid;
+      h.line = line;
+      h.end = uint32_t(i + 1);
+      h.begin = h.end - uint32_t(_patterns[pid].size());
+      fn(h);
+    }
+
+    if (c == '\n') {
+      // matches never cross lines.
+      state = 0;
+      line++;
+    }
+  }
+}
+
+} // namespace ahocorasick
@@ -0,0 +1,208 @@
+// SPDX-License-Identifier: Apache 2.0
+
+#include "binned-writer.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+#include "./zstd.h"
+#include "parquet-sink.hh"
+#include "stage-stats.hh"
+
+#define GLOB_USE_GHC_FILESYSTEM
+#include "glob.hpp"
+
+namespace binning {
+
+std::vector<double> quantile_edges(const quantile::KLLSketch &sketch, uint32_t nbins) {
+  std::vector<double> edges;
+  if ((nbins == 0) || (sketch.count() == 0)) {
+    return edges;
+  }
+
+  std::vector<double> qs(nbins + 1);
+  for (uint32_t i = 0; i <= nbins; i++) {
+    qs[i] = double(i) / double(nbins);
+  }
+
+  edges = sketch.quantiles(qs);
+
+  // duplicates='drop'
+  edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+  return edges;
+}
+
+BinnedWriter::BinnedWriter(const std::string &out_dir, size_t nbins, const BinnedWriterConfig &config)
+    : _out_dir(out_dir), _config(config), _bins(nbins) {
+  if (_config.nthreads == 0) {
+    _config.nthreads = (std::max)(1u, std::thread::hardware_concurrency());
+  }
+  if (_config.max_pending == 0) {
+    _config.max_pending = 2 * _config.nthreads;
+  }
+  if (_config.docs_per_file == 0) {
+    _config.docs_per_file = 1;
+  }
+
+  for (uint32_t t = 0; t < _config.nthreads; t++) {
+    _workers.emplace_back(std::thread([this]() { worker(); }));
+  }
+}
+
+BinnedWriter::~BinnedWriter() {
+  if (!_finished) {
+    finish();
+  }
+}
+
+bool BinnedWriter::add(size_t bin, std::string_view line) {
+  if (bin >= _bins.size()) {
+    std::cerr << "BinnedWriter: invalid bin " << bin << "\n";
+    return false;
+  }
+
+  Bin &b = _bins[bin];
+  if (b.ndocs > 0) {
+    b.buf.push_back('\n');
+  }
+  b.buf.append(line.data(), line.size());
+  b.ndocs++;
+  b.total_docs++;
+
+  if (b.ndocs >= _config.docs_per_file) {
+    submit(bin);
+  }
+
+  std::lock_guard<std::mutex> lk(_mutex);
+  return !_failed;
+}
+
+void BinnedWriter::submit(size_t bin) {
+  Bin &b = _bins[bin];
+  if (b.ndocs == 0) {
+    return;
+  }
+
+  glob::fs::path dir = glob::fs::path(_out_dir) / ("chunk_" + std::to_string(bin));
+  std::error_code ec;
+  glob::fs::create_directories(dir, ec);
+
+  char basename[1024];
+  snprintf(basename, sizeof(basename), _config.basename.c_str(), b.file_count);
+
+  Job job;
+  job.filename = (dir / basename).string();
+  job.data = std::move(b.buf);
+
+  b.buf = std::string();
+  b.ndocs = 0;
+  b.file_count++;
+
+  std::unique_lock<std::mutex> lk(_mutex);
+  _cv_slot.wait(lk, [this]() { return _jobs.size() < _config.max_pending; });
+  _jobs.push_back(std::move(job));
+  lk.unlock();
+  _cv_job.notify_one();
+}
+
+void BinnedWriter::worker() {
+  ZSTD_CCtx *cctx = ZSTD_createCCtx();
+  std::vector<char> cbuf;
+
+  for (;;) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lk(_mutex);
+      _cv_job.wait(lk, [this]() { return _done || !_jobs.empty(); });
+      if (_jobs.empty()) {
+        break;
+      }
+      job = std::move(_jobs.front());
+      _jobs.pop_front();
+    }
+    _cv_slot.notify_one();
+
+    if (_config.parquet) {
+      pqsink::Options options;
+      options.row_group_size = _config.row_group_size ? _config.row_group_size : _config.docs_per_file;
+      options.comp_level = _config.comp_level;
+
+      std::string err;
+      const size_t data_size = job.data.size();
+      if (pqsink::write_jsonl(job.data, job.filename, options, &err)) {
+        std::cout << "write to " << job.filename << " : " << data_size << "\n";
+      } else {
+        std::cerr << "Failed to write Parquet file: " << job.filename << " " << err << "\n";
+        std::lock_guard<std::mutex> lk(_mutex);
+        _failed = true;
+      }
+      continue;
+    }
+
+    const uint64_t compress_start = stagestats::now_ns();
+    cbuf.resize(ZSTD_compressBound(job.data.size()));
+    size_t csize = ZSTD_compressCCtx(cctx, cbuf.data(), cbuf.size(), job.data.data(),
+                                     job.data.size(), _config.comp_level);
+    stagestats::add_time(stagestats::Stage::Compress, stagestats::now_ns() - compress_start);
+
+    bool ok = !ZSTD_isError(csize);
+    if (!ok) {
+      std::cerr << "zstd compression failed: " << ZSTD_getErrorName(csize) << "\n";
+    } else {
+      FILE *fp = fopen(job.filename.c_str(), "wb");
+      if (!fp) {
+        std::cerr << "Failed to open file for write: " << job.filename << "\n";
+        ok = false;
+      } else {
+        stagestats::ScopedTimer timer(stagestats::Stage::Write);
+        ok = (fwrite(cbuf.data(), 1, csize, fp) == csize);
+        ok &= (fclose(fp) == 0);
+        stagestats::add_bytes(stagestats::Stage::Write, csize, csize);
+        if (!ok) {
+          std::cerr << "Failed to write file: " << job.filename << "\n";
+        }
+      }
+    }
+
+    if (ok) {
+      stagestats::add_bytes(stagestats::Stage::Compress, job.data.size(), csize);
+      std::cout << "write to " << job.filename << " : " << job.data.size() << " -> " << csize << "\n";
+    } else {
+      std::lock_guard<std::mutex> lk(_mutex);
+      _failed = true;
+    }
+  }
+
+  ZSTD_freeCCtx(cctx);
+}
+
+bool BinnedWriter::finish() {
+  if (_finished) {
+    std::lock_guard<std::mutex> lk(_mutex);
+    return !_failed;
+  }
+
+  // remainders
+  for (size_t bin = 0; bin < _bins.size(); bin++) {
+    submit(bin);
+  }
+
+  {
+    std::lock_guard<std::mutex> lk(_mutex);
+    _done = true;
+  }
+  _cv_job.notify_all();
+
+  for (auto &th : _workers) {
+    th.join();
+  }
+  _workers.clear();
+  _finished = true;
+
+  std::lock_guard<std::mutex> lk(_mutex);
+  return !_failed;
+}
+
+} // namespace binning
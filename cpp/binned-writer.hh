@@ -0,0 +1,118 @@
+// SPDX-License-Identifier: Apache 2.0
+//
+// Bin(chunk) assignment and per-bin sharded JSONL + zstd(or Parquet) writer
+// for the beauty pass(07_beauty/create_dataset.py).
+//
+// Documents are appended to the buffer of their bin. When a bin reaches
+// `docs_per_file` documents, the buffer is handed to a pool of compressor
+// threads and written to `<out_dir>/chunk_<bin>/<basename % file_index>`.
+// The number of pending buffers is bounded so memory usage stays at about
+// (nbins + max_pending) * docs_per_file documents.
+//
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "quantile-sketch.hh"
+
+namespace binning {
+
+///
+/// Bin edges of `nbins` equal-frequency bins, like
+/// `pandas.qcut(values, nbins, duplicates='drop', retbins=True)`.
+/// Returns (up to) nbins + 1 edges. Duplicated edges are dropped.
+///
+std::vector<double> quantile_edges(const quantile::KLLSketch &sketch, uint32_t nbins);
+
+///
+/// `np.digitize(x, edges)` clamped to [0, edges.size() - 1]
+/// (same as save_to_chunk in create_dataset.py)
+///
+inline size_t digitize(const std::vector<double> &edges, double x) {
+  if (edges.empty()) {
+    return 0;
+  }
+  // np.digitize(right=False): index i such that edges[i-1] <= x < edges[i]
+  size_t lo = 0;
+  size_t hi = edges.size();
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (edges[mid] <= x) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return (lo < edges.size()) ? lo : (edges.size() - 1);
+}
+
+struct BinnedWriterConfig {
+  uint64_t docs_per_file{25600};
+  int comp_level{5};
+  uint32_t nthreads{0};    // # of compressor threads. 0 = use all cores.
+  uint32_t max_pending{0}; // # of buffers waiting for compression. 0 = 2 * nthreads
+  std::string basename{"japanese-corpus-%05u.jsonl.zstd"}; // printf format with the file index
+  bool parquet{false};     // write Parquet files(zstd pages of level `comp_level`) instead of JSONL.zstd
+  uint64_t row_group_size{0}; // Parquet rows per row group. 0 = docs_per_file(one row group per file)
+};
+
+class BinnedWriter {
+ public:
+  BinnedWriter(const std::string &out_dir, size_t nbins, const BinnedWriterConfig &config);
+  ~BinnedWriter();
+  BinnedWriter(const BinnedWriter &) = delete;
+  BinnedWriter &operator=(const BinnedWriter &) = delete;
+
+  ///
+  /// Append one JSONL line(without '\n') to `bin`.
+  /// Blocks when too many full buffers are waiting for compression.
+  ///
+  bool add(size_t bin, std::string_view line);
+
+  ///
+  /// Write the remaining documents of each bin and wait for all writes.
+  /// Returns false when any write failed.
+  ///
+  bool finish();
+
+  uint64_t num_documents(size_t bin) const { return _bins[bin].total_docs; }
+  uint32_t num_files(size_t bin) const { return _bins[bin].file_count; }
+
+ private:
+  struct Bin {
+    std::string buf;
+    uint64_t ndocs{0};
+    uint64_t total_docs{0};
+    uint32_t file_count{0};
+  };
+
+  struct Job {
+    std::string filename;
+    std::string data;
+  };
+
+  void submit(size_t bin);
+  void worker();
+
+  std::string _out_dir;
+  BinnedWriterConfig _config;
+  std::vector<Bin> _bins;
+
+  std::mutex _mutex;
+  std::condition_variable _cv_job;
+  std::condition_variable _cv_slot;
+  std::deque<Job> _jobs;
+  bool _done{false};
+  bool _failed{false};
+  bool _finished{false};
+  std::vector<std::thread> _workers;
+};
+
+} // namespace binning
@@ -0,0 +1,280 @@
+// SPDX-License-Identifier: Apache 2.0
+
+#include "dedup-cluster.hh"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "task-pool.hh"
+
+namespace dedupcluster {
+
+void emit_candidate_pairs(const std::vector<std::vector<uint64_t>> &band_keys, size_t n_docs,
+                          std::vector<Pair> &pairs) {
+  const size_t n_bands = band_keys.size();
+  std::vector<std::vector<Pair>> band_pairs(n_bands);
+
+  taskpool::parallel_for(n_bands, [&](uint64_t begin, uint64_t end, uint32_t) {
+    std::vector<std::pair<uint64_t, uint32_t>> keys;
+
+    for (uint64_t band = begin; band < end; band++) {
+      const std::vector<uint64_t> &src = band_keys[band];
+
+      keys.resize(n_docs);
+      for (size_t i = 0; i < n_docs; i++) {
+        keys[i] = std::make_pair(src[i], uint32_t(i));
+      }
+      // (key, doc) order: the first document of a run is the smallest index.
+      std::sort(keys.begin(), keys.end());
+
+      std::vector<Pair> &dst = band_pairs[band];
+      for (size_t i = 1, first = 0; i < keys.size(); i++) {
+        if (keys[i].first != keys[first].first) {
+          first = i;
+          continue;
+        }
+        dst.emplace_back(keys[first].second, keys[i].second);
+      }
+    }
+  });
+
+  pairs.clear();
+  for (auto &p : band_pairs) {
+    pairs.insert(pairs.end(), p.begin(), p.end());
+    std::vector<Pair>().swap(p);
+  }
+}
+
+namespace {
+
+// Groups of documents(sorted by index) in one array.
+struct Groups
+{
+  std::vector<uint32_t> members;
+  std::vector<size_t> offsets{0};  // group g = members[offsets[g], offsets[g + 1])
+
+  size_t size() const { return offsets.size() - 1; }
+
+  void append(const uint32_t *docs, size_t n) {
+    members.insert(members.end(), docs, docs + n);
+    offsets.push_back(members.size());
+  }
+};
+
+inline uint64_t pair_key(uint32_t a, uint32_t b) { return (uint64_t(a) << 32) | b; }
+
+} // namespace
+
+void emit_verified_pairs(const std::vector<std::vector<uint64_t>> &band_keys, size_t n_docs,
+                         const VerifyFunction &verify, std::vector<Pair> &pairs, size_t *n_verified) {
+  const size_t n_bands = band_keys.size();
+
+  // documents sharing a key, per band.
+  std::vector<Groups> band_groups(n_bands);
+  taskpool::parallel_for(n_bands, [&](uint64_t begin, uint64_t end, uint32_t) {
+    std::vector<std::pair<uint64_t, uint32_t>> keys;
+    std::vector<uint32_t> docs;
+
+    for (uint64_t band = begin; band < end; band++) {
+      const std::vector<uint64_t> &src = band_keys[band];
+
+      keys.resize(n_docs);
+      for (size_t i = 0; i < n_docs; i++) {
+        keys[i] = std::make_pair(src[i], uint32_t(i));
+      }
+      std::sort(keys.begin(), keys.end());
+
+      for (size_t first = 0, i = 1; i <= keys.size(); i++) {
+        if ((i < keys.size()) && (keys[i].first == keys[first].first)) {
+          continue;
+        }
+        if (i - first >= 2) {
+          docs.clear();
+          for (size_t k = first; k < i; k++) {
+            docs.push_back(keys[k].second);
+          }
+          band_groups[band].append(docs.data(), docs.size());
+        }
+        first = i;
+      }
+    }
+  });
+
+  Groups groups;
+  for (auto &g : band_groups) {
+    for (size_t k = 0; k < g.size(); k++) {
+      groups.append(g.members.data() + g.offsets[k], g.offsets[k + 1] - g.offsets[k]);
+    }
+    Groups().members.swap(g.members);
+  }
+
+  // (centre, member) -> verified
+  std::unordered_map<uint64_t, uint8_t> verified;
+  std::vector<Pair> batch;
+  std::vector<uint8_t> keep;
+
+  pairs.clear();
+  while (groups.size()) {
+    batch.clear();
+    for (size_t g = 0; g < groups.size(); g++) {
+      const uint32_t centre = groups.members[groups.offsets[g]];
+      for (size_t k = groups.offsets[g] + 1; k < groups.offsets[g + 1]; k++) {
+        if (!verified.count(pair_key(centre, groups.members[k]))) {
+          batch.emplace_back(centre, groups.members[k]);
+        }
+      }
+    }
+    std::sort(batch.begin(), batch.end());
+    batch.erase(std::unique(batch.begin(), batch.end()), batch.end());
+
+    keep.assign(batch.size(), 0);
+    if (!batch.empty()) {
+      verify(batch, keep);
+    }
+    for (size_t i = 0; i < batch.size(); i++) {
+      verified.emplace(pair_key(batch[i].first, batch[i].second), keep[i]);
+    }
+
+    // kept star pairs are emitted, failed members form the next groups.
+    Groups next;
+    std::vector<uint32_t> failed;
+    for (size_t g = 0; g < groups.size(); g++) {
+      const uint32_t centre = groups.members[groups.offsets[g]];
+      failed.clear();
+      for (size_t k = groups.offsets[g] + 1; k < groups.offsets[g + 1]; k++) {
+        const uint32_t doc = groups.members[k];
+        if (verified[pair_key(centre, doc)]) {
+          pairs.emplace_back(centre, doc);
+        } else {
+          failed.push_back(doc);
+        }
+      }
+      if (failed.size() >= 2) {
+        next.append(failed.data(), failed.size());
+      }
+    }
+    groups = std::move(next);
+  }
+
+  std::sort(pairs.begin(), pairs.end());
+  pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+  if (n_verified) {
+    (*n_verified) = verified.size();
+  }
+}
+
+UnionFind::UnionFind(size_t n) : _n(n), _parent(new std::atomic<uint32_t>[n]) {
+  for (size_t i = 0; i < n; i++) {
+    _parent[i].store(uint32_t(i), std::memory_order_relaxed);
+  }
+}
+
+// parent[x] <= x always holds and parents only decrease, so concurrent path
+// halving can not create cycles. A failed halving CAS is harmless.
+uint32_t UnionFind::find(uint32_t x) {
+  for (;;) {
+    uint32_t p = _parent[x].load(std::memory_order_acquire);
+    if (p == x) {
+      return x;
+    }
+    uint32_t gp = _parent[p].load(std::memory_order_acquire);
+    if (gp != p) {
+      _parent[x].compare_exchange_weak(p, gp, std::memory_order_acq_rel, std::memory_order_relaxed);
+    }
+    x = gp;
+  }
+}
+
+void UnionFind::unite(uint32_t a, uint32_t b) {
+  for (;;) {
+    a = find(a);
+    b = find(b);
+    if (a == b) {
+      return;
+    }
+    if (a < b) {
+      std::swap(a, b);
+    }
+    // link the larger root under the smaller one. Retry when `a` is no
+    // longer a root(another thread linked it).
+    uint32_t expected = a;
+    if (_parent[a].compare_exchange_strong(expected, b, std::memory_order_acq_rel,
+                                           std::memory_order_acquire)) {
+      return;
+    }
+  }
+}
+
+std::vector<uint32_t> cluster(const std::vector<Pair> &pairs, size_t n_docs) {
+  UnionFind uf(n_docs);
+
+  taskpool::parallel_for(pairs.size(), [&](uint64_t begin, uint64_t end, uint32_t) {
+    for (uint64_t i = begin; i < end; i++) {
+      uf.unite(pairs[i].first, pairs[i].second);
+    }
+  }, /* min_range */ 4096);
+
+  std::vector<uint32_t> roots(n_docs);
+  taskpool::parallel_for(n_docs, [&](uint64_t begin, uint64_t end, uint32_t) {
+    for (uint64_t i = begin; i < end; i++) {
+      roots[i] = uf.find(uint32_t(i));
+    }
+  }, /* min_range */ 4096);
+
+  return roots;
+}
+
+void select_keep(const std::vector<uint32_t> &roots, const PreferFunction &prefer,
+                 std::vector<uint8_t> &duplicate) {
+  const size_t n = roots.size();
+
+  duplicate.assign(n, 0);
+
+  if (!prefer) {
+    for (size_t i = 0; i < n; i++) {
+      duplicate[i] = (roots[i] != uint32_t(i)) ? 1 : 0;
+    }
+    return;
+  }
+
+  // kept document of each cluster(indexed by root). The root is visited
+  // first since it is the smallest index of the cluster.
+  std::vector<uint32_t> keep(n);
+  for (size_t i = 0; i < n; i++) {
+    const uint32_t r = roots[i];
+    if (r == uint32_t(i)) {
+      keep[r] = r;
+    } else if (prefer(uint32_t(i), keep[r])) {
+      keep[r] = uint32_t(i);
+    }
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    duplicate[i] = (keep[roots[i]] != uint32_t(i)) ? 1 : 0;
+  }
+}
+
+Summary summarize(const std::vector<uint32_t> &roots, const std::vector<uint8_t> &duplicate) {
+  Summary s;
+  s.n_documents = roots.size();
+
+  std::vector<uint32_t> sizes(roots.size(), 0);
+  for (size_t i = 0; i < roots.size(); i++) {
+    sizes[roots[i]]++;
+  }
+
+  for (size_t i = 0; i < roots.size(); i++) {
+    if (sizes[i] >= 2) {
+      s.n_clusters++;
+      s.n_clustered += sizes[i];
+      s.max_cluster_size = (std::max)(s.max_cluster_size, uint64_t(sizes[i]));
+      s.size_histogram[sizes[i]]++;
+    }
+    s.n_duplicates += (i < duplicate.size()) ? duplicate[i] : 0;
+  }
+
+  return s;
+}
+
+} // namespace dedupcluster
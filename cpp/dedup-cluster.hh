@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: Apache 2.0
+//
+// Near-duplicate clusters from LSH band keys.
+//
+// 1. emit_candidate_pairs(): per band, documents sharing a band key are
+//    paired with the first(smallest index) document of that key. This links
+//    each group as a star, so a key shared by k documents gives k - 1 pairs
+//    instead of k(k - 1) / 2.
+//    emit_verified_pairs() verifies the pairs inside each key group
+//    (re-centred on members failing the first document) before linking, so
+//    one false positive does not chain unrelated documents together.
+// 2. UnionFind: lock-free union-find(CAS linking + path halving) run over the
+//    pairs with taskpool::parallel_for(). The larger root is always linked
+//    under the smaller one, so the root of a cluster is its smallest document
+//    index regardless of thread scheduling.
+// 3. select_keep(): keep one document per cluster(keep-policy hook, default:
+//    the first document) and mark the others as duplicates.
+// 4. summarize(): # of clusters and the cluster-size histogram.
+//
+// Unlike `dedup_stream()`, which only compares a document with the keys of
+// earlier documents, clusters are transitive: A ~ B and B ~ C put A, B and C
+// in one cluster. This replaces attic/generate_connected_components.py
+// (networkit graph of the duplicate pairs held in Python memory).
+//
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace dedupcluster {
+
+using Pair = std::pair<uint32_t, uint32_t>;
+
+///
+/// Candidate pairs(first document of the key, document) of documents sharing
+/// a band key.
+///
+/// @param[in] band_keys `n_bands` arrays of `n_docs` 64-bit band keys
+/// (band_keys[band][doc]).
+///
+void emit_candidate_pairs(const std::vector<std::vector<uint64_t>> &band_keys, size_t n_docs,
+                          std::vector<Pair> &pairs /* out */);
+
+///
+/// Pair test of emit_verified_pairs(): set `keep[i]` to 1 when pairs[i] is a
+/// true near-duplicate(e.g. its Jaccard is above a threshold). `pairs` are
+/// sorted and unique. `keep` is sized to pairs.size().
+///
+using VerifyFunction = std::function<void(const std::vector<Pair> &pairs, std::vector<uint8_t> &keep /* out */)>;
+
+///
+/// emit_candidate_pairs() with the pairs verified inside each group of
+/// documents sharing a band key. Members failing against the first
+/// document of the group are re-grouped with the first failing member as
+/// the new centre(repeated until no group is left). So a false positive
+/// centre does not hide the true duplicates among the other members.
+///
+/// Star pairs of all groups are verified in one `verify` call per round,
+/// sorted and unique, and results are reused in later rounds. So a pair
+/// colliding in several bands is verified once. Returns the kept pairs
+/// (sorted, unique). `n_verified` receives the # of distinct pairs verified.
+///
+void emit_verified_pairs(const std::vector<std::vector<uint64_t>> &band_keys, size_t n_docs,
+                         const VerifyFunction &verify, std::vector<Pair> &pairs /* out */,
+                         size_t *n_verified = nullptr);
+
+///
+/// Union-find over document indices, safe to unite() from multiple threads.
+///
+class UnionFind
+{
+ public:
+  explicit UnionFind(size_t n);
+
+  size_t size() const { return _n; }
+
+  ///
+  /// Root of `x`(the smallest index of its cluster once all unite() calls
+  /// have finished).
+  ///
+  uint32_t find(uint32_t x);
+
+  void unite(uint32_t a, uint32_t b);
+
+ private:
+  size_t _n{0};
+  std::unique_ptr<std::atomic<uint32_t>[]> _parent;
+};
+
+///
+/// Unite all `pairs` in parallel and return the cluster id(root) of each of
+/// `n_docs` documents.
+///
+std::vector<uint32_t> cluster(const std::vector<Pair> &pairs, size_t n_docs);
+
+///
+/// Keep-policy hook: true when document `a` should be kept instead of
+/// document `b`(both in the same cluster).
+///
+using PreferFunction = std::function<bool(uint32_t a, uint32_t b)>;
+
+///
+/// Keep one document per cluster(`prefer`, or the first document when
+/// `prefer` is empty). `duplicate[i]` is 1 for the other documents.
+///
+void select_keep(const std::vector<uint32_t> &roots, const PreferFunction &prefer,
+                 std::vector<uint8_t> &duplicate /* out */);
+
+struct Summary
+{
+  uint64_t n_documents{0};
+  uint64_t n_clusters{0};          // clusters with 2 or more documents
+  uint64_t n_clustered{0};         // documents in those clusters
+  uint64_t n_duplicates{0};
+  uint64_t max_cluster_size{0};
+  std::map<uint64_t, uint64_t> size_histogram;  // cluster size(>= 2) -> # of clusters
+};
+
+Summary summarize(const std::vector<uint32_t> &roots, const std::vector<uint8_t> &duplicate);
+
+} // namespace dedupcluster
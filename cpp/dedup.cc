@@ -2,13 +2,21 @@
 
 #include <algorithm>
 #include <clocale>
+#include <cmath>
 #include <cstdint>
+#include <memory>
 #include <mutex>
 #include <set>
 #include <thread>
 #include <vector>
 #include <unordered_set>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
 #include "rwkv_world_tokenizer_cedar.hh"
 
 static std::unordered_set<std::string> sUNICODE_PUNCT = {
@@ -54,7 +62,7 @@ std::vector<uint16_t> normalize_for_dedup(const std::vector<uint16_t> &text,
   // 2. remove punctuation.
 
   for (size_t i = 0; i < text.size(); i++) {
-    uint16_t id = i;
+    uint16_t id = text[i];
     if (id == ws_id) {
       continue;
     }
@@ -73,25 +81,368 @@ static uint32_t cpu_count() {
   return (std::max)(1u, std::thread::hardware_concurrency());
 }
 
+void compute_shingle_set(const char *text, size_t len, uint32_t n_gram,
+                         std::vector<uint64_t> &dst /* out */) {
+  dst.clear();
+  if (n_gram == 0) {
+    return;
+  }
+
+  // byte offsets of the last `n_gram` chars(ring buffer).
+  constexpr uint32_t kMaxGram = 32;
+  n_gram = (std::min)(n_gram, kMaxGram);
+  size_t starts[kMaxGram];
+
+  auto add_shingle = [&](size_t begin, size_t end) {
+    uint64_t h[2];
+    MurmurHash3_x64_128(text + begin, int(end - begin), 0, h);
+    dst.push_back(h[0]);
+  };
+
+  size_t nchars = 0;
+  for (size_t i = 0; i < len;) {
+    starts[nchars % n_gram] = i;
+    // invalid lead byte: treat as 1 byte char.
+    const uint32_t clen = (std::max)(uint32_t(strutil::utf8_len(text[i])), 1u);
+    i = (std::min)(i + clen, len);
+    nchars++;
+
+    if (nchars >= n_gram) {
+      // the oldest char in the ring starts the shingle.
+      add_shingle(starts[nchars % n_gram], i);
+    }
+  }
+
+  if ((nchars > 0) && (nchars < n_gram)) {
+    add_shingle(0, len);
+  }
+
+  std::sort(dst.begin(), dst.end());
+  dst.erase(std::unique(dst.begin(), dst.end()), dst.end());
+}
+
+void compute_shingle_set(const char *text, const std::vector<std::pair<uint32_t, uint32_t>> &words,
+                         uint32_t k, std::vector<uint64_t> &dst /* out */) {
+  dst.clear();
+  if (words.empty() || (k == 0)) {
+    return;
+  }
+
+  const size_t nshingles = (words.size() < k) ? 1 : (words.size() - k + 1);
+  const size_t w = (std::min)(size_t(k), words.size()) - 1;
+  for (size_t n = 0; n < nshingles; n++) {
+    const uint32_t begin = words[n].first;
+    const uint32_t end = words[n + w].second;
+    uint64_t h[2];
+    MurmurHash3_x64_128(text + begin, int(end - begin), 0, h);
+    dst.push_back(h[0]);
+  }
+
+  std::sort(dst.begin(), dst.end());
+  dst.erase(std::unique(dst.begin(), dst.end()), dst.end());
+}
+
+size_t intersection_count(const uint64_t *a, size_t na, const uint64_t *b, size_t nb) {
+  size_t i = 0, j = 0, n = 0;
+
+  // # of set bits of a 4-bit lane mask.
+  static const uint8_t kPopCount4[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+
+  // Block merge: compare a block of `a` against all rotations of a block of
+  // `b`, count the matched lanes of `a`, then advance the block with the
+  // smaller last element(both when equal). Values are unique, so each
+  // element of `a` matches at most once.
+#if defined(__AVX2__)
+  while ((i + 4 <= na) && (j + 4 <= nb)) {
+    const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+    const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + j));
+
+    __m256i m = _mm256_cmpeq_epi64(va, vb);
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, _MM_SHUFFLE(0, 3, 2, 1))));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, _MM_SHUFFLE(1, 0, 3, 2))));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, _MM_SHUFFLE(2, 1, 0, 3))));
+    n += kPopCount4[_mm256_movemask_pd(_mm256_castsi256_pd(m))];
+
+    const uint64_t a_max = a[i + 3];
+    const uint64_t b_max = b[j + 3];
+    i += 4 * size_t(a_max <= b_max);
+    j += 4 * size_t(b_max <= a_max);
+  }
+#elif defined(__SSE2__) || defined(_M_X64)
+  while ((i + 2 <= na) && (j + 2 <= nb)) {
+    const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+    const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + j));
+
+    // SSE2 has no 64-bit compare: AND the 32-bit compare with its
+    // hi/lo-swapped self.
+    __m128i m0 = _mm_cmpeq_epi32(va, vb);
+    __m128i m1 = _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2)));
+    m0 = _mm_and_si128(m0, _mm_shuffle_epi32(m0, _MM_SHUFFLE(2, 3, 0, 1)));
+    m1 = _mm_and_si128(m1, _mm_shuffle_epi32(m1, _MM_SHUFFLE(2, 3, 0, 1)));
+    n += kPopCount4[_mm_movemask_pd(_mm_castsi128_pd(_mm_or_si128(m0, m1)))];
+
+    const uint64_t a_max = a[i + 1];
+    const uint64_t b_max = b[j + 1];
+    i += 2 * size_t(a_max <= b_max);
+    j += 2 * size_t(b_max <= a_max);
+  }
+#endif
+
+  // branchless merge of the rest.
+  while ((i < na) && (j < nb)) {
+    const uint64_t x = a[i];
+    const uint64_t y = b[j];
+    n += size_t(x == y);
+    i += size_t(x <= y);
+    j += size_t(y <= x);
+  }
+
+  return n;
+}
+
 // ret = intersection(a, b) / union(a, b)
-double compute_jaccard(std::vector<uint32_t> &a, std::vector<uint32_t> &b) {
-  // inputs must be sorted.
-  std::sort(a.begin(), a.end());
-  std::sort(b.begin(), b.end());
+double compute_jaccard(const uint64_t *a, size_t na, const uint64_t *b, size_t nb) {
+  const size_t n_inter = intersection_count(a, na, b, nb);
+  const size_t n_union = na + nb - n_inter;
+
+  if (n_union == 0) {
+    return 0.0;
+  }
+
+  return double(n_inter) / double(n_union);
+}
+
+double lsh_collision_probability(double s, uint32_t n_bands, uint32_t rows) {
+  return 1.0 - std::pow(1.0 - std::pow(s, double(rows)), double(n_bands));
+}
+
+bool optimal_lsh_params(double threshold, uint32_t hash_budget, LSHParams &params /* inout */,
+                        double fp_weight, double fn_weight) {
+  if (!(threshold > 0.0) || !(threshold < 1.0) || (hash_budget == 0)) {
+    return false;
+  }
+
+  // trapezoidal rule over [a, b]
+  auto integrate = [](double a, double b, const std::function<double(double)> &f) {
+    constexpr int kSteps = 256;
+    const double h = (b - a) / kSteps;
+    double sum = 0.5 * (f(a) + f(b));
+    for (int i = 1; i < kSteps; i++) {
+      sum += f(a + h * i);
+    }
+    return sum * h;
+  };
+
+  double min_error = std::numeric_limits<double>::max();
+  for (uint32_t b = 1; b <= hash_budget; b++) {
+    for (uint32_t r = 1; r <= hash_budget / b; r++) {
+      const double fp = integrate(0.0, threshold, [&](double s) { return lsh_collision_probability(s, b, r); });
+      const double fn = integrate(threshold, 1.0, [&](double s) { return 1.0 - lsh_collision_probability(s, b, r); });
+      const double error = fp_weight * fp + fn_weight * fn;
+      if (error < min_error) {
+        min_error = error;
+        params.n_bands = b;
+        params.rows = r;
+      }
+    }
+  }
+
+  return true;
+}
+
+namespace {
+
+// MurmurHash3_x86_32 minhash fingerprints of byte spans [begin, end) of `text`.
+void minhash_spans(const char *text, const std::vector<std::pair<uint32_t, uint32_t>> &spans,
+                   uint32_t n_minhash, uint32_t *dst) {
+  for (uint32_t seed = 0; seed < n_minhash; seed++) {
+    uint32_t min_hashval = std::numeric_limits<uint32_t>::max();
+
+    for (const auto &span : spans) {
+      uint32_t hashval;
+      MurmurHash3_x86_32(text + span.first, int(span.second - span.first), seed, &hashval);
+      min_hashval = std::min(min_hashval, hashval);
+    }
+
+    dst[seed] = min_hashval;
+  }
+}
+
+template<uint32_t N_GRAM, uint32_t N_MINHASH>
+void fixed_fingerprints_chars(const char *text, size_t len, uint32_t *dst) {
+  const auto fingerprints = compute_fingerprints<N_GRAM, N_MINHASH>(
+      strutil::build_ngram<N_GRAM>(std::string(text, len)));
+  memcpy(dst, fingerprints.data(), sizeof(uint32_t) * N_MINHASH);
+}
+
+template<uint32_t N_MINHASH>
+void fixed_fingerprints_words(const char *text, const std::vector<std::pair<uint32_t, uint32_t>> &words, uint32_t k,
+                              uint32_t *dst) {
+  const auto fingerprints = compute_fingerprints<N_MINHASH>(text, words, k);
+  memcpy(dst, fingerprints.data(), sizeof(uint32_t) * N_MINHASH);
+}
+
+template<uint32_t N_GRAM, uint32_t N_MINHASH>
+bool select_fixed_lsh_kernel(LSHKernel &kernel) {
+  const LSHParams &p = kernel.params;
+  if ((p.n_gram != N_GRAM) || (p.n_minhash() != N_MINHASH)) {
+    return false;
+  }
+  kernel.chars = fixed_fingerprints_chars<N_GRAM, N_MINHASH>;
+  kernel.words = fixed_fingerprints_words<N_MINHASH>;
+  kernel.specialized = true;
+  return true;
+}
+
+template<uint32_t BUCKET_SIZE>
+bool make_fixed_band_store(uint32_t n_bands, size_t band_bytes, BandStore &dst) {
+  using Val = MinHashVal<BUCKET_SIZE, 2>;
+  if (band_bytes != Val().size()) {
+    return false;
+  }
+
+  auto store = std::make_shared<std::unordered_set<Val, MinHashValHasher<BUCKET_SIZE, 2>, MinHashValEqual<BUCKET_SIZE, 2>>>();
+  dst.dedup = [store, n_bands](const uint8_t *lsh) {
+    bool duplicated = false;
+    Val val;
+    for (uint32_t b = 0; b < n_bands; b++) {
+      memcpy(val.data(), lsh + b * val.size(), val.size());
+      duplicated |= !store->insert(val).second;
+    }
+    return duplicated;
+  };
+  dst.size = [store]() { return store->size(); };
+  return true;
+}
 
-  std::vector<uint32_t> result_u;
-  std::vector<uint32_t> result_i;
+} // namespace
 
-  std::set_union(a.begin(), a.end(), b.begin(), b.end(),
-                 std::inserter(result_u, std::end(result_u)));
-  std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
-                        std::inserter(result_i, std::end(result_i)));
+void compute_fingerprints(const char *text, size_t len, uint32_t n_gram, uint32_t n_minhash,
+                          uint32_t *dst /* out */) {
+  std::vector<std::pair<uint32_t, uint32_t>> spans;
 
-  if (result_u.size() == 0) {
+  // byte offsets of the last `n_gram` chars(ring buffer), as in
+  // compute_shingle_set(). Like build_ngram(), text with less than `n_gram`
+  // chars is a single shingle.
+  std::vector<uint32_t> starts((std::max)(n_gram, 1u));
+  size_t nchars = 0;
+  for (size_t i = 0; (n_gram > 0) && (i < len);) {
+    starts[nchars % n_gram] = uint32_t(i);
+    const uint32_t clen = (std::max)(uint32_t(strutil::utf8_len(text[i])), 1u);
+    i = (std::min)(i + clen, len);
+    nchars++;
+
+    if (nchars >= n_gram) {
+      spans.emplace_back(starts[nchars % n_gram], uint32_t(i));
+    }
+  }
+
+  if ((nchars > 0) && (nchars < n_gram)) {
+    spans.emplace_back(0u, uint32_t(len));
+  }
+
+  minhash_spans(text, spans, n_minhash, dst);
+}
+
+void compute_fingerprints(const char *text, const std::vector<std::pair<uint32_t, uint32_t>> &words,
+                          uint32_t k, uint32_t n_minhash, uint32_t *dst /* out */) {
+  std::vector<std::pair<uint32_t, uint32_t>> spans;
+
+  if (!words.empty() && (k > 0)) {
+    const size_t nshingles = (words.size() < k) ? 1 : (words.size() - k + 1);
+    const size_t w = (std::min)(size_t(k), words.size()) - 1;
+    for (size_t n = 0; n < nshingles; n++) {
+      spans.emplace_back(words[n].first, words[n + w].second);
+    }
+  }
+
+  minhash_spans(text, spans, n_minhash, dst);
+}
+
+void bucketize_lsh(const LSHParams &params, const uint32_t *fingerprints, uint8_t *dst /* out */) {
+  for (uint32_t b = 0; b < params.n_bands; b++) {
+    const uint32_t *band = fingerprints + size_t(b) * params.rows;
+
+    if (params.hashed_keys) {
+      uint64_t h[2];
+      MurmurHash3_x64_128(band, int(sizeof(uint32_t) * params.rows), b, h);
+      memcpy(dst + size_t(b) * LSHParams::kHashedKeyBytes, &h[0], LSHParams::kHashedKeyBytes);
+      continue;
+    }
+
+    // extract LSB 2 bytes(same as bucketize_lsh<>()).
+    uint8_t *p = dst + size_t(b) * params.band_bytes();
+    for (uint32_t r = 0; r < params.rows; r++) {
+      const uint16_t f = uint16_t(band[r] & 0xffff);
+      memcpy(p + LSHParams::kMinHashBytes * r, &f, LSHParams::kMinHashBytes);
+    }
+  }
+}
+
+LSHKernel select_lsh_kernel(const LSHParams &params) {
+  LSHKernel kernel;
+  kernel.params = params;
+
+  // pre-instantiated configurations: The Pile(20 x 10), RefinedWeb(20 x 450).
+  if (select_fixed_lsh_kernel<5, 200>(kernel) || select_fixed_lsh_kernel<5, 9000>(kernel)) {
+    return kernel;
+  }
+
+  const uint32_t n_minhash = uint32_t(params.n_minhash());
+  kernel.chars = [params, n_minhash](const char *text, size_t len, uint32_t *dst) {
+    compute_fingerprints(text, len, params.n_gram, n_minhash, dst);
+  };
+  kernel.words = [n_minhash](const char *text, const std::vector<std::pair<uint32_t, uint32_t>> &words, uint32_t k,
+                             uint32_t *dst) {
+    compute_fingerprints(text, words, k, n_minhash, dst);
+  };
+  return kernel;
+}
+
+double signature_agreement(const uint32_t *a, const uint32_t *b, size_t n) {
+  if (n == 0) {
     return 0.0;
   }
 
-  return double(result_i.size()) / double(result_u.size());
+  size_t n_equal = 0;
+  for (size_t i = 0; i < n; i++) {
+    n_equal += size_t(a[i] == b[i]);
+  }
+  return double(n_equal) / double(n);
+}
+
+BandStore make_band_store(uint32_t n_bands, size_t band_bytes) {
+  BandStore dst;
+
+  if (band_bytes == sizeof(uint64_t)) {
+    auto store = std::make_shared<std::unordered_set<uint64_t>>();
+    dst.dedup = [store, n_bands](const uint8_t *lsh) {
+      bool duplicated = false;
+      for (uint32_t b = 0; b < n_bands; b++) {
+        uint64_t key;
+        memcpy(&key, lsh + b * sizeof(uint64_t), sizeof(uint64_t));
+        duplicated |= !store->insert(key).second;
+      }
+      return duplicated;
+    };
+    dst.size = [store]() { return store->size(); };
+    return dst;
+  }
+
+  if (make_fixed_band_store<10>(n_bands, band_bytes, dst) || make_fixed_band_store<450>(n_bands, band_bytes, dst)) {
+    return dst;
+  }
+
+  auto store = std::make_shared<std::unordered_set<std::string>>();
+  dst.dedup = [store, n_bands, band_bytes](const uint8_t *lsh) {
+    bool duplicated = false;
+    for (uint32_t b = 0; b < n_bands; b++) {
+      duplicated |= !store->emplace(reinterpret_cast<const char *>(lsh + b * band_bytes), band_bytes).second;
+    }
+    return duplicated;
+  };
+  dst.size = [store]() { return store->size(); };
+  return dst;
 }
 
 bool dedup_stream(const std::vector<std::vector<uint8_t>> &lshs,
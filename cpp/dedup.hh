@@ -1,11 +1,17 @@
 #pragma once
 
+#include <array>
+#include <algorithm>
 #include <cstdint>
+#include <limits>
 #include <set>
 #include <unordered_set>
 #include <vector>
 #include <cstring>
+#include <functional>
 #include <iostream>
+#include <string>
+#include <utility>
 
 #include "str-util.hh"
 #include "MurmurHash3.h"
@@ -106,17 +112,43 @@ std::vector<std::vector<uint8_t>> compute_lsh_fast(
 }
 #endif
 
-template<uint32_t N_GRAM, uint32_t N_BUCKETS = 20, uint32_t BUCKET_SIZE = 10>
-std::array<MinHashVal<BUCKET_SIZE, 2>, N_BUCKETS> compute_lsh(
-  const std::vector<strutil::NGram<N_GRAM>> &ngram_text)
+// bucketize N_BUCKETS * BUCKET_SIZE minhash fingerprints into LSH band keys.
+template<uint32_t N_BUCKETS = 20, uint32_t BUCKET_SIZE = 10>
+std::array<MinHashVal<BUCKET_SIZE, 2>, N_BUCKETS> bucketize_lsh(
+  const std::array<uint32_t, N_BUCKETS * BUCKET_SIZE> &fingerprints)
 {
-  constexpr uint32_t N_MINHASH = N_BUCKETS * BUCKET_SIZE;
+  std::array<MinHashVal<BUCKET_SIZE, 2>, N_BUCKETS> lshs;
+
+  for (size_t bucket_i = 0; bucket_i < N_BUCKETS; bucket_i++) {
+
+    MinHashVal<BUCKET_SIZE, 2> lsh;
+    // lsh = concat fingerprints by extracting lower 2byte of hash
+
+    for (size_t bucket_s = 0; bucket_s < BUCKET_SIZE; bucket_s++) {
+      // extract LSB 2 bytes.
+      uint16_t f = uint16_t(fingerprints[bucket_i * BUCKET_SIZE + bucket_s] & 0xffff);
+
+      memcpy(reinterpret_cast<uint8_t *>(&lsh.vals[0]) + 2 * bucket_s,  &f, 2);
+    }
+
+    lshs[bucket_i] = lsh;
+  }
 
+  return lshs;
+}
+
+// MurmurHash3_x86_32 minhash fingerprints(seed 0 .. N_MINHASH - 1) of N_GRAM-char shingles.
+template<uint32_t N_GRAM, uint32_t N_MINHASH>
+std::array<uint32_t, N_MINHASH> compute_fingerprints(
+  const std::vector<strutil::NGram<N_GRAM>> &ngram_text)
+{
   std::array<uint32_t, N_MINHASH> fingerprints; // len = n_minhash
 
   for (uint32_t seed = 0; seed < N_MINHASH; seed++) {
 
-    uint32_t min_hashval;
+    // only empty text has no shingle(build_ngram() gives text with less
+    // than N_GRAM chars a single shingle).
+    uint32_t min_hashval = std::numeric_limits<uint32_t>::max();
 
     for (size_t n = 0; n < ngram_text.size(); n++) {
 
@@ -125,37 +157,190 @@ std::array<MinHashVal<BUCKET_SIZE, 2>, N_BUCKETS> compute_lsh(
       // TODO: Use 64bit or 128bit hash for better accuracy.
       MurmurHash3_x86_32 ( reinterpret_cast<const void *>(ngram_text[n].buffer()), ngram_text[n].n_bytes(), seed, reinterpret_cast<void *>(&hashval));
 
-      if (n == 0) {
-        min_hashval = hashval;
-      } else {
-        min_hashval = std::min(min_hashval, hashval);
-      }
+      min_hashval = std::min(min_hashval, hashval);
     }
 
     fingerprints[seed] = min_hashval;
   }
 
-  // bucketize
-  std::array<MinHashVal<BUCKET_SIZE, 2>, N_BUCKETS> lshs;
+  return fingerprints;
+}
 
-  for (size_t bucket_i = 0; bucket_i < N_BUCKETS; bucket_i++) {
+template<uint32_t N_GRAM, uint32_t N_BUCKETS = 20, uint32_t BUCKET_SIZE = 10>
+std::array<MinHashVal<BUCKET_SIZE, 2>, N_BUCKETS> compute_lsh(
+  const std::vector<strutil::NGram<N_GRAM>> &ngram_text)
+{
+  return bucketize_lsh<N_BUCKETS, BUCKET_SIZE>(compute_fingerprints<N_GRAM, N_BUCKETS * BUCKET_SIZE>(ngram_text));
+}
 
-    MinHashVal<BUCKET_SIZE, 2> lsh;
-    // lsh = concat fingerprints by extracting lower 2byte of hash
+///
+/// Word-shingle mode of compute_fingerprints.
+///
+/// `words` are [begin, end) byte offsets into `text`(e.g. from
+/// jagger::tagger::segment()). A shingle is the byte span from the beginning
+/// of word i to the end of word i + k - 1, so shingles are hashed in place
+/// without building strings. Text with less than `k` words produces a single
+/// shingle covering all words.
+///
+template<uint32_t N_MINHASH>
+std::array<uint32_t, N_MINHASH> compute_fingerprints(
+  const char *text,
+  const std::vector<std::pair<uint32_t, uint32_t>> &words,
+  const uint32_t k)
+{
+  std::array<uint32_t, N_MINHASH> fingerprints;
+  fingerprints.fill(std::numeric_limits<uint32_t>::max());
 
-    for (size_t bucket_s = 0; bucket_s < BUCKET_SIZE; bucket_s++) {
-      // extract LSB 2 bytes.
-      uint16_t f = uint16_t(fingerprints[bucket_i * BUCKET_SIZE + bucket_s] & 0xffff);
+  if (words.empty() || (k == 0)) {
+    return fingerprints;
+  }
 
-      memcpy(reinterpret_cast<uint8_t *>(&lsh.vals[0]) + 2 * bucket_s,  &f, 2);
+  size_t nshingles = (words.size() < k) ? 1 : (words.size() - k + 1);
+  size_t w = (std::min)(size_t(k), words.size()) - 1;
+
+  for (uint32_t seed = 0; seed < N_MINHASH; seed++) {
+
+    uint32_t min_hashval = fingerprints[seed];
+
+    for (size_t n = 0; n < nshingles; n++) {
+      const uint32_t s_begin = words[n].first;
+      const uint32_t s_end = words[n + w].second;
+
+      uint32_t hashval;
+      MurmurHash3_x86_32 ( reinterpret_cast<const void *>(text + s_begin), int(s_end - s_begin), seed, reinterpret_cast<void *>(&hashval));
+
+      min_hashval = std::min(min_hashval, hashval);
     }
 
-    lshs[bucket_i] = lsh;
+    fingerprints[seed] = min_hashval;
   }
 
-  return lshs;
+  return fingerprints;
+}
+
+///
+/// Word-shingle mode of compute_lsh. See compute_fingerprints() for `words`
+/// and `k`.
+///
+template<uint32_t N_BUCKETS = 20, uint32_t BUCKET_SIZE = 10>
+std::array<MinHashVal<BUCKET_SIZE, 2>, N_BUCKETS> compute_lsh(
+  const char *text,
+  const std::vector<std::pair<uint32_t, uint32_t>> &words,
+  const uint32_t k)
+{
+  return bucketize_lsh<N_BUCKETS, BUCKET_SIZE>(compute_fingerprints<N_BUCKETS * BUCKET_SIZE>(text, words, k));
 }
 
+///
+/// Runtime LSH configuration: `n_bands` bands of `rows` minhash fingerprints
+/// of `n_gram`-char shingles. Defaults are The Pile's(20 x 10). RefinedWeb
+/// uses 20 x 450.
+///
+/// The key of a band is a 64-bit hash of its full 32-bit fingerprints(8
+/// bytes regardless of `rows`), or with `hashed_keys` false, the lower
+/// kMinHashBytes bytes of each fingerprint concatenated(MinHashVal layout).
+///
+struct LSHParams
+{
+  static constexpr uint32_t kMinHashBytes = 2;
+  static constexpr uint32_t kHashedKeyBytes = 8;
+
+  uint32_t n_gram{5};
+  uint32_t n_bands{20};
+  uint32_t rows{10};
+  bool hashed_keys{true};
+
+  size_t n_minhash() const { return size_t(n_bands) * size_t(rows); }
+  size_t band_bytes() const { return hashed_keys ? kHashedKeyBytes : size_t(rows) * kMinHashBytes; }
+  size_t lsh_bytes() const { return size_t(n_bands) * band_bytes(); }
+};
+
+///
+/// Probability that two documents with Jaccard `s` share at least one band
+/// key(the S-curve): 1 - (1 - s^rows)^n_bands.
+///
+double lsh_collision_probability(double s, uint32_t n_bands, uint32_t rows);
+
+///
+/// Pick `n_bands` x `rows`(n_bands * rows <= `hash_budget`) minimising
+/// fp_weight * FP + fn_weight * FN, where FP is the area under the S-curve
+/// below `threshold`(pairs with Jaccard < threshold becoming candidates) and
+/// FN the area above it from `threshold` to 1(pairs with Jaccard >= threshold
+/// being missed). Only `n_bands` and `rows` of `params` are set.
+///
+/// @return false when `threshold` is not in (0, 1) or `hash_budget` is 0.
+///
+bool optimal_lsh_params(double threshold, uint32_t hash_budget, LSHParams &params /* inout */,
+                        double fp_weight = 0.5, double fn_weight = 0.5);
+
+///
+/// Runtime-sized compute_fingerprints(): `n_minhash` fingerprints of the
+/// `n_gram`-char shingles of `text`.
+///
+void compute_fingerprints(const char *text, size_t len, uint32_t n_gram, uint32_t n_minhash,
+                          uint32_t *dst /* out */);
+
+///
+/// Runtime-sized word-shingle mode of compute_fingerprints().
+///
+void compute_fingerprints(const char *text, const std::vector<std::pair<uint32_t, uint32_t>> &words,
+                          uint32_t k, uint32_t n_minhash, uint32_t *dst /* out */);
+
+///
+/// Band keys of `fingerprints`(params.n_minhash()) into `dst`
+/// (params.lsh_bytes(), band by band). Hashed keys are seeded with the band
+/// index, so equal keys of different bands do not collide.
+///
+void bucketize_lsh(const LSHParams &params, const uint32_t *fingerprints, uint8_t *dst /* out */);
+
+///
+/// minhash fingerprint functions of an LSHParams. Both write
+/// params.n_minhash() fingerprints to `dst`.
+///
+struct LSHKernel
+{
+  LSHParams params;
+  bool specialized{false};  // true: pre-instantiated compute_fingerprints() template.
+
+  // `n_gram`-char shingles.
+  std::function<void(const char *text, size_t len, uint32_t *dst)> chars;
+
+  // k-word shingles.
+  std::function<void(const char *text, const std::vector<std::pair<uint32_t, uint32_t>> &words, uint32_t k,
+                     uint32_t *dst)> words;
+};
+
+///
+/// compute_fingerprints() template instance for `params` when it is one of
+/// the pre-instantiated configurations(n_gram 5, 200(The Pile) or
+/// 9000(RefinedWeb) minhashes), otherwise the runtime-sized one.
+///
+LSHKernel select_lsh_kernel(const LSHParams &params);
+
+///
+/// Fraction of equal fingerprints of two signatures of `n` fingerprints(an
+/// estimate of their Jaccard).
+///
+double signature_agreement(const uint32_t *a, const uint32_t *b, size_t n);
+
+///
+/// Band keys seen so far for streaming dedup. `dedup` returns true when a
+/// document's LSH(n_bands * band_bytes bytes) shares a band key with an
+/// earlier document, and adds its band keys.
+///
+struct BandStore
+{
+  std::function<bool(const uint8_t *lsh)> dedup;
+  std::function<size_t()> size;
+};
+
+///
+/// std::unordered_set<uint64_t> for hashed(8 byte) keys,
+/// std::unordered_set<MinHashVal> for the truncated keys of the
+/// pre-instantiated configurations, a set of byte strings otherwise.
+///
+BandStore make_band_store(uint32_t n_bands, size_t band_bytes);
+
 template<uint32_t N_BUCKETS, uint32_t BUCKET_SIZE = 10, uint32_t B = 2>
 bool dedup_stream(
   const std::array<MinHashVal<BUCKET_SIZE, B>, N_BUCKETS> &lshs,
@@ -208,7 +393,39 @@ bool sort_minhashes(
   return true;
 }
 
-double compute_jaccard(std::vector<uint32_t> &a, std::vector<uint32_t> &b);
+///
+/// Sorted, unique 64-bit hashes of the `n_gram`-char shingles of `text`
+/// (the same byte spans as the char shingles of compute_lsh(), hashed with
+/// MurmurHash3_x64_128). Text shorter than `n_gram` chars gives a single
+/// shingle of the whole text. `dst` is reused, so no allocation once its
+/// capacity is large enough.
+///
+void compute_shingle_set(const char *text, size_t len, uint32_t n_gram,
+                         std::vector<uint64_t> &dst /* out */);
+
+///
+/// Word-shingle mode of compute_shingle_set(): `k`-word shingles over
+/// `words`(the same byte spans as the word-shingle compute_fingerprints()).
+/// Text with less than `k` words gives a single shingle of all words.
+///
+void compute_shingle_set(const char *text, const std::vector<std::pair<uint32_t, uint32_t>> &words,
+                         uint32_t k, std::vector<uint64_t> &dst /* out */);
+
+///
+/// |a ∩ b| of sorted, unique arrays. Compares 4x4(AVX2) or 2x2(SSE2) blocks
+/// at once and finishes with a branchless scalar merge. No allocation.
+///
+size_t intersection_count(const uint64_t *a, size_t na, const uint64_t *b, size_t nb);
+
+///
+/// Jaccard similarity |a ∩ b| / |a ∪ b| of sorted, unique arrays(e.g. from
+/// compute_shingle_set()). 0 when both are empty.
+///
+double compute_jaccard(const uint64_t *a, size_t na, const uint64_t *b, size_t nb);
+
+inline double compute_jaccard(const std::vector<uint64_t> &a, const std::vector<uint64_t> &b) {
+  return compute_jaccard(a.data(), a.size(), b.data(), b.size());
+}
 
 std::vector<uint16_t> normalize_for_dedup(const std::vector<uint16_t> &text,
   nanotokenizer::CedarTrieTokenizer &tokenizer,
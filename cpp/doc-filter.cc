@@ -0,0 +1,221 @@
+// SPDX-License-Identifier: Apache 2.0
+
+#include "doc-filter.hh"
+
+#include <cstring>
+#include <sstream>
+
+namespace docfilter {
+
+namespace {
+
+//
+// Sentence-end rules of clean_text.do_clean. Evaluated top to bottom after
+// the whitespace check; the first matching suffix decides the line.
+//
+struct SuffixRule {
+  const char *suffix;
+  LineDropReason action;  // kLineKeep = keep the line.
+};
+
+const SuffixRule kSuffixRules[] = {
+  {"...", kLineEllipsis},
+  {"... ", kLineEllipsis},
+  {"...\xe3\x80\x80", kLineEllipsis},  // zenkaku space
+  {".", kLineKeep},
+  {"\xe3\x80\x82", kLineKeep},  // 。
+  {")", kLineKeep},             // FIXME: May be ascii kaomoji :-)
+  {"!", kLineKeep},
+  {"\xef\xbc\x81", kLineKeep},  // ！
+  {"?", kLineKeep},
+  {"\xef\xbc\x9f", kLineKeep},  // ？
+  {",", kLineComma},
+  {"\"", kLineQuote},
+  {"'", kLineQuote},
+  // closing braces
+  {"\xc2\xbb", kLineKeep},      // »
+  {"\xe3\x80\x8d", kLineKeep},  // 」
+  {"\xe3\x80\x8b", kLineKeep},  // 》
+  {"\xc2\xb4", kLineKeep},      // ´
+  {"\xef\xbc\x89", kLineKeep},  // ）
+  {"\xe3\x80\x89", kLineKeep},  // 〉
+  {">", kLineKeep},
+  {"\xe3\x80\x91", kLineKeep},  // 】
+  {"]", kLineKeep},
+};
+
+inline bool ends_with(std::string_view s, const char *suffix) {
+  size_t n = strlen(suffix);
+  return (s.size() >= n) && (memcmp(s.data() + s.size() - n, suffix, n) == 0);
+}
+
+inline uint32_t count_spaces(std::string_view s) {
+  uint32_t c = 0;
+  for (char ch : s) {
+    c += (ch == ' ');
+  }
+  return c;
+}
+
+} // namespace
+
+const char *doc_drop_reason_name(DocDropReason r) {
+  switch (r) {
+    case kDocKeep: return "keep";
+    case kDocNoHiragana: return "no_hiragana";
+    case kDocTooManyAscii: return "too_many_ascii";
+    case kDocEmpty: return "empty";
+    default: return "unknown";
+  }
+}
+
+const char *line_drop_reason_name(LineDropReason r) {
+  switch (r) {
+    case kLineKeep: return "keep";
+    case kLineWhitespace: return "whitespace";
+    case kLineEllipsis: return "ellipsis";
+    case kLineComma: return "comma";
+    case kLineQuote: return "quote";
+    case kLineNoPunct: return "no_punct";
+    default: return "unknown";
+  }
+}
+
+void CleanStats::merge(const CleanStats &rhs) {
+  n_docs += rhs.n_docs;
+  n_lines += rhs.n_lines;
+  for (size_t i = 0; i < doc_counts.size(); i++) {
+    doc_counts[i] += rhs.doc_counts[i];
+  }
+  for (size_t i = 0; i < line_counts.size(); i++) {
+    line_counts[i] += rhs.line_counts[i];
+  }
+}
+
+std::string CleanStats::to_string() const {
+  std::stringstream ss;
+
+  ss << "docs: " << n_docs << "\n";
+  for (size_t i = 0; i < doc_counts.size(); i++) {
+    ss << "  " << doc_drop_reason_name(DocDropReason(i)) << ": " << doc_counts[i] << "\n";
+  }
+  ss << "lines: " << n_lines << "\n";
+  for (size_t i = 0; i < line_counts.size(); i++) {
+    ss << "  " << line_drop_reason_name(LineDropReason(i)) << ": " << line_counts[i] << "\n";
+  }
+
+  return ss.str();
+}
+
+bool contains_hiragana(std::string_view text) {
+  // U+3040 - U+309F = E3 81 80 - E3 82 9F
+  const char *p = text.data();
+  const char *end = p + text.size();
+
+  while (p + 2 < end) {
+    const char *q = static_cast<const char *>(memchr(p, 0xe3, size_t(end - p - 2)));
+    if (!q) {
+      break;
+    }
+    uint8_t c1 = uint8_t(q[1]);
+    uint8_t c2 = uint8_t(q[2]);
+    if ((c1 == 0x81 && c2 >= 0x80 && c2 <= 0xbf) ||
+        (c1 == 0x82 && c2 >= 0x80 && c2 <= 0x9f)) {
+      return true;
+    }
+    p = q + 1;
+  }
+
+  return false;
+}
+
+bool too_many_ascii(std::string_view text, double threshold) {
+  // count codepoints(non-continuation bytes) and ASCII bytes.
+  // simple loop so that compilers can vectorize it.
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(text.data());
+  size_t n = text.size();
+
+  size_t nchars = 0;
+  size_t nascii = 0;
+  for (size_t i = 0; i < n; i++) {
+    nchars += ((p[i] & 0xc0) != 0x80);
+    nascii += (p[i] < 0x80);
+  }
+
+  if (nchars == 0) {
+    return false;
+  }
+
+  return (100.0 * double(nascii) / double(nchars)) > threshold;
+}
+
+LineDropReason check_line(std::string_view line, const CleanConfig &config) {
+  if (count_spaces(line) >= config.ws_threshold) {
+    return kLineWhitespace;
+  }
+
+  for (const auto &rule : kSuffixRules) {
+    if (ends_with(line, rule.suffix)) {
+      return rule.action;
+    }
+  }
+
+  // assume sentence is broken.
+  return kLineNoPunct;
+}
+
+DocDropReason clean_document(std::string_view text, const CleanConfig &config,
+                             std::string &out, bool &changed,
+                             CleanStats &stats) {
+  stats.n_docs++;
+  changed = false;
+
+  // same order as the python pipeline: filter_ascii, then do_clean.
+  if (config.ascii_filter && too_many_ascii(text, config.ascii_threshold)) {
+    stats.doc_counts[kDocTooManyAscii]++;
+    return kDocTooManyAscii;
+  }
+
+  if (!contains_hiragana(text)) {
+    stats.doc_counts[kDocNoHiragana]++;
+    return kDocNoHiragana;
+  }
+
+  out.clear();
+
+  size_t n_kept = 0;
+  size_t s = 0;
+  for (;;) {
+    size_t e = text.find('\n', s);
+    std::string_view line = text.substr(s, (e == std::string_view::npos) ? std::string_view::npos : e - s);
+
+    LineDropReason r = check_line(line, config);
+    stats.n_lines++;
+    stats.line_counts[r]++;
+
+    if (r == kLineKeep) {
+      if (n_kept) {
+        out.push_back('\n');
+      }
+      out.append(line.data(), line.size());
+      n_kept++;
+    } else {
+      changed = true;
+    }
+
+    if (e == std::string_view::npos) {
+      break;
+    }
+    s = e + 1;
+  }
+
+  if (n_kept == 0) {
+    stats.doc_counts[kDocEmpty]++;
+    return kDocEmpty;
+  }
+
+  stats.doc_counts[kDocKeep]++;
+  return kDocKeep;
+}
+
+} // namespace docfilter
@@ -0,0 +1,85 @@
+// SPDX-License-Identifier: Apache 2.0
+//
+// C++ port of 03_clean_step1/clean_text.py(do_clean) and
+// 03_clean_step1/ascii_filtering.py(filter_ascii).
+//
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace docfilter {
+
+// Why a document was dropped.
+enum DocDropReason {
+  kDocKeep = 0,
+  kDocNoHiragana,    // document does not contain any hiragana.
+  kDocTooManyAscii,  // ASCII characters exceed `ascii_threshold` percent.
+  kDocEmpty,         // all lines were dropped.
+  kNumDocReasons
+};
+
+// Why a line(sentence) was dropped.
+enum LineDropReason {
+  kLineKeep = 0,
+  kLineWhitespace,   // contains `ws_threshold` or more ' '
+  kLineEllipsis,     // ends with "...", "... " or "...　"
+  kLineComma,        // ends with ','
+  kLineQuote,        // ends with '"' or '\''
+  kLineNoPunct,      // does not end with sentence-final punctuation or closing brace.
+  kNumLineReasons
+};
+
+const char *doc_drop_reason_name(DocDropReason r);
+const char *line_drop_reason_name(LineDropReason r);
+
+struct CleanConfig {
+  uint32_t ws_threshold{1};    // same as the default of clean_text.do_clean
+  bool ascii_filter{true};
+  double ascii_threshold{10.0};  // percent
+};
+
+struct CleanStats {
+  uint64_t n_docs{0};
+  uint64_t n_lines{0};
+  std::array<uint64_t, kNumDocReasons> doc_counts{};    // [kDocKeep] = kept docs
+  std::array<uint64_t, kNumLineReasons> line_counts{};  // [kLineKeep] = kept lines
+
+  void merge(const CleanStats &rhs);
+
+  // Human readable summary.
+  std::string to_string() const;
+};
+
+///
+/// true if `text` contains a hiragana(U+3040 - U+309F).
+///
+bool contains_hiragana(std::string_view text);
+
+///
+/// true if ASCII characters exceed `threshold` percent of all characters
+/// (counted in Unicode codepoints).
+///
+bool too_many_ascii(std::string_view text, double threshold);
+
+///
+/// Classify single line(without '\n') by the sentence-end rule table.
+///
+LineDropReason check_line(std::string_view line, const CleanConfig &config);
+
+///
+/// Clean document.
+///
+/// Kept lines are joined with '\n' and written to `out`.
+/// `out` is only written when the return value is `kDocKeep`. It is reused
+/// across calls, so no allocation happens in steady state.
+/// `changed` is set to true when some lines were dropped(i.e. `out` differs
+/// from `text`).
+///
+DocDropReason clean_document(std::string_view text, const CleanConfig &config,
+                             std::string &out, bool &changed,
+                             CleanStats &stats);
+
+} // namespace docfilter
@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: Apache 2.0
+//
+// Stable 64-bit document id.
+//
+// The id is assigned once by the first C++ stage(`cpp_proc clean`) as
+// (shard id << 32) | (line index in the input shard) and stored as `doc_id`
+// in the JSON. Later stages keep the field, so side files(lm_score, dedup
+// flags, ...) can be joined by id instead of by line number.
+//
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace docid {
+
+constexpr const char *kKey = "doc_id";
+
+inline uint64_t make(uint32_t shard, uint32_t ordinal) {
+  return (uint64_t(shard) << 32) | uint64_t(ordinal);
+}
+
+inline uint32_t shard_of(uint64_t id) { return uint32_t(id >> 32); }
+inline uint32_t ordinal_of(uint64_t id) { return uint32_t(id & 0xffffffffull); }
+
+///
+/// Insert `"doc_id":<id>` as the first member of the JSON object `line`
+/// without re-serializing it. Returns an empty string when `line` is not an
+/// object.
+///
+inline std::string insert(std::string_view line, uint64_t id) {
+  size_t p = line.find('{');
+  if (p == std::string_view::npos) {
+    return std::string();
+  }
+
+  size_t q = line.find_first_not_of(" \t\r\n", p + 1);
+  bool empty_object = (q != std::string_view::npos) && (line[q] == '}');
+
+  std::string dst;
+  dst.reserve(line.size() + 32);
+  dst.append(line.data(), p + 1);
+  dst += "\"";
+  dst += kKey;
+  dst += "\":";
+  dst += std::to_string(id);
+  if (!empty_object) {
+    dst += ",";
+  }
+  dst.append(line.data() + p + 1, line.size() - p - 1);
+
+  return dst;
+}
+
+///
+/// Sorted merge join of two id columns.
+/// `right_index[i]` is the row of `right` whose id is `left[i]`, or -1.
+/// Stages keep the document order so the inputs are usually already sorted;
+/// otherwise they are joined through sorted permutations(O(n log n)).
+/// When `right` has the same id more than once, the first row is used.
+///
+inline void merge_join(const std::vector<uint64_t> &left, const std::vector<uint64_t> &right,
+                       std::vector<int64_t> &right_index) {
+  auto sorted_order = [](const std::vector<uint64_t> &ids) {
+    std::vector<size_t> order(ids.size());
+    std::iota(order.begin(), order.end(), size_t(0));
+    if (!std::is_sorted(ids.begin(), ids.end())) {
+      std::stable_sort(order.begin(), order.end(), [&ids](size_t a, size_t b) { return ids[a] < ids[b]; });
+    }
+    return order;
+  };
+
+  std::vector<size_t> lorder = sorted_order(left);
+  std::vector<size_t> rorder = sorted_order(right);
+
+  right_index.assign(left.size(), -1);
+
+  size_t r = 0;
+  for (size_t l = 0; l < lorder.size(); l++) {
+    const uint64_t id = left[lorder[l]];
+    while ((r < rorder.size()) && (right[rorder[r]] < id)) {
+      r++;
+    }
+    if ((r < rorder.size()) && (right[rorder[r]] == id)) {
+      right_index[lorder[l]] = int64_t(rorder[r]);
+    }
+  }
+}
+
+} // namespace docid
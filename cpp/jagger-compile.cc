@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: MIT
+// Copyright 2023 - Present, Light Transport Entertainment Inc.
+//
+// Compile Jagger pattern files into mmap-able model arrays ahead of time,
+// so workers on a fresh node do not stall(or race) in tagger::read_model().
+//
+// Usage: jagger-compile [-f] [-c] patterns [patterns ...]
+//
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "jagger.h"
+
+static void print_help(const char *prog) {
+  std::fprintf(stderr, "Usage: %s [-f] [-c] patterns [patterns ...]\n", prog);
+  std::fprintf(stderr, "\n");
+  std::fprintf(stderr, " -f : Force recompile even if the compiled model is up to date\n");
+  std::fprintf(stderr, " -c : Check only. exit 1 if any compiled model is missing or stale\n");
+  std::fprintf(stderr, " -h : Print this help\n");
+  std::fprintf(stderr, "\n");
+  std::fprintf(stderr, "Multiple pattern files are compiled in parallel.\n");
+}
+
+int main(int argc, char **argv) {
+  bool force{false};
+  bool check_only{false};
+
+  int opt;
+  while ((opt = getopt(argc, argv, "fch")) != -1) {
+    switch (opt) {
+      case 'f':
+        force = true;
+        break;
+      case 'c':
+        check_only = true;
+        break;
+      default:
+        print_help(argv[0]);
+        return -1;
+    }
+  }
+
+  std::vector<std::string> models;
+  for (int i = optind; i < argc; i++) {
+    models.push_back(argv[i]);
+  }
+
+  if (models.empty()) {
+    print_help(argv[0]);
+    return -1;
+  }
+
+  std::atomic<int> n_stale(0);
+  std::vector<std::thread> workers;
+
+  for (const auto &m : models) {
+    workers.emplace_back(std::thread([&, m]() {
+      // Full content hash check here, since this is the explicit build step.
+      if (!force && jagger::tagger::model_is_current(m, /* check_hash */true)) {
+        std::fprintf(stderr, "%s: up to date.\n", m.c_str());
+        return;
+      }
+
+      n_stale++;
+
+      if (check_only) {
+        std::fprintf(stderr, "%s: needs compile.\n", m.c_str());
+        return;
+      }
+
+      jagger::tagger::compile_model(m);
+    }));
+  }
+
+  for (auto &th : workers) {
+    th.join();
+  }
+
+  if (check_only && n_stale > 0) {
+    return 1;
+  }
+
+  return 0;
+}
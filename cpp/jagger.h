@@ -18,6 +18,7 @@
 #include <string>
 #include <map>
 #include <algorithm>
+#include <utility>
 #include "ccedar_core.h"
 
 #ifdef HAVE_CONFIG_H
@@ -146,4 +147,198 @@ public:
     } while (1);
   }
 };
+
+static const size_t MAX_KEY_BITS     = 14;
+static const size_t MAX_FEATURE_BITS = 7;
+
+// FNV-1a (64bit); used to fingerprint pattern files and model headers
+static inline uint64_t fnv1a_64 (const void* data, const size_t n, uint64_t h = 0xcbf29ce484222325ULL) {
+  const uint8_t* p = static_cast <const uint8_t*> (data);
+  for (size_t i = 0; i < n; ++i)
+    h = (h ^ p[i]) * 0x100000001b3ULL;
+  return h;
+}
+
+namespace ccedar {
+  class da_ : public ccedar::da <int, int, MAX_KEY_BITS> {
+  public:
+    struct utf8_feeder { // feed one UTF-8 character by one while mapping codes
+      const char *p, * const end;
+      utf8_feeder (const char *key_, const char *end_) : p (key_), end (end_) {}
+      int read (int &b) const { return p == end ? 0 : unicode (p, b); }
+      void advance (const int b) { p += b; }
+    };
+    int longestPrefixSearchWithPOS (const char* key, const char* const end, int fi_prev, const uint16_t* const c2i, size_t from = 0) const {
+      size_t from_ = 0;
+      int n (0), i (0), b (0);
+      for (utf8_feeder f (key, end); (i = c2i[f.read (b)]); f.advance (b)) {
+        size_t pos = 0;
+        const int n_ = traverse (&i, from, pos, pos + 1);
+        if (n_ == CEDAR_NO_VALUE) continue;
+        if (n_ == CEDAR_NO_PATH)  break;
+        from_ = from;
+        n = n_;
+      }
+      // ad-hock matching at the moment; it prefers POS-ending patterns
+      if (! fi_prev) return n;
+      for (const node* const array_ = reinterpret_cast <const node*> (array ());
+           ; from = array_[from].check) { // hopefully, in the cache
+        const int n_ = exactMatchSearch <int> (&fi_prev, 1, from);
+        if (n_ != CEDAR_NO_VALUE) return n_;
+        if (from == from_)        return n;
+      }
+    }
+  };
+}
+
+namespace jagger {
+  // Compiled model = <patterns>.{da,c2i,p2f,fs} + <patterns>.hdr.
+  // The header is written last (write-then-rename), so a valid header means
+  // a complete set of arrays. It is validated by read_model() before mmap;
+  // the pattern file is re-hashed when its mtime differs from the recorded one.
+  static const char     MODEL_MAGIC[8] = {'J', 'A', 'G', 'G', 'E', 'R', 'M', '\0'};
+  static const uint32_t MODEL_VERSION  = 2;
+
+  struct model_header_t {
+    char     magic[8];
+    uint32_t version;
+    uint32_t build_flags;  // USE_COMPACT_DICT, NUM_POS_FIELD and key bits
+    uint64_t pattern_size; // byte size of the source pattern file
+    uint64_t pattern_hash; // FNV-1a 64 of the source pattern file
+    uint64_t pattern_mtime; // mtime (ns) of the source pattern file
+    uint64_t nbytes[4];    // byte size of .da, .c2i, .p2f, .fs
+    uint64_t checksum;     // FNV-1a 64 of the fields above
+  };
+
+  class tagger {
+  private:
+    ccedar::da_ da;
+    uint16_t* c2i; // mapping from utf8, BOS, unk to character ID
+    uint64_t* p2f; // mapping from pattern ID to feature strings
+    char*     fs;  // feature strings
+    std::vector <std::pair <void*, size_t> > mmaped;
+    static inline void write_string (char* &p, const char* s, size_t len = 0) {
+#ifdef USE_COMPACT_DICT
+      if (! len) {
+        len = *reinterpret_cast <const uint16_t*> (s);
+        s += sizeof (uint16_t);
+      }
+#endif
+      std::memcpy (p, s, len);
+      p += len;
+    }
+    static inline void write_buffer (char* &p, char* buf, const size_t limit) {
+      if (p - buf <= limit) return;
+      ::write (1, buf, static_cast <size_t> (p - buf));
+      p = buf;
+    }
+    void* read_array (const std::string& fn, size_t &nbytes);
+  public:
+    tagger () : da (), c2i (0), p2f (0), fs (0), mmaped () {}
+    ~tagger () {
+      for (size_t i = 0; i < mmaped.size (); ++i)
+        ::munmap (mmaped[i].first, mmaped[i].second);
+    }
+    static uint32_t build_flags ();
+    // true if <m>.hdr is valid and matches the compiled arrays on disk and
+    // the pattern file. the pattern file is re-hashed and compared when its
+    // mtime differs from the recorded one, or always with `check_hash`.
+    static bool model_is_current (const std::string& m, bool check_hash = false);
+    // compile pattern file `m` into <m>.{da,c2i,p2f,fs,hdr}.
+    // each file is written to a temporary file then renamed, so concurrent
+    // compilers (or readers) never observe partially written arrays.
+    static void compile_model (const std::string& m);
+    // mmap compiled model. compiles on the fly when no valid model exists
+    // (prefer running `jagger-compile` beforehand on cluster nodes).
+    void read_model (const std::string& m);
+    // word segmentation without copying; appends [begin, end) byte offsets of
+    // each word in `text` to `words`. newlines are treated as sentence breaks
+    // (same as run ()) and never belong to a word.
+    void segment (const char* text, const size_t len, std::vector <std::pair <uint32_t, uint32_t> >& words) const {
+      const char* const text_end = text + len;
+      for (const char* line = text; line < text_end; ) {
+        const char* p_end = static_cast <const char*> (std::memchr (line, '\n', static_cast <size_t> (text_end - line)));
+        if (! p_end) p_end = text_end;
+        int bytes (0), bytes_prev (0), id (0), ctype (0), ctype_prev (0);
+        uint64_t offsets = c2i[CP_MAX + 1];
+        bool bos (true);
+        for (const char *p (line); p < p_end; bytes_prev = bytes, ctype_prev = ctype, offsets = p2f[static_cast <size_t> (id)], p += bytes) {
+          const int r = da.longestPrefixSearchWithPOS (p, p_end, offsets & 0x3fff, &c2i[0]);
+          id    = r & 0xfffff;
+          bytes = (r >> 23) ? (r >> 23) : u8_len (p);
+          ctype = (r >> 20) & 0x7;
+          const uint32_t pos = static_cast <uint32_t> (p - text);
+          if (bos || ctype_prev != ctype || ctype_prev == 3 ||
+              (ctype_prev == 2 && bytes_prev + bytes >= 18))
+            words.push_back (std::make_pair (pos, pos));
+          bos = false;
+          words.back ().second = static_cast <uint32_t> (std::min (p + bytes, p_end) - text);
+        }
+        line = p_end + 1;
+      }
+    }
+    template <const int BUF_SIZE_, const bool POS_TAGGING>
+    void run () const {
+      if (BUF_SIZE_ == 0) std::fprintf (stderr, "(input: stdin)\n");
+      char _res[BUF_SIZE], *_ptr (&_res[0]), *line (0);
+      simple_reader reader;
+      while (const size_t len = reader.gets (&line)) {
+        int bytes (0), bytes_prev (0), id (0), ctype (0), ctype_prev (0);
+        uint64_t offsets = c2i[CP_MAX + 1];
+        bool bos (true), ret (line[len - 1] == '\n'), concat (false);
+        for (const char *p (line), * const p_end (p + len - ret); p != p_end; bytes_prev = bytes, ctype_prev = ctype, offsets = p2f[static_cast <size_t> (id)], p += bytes) {
+          const int r = da.longestPrefixSearchWithPOS (p, p_end, offsets & 0x3fff, &c2i[0]); // found word
+          id    = r & 0xfffff;
+          bytes = (r >> 23) ? (r >> 23) : u8_len (p);
+          ctype = (r >> 20) & 0x7; // 0: num|unk / 1: alpha / 2: kana / 3: other
+          if (! bos) { // word that may concat with the future context
+            if (ctype_prev != ctype || // different character types
+                ctype_prev == 3 ||     // seen words in non-num/alpha/kana
+                (ctype_prev == 2 && bytes_prev + bytes >= 18)) {
+              if (POS_TAGGING) {
+#ifdef USE_COMPACT_DICT
+                write_string (_ptr, &fs[((offsets >> MAX_KEY_BITS) & 0xfffff)]);
+                if (concat)
+                  write_string (_ptr, ",*,*,*\n", 7);
+                else
+                  write_string (_ptr, &fs[(offsets >> 34)]);
+#else
+                if (concat) {
+                  write_string (_ptr, &fs[(offsets >> 34)], (offsets >> MAX_KEY_BITS) & 0x7f);
+                  write_string (_ptr, ",*,*,*\n", 7);
+                } else
+                  write_string (_ptr, &fs[(offsets >> 34)], (offsets >> (MAX_KEY_BITS + MAX_FEATURE_BITS)) & 0x3ff);
+#endif
+                concat = false;
+              } else
+                write_string (_ptr, " ", 1);
+            } else
+              concat = true;
+          } else
+            bos = false;
+          write_string (_ptr, p, static_cast <size_t> (bytes));
+        }
+        if (! bos) // output fs of last token
+          if (POS_TAGGING) {
+#ifdef USE_COMPACT_DICT
+            write_string (_ptr, &fs[((offsets >> MAX_KEY_BITS) & 0xfffff)]);
+            if (concat)
+              write_string (_ptr, ",*,*,*\n", 7);
+            else
+              write_string (_ptr, &fs[(offsets >> 34)]);
+#else
+            if (concat) {
+              write_string (_ptr, &fs[(offsets >> 34)], (offsets >> MAX_KEY_BITS) & 0x7f);
+              write_string (_ptr, ",*,*,*\n", 7);
+            } else
+              write_string (_ptr, &fs[(offsets >> 34)], (offsets >> (MAX_KEY_BITS + MAX_FEATURE_BITS)) & 0x3ff);
+#endif
+          }
+        write_string (_ptr, POS_TAGGING ? "EOS\n" : "\n", POS_TAGGING ? 4 : 1);
+        write_buffer (_ptr, &_res[0], BUF_SIZE_);
+      }
+      write_buffer (_ptr, &_res[0], 0);
+    }
+  };
+}
 #endif
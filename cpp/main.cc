@@ -9,8 +9,12 @@
 #include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <deque>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <mutex>
+#include <numeric>
 #include <set>
 #include <string>
 #include <thread>
@@ -30,9 +34,24 @@
 #include "glob.hpp"
 
 //
+#include "aho-corasick.hh"
+#include "binned-writer.hh"
 #include "dedup.hh"
+#include "dedup-cluster.hh"
+#include "doc-id.hh"
+#include "doc-filter.hh"
 #include "exact-dedup.hh"
+#include "ngram-lm.hh"
+#include "nfkc-normalize.hh"
+#include "parquet-sink.hh"
+#include "parquet-source.hh"
+#include "quantile-sketch.hh"
+#include "shard-pipeline.hh"
+#include "sidecar.hh"
+#include "stage-stats.hh"
 #include "str-util.hh"
+#include "synth-corpus.hh"
+#include "task-pool.hh"
 #include "pbar.hpp"
 #include "rwkv_world_tokenizer_trie.hh"
 
@@ -41,16 +60,6 @@
 #include "minijson.h"
 
 
-#define N_GRAM 5
-#define B_BYTES 2 // this should be 2
-#define N_BUCKETS 20 // this should be 20
-
-#define BUCKET_SIZE 10 // 10 = The Pile. 450 = RefinedWeb
-
-static uint32_t cpu_count() {
-  return (std::max)(1u, std::thread::hardware_concurrency());
-}
-
 static std::string to_base64(const std::vector<uint8_t> &bytes) {
   size_t len = chromium_base64_encode_len(bytes.size());
 
@@ -93,23 +102,19 @@ static std::string wakachi(const std::string &filename) {
 //
 // Assume `text` is UTF-8 string
 // Return empty string when failed to normalize.
+// Already-normalized text skips utf8proc(see nfkc-normalize.hh). Use
+// nfkc::Normalizer directly to reuse buffers when normalizing many strings.
 //
 static std::string nfkc_normalize(const std::string &text) {
-  utf8proc_uint8_t *ret =
-      utf8proc_NFKC(reinterpret_cast<const uint8_t *>(text.c_str()));
-
-  if (ret) {
-    std::string normalized_text(reinterpret_cast<const char *>(ret));
-    free(ret);
-    return normalized_text;
-  } else {
-    return std::string();
-  }
+  return nfkc::normalize(text);
 }
 
 static bool zstd_compress_to_file(const void *buf, const size_t size,
                                   const char *fname) {
+  stagestats::ScopedTimer timer(stagestats::Stage::Compress);
+
   size_t cBuffSize = ZSTD_compressBound(size);
+  stagestats::add_alloc(stagestats::Stage::Compress, cBuffSize);
 
   /* Compress.
    * If you are doing many compressions, you may want to reuse the context.
@@ -122,6 +127,7 @@ static bool zstd_compress_to_file(const void *buf, const size_t size,
   CHECK_ZSTD(cSize);
 
   saveFile_orDie(fname, cBuff, cSize);
+  stagestats::add_bytes(stagestats::Stage::Compress, size, cSize);
 
   /* success */
   printf("%25s : %6u -> %7u - %s \n", fname, (unsigned)size, (unsigned)cSize,
@@ -218,6 +224,8 @@ static std::string zstd_decompress_stream(const char *fname) {
 }
 
 static std::string zstd_decompress(const char *fname) {
+  stagestats::ScopedTimer timer(stagestats::Stage::Decompress);
+
   size_t cSize;
   void *const cBuff = mallocAndLoadFile_orDie(fname, &cSize);
 
@@ -233,10 +241,14 @@ static std::string zstd_decompress(const char *fname) {
   if (rSize == ZSTD_CONTENTSIZE_UNKNOWN) {
     // Use streaming API
     free(cBuff);
-    return zstd_decompress_stream(fname);
+    std::string buf = zstd_decompress_stream(fname);
+    stagestats::add_bytes(stagestats::Stage::Decompress, cSize, buf.size());
+    stagestats::add_alloc(stagestats::Stage::Decompress, buf.size());
+    return buf;
   }
 
   void *const rBuff = malloc_orDie((size_t)rSize);
+  stagestats::add_alloc(stagestats::Stage::Decompress, cSize + rSize);
 
   /* Decompress.
    * If you are doing many decompressions, you may want to reuse the context
@@ -253,6 +265,7 @@ static std::string zstd_decompress(const char *fname) {
 
   // assume decoded data is utf-8 string.
   std::string buf(reinterpret_cast<const char *>(rBuff), dSize);
+  stagestats::add_bytes(stagestats::Stage::Decompress, cSize, dSize);
 
   free(rBuff);
   free(cBuff);
@@ -282,81 +295,240 @@ std::vector<std::string> split_lines(const std::string &s) {
 }
 
 std::vector<nlohmann::json> decode_jsonl(std::vector<std::string> &&json_strs) {
-  uint32_t nthreads = cpu_count();
-
-  std::vector<std::thread> workers;
-  std::atomic<uint64_t> i(0ull);
-
   std::vector<nlohmann::json> ret;
   ret.resize(json_strs.size());
 
-  for (uint32_t t = 0; t < nthreads; t++) {
-    workers.emplace_back(std::thread([&]() {
-      uint64_t idx;
+  taskpool::parallel_for(json_strs.size(), [&](uint64_t begin, uint64_t end, uint32_t) {
+    stagestats::ScopedTimer timer(stagestats::Stage::Parse);
+    uint64_t bytes = 0;
 
-      while ((idx = (i++)) < json_strs.size()) {
-        // simdjson::ondemand::parser parser;
-        // simdjson::padded_string json_str =
-        // simdjson::padded_string(jsons[idx]); simdjson::ondemand::document doc
-        // = parser.iterate(json_str);
+    for (uint64_t idx = begin; idx < end; idx++) {
+      bytes += json_strs[idx].size();
 
-        nlohmann::json j = nlohmann::json::parse(json_strs[idx]);
+      // simdjson::ondemand::parser parser;
+      // simdjson::padded_string json_str =
+      // simdjson::padded_string(jsons[idx]); simdjson::ondemand::document doc
+      // = parser.iterate(json_str);
 
-        ret[idx] = std::move(j);
-      }
-    }));
-  }
+      nlohmann::json j = nlohmann::json::parse(json_strs[idx]);
 
-  for (auto &th : workers) {
-    th.join();
-  }
+      ret[idx] = std::move(j);
+    }
+
+    stagestats::add_bytes(stagestats::Stage::Parse, bytes, 0);
+    stagestats::add_records(stagestats::Stage::Parse, end - begin);
+  });
 
   return ret;
 }
 
+// `bytes`(optional) receives the decompressed size.
 static std::vector<nlohmann::json> load_jsonl_zstd(
-    const glob::fs::path &filepath) {
+    const glob::fs::path &filepath, uint64_t *bytes = nullptr) {
   std::string jsonl_data = zstd_decompress(filepath.c_str());
+  if (bytes) {
+    (*bytes) = jsonl_data.size();
+  }
 
   std::vector<nlohmann::json> jsonl = decode_jsonl(split_lines(jsonl_data));
 
   return jsonl;
 }
 
-template<uint32_t N>
-void compute_hash(std::vector<nlohmann::json> &jsons,
-                  const std::string &text_key) {
-  uint32_t nthreads = cpu_count();
+// Shingle mode for minhash.
+// char: LSHParams::n_gram-char shingles(default)
+// word: k-word shingles over Jagger segmentation(`--shingle=word:k`, or
+// `--shingle=word` for k = 5)
+struct ShingleOption
+{
+  bool word{false};
+  uint32_t k{5};
+  const jagger::tagger *tagger{nullptr}; // required for word mode.
+};
+
+// parse `char`, `word:k` or `word`(k = 5)
+static bool parse_shingle_option(const std::string &s, ShingleOption &opt) {
+  if (s == "char") {
+    opt.word = false;
+    return true;
+  }
+
+  if (s.compare(0, 5, "word:") == 0) {
+    int k = std::atoi(s.c_str() + 5);
+    if (k <= 0) {
+      std::cerr << "k must be positive in --shingle=word:k, but got `" << s << "`\n";
+      return false;
+    }
+    opt.word = true;
+    opt.k = uint32_t(k);
+    return true;
+  }
+
+  if (s == "word") {
+    opt.word = true;
+    return true;
+  }
+
+  std::cerr << "Unknown shingle mode `" << s << "`. Use `char`, `word:k` or `word`(k = 5)\n";
+  return false;
+}
 
-  std::vector<std::thread> workers;
-  std::atomic<uint64_t> i(0ull);
+// `char` or `word:k`(the `shingle` metadata of minhash side-car files).
+static std::string shingle_option_name(const ShingleOption &opt) {
+  return opt.word ? "word:" + std::to_string(opt.k) : "char";
+}
 
+// LSH configuration of `minhash`(see LSHParams).
+// `--ngram=N`, `--bands=B` and `--rows=R` set it directly. `--threshold=T`
+// instead picks bands x rows for Jaccard threshold T within
+// `--hash_budget=N` minhashes per document(optimal_lsh_params()).
+// `--band_key=hash|bytes` selects 64-bit hashed band keys(default) or the
+// 2-byte truncated ones. `--fingerprints` also stores the full 32-bit
+// fingerprints(for `dedup --cluster --verify_signatures`).
+struct LSHOption
+{
+  LSHParams params;
+  double threshold{0.0};     // > 0: pick bands x rows.
+  uint32_t hash_budget{200}; // 20 x 10
+  bool fingerprints{false};
+};
+
+// Returns true when `arg` is one of the LSH options.
+static bool parse_lsh_option(const std::string &arg, LSHOption &opt) {
+  if (arg.compare(0, 8, "--ngram=") == 0) {
+    opt.params.n_gram = uint32_t((std::max)(0, std::atoi(arg.c_str() + 8)));
+    return true;
+  }
+  if (arg.compare(0, 8, "--bands=") == 0) {
+    opt.params.n_bands = uint32_t((std::max)(0, std::atoi(arg.c_str() + 8)));
+    return true;
+  }
+  if (arg.compare(0, 7, "--rows=") == 0) {
+    opt.params.rows = uint32_t((std::max)(0, std::atoi(arg.c_str() + 7)));
+    return true;
+  }
+  if (arg.compare(0, 12, "--threshold=") == 0) {
+    opt.threshold = std::atof(arg.c_str() + 12);
+    return true;
+  }
+  if (arg.compare(0, 14, "--hash_budget=") == 0) {
+    opt.hash_budget = uint32_t((std::max)(0, std::atoi(arg.c_str() + 14)));
+    return true;
+  }
+  if (arg == "--band_key=hash") {
+    opt.params.hashed_keys = true;
+    return true;
+  }
+  if (arg == "--band_key=bytes") {
+    opt.params.hashed_keys = false;
+    return true;
+  }
+  if (arg == "--fingerprints") {
+    opt.fingerprints = true;
+    return true;
+  }
+  return false;
+}
 
-  for (uint32_t t = 0; t < nthreads; t++) {
-    workers.emplace_back(std::thread([&]() {
-      uint64_t idx;
+// Validate `opt` and apply `--threshold`.
+static bool resolve_lsh_option(LSHOption &opt) {
+  if (opt.threshold > 0.0) {
+    if (!optimal_lsh_params(opt.threshold, opt.hash_budget, opt.params)) {
+      std::cerr << "--threshold must be in (0, 1) and --hash_budget positive\n";
+      return false;
+    }
+    std::cout << "threshold " << opt.threshold << ": " << opt.params.n_bands << " bands x " << opt.params.rows
+              << " rows(P(candidate) = " << lsh_collision_probability(opt.threshold, opt.params.n_bands, opt.params.rows)
+              << " at the threshold)\n";
+  }
+  if ((opt.params.n_gram == 0) || (opt.params.n_bands == 0) || (opt.params.rows == 0)) {
+    std::cerr << "--ngram, --bands and --rows must be positive\n";
+    return false;
+  }
+  return true;
+}
 
-      while ((idx = (i++)) < jsons.size()) {
-        auto &j = jsons[idx];
+// `--prefetch=K`(shards loaded ahead) and `--mem_budget=MB`(memory of loaded
+// shards in flight. 0 = unlimited) for shardpipe::run().
+// Returns true when `arg` is one of them.
+static bool parse_pipeline_option(const std::string &arg, shardpipe::Config &config) {
+  if (arg.compare(0, 11, "--prefetch=") == 0) {
+    config.prefetch = uint32_t((std::max)(0, std::atoi(arg.c_str() + 11)));
+    return true;
+  }
+  if (arg.compare(0, 13, "--mem_budget=") == 0) {
+    config.mem_budget = uint64_t((std::max)(0ll, std::atoll(arg.c_str() + 13))) << 20;
+    return true;
+  }
+  return false;
+}
 
-        // TODO: apply normalize for dedup.
-        // auto lines = split_lines(j[text_key]);
+// Add `minhashes`(base64 of each band key) to documents [begin, end) of `jsons`.
+// With `fingerprints`, also add `fingerprints`(base64 of the full 32-bit
+// fingerprints).
+static void compute_hash_range(std::vector<nlohmann::json> &jsons, uint64_t begin, uint64_t end,
+                               const std::string &text_key, const ShingleOption &shingle, const LSHKernel &lsh,
+                               bool fingerprints) {
+  std::vector<std::pair<uint32_t, uint32_t>> words;
+  const size_t band_bytes = lsh.params.band_bytes();
+  std::vector<uint32_t> fp(lsh.params.n_minhash());
+  std::vector<uint8_t> buf(lsh.params.lsh_bytes());
+
+  // word segmentation and hashing are timed separately(char shingles are
+  // built inside the hash kernel).
+  uint64_t shingle_ns = 0;
+  uint64_t hash_ns = 0;
+  uint64_t text_bytes = 0;
+
+  for (uint64_t idx = begin; idx < end; idx++) {
+    auto &j = jsons[idx];
+
+    // TODO: apply normalize for dedup.
+    // auto lines = split_lines(j[text_key]);
+
+    const std::string &text = j[text_key].get_ref<const std::string &>();
+    text_bytes += text.size();
+
+    uint64_t t0 = stagestats::now_ns();
+    uint64_t t1 = t0;
+    if (shingle.word) {
+      words.clear();
+      shingle.tagger->segment(text.data(), text.size(), words);
+      t1 = stagestats::now_ns();
+      lsh.words(text.data(), words, shingle.k, fp.data());
+    } else {
+      lsh.chars(text.data(), text.size(), fp.data());
+    }
+    bucketize_lsh(lsh.params, fp.data(), buf.data());
 
-        auto ngram = strutil::build_ngram<N_GRAM>(j[text_key]);
-        std::array<MinHashVal<BUCKET_SIZE, B_BYTES>, N_BUCKETS> lshs = compute_lsh<N_GRAM, N_BUCKETS, BUCKET_SIZE>(ngram);
+    std::vector<std::string> lsh_base64_strs(lsh.params.n_bands);
+    for (size_t i = 0; i < lsh_base64_strs.size(); i++) {
+      lsh_base64_strs[i] = to_base64(reinterpret_cast<const char *>(buf.data() + i * band_bytes), band_bytes);
+    }
+    j["minhashes"] = lsh_base64_strs;
+    if (fingerprints) {
+      j["fingerprints"] = to_base64(reinterpret_cast<const char *>(fp.data()), fp.size() * sizeof(uint32_t));
+    }
 
-        std::array<std::string, N_BUCKETS> lsh_base64_strs;
-        for (size_t i = 0; i < N_BUCKETS; i++) {
-          lsh_base64_strs[i] = to_base64(lshs[i].data(), lshs[i].size());
-        }
-        j["minhashes"] = lsh_base64_strs;
-      }
-    }));
+    shingle_ns += t1 - t0;
+    hash_ns += stagestats::now_ns() - t1;
   }
 
-  for (auto &th : workers) {
-    th.join();
+  if (shingle.word) {
+    stagestats::add_time(stagestats::Stage::Tokenize, shingle_ns);
+    stagestats::add_bytes(stagestats::Stage::Tokenize, text_bytes, 0);
+    stagestats::add_records(stagestats::Stage::Tokenize, end - begin);
   }
+  stagestats::add_time(stagestats::Stage::Hash, hash_ns);
+  stagestats::add_bytes(stagestats::Stage::Hash, text_bytes, (end - begin) * buf.size());
+  stagestats::add_records(stagestats::Stage::Hash, end - begin);
+}
+
+static void compute_hash(std::vector<nlohmann::json> &jsons, const std::string &text_key,
+                         const ShingleOption &shingle, const LSHKernel &lsh, bool fingerprints) {
+  taskpool::parallel_for(jsons.size(), [&](uint64_t begin, uint64_t end, uint32_t) {
+    compute_hash_range(jsons, begin, end, text_key, shingle, lsh, fingerprints);
+  });
 }
 
 static bool save_json_zstd(const std::string &filepath,
@@ -375,144 +547,198 @@ static bool save_json_zstd(const std::string &filepath,
 static bool save_jsonl_zstd(const std::string &filepath,
                            const std::vector<nlohmann::json> &js) {
   // stringify
-  std::stringstream ss;
+  std::string s;
+
+  {
+    stagestats::ScopedTimer timer(stagestats::Stage::Serialize);
 
-  for (size_t i = 0; i < js.size(); i++) {
-    const auto &j = js[i];
+    for (size_t i = 0; i < js.size(); i++) {
+      const auto &j = js[i];
+
+      if (i > 0) {
+        s += "\n";
+      }
 
-    if (i > 0) {
-      ss << "\n";
+      s += j.dump();
     }
 
-    ss << j;
+    stagestats::add_bytes(stagestats::Stage::Serialize, 0, s.size());
+    stagestats::add_records(stagestats::Stage::Serialize, js.size());
   }
 
-  std::string s = ss.str();
-
   return zstd_compress_to_file(reinterpret_cast<const void *>(s.c_str()),
                                s.size(), filepath.c_str());
 }
 
-template<uint32_t N = 5>
+// Shards of `minhash_files` are loaded, hashed and stored with
+// shardpipe::run(see shard-pipeline.hh), so reading/decoding the next shards
+// and compressing/writing the previous ones overlap hashing.
 static bool minhash_files(const std::string &filepath,
                           const std::string &output_basedir,
-                          const std::string &text_key) {
+                          const std::string &text_key,
+                          const ShingleOption &shingle = ShingleOption(),
+                          const LSHKernel &lsh = select_lsh_kernel(LSHParams()),
+                          bool fingerprints = false,
+                          const shardpipe::Config &pipe_config = shardpipe::Config()) {
   std::vector<glob::fs::path> files = glob::glob({filepath + "/*.zstd", filepath + "/*.zst"});
   std::cout << "num files: " << files.size() << "\n";
 
-  size_t n_documents = 0;
-  size_t n_dups = 0;
-
-  //LSHDedupConfig conf;
-  std::set<std::vector<uint8_t>> hash_store;
-
-  for (const auto &f : files) {
-    std::cout << f << "\n";
-
-    glob::fs::path outpath = output_basedir / f.filename();
-    std::cout << "output filepath: " << outpath << "\n";
-
-    std::vector<nlohmann::json> jsonl = load_jsonl_zstd(f);
-
-    compute_hash<N>(jsonl, text_key);
-
-    n_documents += jsonl.size();
-
-    //// TODO: threading
-    // for (size_t i = 0; i < jsonl.size(); i++) {
-    //   const auto &j = jsonl[i];
+  shardpipe::Stages<std::vector<nlohmann::json>> stages;
 
-    //  if (dedup_stream(j["minhashes"], hash_store)) {
-    //    n_dups++;
-    //  }
+  stages.load = [&](size_t idx, std::vector<nlohmann::json> &jsonl, uint64_t &bytes) {
+    jsonl = load_jsonl_zstd(files[idx], &bytes);
+    return true;
+  };
 
-    //  n_documents++;
-    //}
+  stages.process = [&](size_t idx, std::vector<nlohmann::json> &jsonl) {
+    std::cout << files[idx] << "\n";
+    compute_hash(jsonl, text_key, shingle, lsh, fingerprints);
+    return true;
+  };
 
-    std::vector<nlohmann::json> out_jsonl = jsonl;
-
-    std::stringstream ss;
+  stages.store = [&](size_t idx, std::vector<nlohmann::json> &jsonl) {
+    glob::fs::path outpath = output_basedir / files[idx].filename();
 
-    // strip text
-    for (size_t i = 0; i < out_jsonl.size(); i++) {
-      auto &j = out_jsonl[i];
+    // strip text(in place. `jsonl` is no longer used)
+    std::string jsonl_str;
+    for (size_t i = 0; i < jsonl.size(); i++) {
+      auto &j = jsonl[i];
 
       if (i > 0) {
-        ss << "\n";
+        jsonl_str += "\n";
       }
       j.erase(text_key);
 
-      ss << j;
+      jsonl_str += j.dump();
     }
 
-    std::string jsonl_str = ss.str();
-
     // save
     if (!zstd_compress_to_file(reinterpret_cast<const void *>(jsonl_str.c_str()),
                                jsonl_str.size(), outpath.c_str())) {
       std::cerr << "Failed to compress/write file: " << outpath << "\n";
       return false;
     }
+    std::cout << "output filepath: " << outpath << "\n";
+    return true;
+  };
 
-  }
-
-  //std::cout << "duplicated " << n_dups << " documents(total " << n_documents << "). ratio = "
-  //          << 100.0 * double(n_dups) / double(n_documents) << " %\n";
-
-  return true;
+  return shardpipe::run(files.size(), pipe_config, stages);
 }
 
-template<uint32_t T_N_BUCKETS, uint32_t T_BUCKET_SIZE = BUCKET_SIZE, uint32_t T_B = B_BYTES>
-static std::array<MinHashVal<T_BUCKET_SIZE, T_B>, T_N_BUCKETS> decode_hashval(
-  const std::vector<std::string> &minhashes_strs)
-{
-  std::array<MinHashVal<T_BUCKET_SIZE, T_B>, T_N_BUCKETS> lshs;
+// Decode base64 band keys of `minhashes` into `dst`(band by band).
+// `band_bytes` receives the size of a band key. All bands must have the same size.
+static bool decode_minhashes(const std::vector<std::string> &minhashes_strs, std::vector<uint8_t> &dst,
+                             size_t &band_bytes) {
+  dst.clear();
+  band_bytes = 0;
 
   std::vector<uint8_t> buf;
 
-  for (size_t i = 0; i < T_N_BUCKETS; i++) {
+  for (size_t i = 0; i < minhashes_strs.size(); i++) {
 
     buf.resize(minhashes_strs[i].size());
 
     size_t n = chromium_base64_decode(reinterpret_cast<char *>(buf.data()), minhashes_strs[i].data(), minhashes_strs[i].size());
     if (n == MODP_B64_ERROR) {
       std::cerr << "failed to decode base64 string\n";
-      exit(-1);
+      return false;
     }
 
-    if (n != (BUCKET_SIZE * B_BYTES)) {
+    if (i == 0) {
+      band_bytes = n;
+    } else if (n != band_bytes) {
       std::cerr << "hashval size mismatch\n";
-      exit(-1);
+      return false;
     }
 
-    memcpy(reinterpret_cast<void *>(lshs[i].data()), buf.data(), BUCKET_SIZE * B_BYTES);
+    dst.insert(dst.end(), buf.begin(), buf.begin() + n);
+  }
+
+  return !minhashes_strs.empty();
+}
+
+// Decode `minhashes` of document `j` into `lsh`. The band layout(# of bands,
+// bytes per band) is taken from the first document and then must not change.
+static bool decode_document_lsh(const nlohmann::json &j, std::vector<uint8_t> &lsh, size_t &n_bands,
+                                size_t &band_bytes) {
+  if (!j.contains("minhashes") || !j["minhashes"].is_array()) {
+    std::cerr << "`minhashes` not found\n";
+    return false;
+  }
+  std::vector<std::string> minhashes_strs = j["minhashes"];
+
+  size_t bytes = 0;
+  if (!decode_minhashes(minhashes_strs, lsh, bytes)) {
+    return false;
+  }
+
+  if (n_bands == 0) {
+    n_bands = minhashes_strs.size();
+    band_bytes = bytes;
+  } else if ((minhashes_strs.size() != n_bands) || (bytes != band_bytes)) {
+    std::cerr << "`minhashes` must be " << n_bands << " bands of " << band_bytes << " bytes, but got "
+              << minhashes_strs.size() << " bands of " << bytes << " bytes\n";
+    return false;
   }
 
-  return lshs;
+  return true;
+}
+
+// Write dedup output of a JSONL shard as *.jsonl.zst, or as *.parquet with `parquet`.
+static bool store_dedup_jsonl(const glob::fs::path &outpath, const std::vector<nlohmann::json> &jsonl,
+                              bool parquet) {
+  if (parquet) {
+    std::string lines;
+    for (const auto &j : jsonl) {
+      lines += j.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+      lines += "\n";
+    }
+    std::string pqpath = pqsink::replace_ext(outpath.string());
+    std::string err;
+    if (!pqsink::write_jsonl(lines, pqpath, pqsink::Options(), &err)) {
+      std::cerr << "Failed to write Parquet file: " << pqpath << " " << err << "\n";
+      return false;
+    }
+  } else if (!save_jsonl_zstd(outpath, jsonl)) {
+    std::cerr << "Failed to compress/write file: " << outpath << "\n";
+    return false;
+  }
+  return true;
 }
 
-static bool dedup_to_files(const std::string &filepath, const std::string &out_basedir)
+static bool dedup_to_files(const std::string &filepath, const std::string &out_basedir, bool parquet = false,
+                           const shardpipe::Config &pipe_config = shardpipe::Config())
 {
   std::vector<glob::fs::path> files = glob::glob({filepath + "/*.zstd", filepath + "/*.zst"});
+  // filename order, so which copy is kept does not depend on the directory order.
+  std::sort(files.begin(), files.end());
   std::cout << "num files: " << files.size() << "\n";
 
   size_t n_documents = 0;
   size_t n_dups = 0;
   size_t n_processed_files = 0;
 
-//#define BUCKETIZED_DEDUP
+  // created for the band layout of the first document.
+  BandStore hash_store;
+  size_t n_bands = 0;
+  size_t band_bytes = 0;
+  std::vector<uint8_t> lsh;
 
-#if defined(BUCKETIZED_DEDUP)
-#error TODO
-  std::array<std::unordered_set<MinHashVal<BUCKET_SIZE, B_BYTES>, MinHashValHasher<BUCKET_SIZE, B_BYTES>, MinHashValEqual<BUCKET_SIZE, B_BYTES>, N_BUCKETS> hash_stores;
-#else
-  std::unordered_set<MinHashVal<BUCKET_SIZE, B_BYTES>, MinHashValHasher<BUCKET_SIZE, B_BYTES>, MinHashValEqual<BUCKET_SIZE, B_BYTES>> hash_store;
-#endif
+  // Files are deduplicated in order on this thread(`hash_store` is shared).
+  // Loading the next files and writing the previous ones run in the
+  // background(see shard-pipeline.hh).
+  shardpipe::Stages<std::vector<nlohmann::json>> stages;
 
-  for (const auto &f : files) {
-    std::cout << f << "\n";
+  stages.load = [&](size_t idx, std::vector<nlohmann::json> &jsonl, uint64_t &bytes) {
+    jsonl = load_jsonl_zstd(files[idx], &bytes);
+    return true;
+  };
 
-    std::vector<nlohmann::json> jsonl = load_jsonl_zstd(f);
+  stages.process = [&](size_t idx, std::vector<nlohmann::json> &jsonl) {
+    std::cout << files[idx] << "\n";
+
+    stagestats::ScopedTimer timer(stagestats::Stage::Dedup);
+    const size_t n_dups_before = n_dups;
 
     n_documents += jsonl.size();
 
@@ -520,22 +746,14 @@ static bool dedup_to_files(const std::string &filepath, const std::string &out_b
     for (size_t i = 0; i < jsonl.size(); i++) {
       auto &j = jsonl[i];
 
-      std::vector<std::string> minhashes_strs = j["minhashes"];
-
-      if (minhashes_strs.size() != N_BUCKETS) {
-        std::cerr << "`minhashes` must be an array with length " << N_BUCKETS << ", but got " << minhashes_strs.size() << "\n";
+      if (!decode_document_lsh(j, lsh, n_bands, band_bytes)) {
         return false;
       }
+      if (!hash_store.dedup) {
+        hash_store = make_band_store(uint32_t(n_bands), band_bytes);
+      }
 
-      auto lshs = decode_hashval<N_BUCKETS, BUCKET_SIZE, B_BYTES>(minhashes_strs);
-
-#if defined(BUCKETIZED_DEDUP)
-      // i = bucket index.
-      bool deduped = false;
-#error todo
-#else
-      bool deduped = dedup_stream<N_BUCKETS, BUCKET_SIZE, B_BYTES>(lshs, hash_store);
-#endif
+      bool deduped = hash_store.dedup(lsh.data());
 
       // add "duplicate" flag
       j["duplicate"] = deduped;
@@ -546,174 +764,3644 @@ static bool dedup_to_files(const std::string &filepath, const std::string &out_b
     }
 
     n_processed_files++;
+    stagestats::add_records(stagestats::Stage::Dedup, jsonl.size(), n_dups - n_dups_before);
 
     std::cout << "duplicated " << n_dups << " documents(total " << n_documents << "). ratio = "
               << 100.0 * double(n_dups) / double(n_documents) << " %\n";
     std::cout << "  processed files: " << n_processed_files << " / " << files.size() << "\n";
-    std::cout << "  hash_store.size: " << hash_store.size() << "\n";
+    std::cout << "  hash_store.size: " << (hash_store.size ? hash_store.size() : 0) << "\n";
+    return true;
+  };
 
-    // save
-    glob::fs::path outpath = out_basedir / f.filename();
-    if (!save_jsonl_zstd(outpath, jsonl)) {
-      std::cerr << "Failed to compress/write file: " << f << "\n";
-      return false;
-    }
+  stages.store = [&](size_t idx, std::vector<nlohmann::json> &jsonl) {
+    return store_dedup_jsonl(out_basedir / files[idx].filename(), jsonl, parquet);
+  };
 
+  if (!shardpipe::run(files.size(), pipe_config, stages)) {
+    return false;
   }
 
   std::cout << "TOTAL: duplicated " << n_dups << " documents(total " << n_documents << "). ratio = "
             << 100.0 * double(n_dups) / double(n_documents) << " %\n";
   std::cout << "  processed files: " << n_processed_files << " / " << files.size() << "\n";
-  std::cout << "  hash_store.size " << hash_store.size() << "\n";
+  std::cout << "  hash_store.size " << (hash_store.size ? hash_store.size() : 0) << "\n";
 
   return true;
 }
 
-static int test_dedup() {
-  const char *in0 =
-      "吾輩は猫である。名前はまだ無い。どこで生まれたかとんと見当がつかぬ。";
-  const char *in1 =
-      "吾輩は鳥である。名前はまだ無い。どこで生まれたかとんと見当がつかぬ。";
-  const char *in2 =
-      "東京は晴れ.";
-
-  auto n0 = strutil::build_ngram<N_GRAM>(in0);
-  auto n1 = strutil::build_ngram<N_GRAM>(in1);
-  auto n2 = strutil::build_ngram<N_GRAM>(in2);
+// split lines without copying. `s` must outlive the returned views.
+static std::vector<std::string_view> split_lines_view(std::string_view s) {
+  std::vector<std::string_view> dst;
 
-  for (const auto &gram : n0) {
-    std::cout << gram.str() << "\n";
-  }
-  for (const auto &gram : n1) {
-    std::cout << gram.str() << "\n";
-  }
-  for (const auto &gram : n2) {
-    std::cout << gram.str() << "\n";
+  size_t s_begin = 0;
+  for (;;) {
+    size_t s_end = s.find('\n', s_begin);
+    if (s_end == std::string_view::npos) {
+      if (s_begin < s.size()) {
+        dst.push_back(s.substr(s_begin));
+      }
+      break;
+    }
+    dst.push_back(s.substr(s_begin, s_end - s_begin));
+    s_begin = s_end + 1;
   }
 
+  return dst;
+}
 
-  //LSHDedupConfig conf;
+//
+// Apply 03_clean_step1 document filter(see doc-filter.hh) to *.zst JSONL
+// files in `filepath` and write kept documents to `out_basedir`.
+// Unchanged documents are written as is(no JSON re-serialization).
+//
+// When `assign_ids` is true, documents without `doc_id` get
+// docid::make(shard_offset + file index, line index)(see doc-id.hh).
+// Files are processed in filename order so the shard id is stable.
+//
+// *.parquet files(HF datasets) are read directly(only `text_key` and
+// `doc_id` columns, see parquet-source.hh) and written as
+// `<stem>.jsonl.zst` with `text_key` and `doc_id` fields.
+//
+static bool clean_files(const std::string &filepath, const std::string &out_basedir,
+                        const std::string &text_key,
+                        const docfilter::CleanConfig &config,
+                        bool assign_ids = true, uint32_t shard_offset = 0)
+{
+  std::vector<glob::fs::path> files =
+      glob::glob({filepath + "/*.zstd", filepath + "/*.zst", filepath + "/*" + pqsource::kExt});
+  std::sort(files.begin(), files.end());
+  std::cout << "num files: " << files.size() << "\n";
 
-  auto lsh0 = compute_lsh<N_GRAM, N_BUCKETS, BUCKET_SIZE>(n0);
-  auto lsh1 = compute_lsh<N_GRAM, N_BUCKETS, BUCKET_SIZE>(n1);
-  auto lsh2 = compute_lsh<N_GRAM, N_BUCKETS, BUCKET_SIZE>(n2);
+  docfilter::CleanStats total_stats;
 
+  for (size_t file_idx = 0; file_idx < files.size(); file_idx++) {
+    const auto &f = files[file_idx];
+    const uint32_t shard = shard_offset + uint32_t(file_idx);
+    std::cout << f << "\n";
 
-  std::cout << in0 << "\n";
-  for (const auto &lsh : lsh0) {
-    std::cout << "lsh.sz = " << lsh.size() << "\n";
-    std::cout << strutil::byte_to_hex_string(lsh.data(), lsh.size()) << "\n";
-  }
+    const bool parquet = pqsource::is_parquet(f.string());
 
-  std::cout << in1 << "\n";
-  for (const auto &lsh : lsh1) {
-    std::cout << strutil::byte_to_hex_string(lsh.data(), lsh.size()) << "\n";
-  }
+    std::string jsonl_data;
+    std::vector<std::string_view> lines;
+    pqsource::TextColumn column;
 
-  std::cout << in2 << "\n";
-  for (const auto &lsh : lsh2) {
-    std::cout << strutil::byte_to_hex_string(lsh.data(), lsh.size()) << "\n";
-  }
+    if (parquet) {
+      // `lines` are texts.
+      std::string err;
+      if (!pqsource::load_text_column(f.string(), text_key, column, &err)) {
+        std::cerr << "Failed to read Parquet file: " << f << " " << err << "\n";
+        return false;
+      }
+      lines = column.rows;
+    } else {
+      jsonl_data = zstd_decompress(f.c_str());
+      size_t data_len = jsonl_data.size();
 
-  std::unordered_set<MinHashVal<BUCKET_SIZE, B_BYTES>, MinHashValHasher<BUCKET_SIZE, B_BYTES>, MinHashValEqual<BUCKET_SIZE, B_BYTES>> hash_store;
+      // simdjson reads up to SIMDJSON_PADDING bytes past the end of the record.
+      jsonl_data.append(simdjson::SIMDJSON_PADDING, ' ');
 
-  if (dedup_stream<N_BUCKETS, BUCKET_SIZE, B_BYTES>(lsh0, hash_store)) {
-    std::cout << in0 << " duplicated!\n";
-  }
-  if (dedup_stream<N_BUCKETS, BUCKET_SIZE, B_BYTES>(lsh1, hash_store)) {
-    std::cout << in1 << " duplicated!\n";
-  }
-  if (dedup_stream<N_BUCKETS, BUCKET_SIZE, B_BYTES>(lsh2, hash_store)) {
-    std::cout << in2 << " duplicated!\n";
-  }
+      lines = split_lines_view(std::string_view(jsonl_data.data(), data_len));
+    }
 
-  return 0;
-}
+    std::vector<std::string> cleaned(lines.size());
+    std::vector<uint8_t> keep(lines.size(), 0);
+
+    std::vector<docfilter::CleanStats> thread_stats(taskpool::num_threads());
+    std::atomic<bool> failed(false);
+
+    taskpool::parallel_for(lines.size(), [&](uint64_t begin, uint64_t end, uint32_t t) {
+      stagestats::ScopedTimer timer(stagestats::Stage::Filter);
+      simdjson::ondemand::parser parser;
+      std::string out;
+      uint64_t bytes = 0;
+
+      for (uint64_t idx = begin; idx < end; idx++) {
+        std::string_view line = lines[idx];
+        bytes += line.size();
+
+        std::string_view text;
+        simdjson::ondemand::document doc;
+        if (parquet) {
+          text = line;
+        } else {
+          size_t capacity = jsonl_data.size() - size_t(line.data() - jsonl_data.data());
+          if (parser.iterate(line.data(), line.size(), capacity).get(doc) ||
+              doc[text_key].get_string().get(text)) {
+            std::cerr << "Failed to parse JSON or get `" << text_key << "` at line " << idx << "\n";
+            failed = true;
+            continue;
+          }
+        }
 
-int main(int argc, char **argv) {
-  if (argc < 3) {
-    std::cout << "Need cmd ARGS\n";
-    std::cout << "  cmd:\n";
-    //std::cout << "    wakachi input.txt output.txt: Do wakachi-gaki for input "
-    //             "string\n";
-    std::cout << "    normalize input_string : NFKC normalization\n";
-    std::cout << "    dedup <folder> [text_key]: do text dedup with minhash. Look *.jsonl.zstd "
-                 "files in "
-                 "<folder>. [text_key] optional. specify text tag in "
-                 "JSON(default `text`)\n";
-    std::cout
-        << "    minhash <folder> <out_folder> [text_key]: Compute minhash and "
-           "store minhash JSON to <out_folder>. Look *.zstd files in "
-           "<folder>. [text_key] optional. specify text tag in JSON(default "
-           "`text`)\n";
-    std::cout << "    exact build <folder> : Build suffix array for exact dedup\n";
-    std::cout << "    exact dedup <folder> : Do exact dedup with suffx array. Look *.jsonl.zstd files in <folder>.\n";
-    std::cout << "    exact count <folder> <key>: Count occurrences of key from suffix array. Look *.jsonl.zstd files in <folder>.\n";
-    std::cout << "    exact search <folder> <key>: Search string 'key' with suffix array. Look *.jsonl.zstd files in <folder>.\n";
-    std::cout << "    proc input.jsonl.zstd : proc(WIP)\n";
-    std::cout << "    test <test_cmd>: Run tests\n";
-    return -1;
-  }
+        bool changed{false};
+        if (docfilter::clean_document(text, config, out, changed, thread_stats[t]) != docfilter::kDocKeep) {
+          continue;
+        }
 
-  std::string cmd = argv[1];
-  if (cmd == "wakachi") {
-  } else if (cmd == "normalize") {
-    std::string ret = nfkc_normalize(argv[2]);
-    std::cout << ret << "\n";
+        if (parquet) {
+          nlohmann::json j;
+          j[text_key] = changed ? out : std::string(text);
+          if (!column.ids.empty()) {
+            j[docid::kKey] = column.ids[idx];
+          } else if (assign_ids) {
+            j[docid::kKey] = docid::make(shard, uint32_t(idx));
+          }
+          keep[idx] = 1;
+          cleaned[idx] = j.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+          continue;
+        }
 
-  } else if (cmd == "minhash") {
-    if (argc < 4) {
-      std::cerr << "Need <folder> <out_folder> [text_key]\n";
-      exit(-1);
+        // keep the id assigned by a previous run.
+        bool new_id = false;
+        if (assign_ids) {
+          uint64_t existing_id;
+          new_id = (doc[docid::kKey].get_uint64().get(existing_id) != simdjson::SUCCESS);
+        }
+        const uint64_t id = docid::make(shard, uint32_t(idx));
+
+        keep[idx] = 1;
+        if (changed) {
+          nlohmann::json j = nlohmann::json::parse(line);
+          j[text_key] = out;
+          if (new_id) {
+            j[docid::kKey] = id;
+          }
+          cleaned[idx] = j.dump();
+        } else if (new_id) {
+          cleaned[idx] = docid::insert(line, id);
+        }
+      }
+
+      stagestats::add_bytes(stagestats::Stage::Filter, bytes, 0);
+      stagestats::add_records(stagestats::Stage::Filter, end - begin,
+                              uint64_t(std::count(keep.begin() + begin, keep.begin() + end, 0)));
+    });
+
+    if (failed) {
+      return false;
     }
 
-    std::string out_basedir = argv[3];
+    const uint64_t serialize_start = stagestats::now_ns();
+    std::string dst;
+    size_t n_kept = 0;
+    for (size_t k = 0; k < lines.size(); k++) {
+      if (!keep[k]) {
+        continue;
+      }
+      if (n_kept) {
+        dst += "\n";
+      }
+      if (cleaned[k].empty()) {
+        dst.append(lines[k].data(), lines[k].size());
+      } else {
+        dst += cleaned[k];
+      }
+      n_kept++;
+    }
+    stagestats::add_time(stagestats::Stage::Serialize, stagestats::now_ns() - serialize_start);
+    stagestats::add_bytes(stagestats::Stage::Serialize, 0, dst.size());
+    stagestats::add_records(stagestats::Stage::Serialize, n_kept);
 
-    std::string text_key = "text";
-    if (argc > 4) {
-      text_key = argv[4];
+    docfilter::CleanStats file_stats;
+    for (const auto &st : thread_stats) {
+      file_stats.merge(st);
     }
+    total_stats.merge(file_stats);
 
-    bool ret = minhash_files(argv[2], out_basedir, text_key);
+    std::cout << "  " << lines.size() << " => " << n_kept << "\n";
 
-    if (ret) {
-      return 0;
-    } else {
-      return -1;
+    glob::fs::path outpath = out_basedir / f.filename();
+    if (parquet) {
+      outpath = glob::fs::path(out_basedir) / (f.stem().string() + ".jsonl.zst");
     }
-  } else if (cmd == "exact") {
-    if (argc < 4) {
-      std::cerr << "Need <task> <folder>\n";
-      exit(-1);
+    if (!zstd_compress_to_file(reinterpret_cast<const void *>(dst.c_str()),
+                               dst.size(), outpath.c_str())) {
+      std::cerr << "Failed to compress/write file: " << outpath << "\n";
+      return false;
     }
+  }
 
-    const std::string task = argv[2];
+  std::cout << "TOTAL:\n" << total_stats.to_string();
 
-    if (task == "build") {
-      std::string input_str = "hello hello";
-      std::vector<int> sa;
-      if (!exact_dedup::build(reinterpret_cast<const uint8_t *>(input_str.c_str()), input_str.size(), sa)) {
-        exit(-1);
-      }
-    } else if (task == "dedup") {
-      std::cout << "TODO\n";
-      exit(-1);
-    } else if (task == "search") {
-      std::cout << "TODO\n";
-      exit(-1);
-    } else {
-      std::cerr << "Unknown task `" << task << "`\n";
-      exit(-1);
-    }
+  return true;
+}
 
-  } else if (cmd == "dedup") {
+// Phrase lists of 03_clean_step3_linewise/linewise_filtering.py
+static const char *kLinewiseStartsWith[] = {
+  "続きを読む", "[続きを読む]", "(続きを読む)", "続きをみる", "続きを見る",
+  "[続きを見る]", "(続きを表示)", "・・・ 続きを読む"};
+static const char *kLinewiseEndsWith[] = {
+  "続きを読む", "[続きを読む]", "(続きを読む)", "続きを見る", "続きをみる",
+  "(続く)", "(続きを表示)", "(続きをみる)", "[続きをみる]", "[続きを見る]"};
+static const char *kLinewiseContains[] = {
+  "...(続きを表示)", "[ 続きを見る ]", "・・・続きを見る", "... 続きを読む"};
+
+struct NGWordMatcher
+{
+  ahocorasick::Matcher matcher;
+  uint32_t startswith_cid{0};
+  uint32_t endswith_cid{0};
+};
 
-    if (argc < 4) {
-      std::cerr << "Need <folder> <out_folder>\n";
-      exit(-1);
-    }
+//
+// Build matcher from `dict_dir`/*.txt(category = file stem) and the
+// linewise phrase lists.
+//
+static bool build_ngword_matcher(const std::string &dict_dir, NGWordMatcher &m) {
+  std::vector<glob::fs::path> files = glob::glob({dict_dir + "/*.txt"});
+  std::sort(files.begin(), files.end());
 
-    bool ret = dedup_to_files(argv[2], argv[3]);
+  for (const auto &f : files) {
+    if (!m.matcher.load_dict(f.string(), f.stem().string())) {
+      return false;
+    }
+  }
+
+  m.startswith_cid = m.matcher.add_category("linewise_startswith");
+  for (const char *s : kLinewiseStartsWith) {
+    m.matcher.add_pattern(s, m.startswith_cid);
+  }
+  m.endswith_cid = m.matcher.add_category("linewise_endswith");
+  for (const char *s : kLinewiseEndsWith) {
+    m.matcher.add_pattern(s, m.endswith_cid);
+  }
+  uint32_t contains_cid = m.matcher.add_category("linewise_contains");
+  for (const char *s : kLinewiseContains) {
+    m.matcher.add_pattern(s, contains_cid);
+  }
+
+  m.matcher.build();
+
+  std::cout << "NG word matcher: " << m.matcher.num_patterns() << " patterns, "
+            << m.matcher.num_categories() << " categories\n";
+
+  return true;
+}
+
+//
+// Scan `text` once and collect per-category hit counts and line indices.
+// linewise_startswith/endswith only count matches at the line start/end.
+//
+static void match_ngwords(const NGWordMatcher &m, const std::string &text,
+                          std::vector<uint32_t> &counts,
+                          std::vector<std::vector<uint32_t>> &lines) {
+  counts.assign(m.matcher.num_categories(), 0);
+  lines.assign(m.matcher.num_categories(), {});
+
+  m.matcher.scan(text, [&](const ahocorasick::Hit &h) {
+    for (uint32_t cid : m.matcher.pattern_categories(h.pattern_id)) {
+      if ((cid == m.startswith_cid) && (h.begin > 0) && (text[h.begin - 1] != '\n')) {
+        continue;
+      }
+      if ((cid == m.endswith_cid) && (h.end < text.size()) && (text[h.end] != '\n')) {
+        continue;
+      }
+      counts[cid]++;
+      if (lines[cid].empty() || (lines[cid].back() != h.line)) {
+        lines[cid].push_back(h.line);
+      }
+    }
+  });
+}
+
+static bool ngword_files(const std::string &dict_dir, const std::string &filepath,
+                         const std::string &out_basedir, const std::string &text_key) {
+  NGWordMatcher m;
+  if (!build_ngword_matcher(dict_dir, m)) {
+    return false;
+  }
+
+  std::vector<glob::fs::path> files = glob::glob({filepath + "/*.zstd", filepath + "/*.zst"});
+  std::cout << "num files: " << files.size() << "\n";
+
+  std::vector<uint64_t> total_docs(m.matcher.num_categories(), 0);
+
+  for (const auto &f : files) {
+    std::cout << f << "\n";
+
+    std::vector<nlohmann::json> jsonl = load_jsonl_zstd(f);
+
+    std::mutex mtx;
+
+    taskpool::parallel_for(jsonl.size(), [&](uint64_t begin, uint64_t end, uint32_t) {
+      stagestats::ScopedTimer timer(stagestats::Stage::Filter);
+      std::vector<uint32_t> counts;
+      std::vector<std::vector<uint32_t>> lines;
+      std::vector<uint64_t> docs(m.matcher.num_categories(), 0);
+      uint64_t bytes = 0;
+
+      for (uint64_t idx = begin; idx < end; idx++) {
+        auto &j = jsonl[idx];
+
+        const std::string &text = j[text_key].get_ref<const std::string &>();
+        bytes += text.size();
+        match_ngwords(m, text, counts, lines);
+
+        nlohmann::json j_counts = nlohmann::json::object();
+        nlohmann::json j_lines = nlohmann::json::object();
+        for (size_t c = 0; c < counts.size(); c++) {
+          if (counts[c]) {
+            j_counts[m.matcher.category_name(uint32_t(c))] = counts[c];
+            j_lines[m.matcher.category_name(uint32_t(c))] = lines[c];
+            docs[c]++;
+          }
+        }
+        j["ng_counts"] = j_counts;
+        j["ng_lines"] = j_lines;
+      }
+
+      stagestats::add_bytes(stagestats::Stage::Filter, bytes, 0);
+      stagestats::add_records(stagestats::Stage::Filter, end - begin);
+
+      std::lock_guard<std::mutex> lock(mtx);
+      for (size_t c = 0; c < docs.size(); c++) {
+        total_docs[c] += docs[c];
+      }
+    });
+
+    glob::fs::path outpath = out_basedir / f.filename();
+    if (!save_jsonl_zstd(outpath, jsonl)) {
+      std::cerr << "Failed to compress/write file: " << outpath << "\n";
+      return false;
+    }
+  }
+
+  std::cout << "# of docs with hits per category:\n";
+  for (size_t c = 0; c < total_docs.size(); c++) {
+    std::cout << "  " << m.matcher.category_name(uint32_t(c)) << ": " << total_docs[c] << "\n";
+  }
+
+  return true;
+}
+
+// Tokenizer for LM scoring. Must match the one used to train the model.
+// char: each UTF-8 character is a token(kenml/char_tokenize.py)
+// jagger: Jagger word segmentation(wakachi-gaki)
+struct LMTokenizer
+{
+  bool jagger{false};
+  const jagger::tagger *tagger{nullptr};
+};
+
+// Split by whitespace(ASCII whitespace and U+3000), as Python's str.split().
+static void split_whitespace(std::string_view s, std::vector<std::string_view> &dst) {
+  dst.clear();
+  size_t i = 0;
+  size_t begin = 0;
+  auto flush = [&](size_t end) {
+    if (end > begin) {
+      dst.push_back(s.substr(begin, end - begin));
+    }
+  };
+  while (i < s.size()) {
+    const uint8_t c = uint8_t(s[i]);
+    size_t ws = 0;
+    if ((c == ' ') || (c == '\t') || (c == '\n') || (c == '\r') || (c == '\v') || (c == '\f')) {
+      ws = 1;
+    } else if ((c == 0xe3) && (i + 2 < s.size()) && (uint8_t(s[i + 1]) == 0x80) && (uint8_t(s[i + 2]) == 0x80)) {
+      ws = 3;
+    }
+    if (ws) {
+      flush(i);
+      i += ws;
+      begin = i;
+    } else {
+      i++;
+    }
+  }
+  flush(s.size());
+}
+
+static size_t utf8_strlen(std::string_view s) {
+  size_t n = 0;
+  for (char c : s) {
+    n += ((uint8_t(c) & 0xc0) != 0x80);
+  }
+  return n;
+}
+
+//
+// Document perplexity as in 04_lm_scoring/scoring_task.py:
+// text is split by whitespace, chunks shorter than 3 characters are
+// skipped, each chunk is scored as a sentence(with <s> and </s>) and
+// pp = 10^(-sum(log_score) / sum(n_tokens + 1)).
+//
+// Returns -1 when the document has no chunk to score.
+//
+static double lm_doc_perplexity(const ngramlm::Model &model, const LMTokenizer &tokenizer,
+                                std::string_view text,
+                                std::vector<std::string_view> &chunks,
+                                std::vector<std::string_view> &tokens,
+                                std::vector<std::pair<uint32_t, uint32_t>> &spans) {
+  split_whitespace(text, chunks);
+
+  double log_score = 0.0;
+  uint64_t length = 0;
+
+  for (const auto &chunk : chunks) {
+    if (utf8_strlen(chunk) < 3) {
+      continue;
+    }
+
+    tokens.clear();
+    if (tokenizer.jagger) {
+      spans.clear();
+      tokenizer.tagger->segment(chunk.data(), chunk.size(), spans);
+      for (const auto &sp : spans) {
+        tokens.push_back(chunk.substr(sp.first, sp.second - sp.first));
+      }
+    } else {
+      for (size_t i = 0; i < chunk.size();) {
+        size_t len = (std::max)(size_t(1), size_t(strutil::utf8_len(uint8_t(chunk[i]))));
+        len = (std::min)(len, chunk.size() - i);
+        tokens.push_back(chunk.substr(i, len));
+        i += len;
+      }
+    }
+
+    log_score += double(model.score(tokens));
+    length += tokens.size() + 1;
+  }
+
+  if (length == 0) {
+    return -1.0;
+  }
+
+  return std::round(ngramlm::perplexity(log_score, length) * 10.0) / 10.0;
+}
+
+//
+// Compute `lm_score`(document perplexity) for *.zst JSONL files in
+// `filepath`. Writes {"lm_score": ppl} per line to `out_basedir`
+// (same layout as 04_lm_scoring/scoring_task.py). `doc_id` is copied when
+// the document has one. With `use_sidecar`, `lm_score`(float64) and `doc_id`
+// are written to `<shard>.lmscore.safetensors` instead(see sidecar.hh).
+//
+static bool lmscore_files(const ngramlm::Model &model, const LMTokenizer &tokenizer,
+                          const std::string &filepath, const std::string &out_basedir,
+                          const std::string &text_key, bool use_sidecar = false)
+{
+  std::vector<glob::fs::path> files = glob::glob({filepath + "/*.zstd", filepath + "/*.zst"});
+  std::cout << "num files: " << files.size() << "\n";
+
+  uint64_t n_documents = 0;
+  uint64_t n_unscored = 0;
+
+  for (const auto &f : files) {
+    std::cout << f << "\n";
+
+    std::string jsonl_data = zstd_decompress(f.c_str());
+    size_t data_len = jsonl_data.size();
+    jsonl_data.append(simdjson::SIMDJSON_PADDING, ' ');
+
+    std::vector<std::string_view> lines = split_lines_view(std::string_view(jsonl_data.data(), data_len));
+    std::vector<double> scores(lines.size(), -1.0);
+    std::vector<uint64_t> ids(lines.size(), 0);
+    std::vector<uint8_t> has_id(lines.size(), 0);
+
+    std::atomic<bool> failed(false);
+
+    taskpool::parallel_for(lines.size(), [&](uint64_t begin, uint64_t end, uint32_t) {
+      stagestats::ScopedTimer timer(stagestats::Stage::Ngram);
+      simdjson::ondemand::parser parser;
+      std::vector<std::string_view> chunks;
+      std::vector<std::string_view> tokens;
+      std::vector<std::pair<uint32_t, uint32_t>> spans;
+      uint64_t bytes = 0;
+
+      for (uint64_t idx = begin; idx < end; idx++) {
+        std::string_view line = lines[idx];
+        size_t capacity = jsonl_data.size() - size_t(line.data() - jsonl_data.data());
+        bytes += line.size();
+
+        std::string_view text;
+        simdjson::ondemand::document doc;
+        if (parser.iterate(line.data(), line.size(), capacity).get(doc) ||
+            doc[text_key].get_string().get(text)) {
+          std::cerr << "Failed to parse JSON or get `" << text_key << "` at line " << idx << "\n";
+          failed = true;
+          continue;
+        }
+
+        scores[idx] = lm_doc_perplexity(model, tokenizer, text, chunks, tokens, spans);
+        has_id[idx] = (doc[docid::kKey].get_uint64().get(ids[idx]) == simdjson::SUCCESS);
+      }
+
+      stagestats::add_bytes(stagestats::Stage::Ngram, bytes, (end - begin) * sizeof(double));
+      stagestats::add_records(stagestats::Stage::Ngram, end - begin);
+    });
+
+    if (failed) {
+      return false;
+    }
+
+    if (use_sidecar) {
+      for (size_t k = 0; k < scores.size(); k++) {
+        if (scores[k] < 0.0) {
+          n_unscored++;
+        }
+      }
+      n_documents += scores.size();
+
+      sidecar::Writer writer(scores.size());
+      writer.add("lm_score", scores.data());
+      if (!scores.empty() && std::all_of(has_id.begin(), has_id.end(), [](uint8_t v) { return v != 0; })) {
+        writer.add(docid::kKey, ids.data());
+      }
+      writer.set_metadata("source", f.filename().string());
+      writer.set_metadata("stage", "lmscore");
+
+      std::string outpath = sidecar::filename(out_basedir, f.filename().string(), "lmscore");
+      std::string err;
+      if (!writer.save(outpath, &err)) {
+        std::cerr << "Failed to write side-car file: " << outpath << " " << err << "\n";
+        return false;
+      }
+      continue;
+    }
+
+    std::stringstream ss;
+    for (size_t k = 0; k < scores.size(); k++) {
+      if (k > 0) {
+        ss << "\n";
+      }
+      nlohmann::json j;
+      if (has_id[k]) {
+        j[docid::kKey] = ids[k];
+      }
+      j["lm_score"] = scores[k];
+      ss << j;
+      if (scores[k] < 0.0) {
+        n_unscored++;
+      }
+    }
+    n_documents += scores.size();
+
+    std::string dst = ss.str();
+    glob::fs::path outpath = out_basedir / f.filename();
+    if (!zstd_compress_to_file(reinterpret_cast<const void *>(dst.c_str()),
+                               dst.size(), outpath.c_str())) {
+      std::cerr << "Failed to compress/write file: " << outpath << "\n";
+      return false;
+    }
+  }
+
+  std::cout << "TOTAL: " << n_documents << " documents(" << n_unscored << " have no text to score. lm_score = -1)\n";
+
+  return true;
+}
+
+// Decompress `f` and split into non-empty lines(same as load_jsonl_zstd in
+// 07_beauty/create_dataset.py). SIMDJSON_PADDING is appended to `data`.
+static std::vector<std::string_view> load_jsonl_lines_padded(const glob::fs::path &f, std::string &data) {
+  data = zstd_decompress(f.c_str());
+  size_t data_len = data.size();
+  data.append(simdjson::SIMDJSON_PADDING, ' ');
+
+  std::vector<std::string_view> lines = split_lines_view(std::string_view(data.data(), data_len));
+  lines.erase(std::remove_if(lines.begin(), lines.end(), [](std::string_view l) { return l.empty(); }),
+              lines.end());
+  return lines;
+}
+
+static inline size_t padded_capacity(const std::string &data, std::string_view line) {
+  return data.size() - size_t(line.data() - data.data());
+}
+
+// Fingerprints(lsh.params.n_minhash()) and raw LSH bytes(lsh.params.lsh_bytes())
+// of one document.
+static void compute_lsh_bytes(std::string_view text, const ShingleOption &shingle, const LSHKernel &lsh,
+                              std::vector<std::pair<uint32_t, uint32_t>> &words, uint32_t *fingerprints,
+                              uint8_t *dst) {
+  if (shingle.word) {
+    words.clear();
+    shingle.tagger->segment(text.data(), text.size(), words);
+    lsh.words(text.data(), words, shingle.k, fingerprints);
+  } else {
+    lsh.chars(text.data(), text.size(), fingerprints);
+  }
+  bucketize_lsh(lsh.params, fingerprints, dst);
+}
+
+//
+// minhash with side-car output(see sidecar.hh): writes only `minhashes`
+// (uint8 [n, lsh_bytes]), `doc_id` and with `fingerprints`, `fingerprints`
+// (uint32 [n, n_minhash]) to `<out_basedir>/<shard>.minhash.safetensors`.
+// Text is read with simdjson and never re-serialized. *.parquet files are
+// also accepted(only `text_key` and `doc_id` columns are decoded).
+//
+static bool minhash_sidecar_files(const std::string &filepath, const std::string &out_basedir,
+                                  const std::string &text_key, const ShingleOption &shingle,
+                                  const LSHKernel &lsh, bool fingerprints)
+{
+  const size_t lsh_bytes = lsh.params.lsh_bytes();
+  const size_t n_minhash = lsh.params.n_minhash();
+
+  std::vector<glob::fs::path> files =
+      glob::glob({filepath + "/*.zstd", filepath + "/*.zst", filepath + "/*" + pqsource::kExt});
+  std::cout << "num files: " << files.size() << "\n";
+
+  for (const auto &f : files) {
+    std::cout << f << "\n";
+
+    const bool parquet = pqsource::is_parquet(f.string());
+
+    std::string jsonl_data;
+    std::vector<std::string_view> lines;
+    pqsource::TextColumn column;
+
+    if (parquet) {
+      // `lines` are texts.
+      std::string err;
+      if (!pqsource::load_text_column(f.string(), text_key, column, &err)) {
+        std::cerr << "Failed to read Parquet file: " << f << " " << err << "\n";
+        return false;
+      }
+      lines = column.rows;
+    } else {
+      jsonl_data = zstd_decompress(f.c_str());
+      size_t data_len = jsonl_data.size();
+      jsonl_data.append(simdjson::SIMDJSON_PADDING, ' ');
+
+      lines = split_lines_view(std::string_view(jsonl_data.data(), data_len));
+    }
+
+    std::vector<uint8_t> hashes(lines.size() * lsh_bytes);
+    std::vector<uint32_t> fps(fingerprints ? lines.size() * n_minhash : 0);
+    std::vector<uint64_t> ids(lines.size(), 0);
+    std::atomic<bool> has_ids(!parquet || !column.ids.empty());
+    if (parquet && !column.ids.empty()) {
+      ids = column.ids;
+    }
+
+    std::atomic<bool> failed(false);
+
+    taskpool::parallel_for(lines.size(), [&](uint64_t begin, uint64_t end, uint32_t) {
+      stagestats::ScopedTimer timer(stagestats::Stage::Hash);
+      simdjson::ondemand::parser parser;
+      std::vector<std::pair<uint32_t, uint32_t>> words;
+      std::vector<uint32_t> fp(n_minhash);
+      uint64_t bytes = 0;
+
+      for (uint64_t idx = begin; idx < end; idx++) {
+        std::string_view line = lines[idx];
+        bytes += line.size();
+        uint32_t *fp_dst = fingerprints ? fps.data() + idx * n_minhash : fp.data();
+
+        if (parquet) {
+          compute_lsh_bytes(line, shingle, lsh, words, fp_dst, hashes.data() + idx * lsh_bytes);
+          continue;
+        }
+
+        std::string_view text;
+        simdjson::ondemand::document doc;
+        if (parser.iterate(line.data(), line.size(), padded_capacity(jsonl_data, line)).get(doc) ||
+            doc[text_key].get_string().get(text)) {
+          std::cerr << "Failed to parse JSON or get `" << text_key << "` at line " << idx << "\n";
+          failed = true;
+          continue;
+        }
+
+        compute_lsh_bytes(text, shingle, lsh, words, fp_dst, hashes.data() + idx * lsh_bytes);
+
+        if (doc[docid::kKey].get_uint64().get(ids[idx])) {
+          has_ids = false;
+        }
+      }
+
+      stagestats::add_bytes(stagestats::Stage::Hash, bytes, (end - begin) * lsh_bytes);
+      stagestats::add_records(stagestats::Stage::Hash, end - begin);
+    });
+
+    if (failed) {
+      return false;
+    }
+
+    sidecar::Writer writer(lines.size());
+    writer.add("minhashes", hashes.data(), lsh_bytes);
+    if (fingerprints) {
+      writer.add("fingerprints", fps.data(), n_minhash);
+    }
+    if (has_ids && lines.size()) {
+      writer.add(docid::kKey, ids.data());
+    }
+    writer.set_metadata("source", f.filename().string());
+    writer.set_metadata("stage", "minhash");
+    writer.set_metadata("n_gram", std::to_string(lsh.params.n_gram));
+    writer.set_metadata("shingle", shingle_option_name(shingle));
+    writer.set_metadata("n_buckets", std::to_string(lsh.params.n_bands));
+    writer.set_metadata("bucket_size", std::to_string(lsh.params.rows));
+    writer.set_metadata("b_bytes", std::to_string(LSHParams::kMinHashBytes));
+    writer.set_metadata("band_key", lsh.params.hashed_keys ? "hash" : "bytes");
+
+    std::string outpath = sidecar::filename(out_basedir, f.filename().string(), "minhash");
+    std::string err;
+    if (!writer.save(outpath, &err)) {
+      std::cerr << "Failed to write side-car file: " << outpath << " " << err << "\n";
+      return false;
+    }
+    std::cout << "  " << lines.size() << " documents => " << outpath << "\n";
+  }
+
+  return true;
+}
+
+// Write `duplicate`(+ `cluster_id`, `doc_id` when not null) of the shard
+// `source` to `<out_basedir>/<source>.dedup.safetensors`(and .dedup.parquet
+// with `parquet`).
+static bool write_dedup_sidecar(const std::string &out_basedir, const std::string &source,
+                                const std::vector<uint8_t> &dups, const uint64_t *cluster_ids,
+                                const uint64_t *ids, bool parquet) {
+  sidecar::Writer writer(dups.size());
+  writer.add("duplicate", dups.data());
+  if (cluster_ids) {
+    writer.add("cluster_id", cluster_ids);
+  }
+  if (ids) {
+    writer.add(docid::kKey, ids);
+  }
+  writer.set_metadata("source", source);
+  writer.set_metadata("stage", "dedup");
+
+  std::string outpath = sidecar::filename(out_basedir, source, "dedup");
+  std::string err;
+  if (!writer.save(outpath, &err)) {
+    std::cerr << "Failed to write side-car file: " << outpath << " " << err << "\n";
+    return false;
+  }
+
+  if (parquet) {
+    std::string lines;
+    for (size_t k = 0; k < dups.size(); k++) {
+      lines += dups[k] ? "{\"duplicate\": true" : "{\"duplicate\": false";
+      if (cluster_ids) {
+        lines += ", \"cluster_id\": " + std::to_string(cluster_ids[k]);
+      }
+      if (ids) {
+        lines += ", \"doc_id\": " + std::to_string(ids[k]);
+      }
+      lines += "}\n";
+    }
+    std::string pqpath = outpath.substr(0, outpath.size() - strlen(sidecar::kExt)) + pqsink::kExt;
+    if (!pqsink::write_jsonl(lines, pqpath, pqsink::Options(), &err)) {
+      std::cerr << "Failed to write Parquet file: " << pqpath << " " << err << "\n";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// `minhashes` column of a minhash side-car file and its band layout(from the
+// `n_buckets` metadata, or The Pile's 20 bands for files without it).
+static const uint8_t *sidecar_minhashes(const sidecar::Reader &reader, const glob::fs::path &f, size_t &n_bands,
+                                        size_t &band_bytes) {
+  size_t width = 0;
+  const uint8_t *hashes = reader.column<uint8_t>("minhashes", &width);
+  if (!hashes) {
+    std::cerr << "`minhashes` not found in " << f << "\n";
+    return nullptr;
+  }
+
+  const std::string s = reader.metadata("n_buckets");
+  const size_t n = s.empty() ? size_t(LSHParams().n_bands) : size_t(std::strtoull(s.c_str(), nullptr, 10));
+  if ((n == 0) || (width % n) != 0) {
+    std::cerr << "`minhashes` of " << width << " bytes is not " << n << " bands in " << f << "\n";
+    return nullptr;
+  }
+
+  if (n_bands == 0) {
+    n_bands = n;
+    band_bytes = width / n;
+  } else if ((n != n_bands) || (width / n != band_bytes)) {
+    std::cerr << "`minhashes` of " << f << " must be " << n_bands << " bands of " << band_bytes
+              << " bytes, but got " << n << " bands of " << width / n << " bytes\n";
+    return nullptr;
+  }
+
+  return hashes;
+}
+
+//
+// dedup with side-car input/output: reads `*.minhash.safetensors` in
+// `filepath`(files in filename order) and writes `duplicate`(uint8 [n]) and
+// `doc_id` to `<out_basedir>/<shard>.dedup.safetensors`. With `parquet`, the
+// same columns are also written to `<out_basedir>/<shard>.dedup.parquet`.
+//
+static bool dedup_sidecar_files(const std::string &filepath, const std::string &out_basedir,
+                                bool parquet = false)
+{
+  std::vector<glob::fs::path> files = glob::glob(filepath + "/*.minhash" + sidecar::kExt);
+  std::sort(files.begin(), files.end());
+  std::cout << "num files: " << files.size() << "\n";
+
+  size_t n_documents = 0;
+  size_t n_dups = 0;
+
+  // created for the band layout of the first file.
+  BandStore hash_store;
+  size_t n_bands = 0;
+  size_t band_bytes = 0;
+
+  for (const auto &f : files) {
+    std::cout << f << "\n";
+
+    sidecar::Reader reader;
+    std::string err;
+    if (!reader.open(f.string(), &err)) {
+      std::cerr << "Failed to open side-car file: " << f << " " << err << "\n";
+      return false;
+    }
+
+    const uint8_t *hashes = nullptr;
+    if (reader.num_rows()) {
+      hashes = sidecar_minhashes(reader, f, n_bands, band_bytes);
+      if (!hashes) {
+        return false;
+      }
+      if (!hash_store.dedup) {
+        hash_store = make_band_store(uint32_t(n_bands), band_bytes);
+      }
+    }
+    const size_t lsh_bytes = n_bands * band_bytes;
+
+    std::vector<uint8_t> dups(reader.num_rows(), 0);
+    {
+      stagestats::ScopedTimer timer(stagestats::Stage::Dedup);
+      const size_t n_dups_before = n_dups;
+
+      for (size_t k = 0; k < reader.num_rows(); k++) {
+        dups[k] = hash_store.dedup(hashes + k * lsh_bytes) ? 1 : 0;
+        n_dups += dups[k];
+      }
+
+      stagestats::add_bytes(stagestats::Stage::Dedup, reader.num_rows() * lsh_bytes, 0);
+      stagestats::add_records(stagestats::Stage::Dedup, reader.num_rows(), n_dups - n_dups_before);
+    }
+    n_documents += reader.num_rows();
+
+    if (!write_dedup_sidecar(out_basedir, reader.metadata("source"), dups, nullptr,
+                             reader.column<uint64_t>(docid::kKey), parquet)) {
+      return false;
+    }
+
+    std::cout << "duplicated " << n_dups << " documents(total " << n_documents << "). ratio = "
+              << 100.0 * double(n_dups) / double(n_documents) << " %\n";
+  }
+
+  std::cout << "TOTAL: duplicated " << n_dups << " documents(total " << n_documents << ")\n";
+  std::cout << "  hash_store.size " << (hash_store.size ? hash_store.size() : 0) << "\n";
+
+  return true;
+}
+
+// Open side-car `<basedir>/<shard filename>.<stage>.safetensors` if exists.
+static bool open_sidecar_if_exists(const std::string &basedir, const glob::fs::path &shard,
+                                   const std::string &stage, sidecar::Reader &reader) {
+  std::string filename = sidecar::filename(basedir, shard.filename().string(), stage);
+  if (!glob::fs::exists(filename)) {
+    return false;
+  }
+
+  std::string err;
+  if (!reader.open(filename, &err)) {
+    std::cerr << "Failed to open side-car file: " << filename << " " << err << "\n";
+    exit(-1);
+  }
+  std::cout << "  use " << filename << "\n";
+  return true;
+}
+
+// Copy a [n_rows] column. false when the column does not exist.
+template<typename T>
+static bool copy_sidecar_column(const sidecar::Reader &reader, const std::string &name, std::vector<T> &dst) {
+  const T *p = reader.column<T>(name);
+  if (!p) {
+    return false;
+  }
+  dst.assign(p, p + reader.num_rows());
+  return true;
+}
+
+// 64-bit key of an LSH band for clustering. Hashed band keys are used as is.
+static inline uint64_t band_key(const uint8_t *band, size_t band_bytes) {
+  uint64_t key;
+  if (band_bytes == sizeof(uint64_t)) {
+    memcpy(&key, band, sizeof(uint64_t));
+    return key;
+  }
+  uint64_t h[2];
+  MurmurHash3_x64_128(band, int(band_bytes), 0, h);
+  return h[0];
+}
+
+// Verification of candidate pairs in `dedup --cluster`(pairs with a
+// similarity below `threshold` are not linked, see
+// dedupcluster::emit_verified_pairs()).
+// `--verify_dir=DIR`: exact Jaccard of the shingle sets of the texts in DIR
+// (load_shingle_sets()). Shingles must be the ones of `minhash`: `--ngram=N`
+// chars, or `--shingle=word:k` words with `--jagger_model`. With `--sidecar`
+// they are taken from the `n_gram`/`shingle` metadata of the minhash files,
+// and an explicit option which disagrees is an error.
+// `--verify_text_key=KEY` is the JSON key or Parquet column of the text(the
+// [text_key] given to `minhash`).
+// `--verify_signatures`: agreement of the full 32-bit fingerprints stored by
+// `minhash --fingerprints`.
+struct VerifyOption
+{
+  std::string text_dir;
+  std::string text_key{"text"};
+  bool signatures{false};
+  uint32_t n_gram{5};
+  ShingleOption shingle;
+  bool n_gram_given{false};   // `--ngram` or the metadata of an earlier file.
+  bool shingle_given{false};  // `--shingle` or the metadata of an earlier file.
+  double threshold{0.5};
+
+  bool enabled() const { return !text_dir.empty() || signatures; }
+};
+
+// Take the shingle config for `--verify_dir` from the `n_gram`/`shingle`
+// metadata of a minhash side-car file. It must agree with `--ngram`/`--shingle`
+// and with the earlier files.
+static bool adopt_minhash_shingles(const sidecar::Reader &reader, const glob::fs::path &f,
+                                   VerifyOption &verify /* inout */) {
+  const std::string n_gram = reader.metadata("n_gram");
+  if (!n_gram.empty()) {
+    const uint32_t n = uint32_t((std::max)(1, std::atoi(n_gram.c_str())));
+    if (verify.n_gram_given && (n != verify.n_gram)) {
+      std::cerr << f << " was minhashed with n_gram " << n << ", but verification uses " << verify.n_gram
+                << "(--ngram or an earlier file)\n";
+      return false;
+    }
+    verify.n_gram = n;
+    verify.n_gram_given = true;
+  }
+
+  const std::string mode = reader.metadata("shingle");
+  if (!mode.empty()) {
+    ShingleOption shingle;
+    if (!parse_shingle_option(mode, shingle)) {
+      return false;
+    }
+    if (verify.shingle_given && (shingle_option_name(shingle) != shingle_option_name(verify.shingle))) {
+      std::cerr << f << " was minhashed with shingle " << mode << ", but verification uses "
+                << shingle_option_name(verify.shingle) << "(--shingle or an earlier file)\n";
+      return false;
+    }
+    verify.shingle.word = shingle.word;
+    verify.shingle.k = shingle.k;
+    verify.shingle_given = true;
+  }
+
+  return true;
+}
+
+//
+// Shingle sets for the verification of LSH candidate pairs
+// (`dedup --cluster --verify_dir=DIR`): band keys collide by chance, so pairs
+// whose exact Jaccard of `verify.n_gram`-char or `verify.shingle.k`-word
+// shingle sets(compute_shingle_set()) is below `verify.threshold` are not
+// linked.
+// Texts(`verify.text_key`) are read from `<verify.text_dir>/<names[fi]>`(the
+// input of `minhash`: *.jsonl.zst or *.parquet) and sets are only built for
+// documents with `needed[doc]` set. A missing text key is an error.
+//
+static bool load_shingle_sets(const VerifyOption &verify, const std::vector<std::string> &names,
+                              const std::vector<size_t> &file_offsets, const std::vector<uint8_t> &needed,
+                              std::vector<std::vector<uint64_t>> &sets /* out */)
+{
+  sets.assign(file_offsets.back(), std::vector<uint64_t>());
+
+  for (size_t fi = 0; fi < names.size(); fi++) {
+    const size_t off = file_offsets[fi];
+    const size_t n = file_offsets[fi + 1] - off;
+    if (std::find(needed.begin() + off, needed.begin() + off + n, 1) == needed.begin() + off + n) {
+      continue;
+    }
+
+    const glob::fs::path f = glob::fs::path(verify.text_dir) / names[fi];
+    if (!glob::fs::exists(f)) {
+      std::cerr << "Text file for verification not found: " << f << "\n";
+      return false;
+    }
+
+    std::vector<std::string_view> texts;
+    std::vector<nlohmann::json> jsonl;
+    pqsource::TextColumn column;
+    if (pqsource::is_parquet(f.string())) {
+      std::string err;
+      if (!pqsource::load_text_column(f.string(), verify.text_key, column, &err)) {
+        std::cerr << "Failed to read Parquet file: " << f << " " << err << "\n";
+        return false;
+      }
+      texts = column.rows;
+    } else {
+      jsonl = load_jsonl_zstd(f);
+      for (size_t k = 0; k < jsonl.size(); k++) {
+        const auto it = jsonl[k].find(verify.text_key);
+        if ((it == jsonl[k].end()) || !it->is_string()) {
+          std::cerr << "`" << verify.text_key << "` string not found in line " << k << " of " << f
+                    << "(see --verify_text_key)\n";
+          return false;
+        }
+        texts.push_back(it->get_ref<const std::string &>());
+      }
+    }
+
+    if (texts.size() != n) {
+      std::cerr << f << " has " << texts.size() << " documents, but the minhash input has " << n << "\n";
+      return false;
+    }
+
+    taskpool::parallel_for(n, [&](uint64_t begin, uint64_t end, uint32_t) {
+      stagestats::ScopedTimer timer(stagestats::Stage::Ngram);
+      std::vector<uint64_t> buf;
+      std::vector<std::pair<uint32_t, uint32_t>> words;
+      uint64_t records = 0;
+      for (uint64_t k = begin; k < end; k++) {
+        if (!needed[off + k]) {
+          continue;
+        }
+        if (verify.shingle.word) {
+          words.clear();
+          verify.shingle.tagger->segment(texts[k].data(), texts[k].size(), words);
+          compute_shingle_set(texts[k].data(), words, verify.shingle.k, buf);
+        } else {
+          compute_shingle_set(texts[k].data(), texts[k].size(), verify.n_gram, buf);
+        }
+        sets[off + k].assign(buf.begin(), buf.end());
+        records++;
+      }
+      stagestats::add_records(stagestats::Stage::Ngram, records);
+    });
+  }
+
+  return true;
+}
+
+//
+// dedup with clusters(`dedup --cluster`): documents of all files are
+// clustered with union-find over LSH candidate pairs(see dedup-cluster.hh) and
+// one document per cluster is kept. `keep`:
+//
+// - "first": the first document in filename/line order.
+// - "lm_score": the lowest `lm_score`(perplexity). Documents without a score
+//   (no field or < 0) are kept last. JSONL input reads `lm_score` of each
+//   document. Side-car input reads `<lmscore_dir>/<shard>.lmscore.safetensors`.
+//
+// Candidate pairs are verified before clustering with `verify`(see
+// VerifyOption).
+//
+// Adds `duplicate` and `cluster_id`(doc_id of the first document of the
+// cluster, or its index in the whole input when documents have no doc_id) to
+// the output and writes the cluster-size histogram to
+// <out_basedir>/clusters.json. JSONL input is read twice(band keys, then
+// flags), since clusters are only known after all files are read.
+//
+static bool dedup_cluster_files(const std::string &filepath, const std::string &out_basedir,
+                                bool use_sidecar, bool parquet, const std::string &keep,
+                                const std::string &lmscore_dir, const VerifyOption &verify_option,
+                                const shardpipe::Config &pipe_config = shardpipe::Config())
+{
+  VerifyOption verify = verify_option;  // shingle config is taken from the minhash files.
+  const bool keep_lm_score = (keep == "lm_score");
+  if (!keep_lm_score && (keep != "first")) {
+    std::cerr << "Unknown keep policy: " << keep << "(first or lm_score)\n";
+    return false;
+  }
+  if (keep_lm_score && use_sidecar && lmscore_dir.empty()) {
+    std::cerr << "--keep=lm_score with --sidecar needs --lmscore_dir=DIR\n";
+    return false;
+  }
+
+  std::vector<glob::fs::path> files = use_sidecar
+      ? glob::glob(filepath + "/*.minhash" + sidecar::kExt)
+      : glob::glob({filepath + "/*.zstd", filepath + "/*.zst"});
+  std::sort(files.begin(), files.end());
+  std::cout << "num files: " << files.size() << "\n";
+
+  // 1. band keys, doc_id and lm_score of all documents.
+  // n_bands x n_docs, sized by the band layout of the first document.
+  std::vector<std::vector<uint64_t>> band_keys;
+  size_t n_bands = 0;
+  size_t band_bytes = 0;
+  std::vector<size_t> file_offsets(files.size() + 1, 0);
+  std::vector<std::string> sources(files.size());
+  std::vector<uint64_t> doc_ids;
+  std::vector<double> scores;
+  bool has_ids = true;
+  // n_docs x n_minhash full fingerprints(`verify.signatures`).
+  std::vector<uint32_t> signatures;
+  size_t n_minhash = 0;
+
+  auto add_signatures = [&](const uint32_t *fp, size_t width, size_t n, const std::string &where) {
+    if (!n) {
+      return true;
+    }
+    if (!fp || !width) {
+      std::cerr << "`fingerprints` not found in " << where << "(run `minhash --fingerprints`)\n";
+      return false;
+    }
+    if (n_minhash && (width != n_minhash)) {
+      std::cerr << "# of fingerprints mismatch in " << where << ": " << width << " != " << n_minhash << "\n";
+      return false;
+    }
+    n_minhash = width;
+    signatures.insert(signatures.end(), fp, fp + n * width);
+    return true;
+  };
+
+  auto add_document = [&](const uint8_t *lsh) {
+    band_keys.resize(n_bands);
+    for (size_t b = 0; b < n_bands; b++) {
+      band_keys[b].push_back(band_key(lsh + b * band_bytes, band_bytes));
+    }
+  };
+
+  if (use_sidecar) {
+    for (size_t fi = 0; fi < files.size(); fi++) {
+      const auto &f = files[fi];
+      std::cout << f << "\n";
+
+      sidecar::Reader reader;
+      std::string err;
+      if (!reader.open(f.string(), &err)) {
+        std::cerr << "Failed to open side-car file: " << f << " " << err << "\n";
+        return false;
+      }
+
+      const uint8_t *hashes = nullptr;
+      if (reader.num_rows() && !(hashes = sidecar_minhashes(reader, f, n_bands, band_bytes))) {
+        return false;
+      }
+
+      for (size_t k = 0; k < reader.num_rows(); k++) {
+        add_document(hashes + k * n_bands * band_bytes);
+      }
+
+      if (verify.signatures) {
+        size_t width = 0;
+        const uint32_t *fp = reader.column<uint32_t>("fingerprints", &width);
+        if (!add_signatures(fp, width, reader.num_rows(), f.string())) {
+          return false;
+        }
+      }
+
+      if (!verify.text_dir.empty() && !adopt_minhash_shingles(reader, f, verify)) {
+        return false;
+      }
+
+      const uint64_t *ids = reader.column<uint64_t>(docid::kKey);
+      has_ids = has_ids && (ids || !reader.num_rows());
+      if (ids) {
+        doc_ids.insert(doc_ids.end(), ids, ids + reader.num_rows());
+      }
+
+      sources[fi] = reader.metadata("source");
+
+      if (keep_lm_score) {
+        sidecar::Reader score_sc;
+        std::vector<double> s;
+        if (!open_sidecar_if_exists(lmscore_dir, glob::fs::path(sources[fi]), "lmscore", score_sc) ||
+            !copy_sidecar_column(score_sc, "lm_score", s) || (s.size() != reader.num_rows())) {
+          std::cerr << "`lm_score` of " << reader.num_rows() << " documents not found for " << sources[fi]
+                    << " in " << lmscore_dir << "\n";
+          return false;
+        }
+        scores.insert(scores.end(), s.begin(), s.end());
+      }
+
+      file_offsets[fi + 1] = file_offsets[fi] + reader.num_rows();
+    }
+  } else {
+    shardpipe::Stages<std::vector<nlohmann::json>> stages;
+
+    stages.load = [&](size_t idx, std::vector<nlohmann::json> &jsonl, uint64_t &bytes) {
+      jsonl = load_jsonl_zstd(files[idx], &bytes);
+      return true;
+    };
+
+    stages.process = [&](size_t idx, std::vector<nlohmann::json> &jsonl) {
+      std::cout << files[idx] << "\n";
+
+      std::vector<uint8_t> lsh;
+      for (size_t i = 0; i < jsonl.size(); i++) {
+        const auto &j = jsonl[i];
+
+        if (!decode_document_lsh(j, lsh, n_bands, band_bytes)) {
+          return false;
+        }
+        add_document(lsh.data());
+
+        if (verify.signatures) {
+          std::vector<uint8_t> fp_bytes;
+          size_t nbytes = 0;
+          if (j.contains("fingerprints") && j["fingerprints"].is_string()) {
+            std::vector<std::string> strs{j["fingerprints"].get<std::string>()};
+            if (!decode_minhashes(strs, fp_bytes, nbytes)) {
+              return false;
+            }
+          }
+          if (!add_signatures(fp_bytes.empty() ? nullptr : reinterpret_cast<const uint32_t *>(fp_bytes.data()),
+                              nbytes / sizeof(uint32_t), 1, files[idx].string())) {
+            return false;
+          }
+        }
+
+        if (has_ids && j.contains(docid::kKey) && j[docid::kKey].is_number_unsigned()) {
+          doc_ids.push_back(j[docid::kKey].get<uint64_t>());
+        } else {
+          has_ids = false;
+        }
+
+        if (keep_lm_score) {
+          scores.push_back((j.contains("lm_score") && j["lm_score"].is_number()) ? j["lm_score"].get<double>() : -1.0);
+        }
+      }
+
+      file_offsets[idx + 1] = file_offsets[idx] + jsonl.size();
+      return true;
+    };
+
+    stages.store = [](size_t, std::vector<nlohmann::json> &) { return true; };
+
+    if (!shardpipe::run(files.size(), pipe_config, stages)) {
+      return false;
+    }
+  }
+
+  const size_t n_docs = file_offsets.back();
+  if (n_docs > size_t((std::numeric_limits<uint32_t>::max)())) {
+    std::cerr << "Too many documents for --cluster: " << n_docs << "\n";
+    return false;
+  }
+
+  // 2. candidate pairs -> clusters -> kept documents.
+  std::vector<dedupcluster::Pair> pairs;
+  std::vector<uint32_t> roots;
+  std::vector<uint8_t> dups;
+  {
+    stagestats::ScopedTimer timer(stagestats::Stage::Dedup);
+
+    band_keys.resize(n_bands);
+    dedupcluster::emit_candidate_pairs(band_keys, n_docs, pairs);
+  }
+
+  const size_t n_candidate_pairs = pairs.size();
+  if (verify.enabled()) {
+    // shingle sets of the documents in a candidate pair.
+    std::vector<std::vector<uint64_t>> sets;
+    if (!verify.text_dir.empty()) {
+      if (verify.shingle.word && !verify.shingle.tagger) {
+        std::cerr << "Verification of word:" << verify.shingle.k << " shingles needs --jagger_model=<patterns>\n";
+        return false;
+      }
+      std::vector<uint8_t> needed(n_docs, 0);
+      for (const auto &p : pairs) {
+        needed[p.first] = 1;
+        needed[p.second] = 1;
+      }
+      std::vector<std::string> names(files.size());
+      for (size_t fi = 0; fi < files.size(); fi++) {
+        names[fi] = use_sidecar ? sources[fi] : files[fi].filename().string();
+      }
+      if (!load_shingle_sets(verify, names, file_offsets, needed, sets)) {
+        return false;
+      }
+    }
+
+    const dedupcluster::VerifyFunction verify_pairs = [&](const std::vector<dedupcluster::Pair> &batch,
+                                                          std::vector<uint8_t> &keep) {
+      taskpool::parallel_for(batch.size(), [&](uint64_t begin, uint64_t end, uint32_t) {
+        for (uint64_t i = begin; i < end; i++) {
+          const uint32_t a = batch[i].first;
+          const uint32_t b = batch[i].second;
+          bool ok = true;
+          if (verify.signatures) {
+            ok = signature_agreement(signatures.data() + size_t(a) * n_minhash,
+                                     signatures.data() + size_t(b) * n_minhash, n_minhash) >= verify.threshold;
+          }
+          if (ok && !sets.empty()) {
+            ok = compute_jaccard(sets[a], sets[b]) >= verify.threshold;
+          }
+          keep[i] = ok;
+        }
+      }, /* min_range */ 1024);
+    };
+
+    stagestats::ScopedTimer timer(stagestats::Stage::Dedup);
+
+    size_t n_verified = 0;
+    dedupcluster::emit_verified_pairs(band_keys, n_docs, verify_pairs, pairs, &n_verified);
+    std::vector<uint32_t>().swap(signatures);
+
+    std::cout << "verified pairs: " << pairs.size() << " / " << n_verified << "\n";
+  }
+  std::vector<std::vector<uint64_t>>().swap(band_keys);
+
+  {
+    stagestats::ScopedTimer timer(stagestats::Stage::Dedup);
+
+    roots = dedupcluster::cluster(pairs, n_docs);
+
+    dedupcluster::PreferFunction prefer;
+    if (keep_lm_score) {
+      prefer = [&scores](uint32_t a, uint32_t b) {
+        const bool a_scored = scores[a] >= 0.0;
+        const bool b_scored = scores[b] >= 0.0;
+        if (a_scored != b_scored) {
+          return a_scored;
+        }
+        return scores[a] < scores[b];
+      };
+    }
+    dedupcluster::select_keep(roots, prefer, dups);
+  }
+
+  const dedupcluster::Summary summary = dedupcluster::summarize(roots, dups);
+  stagestats::add_records(stagestats::Stage::Dedup, n_docs, summary.n_duplicates);
+
+  std::vector<uint64_t> cluster_ids(n_docs);
+  for (size_t i = 0; i < n_docs; i++) {
+    cluster_ids[i] = has_ids ? doc_ids[roots[i]] : uint64_t(roots[i]);
+  }
+
+  // 3. write flags
+  if (use_sidecar) {
+    for (size_t fi = 0; fi < files.size(); fi++) {
+      const size_t off = file_offsets[fi];
+      const size_t n = file_offsets[fi + 1] - off;
+      std::vector<uint8_t> file_dups(dups.begin() + off, dups.begin() + off + n);
+      if (!write_dedup_sidecar(out_basedir, sources[fi], file_dups, cluster_ids.data() + off,
+                               has_ids ? doc_ids.data() + off : nullptr, parquet)) {
+        return false;
+      }
+    }
+  } else {
+    shardpipe::Stages<std::vector<nlohmann::json>> stages;
+
+    stages.load = [&](size_t idx, std::vector<nlohmann::json> &jsonl, uint64_t &bytes) {
+      jsonl = load_jsonl_zstd(files[idx], &bytes);
+      return true;
+    };
+
+    stages.process = [&](size_t idx, std::vector<nlohmann::json> &jsonl) {
+      const size_t off = file_offsets[idx];
+      if (jsonl.size() != file_offsets[idx + 1] - off) {
+        std::cerr << files[idx] << " changed while processing\n";
+        return false;
+      }
+      for (size_t i = 0; i < jsonl.size(); i++) {
+        jsonl[i]["duplicate"] = bool(dups[off + i]);
+        jsonl[i]["cluster_id"] = cluster_ids[off + i];
+      }
+      return true;
+    };
+
+    stages.store = [&](size_t idx, std::vector<nlohmann::json> &jsonl) {
+      return store_dedup_jsonl(out_basedir / files[idx].filename(), jsonl, parquet);
+    };
+
+    if (!shardpipe::run(files.size(), pipe_config, stages)) {
+      return false;
+    }
+  }
+
+  // 4. cluster summary
+  nlohmann::json report;
+  report["n_documents"] = summary.n_documents;
+  report["n_candidate_pairs"] = n_candidate_pairs;
+  if (verify.enabled()) {
+    report["n_verified_pairs"] = pairs.size();
+    report["verify_threshold"] = verify.threshold;
+  }
+  report["n_clusters"] = summary.n_clusters;
+  report["n_clustered_documents"] = summary.n_clustered;
+  report["n_duplicates"] = summary.n_duplicates;
+  report["max_cluster_size"] = summary.max_cluster_size;
+  report["keep"] = keep;
+  nlohmann::json histogram = nlohmann::json::object();
+  for (const auto &it : summary.size_histogram) {
+    histogram[std::to_string(it.first)] = it.second;
+  }
+  report["cluster_size_histogram"] = histogram;
+
+  std::string report_path = (glob::fs::path(out_basedir) / "clusters.json").string();
+  std::ofstream ofs(report_path);
+  if (!ofs) {
+    std::cerr << "Failed to open " << report_path << "\n";
+    return false;
+  }
+  ofs << report.dump(2) << "\n";
+
+  std::cout << "TOTAL: duplicated " << summary.n_duplicates << " documents(total " << n_docs << "). ratio = "
+            << 100.0 * double(summary.n_duplicates) / double((std::max)(n_docs, size_t(1))) << " %\n";
+  std::cout << "  " << summary.n_clusters << " clusters(" << summary.n_clustered << " documents, max size "
+            << summary.max_cluster_size << ") from " << n_candidate_pairs << " candidate pairs\n";
+  std::cout << "  cluster size histogram:";
+  for (const auto &it : summary.size_histogram) {
+    std::cout << " " << it.first << ":" << it.second;
+  }
+  std::cout << "\n  => " << report_path << "\n";
+
+  return true;
+}
+
+// Corpus for the beauty pass: `<text_folder>:<score_folder>[:text_key]`
+struct BeautyCorpus
+{
+  std::string text_dir;
+  std::string score_dir;
+  std::string text_key{"text"};
+};
+
+static bool parse_beauty_corpus(const std::string &s, BeautyCorpus &corpus) {
+  size_t p = s.find(':');
+  if (p == std::string::npos) {
+    std::cerr << "Corpus must be `<text_folder>:<score_folder>[:text_key]`, but got `" << s << "`\n";
+    return false;
+  }
+  corpus.text_dir = s.substr(0, p);
+  std::string rest = s.substr(p + 1);
+  size_t q = rest.find(':');
+  if (q == std::string::npos) {
+    corpus.score_dir = rest;
+  } else {
+    corpus.score_dir = rest.substr(0, q);
+    corpus.text_key = rest.substr(q + 1);
+  }
+  return !corpus.text_dir.empty() && !corpus.score_dir.empty() && !corpus.text_key.empty();
+}
+
+//
+// Step 1 of 07_beauty: equal-frequency lm_score bin edges.
+// `lm_score` of all score files is streamed into per-file KLL sketches which
+// are merged in file order(deterministic), so no score array is kept in
+// memory. Side-car files(`lmscore --sidecar`) are used when they exist, as in
+// beauty_files(). Writes {"bins", "lm_min", "lm_max"} to `bins_filename`.
+//
+static bool compute_lm_score_bins(const std::vector<BeautyCorpus> &corpora, uint32_t nbins,
+                                  const std::string &bins_filename, std::vector<double> &bins)
+{
+  // (score folder, text shard)
+  std::vector<std::pair<std::string, glob::fs::path>> shards;
+  for (const auto &corpus : corpora) {
+    std::vector<glob::fs::path> files = glob::glob({corpus.text_dir + "/*.zstd", corpus.text_dir + "/*.zst"});
+    for (const auto &f : files) {
+      shards.emplace_back(corpus.score_dir, f);
+    }
+  }
+
+  std::vector<quantile::KLLSketch> sketches(shards.size());
+
+  std::atomic<bool> failed(false);
+
+  taskpool::parallel_for(shards.size(), [&](uint64_t begin, uint64_t end, uint32_t) {
+    simdjson::ondemand::parser parser;
+    std::string data;
+
+    for (uint64_t idx = begin; idx < end; idx++) {
+      const glob::fs::path f = shards[idx].first / shards[idx].second.filename();
+
+      sidecar::Reader sc;
+      if (open_sidecar_if_exists(shards[idx].first, shards[idx].second, "lmscore", sc)) {
+        const double *scores = sc.column<double>("lm_score");
+        if (!scores && sc.num_rows()) {
+          std::cerr << "`lm_score` not found in the side-car file of " << f << "\n";
+          failed = true;
+          continue;
+        }
+        for (size_t k = 0; k < sc.num_rows(); k++) {
+          sketches[idx].insert(scores[k]);
+        }
+        continue;
+      }
+
+      if (!glob::fs::exists(f)) {
+        std::cerr << "lm score file not found: " << f << "\n";
+        failed = true;
+        continue;
+      }
+
+      std::vector<std::string_view> lines = load_jsonl_lines_padded(f, data);
+      for (size_t k = 0; k < lines.size(); k++) {
+        double score;
+        simdjson::ondemand::document doc;
+        if (parser.iterate(lines[k].data(), lines[k].size(), padded_capacity(data, lines[k])).get(doc) ||
+            doc["lm_score"].get_double().get(score)) {
+          std::cerr << "Failed to get `lm_score` at line " << k << " of " << f << "\n";
+          failed = true;
+          break;
+        }
+        sketches[idx].insert(score);
+      }
+    }
+  });
+
+  if (failed) {
+    return false;
+  }
+
+  quantile::KLLSketch sketch;
+  for (const auto &s : sketches) {
+    sketch.merge(s);
+  }
+
+  if (sketch.count() == 0) {
+    std::cerr << "No lm_score found.\n";
+    return false;
+  }
+
+  bins = binning::quantile_edges(sketch, nbins);
+
+  nlohmann::json j;
+  j["bins"] = bins;
+  j["lm_min"] = sketch.min();
+  j["lm_max"] = sketch.max();
+  std::string s = j.dump();
+  saveFile_orDie(bins_filename.c_str(), s.data(), s.size());
+
+  std::cout << "lm_score: " << sketch.count() << " documents. " << bins.size() << " bin edges. min = "
+            << sketch.min() << ", max = " << sketch.max() << "\n";
+
+  return true;
+}
+
+//
+// Step 2 of 07_beauty: merge text, lm_score and dedup JSONL, drop duplicates
+// and route documents to per-bin chunk files of `docs_per_file` documents
+// (see binned-writer.hh). Output is the same as create_dataset.py(plus
+// `doc_id` when the text has one).
+// Files are joined by `doc_id` when all of them have it, by line otherwise.
+// Text is copied from the input as the raw JSON string(no re-serialization).
+//
+static bool beauty_files(const std::vector<BeautyCorpus> &corpora, const std::string &dedup_dir,
+                         const std::string &out_dir, const std::vector<double> &bins,
+                         const binning::BinnedWriterConfig &config)
+{
+  binning::BinnedWriter writer(out_dir, bins.size(), config);
+
+  uint64_t n_documents = 0;
+  uint64_t n_dups = 0;
+
+  for (const auto &corpus : corpora) {
+    std::vector<glob::fs::path> files = glob::glob({corpus.text_dir + "/*.zstd", corpus.text_dir + "/*.zst"});
+    std::cout << corpus.text_dir << ": num files: " << files.size() << "\n";
+
+    for (const auto &f : files) {
+      glob::fs::path score_file = corpus.score_dir / f.filename();
+      glob::fs::path dedup_file = dedup_dir / f.filename();
+      std::cout << "merge " << f << " " << score_file << " " << dedup_file << "\n";
+
+      std::string text_data, score_data, dedup_data;
+      std::vector<std::string_view> text_lines = load_jsonl_lines_padded(f, text_data);
+
+      // Use side-car files(see sidecar.hh) when they exist.
+      sidecar::Reader score_sc, dedup_sc;
+      std::vector<std::string_view> score_lines, dedup_lines;
+      const bool score_from_sc = open_sidecar_if_exists(corpus.score_dir, f, "lmscore", score_sc);
+      const bool dedup_from_sc = open_sidecar_if_exists(dedup_dir, f, "dedup", dedup_sc);
+      if (!score_from_sc) {
+        score_lines = load_jsonl_lines_padded(score_file, score_data);
+      }
+      if (!dedup_from_sc) {
+        dedup_lines = load_jsonl_lines_padded(dedup_file, dedup_data);
+      }
+
+      const size_t n = text_lines.size();
+      const size_t n_score = score_from_sc ? size_t(score_sc.num_rows()) : score_lines.size();
+      const size_t n_dedup = dedup_from_sc ? size_t(dedup_sc.num_rows()) : dedup_lines.size();
+      const size_t nmax = (std::max)(n, (std::max)(score_lines.size(), dedup_lines.size()));
+
+      std::vector<std::string_view> texts(n);  // raw JSON string(with quotes)
+      std::vector<double> scores(n_score, 0.0);
+      std::vector<uint8_t> dups(n_dedup, 0);
+      std::vector<uint64_t> text_ids(n), score_ids(n_score), dedup_ids(n_dedup);
+      std::atomic<bool> text_has_ids(true), score_has_ids(true), dedup_has_ids(true);
+
+      if (score_from_sc) {
+        if (n_score && !copy_sidecar_column(score_sc, "lm_score", scores)) {
+          std::cerr << "`lm_score` not found in the side-car file of " << score_file << "\n";
+          return false;
+        }
+        if (!copy_sidecar_column(score_sc, docid::kKey, score_ids)) {
+          score_has_ids = false;
+        }
+      }
+      if (dedup_from_sc) {
+        if (!copy_sidecar_column(dedup_sc, docid::kKey, dedup_ids)) {
+          dedup_has_ids = false;
+        }
+        if (n_dedup && !copy_sidecar_column(dedup_sc, "duplicate", dups)) {
+          std::cerr << "`duplicate` not found in the side-car file of " << dedup_file << "\n";
+          return false;
+        }
+      }
+
+      std::atomic<bool> failed(false);
+
+      taskpool::parallel_for(nmax, [&](uint64_t begin, uint64_t end, uint32_t) {
+        simdjson::ondemand::parser parser;
+
+        for (uint64_t idx = begin; idx < end; idx++) {
+          simdjson::ondemand::document doc;
+
+          if (idx < dedup_lines.size()) {
+            bool dup = false;
+            if (parser.iterate(dedup_lines[idx].data(), dedup_lines[idx].size(),
+                               padded_capacity(dedup_data, dedup_lines[idx])).get(doc) ||
+                doc["duplicate"].get_bool().get(dup)) {
+              std::cerr << "Failed to get `duplicate` at line " << idx << " of " << dedup_file << "\n";
+              failed = true;
+              continue;
+            }
+            dups[idx] = dup ? 1 : 0;
+            if (doc[docid::kKey].get_uint64().get(dedup_ids[idx])) {
+              dedup_has_ids = false;
+            }
+          }
+
+          if (idx < score_lines.size()) {
+            if (parser.iterate(score_lines[idx].data(), score_lines[idx].size(),
+                               padded_capacity(score_data, score_lines[idx])).get(doc) ||
+                doc["lm_score"].get_double().get(scores[idx])) {
+              std::cerr << "Failed to get `lm_score` at line " << idx << " of " << score_file << "\n";
+              failed = true;
+              continue;
+            }
+            if (doc[docid::kKey].get_uint64().get(score_ids[idx])) {
+              score_has_ids = false;
+            }
+          }
+
+          if (idx < n) {
+            simdjson::ondemand::value text;
+            if (parser.iterate(text_lines[idx].data(), text_lines[idx].size(),
+                               padded_capacity(text_data, text_lines[idx])).get(doc) ||
+                doc[corpus.text_key].get(text)) {
+              std::cerr << "Failed to get `" << corpus.text_key << "` at line " << idx << " of " << f << "\n";
+              failed = true;
+              continue;
+            }
+            // raw token may have trailing whitespace.
+            std::string_view raw = text.raw_json_token();
+            while (!raw.empty() && (raw.back() == ' ' || raw.back() == '\t' || raw.back() == '\r')) {
+              raw.remove_suffix(1);
+            }
+            if (raw.empty() || (raw.front() != '"')) {
+              std::cerr << "`" << corpus.text_key << "` is not a string at line " << idx << " of " << f << "\n";
+              failed = true;
+              continue;
+            }
+            texts[idx] = raw;
+            if (doc[docid::kKey].get_uint64().get(text_ids[idx])) {
+              text_has_ids = false;
+            }
+          }
+        }
+      });
+
+      if (failed) {
+        return false;
+      }
+
+      // Join side files by `doc_id` when every file has it, by line otherwise.
+      const bool by_id = text_has_ids && score_has_ids && dedup_has_ids;
+      std::vector<int64_t> score_idx, dedup_idx;
+      if (by_id) {
+        docid::merge_join(text_ids, score_ids, score_idx);
+        docid::merge_join(text_ids, dedup_ids, dedup_idx);
+      } else {
+        if ((n != n_score) || (n != n_dedup)) {
+          std::cerr << "jsonl lines mismatch: " << f << "(" << n << "), " << score_file << "("
+                    << n_score << "), " << dedup_file << "(" << n_dedup << ")\n";
+          return false;
+        }
+        score_idx.resize(n);
+        std::iota(score_idx.begin(), score_idx.end(), int64_t(0));
+        dedup_idx = score_idx;
+      }
+
+      std::vector<size_t> order;
+      std::vector<double> doc_scores(n, 0.0);
+      for (size_t k = 0; k < n; k++) {
+        if ((score_idx[k] < 0) || (dedup_idx[k] < 0)) {
+          std::cerr << "doc_id " << text_ids[k] << " of " << f << " not found in "
+                    << ((score_idx[k] < 0) ? score_file : dedup_file) << "\n";
+          return false;
+        }
+        if (dups[size_t(dedup_idx[k])]) {
+          n_dups++;
+        } else {
+          doc_scores[k] = scores[size_t(score_idx[k])];
+          order.push_back(k);
+        }
+      }
+      n_documents += n;
+
+      // sorted by lm_score in each file, as create_dataset.py does.
+      std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return doc_scores[a] < doc_scores[b]; });
+
+      std::string line;
+      for (size_t k : order) {
+        // json.dumps({"text": ..., "lm_score": ...}, ensure_ascii=False)
+        line = "{\"text\": ";
+        line.append(texts[k].data(), texts[k].size());
+        line += ", \"lm_score\": ";
+        line += nlohmann::json(doc_scores[k]).dump();
+        if (text_has_ids) {
+          line += ", \"doc_id\": ";
+          line += std::to_string(text_ids[k]);
+        }
+        line += "}";
+
+        if (!writer.add(binning::digitize(bins, doc_scores[k]), line)) {
+          return false;
+        }
+      }
+    }
+  }
+
+  if (!writer.finish()) {
+    return false;
+  }
+
+  std::cout << "TOTAL: " << n_documents << " documents. " << n_dups << " duplicates removed.\n";
+  for (size_t b = 0; b < bins.size(); b++) {
+    std::cout << "  chunk_" << b << ": " << writer.num_documents(b) << " documents, " << writer.num_files(b)
+              << " files\n";
+  }
+
+  return true;
+}
+
+// One JSONL row for `join`. `fields` are raw JSON values(views into the
+// decompressed file) except `doc_id`.
+struct JoinRow
+{
+  uint64_t id{0};
+  std::vector<std::pair<std::string, std::string_view>> fields;
+};
+
+static bool parse_join_row(simdjson::ondemand::parser &parser, std::string_view line, size_t capacity,
+                           JoinRow &row)
+{
+  simdjson::ondemand::document doc;
+  simdjson::ondemand::object obj;
+  if (parser.iterate(line.data(), line.size(), capacity).get(doc) || doc.get_object().get(obj)) {
+    return false;
+  }
+
+  bool has_id = false;
+  for (auto field : obj) {
+    std::string_view key;
+    if (field.unescaped_key().get(key)) {
+      return false;
+    }
+    simdjson::ondemand::value val = field.value();
+
+    if (key == docid::kKey) {
+      if (val.get_uint64().get(row.id)) {
+        return false;
+      }
+      has_id = true;
+      continue;
+    }
+
+    simdjson::ondemand::json_type type;
+    if (val.type().get(type)) {
+      return false;
+    }
+
+    std::string_view raw;
+    if (type == simdjson::ondemand::json_type::object) {
+      simdjson::ondemand::object o;
+      if (val.get_object().get(o) || o.raw_json().get(raw)) {
+        return false;
+      }
+    } else if (type == simdjson::ondemand::json_type::array) {
+      simdjson::ondemand::array a;
+      if (val.get_array().get(a) || a.raw_json().get(raw)) {
+        return false;
+      }
+    } else {
+      // raw token may have trailing whitespace.
+      raw = val.raw_json_token();
+      while (!raw.empty() && (raw.back() == ' ' || raw.back() == '\t' || raw.back() == '\r')) {
+        raw.remove_suffix(1);
+      }
+    }
+
+    row.fields.emplace_back(std::string(key), raw);
+  }
+
+  return has_id;
+}
+
+static bool load_join_rows(const glob::fs::path &f, std::string &data, std::vector<std::string_view> &lines,
+                           std::vector<JoinRow> &rows)
+{
+  lines = load_jsonl_lines_padded(f, data);
+  rows.clear();
+  rows.resize(lines.size());
+
+  std::atomic<bool> failed(false);
+
+  taskpool::parallel_for(lines.size(), [&](uint64_t begin, uint64_t end, uint32_t) {
+    simdjson::ondemand::parser parser;
+
+    for (uint64_t idx = begin; idx < end; idx++) {
+      if (!parse_join_row(parser, lines[idx], padded_capacity(data, lines[idx]), rows[idx])) {
+        std::cerr << "Failed to parse JSON object or get `" << docid::kKey << "` at line " << idx << " of " << f << "\n";
+        failed = true;
+      }
+    }
+  });
+
+  return !failed;
+}
+
+//
+// Join side files(e.g. lm_score, dedup flags) to the documents in
+// `main_dir` by `doc_id`(sorted merge per shard, see doc-id.hh).
+// Files with the same name are joined. Fields of side files are appended to
+// the main document(left join. fields which already exist are not
+// overwritten). Only one shard is kept in memory at a time.
+//
+static bool join_files(const std::string &main_dir, const std::vector<std::string> &side_dirs,
+                       const std::string &out_basedir)
+{
+  std::vector<glob::fs::path> files = glob::glob({main_dir + "/*.zstd", main_dir + "/*.zst"});
+  std::cout << "num files: " << files.size() << "\n";
+
+  uint64_t n_documents = 0;
+  std::vector<uint64_t> n_unmatched(side_dirs.size(), 0);
+
+  for (const auto &f : files) {
+    std::cout << f << "\n";
+
+    std::string main_data;
+    std::vector<std::string_view> main_lines;
+    std::vector<JoinRow> main_rows;
+    if (!load_join_rows(f, main_data, main_lines, main_rows)) {
+      return false;
+    }
+
+    std::vector<uint64_t> main_ids(main_rows.size());
+    for (size_t k = 0; k < main_rows.size(); k++) {
+      main_ids[k] = main_rows[k].id;
+    }
+
+    std::vector<std::string> side_data(side_dirs.size());
+    std::vector<std::vector<std::string_view>> side_lines(side_dirs.size());
+    std::vector<std::vector<JoinRow>> side_rows(side_dirs.size());
+    std::vector<std::vector<int64_t>> side_index(side_dirs.size());
+
+    for (size_t s = 0; s < side_dirs.size(); s++) {
+      glob::fs::path side_file = side_dirs[s] / f.filename();
+      if (!glob::fs::exists(side_file)) {
+        std::cerr << "side file not found: " << side_file << "\n";
+        return false;
+      }
+      if (!load_join_rows(side_file, side_data[s], side_lines[s], side_rows[s])) {
+        return false;
+      }
+
+      std::vector<uint64_t> ids(side_rows[s].size());
+      for (size_t k = 0; k < side_rows[s].size(); k++) {
+        ids[k] = side_rows[s][k].id;
+      }
+      docid::merge_join(main_ids, ids, side_index[s]);
+    }
+
+    std::string dst;
+    std::vector<std::string> keys;
+    for (size_t k = 0; k < main_rows.size(); k++) {
+      std::string_view line = main_lines[k];
+      while (!line.empty() && (line.back() != '}')) {
+        line.remove_suffix(1);
+      }
+      line.remove_suffix(1);  // '}'
+
+      keys.clear();
+      for (const auto &field : main_rows[k].fields) {
+        keys.push_back(field.first);
+      }
+
+      if (k > 0) {
+        dst += "\n";
+      }
+      dst.append(line.data(), line.size());
+
+      for (size_t s = 0; s < side_dirs.size(); s++) {
+        int64_t r = side_index[s][k];
+        if (r < 0) {
+          n_unmatched[s]++;
+          continue;
+        }
+        for (const auto &field : side_rows[s][size_t(r)].fields) {
+          if (std::find(keys.begin(), keys.end(), field.first) != keys.end()) {
+            continue;
+          }
+          keys.push_back(field.first);
+          dst += ",";
+          dst += nlohmann::json(field.first).dump();
+          dst += ":";
+          dst.append(field.second.data(), field.second.size());
+        }
+      }
+      dst += "}";
+    }
+    n_documents += main_rows.size();
+
+    glob::fs::path outpath = out_basedir / f.filename();
+    if (!zstd_compress_to_file(reinterpret_cast<const void *>(dst.c_str()),
+                               dst.size(), outpath.c_str())) {
+      std::cerr << "Failed to compress/write file: " << outpath << "\n";
+      return false;
+    }
+  }
+
+  std::cout << "TOTAL: " << n_documents << " documents\n";
+  for (size_t s = 0; s < side_dirs.size(); s++) {
+    std::cout << "  " << side_dirs[s] << ": " << n_unmatched[s] << " documents not found\n";
+  }
+
+  return true;
+}
+
+//
+// End-to-end benchmark on a synthetic corpus(see synth-corpus.hh).
+//
+// Writes `num_shards` shards to <work_dir>/corpus, then runs clean, minhash,
+// dedup and a suffix array build over all texts. Reports wall time,
+// throughput(uncompressed input) and peak RSS after each stage, and dedup
+// recall/precision against the generated duplicates. The report is also
+// written to <work_dir>/bench.json.
+//
+static bool bench_files(const synthcorpus::Config &config, uint32_t num_shards, const std::string &work_dir)
+{
+  const glob::fs::path base(work_dir);
+  const glob::fs::path corpus_dir = base / "corpus";
+  const glob::fs::path clean_dir = base / "clean";
+  const glob::fs::path minhash_dir = base / "minhash";
+  const glob::fs::path dedup_dir = base / "dedup";
+  for (const auto &d : {corpus_dir, clean_dir, minhash_dir, dedup_dir}) {
+    std::error_code ec;
+    glob::fs::create_directories(d, ec);
+    if (ec) {
+      std::cerr << "Failed to create directory: " << d << "\n";
+      return false;
+    }
+  }
+
+  struct StageResult
+  {
+    std::string name;
+    double sec{0.0};
+    uint64_t bytes{0};  // input bytes(uncompressed)
+    uint64_t peak_rss{0};
+  };
+  std::vector<StageResult> results;
+
+  auto run_stage = [&](const std::string &name, uint64_t bytes, const std::function<bool()> &fn) {
+    std::cout << "[bench] " << name << "\n";
+    const uint64_t t0 = stagestats::now_ns();
+    if (!fn()) {
+      std::cerr << "bench: stage `" << name << "` failed\n";
+      return false;
+    }
+    results.push_back({name, double(stagestats::now_ns() - t0) * 1e-9, bytes, stagestats::peak_rss_bytes()});
+    return true;
+  };
+
+  std::vector<synthcorpus::Document> docs;
+  std::vector<uint64_t> shard_begin(num_shards + 1, 0);
+  uint64_t jsonl_bytes = 0;
+  uint64_t text_bytes = 0;
+
+  bool ok = run_stage("generate", 0, [&]() {
+    docs = synthcorpus::generate(config);
+    for (uint32_t k = 0; k <= num_shards; k++) {
+      shard_begin[k] = docs.size() * k / num_shards;
+    }
+
+    for (uint32_t k = 0; k < num_shards; k++) {
+      std::string s;
+      for (uint64_t i = shard_begin[k]; i < shard_begin[k + 1]; i++) {
+        nlohmann::json j;
+        j["text"] = docs[i].text;
+        j[docid::kKey] = docid::make(k, uint32_t(i - shard_begin[k]));
+        if (i > shard_begin[k]) {
+          s += "\n";
+        }
+        s += j.dump();
+        text_bytes += docs[i].text.size();
+      }
+      jsonl_bytes += s.size();
+
+      char name[64];
+      snprintf(name, sizeof(name), "synth_%05u.jsonl.zst", k);
+      const glob::fs::path outpath = corpus_dir / name;
+      if (!zstd_compress_to_file(s.data(), s.size(), outpath.c_str())) {
+        return false;
+      }
+    }
+    return true;
+  });
+  if (ok) {
+    results.back().bytes = jsonl_bytes;  // output of this stage
+  }
+
+  ok = ok && run_stage("clean", jsonl_bytes, [&]() {
+    return clean_files(corpus_dir.string(), clean_dir.string(), "text", docfilter::CleanConfig());
+  });
+
+  ok = ok && run_stage("minhash", jsonl_bytes, [&]() {
+    return minhash_files(corpus_dir.string(), minhash_dir.string(), "text", ShingleOption());
+  });
+
+  ok = ok && run_stage("dedup", jsonl_bytes, [&]() {
+    return dedup_to_files(minhash_dir.string(), dedup_dir.string());
+  });
+
+  ok = ok && run_stage("suffix_array", text_bytes, [&]() {
+    std::vector<uint8_t> texts;
+    texts.reserve(text_bytes + docs.size());
+    for (const auto &doc : docs) {
+      texts.insert(texts.end(), doc.text.begin(), doc.text.end());
+      texts.push_back(3);  // end-of-text(same as build_sa)
+    }
+    if (texts.size() > size_t((std::numeric_limits<int32_t>::max)())) {
+      std::cerr << "Corpus must be 2GB or less for suffix array\n";
+      return false;
+    }
+    std::vector<int32_t> sa;
+    return exact_dedup::build(texts.data(), texts.size(), sa);
+  });
+
+  if (!ok) {
+    return false;
+  }
+
+  // ground truth vs `duplicate` flags
+  std::vector<uint8_t> flagged(docs.size(), 0);
+  for (const auto &f : glob::glob({dedup_dir.string() + "/*.zst"})) {
+    for (const auto &j : load_jsonl_zstd(f)) {
+      const uint64_t id = j[docid::kKey].get<uint64_t>();
+      const uint32_t shard = docid::shard_of(id);
+      if (shard >= num_shards) {
+        continue;
+      }
+      const uint64_t idx = shard_begin[shard] + docid::ordinal_of(id);
+      if (idx < shard_begin[shard + 1]) {
+        flagged[idx] = j.value("duplicate", false) ? 1 : 0;
+      }
+    }
+  }
+  const synthcorpus::Score score = synthcorpus::evaluate(docs, flagged);
+
+  nlohmann::json report;
+  report["num_docs"] = config.num_docs;
+  report["num_shards"] = num_shards;
+  report["seed"] = config.seed;
+  report["dup_rate"] = config.dup_rate;
+  report["exact_ratio"] = config.exact_ratio;
+  report["edit_rate"] = config.edit_rate;
+  report["boilerplate_rate"] = config.boilerplate_rate;
+  report["jsonl_bytes"] = jsonl_bytes;
+  report["text_bytes"] = text_bytes;
+  report["num_threads"] = taskpool::num_threads();
+
+  std::cout << "\n[bench] " << config.num_docs << " docs, " << num_shards << " shards, "
+            << double(jsonl_bytes) / (1024.0 * 1024.0) << " MB JSONL, " << taskpool::num_threads()
+            << " threads\n";
+  for (const auto &r : results) {
+    const double mb_per_sec = (r.sec > 0.0) ? double(r.bytes) / (1024.0 * 1024.0) / r.sec : 0.0;
+    const double docs_per_sec = (r.sec > 0.0) ? double(docs.size()) / r.sec : 0.0;
+    printf("  %-14s %9.3f sec %10.2f MB/s %12.1f docs/s  peak RSS %8.1f MB\n", r.name.c_str(), r.sec,
+           mb_per_sec, docs_per_sec, double(r.peak_rss) / (1024.0 * 1024.0));
+
+    nlohmann::json j;
+    j["sec"] = r.sec;
+    j["mb_per_sec"] = mb_per_sec;
+    j["docs_per_sec"] = docs_per_sec;
+    j["peak_rss_bytes"] = r.peak_rss;
+    report["stages"][r.name] = j;
+  }
+
+  printf("  dedup: recall %.4f(exact %.4f, near %.4f) precision %.4f\n", score.recall(),
+         score.recall(synthcorpus::kExactDup), score.recall(synthcorpus::kNearDup), score.precision());
+  printf("         %llu exact + %llu near duplicates, %llu false positives\n",
+         (unsigned long long)score.n_dups[synthcorpus::kExactDup],
+         (unsigned long long)score.n_dups[synthcorpus::kNearDup],
+         (unsigned long long)score.n_flagged[synthcorpus::kOriginal]);
+
+  report["dedup"]["recall"] = score.recall();
+  report["dedup"]["precision"] = score.precision();
+  report["dedup"]["exact_recall"] = score.recall(synthcorpus::kExactDup);
+  report["dedup"]["near_recall"] = score.recall(synthcorpus::kNearDup);
+  report["dedup"]["false_positives"] = score.n_flagged[synthcorpus::kOriginal];
+
+  const std::string report_path = (base / "bench.json").string();
+  std::ofstream ofs(report_path);
+  ofs << report.dump(2) << "\n";
+  if (!ofs) {
+    std::cerr << "Failed to write " << report_path << "\n";
+    return false;
+  }
+  std::cout << "  report: " << report_path << "\n";
+
+  return true;
+}
+
+static int test_sidecar() {
+  const std::string filename = "test_sidecar.safetensors";
+
+  std::vector<uint8_t> flags{1, 0, 1};
+  std::vector<double> scores{1.5, -1.0, 100.25};
+  std::vector<uint8_t> hashes{1, 2, 3, 4, 5, 6};
+
+  sidecar::Writer writer(3);
+  writer.add("duplicate", flags.data());
+  writer.add("minhashes", hashes.data(), 2);
+  writer.add("lm_score", scores.data());
+  writer.set_metadata("stage", "test");
+
+  std::string err;
+  if (!writer.save(filename, &err)) {
+    std::cout << "FAIL: save " << err << "\n";
+    return -1;
+  }
+
+  int ret = 0;
+  {
+    sidecar::Reader reader;
+    if (!reader.open(filename, &err)) {
+      std::cout << "FAIL: open " << err << "\n";
+      return -1;
+    }
+
+    size_t width = 0;
+    const double *s = reader.column<double>("lm_score");
+    const uint8_t *f = reader.column<uint8_t>("duplicate");
+    const uint8_t *h = reader.column<uint8_t>("minhashes", &width);
+    if ((reader.num_rows() != 3) || !s || !f || !h || (width != 2) || (reader.metadata("stage") != "test")) {
+      std::cout << "FAIL: columns\n";
+      ret = -1;
+    } else if (!std::equal(scores.begin(), scores.end(), s) || !std::equal(flags.begin(), flags.end(), f) ||
+               !std::equal(hashes.begin(), hashes.end(), h)) {
+      std::cout << "FAIL: values\n";
+      ret = -1;
+    }
+
+    if (reader.column<float>("lm_score") || reader.column<uint8_t>("not_found")) {
+      std::cout << "FAIL: dtype mismatch or missing column must return nullptr\n";
+      ret = -1;
+    }
+  }
+
+  remove(filename.c_str());
+
+  // beauty step 1 reads `lm_score` from `lmscore --sidecar` output(no JSONL score file).
+  {
+    const glob::fs::path dir("test_sidecar_beauty");
+    std::error_code ec;
+    glob::fs::create_directories(dir / "text", ec);
+    glob::fs::create_directories(dir / "score", ec);
+    std::ofstream((dir / "text" / "a.jsonl.zst").string());  // only globbed
+
+    sidecar::Writer score_writer(3);
+    score_writer.add("lm_score", scores.data());
+    BeautyCorpus corpus;
+    corpus.text_dir = (dir / "text").string();
+    corpus.score_dir = (dir / "score").string();
+
+    std::vector<double> bins;
+    if (!score_writer.save(sidecar::filename(corpus.score_dir, "a.jsonl.zst", "lmscore"), &err) ||
+        !compute_lm_score_bins({corpus}, 2, (dir / "bins.json").string(), bins) || (bins.size() != 3) ||
+        (bins.front() != -1.0) || (bins.back() != 100.25)) {
+      std::cout << "FAIL: compute_lm_score_bins(side-car) " << err << "\n";
+      ret = -1;
+    }
+
+    glob::fs::remove_all(dir, ec);
+  }
+
+  return ret;
+}
+
+static int test_parquet() {
+  const std::string filename = "test_parquet.parquet";
+
+  // repeated texts(dictionary), escapes, null/missing text, mixed-type `meta`
+  std::string jsonl =
+      "{\"text\": \"\u3053\u3093\u306b\u3061\u306f\", \"doc_id\": 10, \"lm_score\": 1.5, \"duplicate\": false, \"meta\": {\"a\": 1}}\n"
+      "{\"text\": \"line\\nbreak \\\"quoted\\\"\", \"doc_id\": 11, \"lm_score\": 2, \"duplicate\": true, \"meta\": [1, 2]}\n"
+      "{\"text\": \"\u3053\u3093\u306b\u3061\u306f\", \"doc_id\": 12, \"lm_score\": -3.25, \"duplicate\": false, \"meta\": \"s\"}\n"
+      "{\"text\": null, \"doc_id\": 13, \"duplicate\": true}\n"
+      "{\"doc_id\": 14, \"lm_score\": 0.0, \"duplicate\": false, \"meta\": null}\n";
+  const std::vector<std::string> texts{"こんにちは", "line\nbreak \"quoted\"", "こんにちは", "", ""};
+
+  int ret = 0;
+  for (bool dictionary : {true, false}) {
+    pqsink::Options options;
+    options.row_group_size = 2;  // 3 row groups
+    options.dictionary = dictionary;
+
+    std::string data = jsonl;
+    std::string err;
+    if (!pqsink::write_jsonl(data, filename, options, &err)) {
+      std::cout << "FAIL: write_jsonl " << err << "\n";
+      return -1;
+    }
+
+    pqsource::TextColumn column;
+    if (!pqsource::load_text_column(filename, "text", column, &err)) {
+      std::cout << "FAIL: load_text_column " << err << "\n";
+      ret = -1;
+      continue;
+    }
+
+    if ((column.rows.size() != texts.size()) || (column.ids.size() != texts.size())) {
+      std::cout << "FAIL: # of rows\n";
+      ret = -1;
+      continue;
+    }
+    for (size_t i = 0; i < texts.size(); i++) {
+      if ((column.rows[i] != texts[i]) || (column.ids[i] != 10 + i)) {
+        std::cout << "FAIL: row " << i << " dictionary=" << dictionary << "\n";
+        ret = -1;
+      }
+    }
+  }
+
+  if (pqsink::replace_ext("out/a.jsonl.zst") != "out/a.parquet") {
+    std::cout << "FAIL: replace_ext\n";
+    ret = -1;
+  }
+
+  remove(filename.c_str());
+
+  return ret;
+}
+
+static int test_docid() {
+  int ret = 0;
+
+  uint64_t id = docid::make(3, 7);
+  if ((docid::shard_of(id) != 3) || (docid::ordinal_of(id) != 7)) {
+    std::cout << "FAIL: make/shard_of/ordinal_of\n";
+    ret = -1;
+  }
+
+  struct InsertCase {
+    const char *line;
+    const char *expected;
+  };
+  InsertCase insert_cases[] = {
+    {"{\"text\": \"a\"}", "{\"doc_id\":5,\"text\": \"a\"}"},
+    {"{ }", "{\"doc_id\":5 }"},
+    {"[1]", ""},
+  };
+  for (const auto &c : insert_cases) {
+    std::string s = docid::insert(c.line, 5);
+    if (s != c.expected) {
+      std::cout << "FAIL: insert(" << c.line << ") = " << s << "(expected " << c.expected << ")\n";
+      ret = -1;
+    }
+  }
+
+  // sorted, unsorted and missing ids.
+  std::vector<uint64_t> left{1, 2, 3, 5};
+  std::vector<uint64_t> right{5, 1, 3, 3};
+  std::vector<int64_t> index;
+  docid::merge_join(left, right, index);
+  std::vector<int64_t> expected{1, -1, 2, 0};
+  if (index != expected) {
+    std::cout << "FAIL: merge_join\n";
+    ret = -1;
+  }
+
+  return ret;
+}
+
+static int test_quantile() {
+  // deterministic skewed values(like perplexity)
+  std::vector<double> values;
+  uint64_t x = 88172645463325252ull;
+  for (size_t i = 0; i < 200000; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    double u = double(x >> 11) / double(1ull << 53);
+    values.push_back(std::exp(8.0 * u) + ((i % 10) == 0 ? 1000.0 : 0.0));
+  }
+
+  quantile::KLLSketch sketch;
+  std::vector<quantile::KLLSketch> parts(4);
+  for (size_t i = 0; i < values.size(); i++) {
+    sketch.insert(values[i]);
+    parts[i % parts.size()].insert(values[i]);
+  }
+  quantile::KLLSketch merged;
+  for (const auto &p : parts) {
+    merged.merge(p);
+  }
+
+  std::vector<double> sorted = values;
+  std::sort(sorted.begin(), sorted.end());
+
+  int ret = 0;
+  for (const quantile::KLLSketch *s : {&sketch, &merged}) {
+    if ((s->count() != values.size()) || (s->min() != sorted.front()) || (s->max() != sorted.back())) {
+      std::cout << "FAIL: count/min/max\n";
+      ret = -1;
+    }
+
+    double max_err = 0.0;
+    for (uint32_t k = 1; k < 32; k++) {
+      double q = double(k) / 32.0;
+      double v = s->quantile(q);
+      // rank error
+      double rank = double(std::lower_bound(sorted.begin(), sorted.end(), v) - sorted.begin()) / double(sorted.size());
+      max_err = (std::max)(max_err, std::fabs(rank - q));
+    }
+    std::cout << "max rank error = " << max_err << "\n";
+    if (max_err > 0.02) {
+      std::cout << "FAIL: rank error too large\n";
+      ret = -1;
+    }
+  }
+
+  // duplicates='drop'
+  quantile::KLLSketch constant;
+  for (size_t i = 0; i < 1000; i++) {
+    constant.insert((i < 900) ? 1.0 : 2.0);
+  }
+  std::vector<double> edges = binning::quantile_edges(constant, 32);
+  if ((edges.size() != 2) || (edges[0] != 1.0) || (edges[1] != 2.0)) {
+    std::cout << "FAIL: quantile_edges with duplicated values\n";
+    ret = -1;
+  }
+
+  // np.digitize semantics, clamped.
+  std::vector<double> bins{1.0, 2.0, 3.0};
+  struct Case {
+    double x;
+    size_t expected;
+  };
+  Case cases[] = {{0.5, 0}, {1.0, 1}, {1.5, 1}, {2.0, 2}, {3.0, 2}, {100.0, 2}};
+  for (const auto &c : cases) {
+    size_t b = binning::digitize(bins, c.x);
+    if (b != c.expected) {
+      std::cout << "FAIL: digitize(" << c.x << ") = " << b << "(expected " << c.expected << ")\n";
+      ret = -1;
+    }
+  }
+
+  return ret;
+}
+
+static int test_lmscore() {
+  const char *arpa =
+      "\\data\\\n"
+      "ngram 1=5\n"
+      "ngram 2=3\n"
+      "\n"
+      "\\1-grams:\n"
+      "-1.0\t<unk>\t0\n"
+      "-99\t<s>\t-0.5\n"
+      "-0.5\t</s>\n"
+      "-0.7\ta\t-0.3\n"
+      "-0.9\tb\t-0.2\n"
+      "\n"
+      "\\2-grams:\n"
+      "-0.2\t<s> a\n"
+      "-0.3\ta b\n"
+      "-0.4\tb </s>\n"
+      "\n"
+      "\\end\\\n";
+
+  std::string arpa_filename = "test_lmscore.arpa";
+  saveFile_orDie(arpa_filename.c_str(), arpa, strlen(arpa));
+
+  ngramlm::Model model;
+  if (!model.load(arpa_filename)) {
+    std::cout << "FAIL: load ARPA\n";
+    return -1;
+  }
+
+  struct Case {
+    std::vector<std::string_view> words;
+    float expected;
+  };
+
+  Case cases[] = {
+    {{"a", "b"}, -0.9f},        // all bigrams hit
+    {{"b", "a"}, -3.1f},        // back off everywhere
+    {{"c"}, -2.0f},             // <unk>
+  };
+
+  int ret = 0;
+  for (const auto &c : cases) {
+    float score = model.score(c.words);
+    std::cout << "score = " << score << "(expected " << c.expected << ")\n";
+    if (std::fabs(score - c.expected) > 1e-5f) {
+      std::cout << "FAIL\n";
+      ret = -1;
+    }
+  }
+
+  remove(arpa_filename.c_str());
+  remove((arpa_filename + ".probing").c_str());
+
+  return ret;
+}
+
+static int test_aho_corasick() {
+  ahocorasick::Matcher matcher;
+  uint32_t c0 = matcher.add_category("a");
+  uint32_t c1 = matcher.add_category("b");
+  matcher.add_pattern("he", c0);
+  matcher.add_pattern("she", c0);
+  matcher.add_pattern("his", c1);
+  matcher.add_pattern("hers", c1);
+  matcher.add_pattern("続きを読む", c1);
+  matcher.add_pattern("he", c1);  // same pattern in two categories
+  matcher.build();
+
+  const std::string text = "ushers\nhis 続きを読む";
+
+  std::vector<ahocorasick::Hit> hits;
+  matcher.search(text, hits);
+
+  // naive search for reference
+  size_t n_expected = 0;
+  for (uint32_t pid = 0; pid < matcher.num_patterns(); pid++) {
+    const std::string &pat = matcher.pattern(pid);
+    for (size_t pos = text.find(pat); pos != std::string::npos; pos = text.find(pat, pos + 1)) {
+      n_expected++;
+    }
+  }
+
+  for (const auto &h : hits) {
+    std::cout << matcher.pattern(h.pattern_id) << " line " << h.line << " [" << h.begin << ", " << h.end << ")\n";
+    if (text.compare(h.begin, h.end - h.begin, matcher.pattern(h.pattern_id)) != 0) {
+      std::cout << "FAIL: wrong position\n";
+      return -1;
+    }
+  }
+
+  if (hits.size() != n_expected) {
+    std::cout << "FAIL: expected " << n_expected << " hits, got " << hits.size() << "\n";
+    return -1;
+  }
+
+  std::vector<uint32_t> counts;
+  matcher.count(text, counts);
+  std::cout << "a: " << counts[c0] << ", b: " << counts[c1] << "\n";
+  // a: he, she / b: hers, his, 続きを読む, he
+  if ((counts[c0] != 2) || (counts[c1] != 4)) {
+    std::cout << "FAIL: category counts\n";
+    return -1;
+  }
+
+  return 0;
+}
+
+static int test_clean() {
+  docfilter::CleanConfig config;
+  config.ws_threshold = 3;
+  config.ascii_filter = false;  // test sentence-end rules only
+
+  const char *text =
+      "今日は晴れです。\n"
+      "明日は雨かもしれない...\n"
+      "これ は 空白 が多い。\n"
+      "「こんにちは」\n"
+      "途中で終わっている、\n"
+      "句読点なし\n"
+      "本当に？";
+
+  docfilter::CleanStats stats;
+  std::string out;
+  bool changed{false};
+
+  docfilter::DocDropReason r = docfilter::clean_document(text, config, out, changed, stats);
+  std::cout << "reason: " << docfilter::doc_drop_reason_name(r) << "\n";
+  std::cout << out << "\n";
+  std::cout << stats.to_string();
+
+  const std::string expected = "今日は晴れです。\n「こんにちは」\n本当に？";
+  if ((r != docfilter::kDocKeep) || !changed || (out != expected)) {
+    std::cout << "FAIL: unexpected clean result\n";
+    return -1;
+  }
+
+  if (docfilter::clean_document("カタカナダケ。", config, out, changed, stats) != docfilter::kDocNoHiragana) {
+    std::cout << "FAIL: expected no_hiragana\n";
+    return -1;
+  }
+
+  // same cases as ascii_filtering.py
+  if (!docfilter::too_many_ascii("aaaaaaaaa今日", 10.0) ||
+      docfilter::too_many_ascii("a今日明日漁ってしあさってはカレーです", 10.0)) {
+    std::cout << "FAIL: ascii filter\n";
+    return -1;
+  }
+
+  return 0;
+}
+
+static int test_dedup() {
+  const char *in0 =
+      "吾輩は猫である。名前はまだ無い。どこで生まれたかとんと見当がつかぬ。";
+  const char *in1 =
+      "吾輩は鳥である。名前はまだ無い。どこで生まれたかとんと見当がつかぬ。";
+  const char *in2 =
+      "東京は晴れ.";
+
+  auto n0 = strutil::build_ngram<5>(in0);
+  auto n1 = strutil::build_ngram<5>(in1);
+  auto n2 = strutil::build_ngram<5>(in2);
+
+  for (const auto &gram : n0) {
+    std::cout << gram.str() << "\n";
+  }
+  for (const auto &gram : n1) {
+    std::cout << gram.str() << "\n";
+  }
+  for (const auto &gram : n2) {
+    std::cout << gram.str() << "\n";
+  }
+
+
+  //LSHDedupConfig conf;
+
+  auto lsh0 = compute_lsh<5, 20, 10>(n0);
+  auto lsh1 = compute_lsh<5, 20, 10>(n1);
+  auto lsh2 = compute_lsh<5, 20, 10>(n2);
+
+
+  std::cout << in0 << "\n";
+  for (const auto &lsh : lsh0) {
+    std::cout << "lsh.sz = " << lsh.size() << "\n";
+    std::cout << strutil::byte_to_hex_string(lsh.data(), lsh.size()) << "\n";
+  }
+
+  std::cout << in1 << "\n";
+  for (const auto &lsh : lsh1) {
+    std::cout << strutil::byte_to_hex_string(lsh.data(), lsh.size()) << "\n";
+  }
+
+  std::cout << in2 << "\n";
+  for (const auto &lsh : lsh2) {
+    std::cout << strutil::byte_to_hex_string(lsh.data(), lsh.size()) << "\n";
+  }
+
+  std::unordered_set<MinHashVal<10, 2>, MinHashValHasher<10, 2>, MinHashValEqual<10, 2>> hash_store;
+
+  if (dedup_stream<20, 10, 2>(lsh0, hash_store)) {
+    std::cout << in0 << " duplicated!\n";
+  }
+  if (dedup_stream<20, 10, 2>(lsh1, hash_store)) {
+    std::cout << in1 << " duplicated!\n";
+  }
+  if (dedup_stream<20, 10, 2>(lsh2, hash_store)) {
+    std::cout << in2 << " duplicated!\n";
+  }
+
+  return 0;
+}
+
+static int test_cluster() {
+  int ret = 0;
+
+  // chains are merged transitively, root = smallest index.
+  {
+    std::vector<dedupcluster::Pair> pairs{{5, 3}, {3, 1}, {7, 8}, {9, 8}};
+    std::vector<uint32_t> roots = dedupcluster::cluster(pairs, 10);
+    std::vector<uint32_t> expected{0, 1, 2, 1, 4, 1, 6, 7, 7, 7};
+    if (roots != expected) {
+      std::cout << "FAIL: cluster\n";
+      ret = -1;
+    }
+
+    std::vector<uint8_t> dups;
+    dedupcluster::select_keep(roots, nullptr, dups);
+    std::vector<uint8_t> expected_dups{0, 0, 0, 1, 0, 1, 0, 0, 1, 1};
+    if (dups != expected_dups) {
+      std::cout << "FAIL: select_keep(first)\n";
+      ret = -1;
+    }
+
+    // keep the largest index.
+    dedupcluster::select_keep(roots, [](uint32_t a, uint32_t b) { return a > b; }, dups);
+    std::vector<uint8_t> expected_last{0, 1, 0, 1, 0, 0, 0, 1, 1, 0};
+    if (dups != expected_last) {
+      std::cout << "FAIL: select_keep(prefer)\n";
+      ret = -1;
+    }
+
+    dedupcluster::Summary summary = dedupcluster::summarize(roots, dups);
+    if ((summary.n_clusters != 2) || (summary.n_clustered != 6) || (summary.n_duplicates != 4) ||
+        (summary.max_cluster_size != 3) || (summary.size_histogram.size() != 1) ||
+        (summary.size_histogram[3] != 2)) {
+      std::cout << "FAIL: summarize\n";
+      ret = -1;
+    }
+  }
+
+  // documents sharing a key in any band are paired with the first one.
+  {
+    std::vector<std::vector<uint64_t>> band_keys{
+      {10, 11, 10, 12, 10},
+      {20, 21, 22, 21, 23},
+    };
+    std::vector<dedupcluster::Pair> pairs;
+    dedupcluster::emit_candidate_pairs(band_keys, 5, pairs);
+    std::sort(pairs.begin(), pairs.end());
+    std::vector<dedupcluster::Pair> expected{{0, 2}, {0, 4}, {1, 3}};
+    if (pairs != expected) {
+      std::cout << "FAIL: emit_candidate_pairs\n";
+      ret = -1;
+    }
+  }
+
+  // a false positive first document does not hide the duplicates behind it:
+  // group {0(false positive), 1, 2} with 1 ~ 2 only.
+  {
+    std::vector<std::vector<uint64_t>> band_keys{
+      {10, 10, 10, 11},
+      {20, 20, 20, 21},
+    };
+    size_t n_calls = 0;
+    size_t n_checked = 0;
+    bool unique = true;
+    const dedupcluster::VerifyFunction verify = [&](const std::vector<dedupcluster::Pair> &batch,
+                                                    std::vector<uint8_t> &keep) {
+      n_calls++;
+      n_checked += batch.size();
+      unique = unique && std::is_sorted(batch.begin(), batch.end()) &&
+               (std::adjacent_find(batch.begin(), batch.end()) == batch.end());
+      for (size_t i = 0; i < batch.size(); i++) {
+        keep[i] = (batch[i] == dedupcluster::Pair(1, 2));
+      }
+    };
+    std::vector<dedupcluster::Pair> pairs;
+    size_t n_verified = 0;
+    dedupcluster::emit_verified_pairs(band_keys, 4, verify, pairs, &n_verified);
+
+    std::vector<dedupcluster::Pair> expected{{1, 2}};
+    std::vector<uint32_t> roots = dedupcluster::cluster(pairs, 4);
+    if ((pairs != expected) || (roots[1] != roots[2]) || (roots[0] == roots[1])) {
+      std::cout << "FAIL: emit_verified_pairs(false positive first)\n";
+      ret = -1;
+    }
+    // (0, 1), (0, 2) in round 1, (1, 2) in round 2, once each for both bands.
+    if ((n_calls != 2) || (n_checked != 3) || (n_verified != 3) || !unique) {
+      std::cout << "FAIL: emit_verified_pairs(pairs verified once)\n";
+      ret = -1;
+    }
+  }
+
+  // parallel union-find == sequential union-find on random pairs.
+  {
+    const uint32_t n = 200000;
+    uint64_t x = 88172645463325252ull;
+    auto next = [&x]() {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      return x;
+    };
+    std::vector<dedupcluster::Pair> pairs(n / 2);
+    for (auto &p : pairs) {
+      p = dedupcluster::Pair(uint32_t(next() % n), uint32_t(next() % n));
+    }
+
+    std::vector<uint32_t> parent(n);
+    std::iota(parent.begin(), parent.end(), 0u);
+    std::function<uint32_t(uint32_t)> find = [&](uint32_t v) {
+      while (parent[v] != v) {
+        v = parent[v] = parent[parent[v]];
+      }
+      return v;
+    };
+    for (const auto &p : pairs) {
+      uint32_t a = find(p.first);
+      uint32_t b = find(p.second);
+      if (a != b) {
+        parent[(std::max)(a, b)] = (std::min)(a, b);
+      }
+    }
+
+    std::vector<uint32_t> roots = dedupcluster::cluster(pairs, n);
+    for (uint32_t i = 0; i < n; i++) {
+      if (roots[i] != find(i)) {
+        std::cout << "FAIL: parallel cluster differs at " << i << "\n";
+        ret = -1;
+        break;
+      }
+    }
+  }
+
+  // block intersection == std::set_intersection for all block alignments.
+  {
+    uint64_t x = 2463534242ull;
+    auto next = [&x]() {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      return x;
+    };
+    for (size_t na = 0; na < 40; na++) {
+      for (size_t nb = 0; nb < 40; nb += 3) {
+        std::vector<uint64_t> a(na), b(nb);
+        for (auto &v : a) v = next() % 64;
+        for (auto &v : b) v = next() % 64;
+        std::sort(a.begin(), a.end());
+        a.erase(std::unique(a.begin(), a.end()), a.end());
+        std::sort(b.begin(), b.end());
+        b.erase(std::unique(b.begin(), b.end()), b.end());
+
+        std::vector<uint64_t> expected;
+        std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+        if (intersection_count(a.data(), a.size(), b.data(), b.size()) != expected.size()) {
+          std::cout << "FAIL: intersection_count(" << a.size() << ", " << b.size() << ")\n";
+          ret = -1;
+        }
+      }
+    }
+  }
+
+  // exact Jaccard of char shingle sets.
+  {
+    std::vector<uint64_t> a, b;
+    compute_shingle_set("abcdefg", 7, 5, a);  // abcde bcdef cdefg
+    compute_shingle_set("abcdefh", 7, 5, b);  // abcde bcdef cdefh
+    if ((a.size() != 3) || (b.size() != 3) || (compute_jaccard(a, b) != 0.5)) {
+      std::cout << "FAIL: compute_jaccard\n";
+      ret = -1;
+    }
+
+    const std::string ja = "吾輩は猫である";
+    compute_shingle_set(ja.data(), ja.size(), 5, a);
+    compute_shingle_set(ja.data(), 6, 5, b);  // shorter than 5 chars: one shingle
+    if ((a.size() != 3) || (b.size() != 1) || (compute_jaccard(a, a) != 1.0) || (compute_jaccard(a, b) != 0.0)) {
+      std::cout << "FAIL: compute_shingle_set(UTF-8)\n";
+      ret = -1;
+    }
+
+    // word shingles: "ab cd", "cd ef", "ef gh". Less than k words: one
+    // shingle of all words(== the char set of a text shorter than n_gram).
+    const std::string text = "ab cd ef gh";
+    const std::vector<std::pair<uint32_t, uint32_t>> words{{0, 2}, {3, 5}, {6, 8}, {9, 11}};
+    compute_shingle_set(text.data(), words, 2, a);
+    compute_shingle_set("cd ef", 5, 20, b);
+    if ((a.size() != 3) || !std::binary_search(a.begin(), a.end(), b[0])) {
+      std::cout << "FAIL: compute_shingle_set(word)\n";
+      ret = -1;
+    }
+    compute_shingle_set(text.data(), words, 5, a);
+    compute_shingle_set(text.data(), text.size(), 20, b);
+    if ((a.size() != 1) || (a != b)) {
+      std::cout << "FAIL: compute_shingle_set(word, less than k words)\n";
+      ret = -1;
+    }
+  }
+
+  return ret;
+}
+
+static int test_lsh() {
+  int ret = 0;
+
+  const std::vector<std::string> texts{
+    "吾輩は猫である。名前はまだ無い。どこで生まれたかとんと見当がつかぬ。",
+    "東京は晴れ.",
+    "abc",
+    "",
+  };
+
+  // runtime-sized fingerprints == pre-instantiated compute_fingerprints().
+  {
+    LSHParams params;
+    const LSHKernel fixed = select_lsh_kernel(params);
+    std::vector<uint32_t> a(params.n_minhash()), b(params.n_minhash());
+    for (const auto &text : texts) {
+      fixed.chars(text.data(), text.size(), a.data());
+      compute_fingerprints(text.data(), text.size(), params.n_gram, uint32_t(params.n_minhash()), b.data());
+      if (!fixed.specialized || (a != b)) {
+        std::cout << "FAIL: compute_fingerprints(chars) `" << text << "`\n";
+        ret = -1;
+      }
+
+      // 3-byte "words"
+      std::vector<std::pair<uint32_t, uint32_t>> words;
+      for (uint32_t i = 0; i + 3 <= text.size(); i += 3) {
+        words.emplace_back(i, i + 3);
+      }
+      fixed.words(text.data(), words, 4, a.data());
+      compute_fingerprints(text.data(), words, 4, uint32_t(params.n_minhash()), b.data());
+      if (a != b) {
+        std::cout << "FAIL: compute_fingerprints(words) `" << text << "`\n";
+        ret = -1;
+      }
+    }
+
+    params.rows = 7;
+    if (select_lsh_kernel(params).specialized) {
+      std::cout << "FAIL: select_lsh_kernel(20 x 7)\n";
+      ret = -1;
+    }
+  }
+
+  // text shorter than n_gram is a single shingle: distinct short texts share no band key.
+  for (const uint32_t rows : {10u, 7u}) {
+    LSHParams params;
+    params.rows = rows;
+    const LSHKernel lsh = select_lsh_kernel(params);
+    BandStore store = make_band_store(params.n_bands, params.band_bytes());
+    std::vector<uint32_t> fp(params.n_minhash());
+    std::vector<uint8_t> buf(params.lsh_bytes());
+    for (const std::string text : {"abc", "xyz", "東京"}) {
+      lsh.chars(text.data(), text.size(), fp.data());
+      bucketize_lsh(params, fp.data(), buf.data());
+      if (store.dedup(buf.data())) {
+        std::cout << "FAIL: short text `" << text << "` collides(" << (lsh.specialized ? "fixed" : "runtime") << ")\n";
+        ret = -1;
+      }
+    }
+  }
+
+  // band keys: truncated bytes == compute_lsh() MinHashVal, hashed keys are 8 bytes.
+  {
+    LSHParams params;
+    params.hashed_keys = false;
+    std::vector<uint32_t> fp(params.n_minhash());
+    std::vector<uint8_t> b(params.lsh_bytes());
+    for (const auto &text : texts) {
+      const auto lshs = compute_lsh<5, 20, 10>(strutil::build_ngram<5>(text));
+      compute_fingerprints(text.data(), text.size(), params.n_gram, uint32_t(params.n_minhash()), fp.data());
+      bucketize_lsh(params, fp.data(), b.data());
+      if ((b.size() != sizeof(lshs)) || memcmp(b.data(), lshs.data(), b.size())) {
+        std::cout << "FAIL: bucketize_lsh(bytes) `" << text << "`\n";
+        ret = -1;
+      }
+    }
+
+    // equal rows in two bands: equal truncated keys, distinct hashed keys(band-seeded).
+    params.n_bands = 2;
+    params.rows = 3;
+    const uint32_t same[6] = {0x10001, 0x20002, 0x30003, 0x10001, 0x20002, 0x30003};
+    const uint32_t near[6] = {0x10001, 0x20002, 0x30003, 0x90001, 0x20002, 0x30003};
+    uint8_t k0[16], k1[16];  // 2 bands x max(3 rows x 2, 8) bytes
+    bucketize_lsh(params, same, k0);
+    bucketize_lsh(params, near, k1);
+    // the 2 low bytes of 0x10001 and 0x90001 are equal.
+    if (memcmp(k0, k0 + 6, 6) || memcmp(k0, k1, 12)) {
+      std::cout << "FAIL: bucketize_lsh(bytes) layout\n";
+      ret = -1;
+    }
+    params.hashed_keys = true;
+    bucketize_lsh(params, same, k0);
+    bucketize_lsh(params, near, k1);
+    if ((params.band_bytes() != 8) || !memcmp(k0, k0 + 8, 8) || memcmp(k0, k1, 8) || !memcmp(k0 + 8, k1 + 8, 8)) {
+      std::cout << "FAIL: bucketize_lsh(hash)\n";
+      ret = -1;
+    }
+
+    if ((signature_agreement(same, same, 6) != 1.0) || (std::fabs(signature_agreement(same, near, 6) - 5.0 / 6.0) > 1e-12) ||
+        (signature_agreement(same, near, 0) != 0.0)) {
+      std::cout << "FAIL: signature_agreement\n";
+      ret = -1;
+    }
+  }
+
+  // band stores: hashed keys(uint64_t), MinHashVal keys(20 bytes) and runtime-sized keys.
+  for (const bool hashed : {true, false}) {
+    LSHParams params;
+    params.n_bands = 4;
+    params.hashed_keys = hashed;
+    const LSHKernel lsh = select_lsh_kernel(params);
+    BandStore store = make_band_store(params.n_bands, params.band_bytes());
+    std::vector<uint32_t> fp(params.n_minhash());
+    std::vector<uint8_t> buf(params.lsh_bytes());
+    std::vector<bool> dups;
+    for (const std::string &text : {texts[0], texts[1], texts[0]}) {
+      lsh.chars(text.data(), text.size(), fp.data());
+      bucketize_lsh(params, fp.data(), buf.data());
+      dups.push_back(store.dedup(buf.data()));
+    }
+    if ((store.size() != 2 * params.n_bands) || (dups != std::vector<bool>{false, false, true})) {
+      std::cout << "FAIL: make_band_store(" << (hashed ? "hash" : "bytes") << ") size " << store.size() << "\n";
+      ret = -1;
+    }
+  }
+  {
+    BandStore odd = make_band_store(2, 3);
+    const uint8_t k0[6] = {1, 2, 3, 4, 5, 6};
+    const uint8_t k1[6] = {9, 9, 9, 1, 2, 3};
+    if (odd.dedup(k0) || !odd.dedup(k1) || (odd.size() != 3)) {
+      std::cout << "FAIL: make_band_store(runtime-sized)\n";
+      ret = -1;
+    }
+  }
+
+  // S-curve and bands x rows selection.
+  {
+    if ((std::fabs(lsh_collision_probability(1.0, 20, 10) - 1.0) > 1e-12) ||
+        (lsh_collision_probability(0.0, 20, 10) != 0.0)) {
+      std::cout << "FAIL: lsh_collision_probability\n";
+      ret = -1;
+    }
+
+    LSHParams lo, hi;
+    if (!optimal_lsh_params(0.5, 200, lo) || !optimal_lsh_params(0.9, 200, hi) ||
+        optimal_lsh_params(1.5, 200, lo) || optimal_lsh_params(0.5, 0, lo)) {
+      std::cout << "FAIL: optimal_lsh_params\n";
+      ret = -1;
+    }
+    // higher threshold => more rows per band. The S-curve crosses ~0.5 near the threshold.
+    if ((lo.n_bands * lo.rows > 200) || (hi.n_bands * hi.rows > 200) || (hi.rows <= lo.rows) ||
+        (std::fabs(lsh_collision_probability(0.5, lo.n_bands, lo.rows) - 0.5) > 0.3) ||
+        (std::fabs(lsh_collision_probability(0.9, hi.n_bands, hi.rows) - 0.5) > 0.3)) {
+      std::cout << "FAIL: optimal_lsh_params 0.5 -> " << lo.n_bands << " x " << lo.rows << ", 0.9 -> " << hi.n_bands
+                << " x " << hi.rows << "\n";
+      ret = -1;
+    }
+  }
+
+  return ret;
+}
+
+static int test_synth() {
+  synthcorpus::Config config;
+  config.num_docs = 300;
+  config.mean_chars = 200;
+  config.seed = 7;
+
+  const std::vector<synthcorpus::Document> docs = synthcorpus::generate(config);
+  const std::vector<synthcorpus::Document> docs2 = synthcorpus::generate(config);
+
+  if (docs.size() != config.num_docs) {
+    std::cout << "FAIL: # of documents\n";
+    return -1;
+  }
+
+  std::vector<uint8_t> flagged(docs.size(), 0);
+  docfilter::CleanStats stats;
+  std::string out;
+  for (size_t i = 0; i < docs.size(); i++) {
+    const auto &doc = docs[i];
+    if ((doc.text != docs2[i].text) || (doc.kind != docs2[i].kind)) {
+      std::cout << "FAIL: not deterministic at " << i << "\n";
+      return -1;
+    }
+    if ((doc.source > i) || ((doc.kind == synthcorpus::kOriginal) != (doc.source == i)) ||
+        (docs[doc.source].kind != synthcorpus::kOriginal)) {
+      std::cout << "FAIL: invalid source of " << i << "\n";
+      return -1;
+    }
+    if ((doc.kind == synthcorpus::kExactDup) != ((doc.source != i) && (doc.text == docs[doc.source].text))) {
+      std::cout << "FAIL: exact duplicate mismatch at " << i << "\n";
+      return -1;
+    }
+    bool changed{false};
+    if ((doc.kind == synthcorpus::kOriginal) &&
+        (docfilter::clean_document(doc.text, docfilter::CleanConfig(), out, changed, stats) != docfilter::kDocKeep)) {
+      std::cout << "FAIL: document " << i << " dropped by clean\n";
+      return -1;
+    }
+    flagged[i] = (doc.kind != synthcorpus::kOriginal);
+  }
+
+  const synthcorpus::Score score = synthcorpus::evaluate(docs, flagged);
+  std::cout << "original " << score.n_dups[synthcorpus::kOriginal] << ", exact "
+            << score.n_dups[synthcorpus::kExactDup] << ", near " << score.n_dups[synthcorpus::kNearDup] << "\n";
+  if (!score.n_dups[synthcorpus::kExactDup] || !score.n_dups[synthcorpus::kNearDup] ||
+      (score.recall() != 1.0) || (score.precision() != 1.0)) {
+    std::cout << "FAIL: score\n";
+    return -1;
+  }
+
+  // boilerplate lines are removed by the line filter.
+  if (stats.line_counts[docfilter::kLineNoPunct] == 0) {
+    std::cout << "FAIL: no boilerplate lines\n";
+    return -1;
+  }
+
+  config.seed = 8;
+  if (synthcorpus::generate(config)[0].text == docs[0].text) {
+    std::cout << "FAIL: seed is ignored\n";
+    return -1;
+  }
+
+  return 0;
+}
+
+static int test_nfkc() {
+  const char *inputs[] = {
+    "hello world.",
+    "吾輩は猫である。名前はまだ無い。",
+    "カタカナとひらがな、漢字。",
+    "ｶﾞｷﾞｸﾞ ﾊﾝｶｸ",                 // half-width katakana
+    "ＡＢＣ１２３！？",             // full-width alnum
+    "㈱㌔①",                     // compatibility chars
+    "\xe3\x81\x8b\xe3\x82\x99",  // か + U+3099(composes to が)
+    "\xe1\x84\x80\xe1\x85\xa1",  // Hangul L + V
+    "e\xcc\x81",                   // e + U+0301
+    "🍣 emoji 😀",
+    "Ω Å ﬁ",                      // singleton and ligature
+    "",
+  };
+
+  nfkc::Normalizer normalizer;
+
+  int n_fail = 0;
+  for (const char *s : inputs) {
+    utf8proc_uint8_t *ref = utf8proc_NFKC(reinterpret_cast<const uint8_t *>(s));
+    std::string expected = ref ? std::string(reinterpret_cast<const char *>(ref)) : std::string();
+    free(ref);
+
+    std::string_view ret = normalizer.normalize(s);
+    bool quick = nfkc::is_nfkc_quick(s);
+
+    if (ret != expected) {
+      std::cout << "FAIL: " << s << " -> " << ret << " (expected " << expected << ")\n";
+      n_fail++;
+    } else {
+      std::cout << "OK(" << (quick ? "fast" : "slow") << "): " << s << " -> " << ret << "\n";
+    }
+
+    // quick check must never accept non-NFKC text.
+    if (quick && (expected != s)) {
+      std::cout << "FAIL: quick check accepted non-NFKC text: " << s << "\n";
+      n_fail++;
+    }
+  }
+
+  // Every codepoint the quick check accepts must be unchanged by NFKC
+  // (also when preceded by a starter it may compose with).
+  for (int32_t cp = 1; cp < 0x20000; cp++) {
+    utf8proc_uint8_t buf[8] = {'A'};
+    utf8proc_ssize_t n = utf8proc_encode_char(cp, buf + 1);
+    if (n <= 0) continue;
+    std::string s(reinterpret_cast<const char *>(buf), size_t(n) + 1);
+    if (!nfkc::is_nfkc_quick(s)) continue;
+
+    utf8proc_uint8_t *ref = utf8proc_NFKC(buf);
+    bool same = ref && (s == reinterpret_cast<const char *>(ref));
+    free(ref);
+    if (!same) {
+      std::cout << "FAIL: quick check accepted U+" << std::hex << cp << std::dec << "\n";
+      n_fail++;
+    }
+  }
+
+  std::cout << "fast: " << normalizer.n_fast() << ", slow: " << normalizer.n_slow() << "\n";
+
+  return n_fail ? -1 : 0;
+}
+
+int main(int argc, char **argv) {
+  // Options for all commands(removed from argv).
+  std::string stats_filename;
+  bool profile = false;
+  {
+    int n = 1;
+    for (int i = 1; i < argc; i++) {
+      std::string arg = argv[i];
+      if (arg.compare(0, 8, "--stats=") == 0) {
+        stats_filename = arg.substr(8);
+      } else if (arg == "--profile") {
+        profile = true;
+      } else {
+        argv[n++] = argv[i];
+      }
+    }
+    argc = n;
+  }
+
+  if (argc < 3) {
+    std::cout << "Need cmd ARGS\n";
+    std::cout << "  cmd:\n";
+    //std::cout << "    wakachi input.txt output.txt: Do wakachi-gaki for input "
+    //             "string\n";
+    std::cout << "    normalize input_string : NFKC normalization\n";
+    std::cout << "    dedup [--sidecar] [--parquet] [--prefetch=K] [--mem_budget=MB] <folder> <out_folder>: do text dedup with minhash. Look *.jsonl.zstd "
+                 "files(output of `minhash`) in <folder>. --sidecar reads *.minhash.safetensors and writes "
+                 "`duplicate` flags to <out_folder>/<file>.dedup.safetensors. --parquet writes results as "
+                 "<out_folder>/<file>.parquet(<file>.dedup.parquet with --sidecar)\n";
+    std::cout << "      dedup --cluster [--keep=first|lm_score] [--lmscore_dir=DIR] ...: cluster all documents with "
+                 "union-find over LSH candidate pairs(transitive), keep one document per cluster(first, or lowest "
+                 "`lm_score`; --sidecar reads DIR/<file>.lmscore.safetensors) and add `cluster_id`. Writes the "
+                 "cluster-size histogram to <out_folder>/clusters.json\n";
+    std::cout << "      dedup --cluster --verify_dir=DIR [--verify_text_key=text] [--verify_threshold=0.5] [--ngram=5] "
+                 "[--shingle=char|word[:k]] [--jagger_model=<patterns>] ...: drop candidate pairs whose exact Jaccard "
+                 "of shingle sets is below the threshold. Texts are read from DIR/<file>(the input folder of "
+                 "`minhash`). Shingles must match the `minhash` run: --sidecar takes them from the minhash files "
+                 "(a mismatching --ngram/--shingle is an error), word shingles need --jagger_model\n";
+    std::cout << "      dedup --cluster --verify_signatures [--verify_threshold=0.5] ...: drop candidate pairs whose "
+                 "fraction of equal 32-bit fingerprints is below the threshold(needs `minhash --fingerprints`)\n";
+    std::cout
+        << "    minhash [--shingle=char|word[:k]] [--jagger_model=<patterns>] [--sidecar] [--ngram=5] [--bands=20] "
+           "[--rows=10] [--threshold=T [--hash_budget=200]] [--band_key=hash|bytes] [--fingerprints] [--prefetch=K] "
+           "[--mem_budget=MB] "
+           "<folder> <out_folder> [text_key]: Compute minhash and "
+           "store minhash JSON to <out_folder>. Look *.zstd files in "
+           "<folder>. [text_key] optional. specify text tag in JSON(default "
+           "`text`). --shingle=word:k uses k-word shingles segmented by "
+           "Jagger(requires --jagger_model, k = 5 when omitted). --ngram/--bands/--rows set the LSH configuration(default 5-char "
+           "shingles, 20 bands x 10 rows = The Pile. RefinedWeb: --rows=450). --threshold=T picks bands x rows "
+           "within --hash_budget minhashes minimising the false positive/negative area of the S-curve around T. "
+           "--band_key=hash(default) stores each band as a 64-bit hash of its full 32-bit fingerprints, "
+           "--band_key=bytes as the 2 low bytes per row. --fingerprints also stores the fingerprints(for "
+           "`dedup --cluster --verify_signatures`). "
+           "--sidecar writes only minhashes to "
+           "<out_folder>/<file>.minhash.safetensors(*.parquet files in <folder> are also read). "
+           "--prefetch=K loads K files ahead of the one being processed(default 2) unless the loaded files "
+           "exceed --mem_budget=MB(decompressed size, 0 = unlimited). Also for `dedup`\n";
+    std::cout << "    clean [--ws_threshold=N] [--ascii_threshold=P] [--no_ascii_filter] [--no_doc_id] [--shard_offset=N] "
+                 "<folder> <out_folder> [text_key]: Apply 03_clean_step1 document "
+                 "filter(clean_text.py + ascii_filtering.py) to *.zst JSONL or *.parquet files in <folder>. "
+                 "Assigns `doc_id`((shard_offset + file index) << 32 | line) unless --no_doc_id\n";
+    std::cout << "    ngword <dict_dir> <folder> <out_folder> [text_key]: Count NG words(<dict_dir>/*.txt) "
+                 "and linewise filter phrases per category with Aho-Corasick. Adds `ng_counts` and `ng_lines` to each JSON\n";
+    std::cout << "    lmscore [--tokenizer=char|jagger] [--jagger_model=<patterns>] [--sidecar] <model.arpa|model.probing> "
+                 "<folder> <out_folder> [text_key]: Compute document perplexity(`lm_score`) with n-gram LM. "
+                 "--sidecar writes <out_folder>/<file>.lmscore.safetensors\n";
+    std::cout << "    beauty [--nbins=N] [--bins=<lm_score_bins.json>] [--docs_per_file=N] [--comp_level=N] "
+                 "[--format=jsonl|parquet] [--row_group_size=N] "
+                 "<dedup_folder> <out_folder> <text_folder>:<score_folder>[:text_key] ...: Drop duplicates and "
+                 "write documents to lm_score bins(chunk_<bin>/*.jsonl.zstd) as 07_beauty/create_dataset.py. "
+                 "Bins are computed with a streaming quantile sketch when <lm_score_bins.json> does not exist. "
+                 "--format=parquet writes chunk_<bin>/*.parquet(zstd pages, --row_group_size rows per row group)\n";
+    std::cout << "    join <out_folder> <folder> <side_folder> [side_folder ...]: Append fields of JSONL files "
+                 "in <side_folder>s to the documents in <folder> by `doc_id`(files with the same name are joined)\n";
+    std::cout << "    bench [--docs=N] [--shards=K] [--mean_chars=N] [--dup_rate=P] [--exact_ratio=P] [--edit_rate=P] "
+                 "[--boilerplate=P] [--seed=S] <work_dir>: Generate a deterministic synthetic Japanese corpus(exact "
+                 "and near duplicates, boilerplate lines) in <work_dir>/corpus and run clean, minhash, dedup and "
+                 "suffix array build on it. Reports throughput, peak memory and dedup recall/precision "
+                 "(<work_dir>/bench.json)\n";
+    std::cout << "    exact build <folder> : Build suffix array for exact dedup\n";
+    std::cout << "    exact dedup <folder> : Do exact dedup with suffx array. Look *.jsonl.zstd files in <folder>.\n";
+    std::cout << "    exact count <folder> <key>: Count occurrences of key from suffix array. Look *.jsonl.zstd files in <folder>.\n";
+    std::cout << "    exact search <folder> <key>: Search string 'key' with suffix array. Look *.jsonl.zstd files in <folder>.\n";
+    std::cout << "    proc input.jsonl.zstd : proc(WIP)\n";
+    std::cout << "    test <test_cmd>: Run tests\n";
+    std::cout << "  options(all commands):\n";
+    std::cout << "    --stats=<file.json>: Write time, bytes in/out and records of each stage(decompress, parse, "
+                 "hash, ...) and peak memory to <file.json>(`-` = stdout) at exit\n";
+    std::cout << "    --profile: Also record idle/wait time of each task thread(implies --stats=- when not given)\n";
+    return -1;
+  }
+
+  // One task scheduler for all stages(created here so the main thread is task thread 0).
+  taskpool::init(/* nthreads */0, profile);
+
+  if (profile && stats_filename.empty()) {
+    stats_filename = "-";
+  }
+  if (!stats_filename.empty()) {
+    std::string command = "cpp_proc";
+    for (int i = 1; i < argc; i++) {
+      command += std::string(" ") + argv[i];
+    }
+    stagestats::begin_run(command);
+    stagestats::write_json_at_exit(stats_filename);
+  }
+
+  std::string cmd = argv[1];
+  if (cmd == "wakachi") {
+  } else if (cmd == "normalize") {
+    std::string ret = nfkc_normalize(argv[2]);
+    std::cout << ret << "\n";
+
+  } else if (cmd == "minhash") {
+    ShingleOption shingle;
+    LSHOption lsh_option;
+    std::string jagger_model;
+    bool use_sidecar = false;
+    shardpipe::Config pipe_config;
+    std::vector<std::string> args;
+
+    for (int i = 2; i < argc; i++) {
+      std::string arg = argv[i];
+      if (parse_pipeline_option(arg, pipe_config) || parse_lsh_option(arg, lsh_option)) {
+        continue;
+      } else if (arg.compare(0, 10, "--shingle=") == 0) {
+        if (!parse_shingle_option(arg.substr(10), shingle)) {
+          exit(-1);
+        }
+      } else if (arg.compare(0, 15, "--jagger_model=") == 0) {
+        jagger_model = arg.substr(15);
+      } else if (arg == "--sidecar") {
+        use_sidecar = true;
+      } else {
+        args.push_back(arg);
+      }
+    }
+
+    if (args.size() < 2) {
+      std::cerr << "Need [--shingle=char|word[:k]] [--jagger_model=<patterns>] [--sidecar] [--ngram=N] [--bands=B] "
+                   "[--rows=R] [--threshold=T] [--hash_budget=N] [--prefetch=K] [--mem_budget=MB] <folder> <out_folder> "
+                   "[text_key]\n";
+      exit(-1);
+    }
+
+    if (!resolve_lsh_option(lsh_option)) {
+      exit(-1);
+    }
+    const LSHKernel lsh = select_lsh_kernel(lsh_option.params);
+    std::cout << "LSH: " << lsh.params.n_gram << "-gram, " << lsh.params.n_bands << " bands x " << lsh.params.rows
+              << " rows(" << (lsh.specialized ? "pre-instantiated" : "runtime-sized") << ")\n";
+
+    std::string out_basedir = args[1];
+
+    std::string text_key = "text";
+    if (args.size() > 2) {
+      text_key = args[2];
+    }
+
+    jagger::tagger tagger;
+    if (shingle.word) {
+      if (jagger_model.empty()) {
+        std::cerr << "--shingle=word:k requires --jagger_model=<patterns>\n";
+        exit(-1);
+      }
+      tagger.read_model(jagger_model);
+      shingle.tagger = &tagger;
+    }
+
+    bool ret;
+    if (use_sidecar) {
+      ret = minhash_sidecar_files(args[0], out_basedir, text_key, shingle, lsh, lsh_option.fingerprints);
+    } else {
+      ret = minhash_files(args[0], out_basedir, text_key, shingle, lsh, lsh_option.fingerprints, pipe_config);
+    }
+
+    if (ret) {
+      return 0;
+    } else {
+      return -1;
+    }
+  } else if (cmd == "clean") {
+    docfilter::CleanConfig config;
+    bool assign_ids = true;
+    uint32_t shard_offset = 0;
+    std::vector<std::string> args;
+
+    for (int i = 2; i < argc; i++) {
+      std::string arg = argv[i];
+      if (arg.compare(0, 15, "--ws_threshold=") == 0) {
+        config.ws_threshold = uint32_t(std::atoi(arg.c_str() + 15));
+      } else if (arg.compare(0, 18, "--ascii_threshold=") == 0) {
+        config.ascii_threshold = std::atof(arg.c_str() + 18);
+      } else if (arg == "--no_ascii_filter") {
+        config.ascii_filter = false;
+      } else if (arg == "--no_doc_id") {
+        assign_ids = false;
+      } else if (arg.compare(0, 15, "--shard_offset=") == 0) {
+        shard_offset = uint32_t(std::atoi(arg.c_str() + 15));
+      } else {
+        args.push_back(arg);
+      }
+    }
+
+    if (args.size() < 2) {
+      std::cerr << "Need [--ws_threshold=N] [--ascii_threshold=P] [--no_ascii_filter] [--no_doc_id] [--shard_offset=N] "
+                   "<folder> <out_folder> [text_key]\n";
+      exit(-1);
+    }
+
+    std::string text_key = "text";
+    if (args.size() > 2) {
+      text_key = args[2];
+    }
+
+    bool ret = clean_files(args[0], args[1], text_key, config, assign_ids, shard_offset);
+
+    if (ret) {
+      return 0;
+    } else {
+      return -1;
+    }
+  } else if (cmd == "ngword") {
+    if (argc < 5) {
+      std::cerr << "Need <dict_dir> <folder> <out_folder> [text_key]\n";
+      exit(-1);
+    }
+
+    std::string text_key = "text";
+    if (argc > 5) {
+      text_key = argv[5];
+    }
+
+    bool ret = ngword_files(argv[2], argv[3], argv[4], text_key);
+
+    if (ret) {
+      return 0;
+    } else {
+      return -1;
+    }
+  } else if (cmd == "lmscore") {
+    LMTokenizer tokenizer;
+    std::string jagger_model;
+    bool use_sidecar = false;
+    std::vector<std::string> args;
+
+    for (int i = 2; i < argc; i++) {
+      std::string arg = argv[i];
+      if (arg.compare(0, 12, "--tokenizer=") == 0) {
+        std::string name = arg.substr(12);
+        if (name == "jagger") {
+          tokenizer.jagger = true;
+        } else if (name != "char") {
+          std::cerr << "Unknown tokenizer `" << name << "`. Use `char` or `jagger`\n";
+          exit(-1);
+        }
+      } else if (arg.compare(0, 15, "--jagger_model=") == 0) {
+        jagger_model = arg.substr(15);
+      } else if (arg == "--sidecar") {
+        use_sidecar = true;
+      } else {
+        args.push_back(arg);
+      }
+    }
+
+    if (args.size() < 3) {
+      std::cerr << "Need [--tokenizer=char|jagger] [--jagger_model=<patterns>] [--sidecar] <model.arpa|model.probing> <folder> <out_folder> [text_key]\n";
+      exit(-1);
+    }
+
+    std::string text_key = "text";
+    if (args.size() > 3) {
+      text_key = args[3];
+    }
+
+    jagger::tagger tagger;
+    if (tokenizer.jagger) {
+      if (jagger_model.empty()) {
+        std::cerr << "--tokenizer=jagger requires --jagger_model=<patterns>\n";
+        exit(-1);
+      }
+      tagger.read_model(jagger_model);
+      tokenizer.tagger = &tagger;
+    }
+
+    ngramlm::Model model;
+    if (!model.load(args[0])) {
+      std::cerr << "Failed to load n-gram model: " << args[0] << "\n";
+      exit(-1);
+    }
+
+    bool ret = lmscore_files(model, tokenizer, args[1], args[2], text_key, use_sidecar);
+
+    if (ret) {
+      return 0;
+    } else {
+      return -1;
+    }
+  } else if (cmd == "beauty") {
+    uint32_t nbins = 32;
+    std::string bins_filename = "lm_score_bins.json";
+    binning::BinnedWriterConfig config;
+    std::vector<std::string> args;
+
+    for (int i = 2; i < argc; i++) {
+      std::string arg = argv[i];
+      if (arg.compare(0, 8, "--nbins=") == 0) {
+        nbins = uint32_t(std::atoi(arg.c_str() + 8));
+      } else if (arg.compare(0, 7, "--bins=") == 0) {
+        bins_filename = arg.substr(7);
+      } else if (arg.compare(0, 16, "--docs_per_file=") == 0) {
+        config.docs_per_file = uint64_t(std::atoll(arg.c_str() + 16));
+      } else if (arg.compare(0, 13, "--comp_level=") == 0) {
+        config.comp_level = std::atoi(arg.c_str() + 13);
+      } else if (arg.compare(0, 9, "--format=") == 0) {
+        std::string format = arg.substr(9);
+        if ((format != "jsonl") && (format != "parquet")) {
+          std::cerr << "--format must be jsonl or parquet, but got " << format << "\n";
+          exit(-1);
+        }
+        config.parquet = (format == "parquet");
+      } else if (arg.compare(0, 17, "--row_group_size=") == 0) {
+        config.row_group_size = uint64_t(std::atoll(arg.c_str() + 17));
+      } else {
+        args.push_back(arg);
+      }
+    }
+
+    if (args.size() < 3) {
+      std::cerr << "Need [--nbins=N] [--bins=<lm_score_bins.json>] [--docs_per_file=N] [--comp_level=N] "
+                   "[--format=jsonl|parquet] [--row_group_size=N] <dedup_folder> <out_folder> <text_folder>:<score_folder>[:text_key] ...\n";
+      exit(-1);
+    }
+
+    if (config.parquet) {
+      config.basename = "japanese-corpus-%05u.parquet";
+    }
+
+    std::vector<BeautyCorpus> corpora;
+    for (size_t i = 2; i < args.size(); i++) {
+      BeautyCorpus corpus;
+      if (!parse_beauty_corpus(args[i], corpus)) {
+        exit(-1);
+      }
+      corpora.push_back(corpus);
+    }
+
+    // Reuse the bins file when it exists(same as create_dataset.py)
+    std::vector<double> bins;
+    std::ifstream ifs(bins_filename);
+    if (ifs) {
+      nlohmann::json j = nlohmann::json::parse(ifs, nullptr, /* allow_exceptions */ false);
+      if (j.is_discarded() || !j.contains("bins") || !j["bins"].is_array()) {
+        std::cerr << "Invalid bins file: " << bins_filename << "\n";
+        exit(-1);
+      }
+      bins = j["bins"].get<std::vector<double>>();
+      std::cout << "Use bins in " << bins_filename << "\n";
+    } else if (!compute_lm_score_bins(corpora, nbins, bins_filename, bins)) {
+      exit(-1);
+    }
+
+    if (bins.empty()) {
+      std::cerr << "No lm_score bins.\n";
+      exit(-1);
+    }
+
+    bool ret = beauty_files(corpora, args[0], args[1], bins, config);
+
+    if (ret) {
+      return 0;
+    } else {
+      return -1;
+    }
+  } else if (cmd == "join") {
+    if (argc < 5) {
+      std::cerr << "Need <out_folder> <folder> <side_folder> [side_folder ...]\n";
+      exit(-1);
+    }
+
+    std::vector<std::string> side_dirs;
+    for (int i = 4; i < argc; i++) {
+      side_dirs.push_back(argv[i]);
+    }
+
+    bool ret = join_files(argv[3], side_dirs, argv[2]);
+
+    if (ret) {
+      return 0;
+    } else {
+      return -1;
+    }
+  } else if (cmd == "bench") {
+    synthcorpus::Config config;
+    uint32_t num_shards = 4;
+    std::vector<std::string> args;
+
+    for (int i = 2; i < argc; i++) {
+      std::string arg = argv[i];
+      if (arg.compare(0, 7, "--docs=") == 0) {
+        config.num_docs = uint64_t((std::max)(1ll, std::atoll(arg.c_str() + 7)));
+      } else if (arg.compare(0, 9, "--shards=") == 0) {
+        num_shards = uint32_t((std::max)(1, std::atoi(arg.c_str() + 9)));
+      } else if (arg.compare(0, 13, "--mean_chars=") == 0) {
+        config.mean_chars = uint32_t((std::max)(1, std::atoi(arg.c_str() + 13)));
+      } else if (arg.compare(0, 11, "--dup_rate=") == 0) {
+        config.dup_rate = std::atof(arg.c_str() + 11);
+      } else if (arg.compare(0, 14, "--exact_ratio=") == 0) {
+        config.exact_ratio = std::atof(arg.c_str() + 14);
+      } else if (arg.compare(0, 12, "--edit_rate=") == 0) {
+        config.edit_rate = std::atof(arg.c_str() + 12);
+      } else if (arg.compare(0, 14, "--boilerplate=") == 0) {
+        config.boilerplate_rate = std::atof(arg.c_str() + 14);
+      } else if (arg.compare(0, 7, "--seed=") == 0) {
+        config.seed = uint64_t(std::strtoull(arg.c_str() + 7, nullptr, 10));
+      } else {
+        args.push_back(arg);
+      }
+    }
+
+    if (args.size() < 1) {
+      std::cerr << "Need [--docs=N] [--shards=K] [--mean_chars=N] [--dup_rate=P] [--exact_ratio=P] [--edit_rate=P] "
+                   "[--boilerplate=P] [--seed=S] <work_dir>\n";
+      exit(-1);
+    }
+
+    // no empty shard
+    num_shards = uint32_t((std::min)(uint64_t(num_shards), config.num_docs));
+
+    if (bench_files(config, num_shards, args[0])) {
+      return 0;
+    } else {
+      return -1;
+    }
+  } else if (cmd == "exact") {
+    if (argc < 4) {
+      std::cerr << "Need <task> <folder>\n";
+      exit(-1);
+    }
+
+    const std::string task = argv[2];
+
+    if (task == "build") {
+      std::string input_str = "hello hello";
+      std::vector<int> sa;
+      if (!exact_dedup::build(reinterpret_cast<const uint8_t *>(input_str.c_str()), input_str.size(), sa)) {
+        exit(-1);
+      }
+    } else if (task == "dedup") {
+      std::cout << "TODO\n";
+      exit(-1);
+    } else if (task == "search") {
+      std::cout << "TODO\n";
+      exit(-1);
+    } else {
+      std::cerr << "Unknown task `" << task << "`\n";
+      exit(-1);
+    }
+
+  } else if (cmd == "dedup") {
+    bool use_sidecar = false;
+    bool use_parquet = false;
+    bool use_cluster = false;
+    std::string keep = "first";
+    std::string lmscore_dir;
+    VerifyOption verify;
+    std::string jagger_model;
+    shardpipe::Config pipe_config;
+    std::vector<std::string> args;
+
+    for (int i = 2; i < argc; i++) {
+      std::string arg = argv[i];
+      if (parse_pipeline_option(arg, pipe_config)) {
+        continue;
+      } else if (arg == "--sidecar") {
+        use_sidecar = true;
+      } else if (arg == "--parquet") {
+        use_parquet = true;
+      } else if (arg == "--cluster") {
+        use_cluster = true;
+      } else if (arg.compare(0, 7, "--keep=") == 0) {
+        keep = arg.substr(7);
+      } else if (arg.compare(0, 14, "--lmscore_dir=") == 0) {
+        lmscore_dir = arg.substr(14);
+      } else if (arg.compare(0, 13, "--verify_dir=") == 0) {
+        verify.text_dir = arg.substr(13);
+      } else if (arg.compare(0, 18, "--verify_text_key=") == 0) {
+        verify.text_key = arg.substr(18);
+      } else if (arg == "--verify_signatures") {
+        verify.signatures = true;
+      } else if (arg.compare(0, 19, "--verify_threshold=") == 0) {
+        verify.threshold = std::stod(arg.substr(19));
+      } else if (arg.compare(0, 8, "--ngram=") == 0) {
+        verify.n_gram = uint32_t((std::max)(1, std::atoi(arg.c_str() + 8)));
+        verify.n_gram_given = true;
+      } else if (arg.compare(0, 10, "--shingle=") == 0) {
+        if (!parse_shingle_option(arg.substr(10), verify.shingle)) {
+          exit(-1);
+        }
+        verify.shingle_given = true;
+      } else if (arg.compare(0, 15, "--jagger_model=") == 0) {
+        jagger_model = arg.substr(15);
+      } else {
+        args.push_back(arg);
+      }
+    }
+
+    if (args.size() < 2) {
+      std::cerr << "Need [--sidecar] [--parquet] [--cluster] [--keep=first|lm_score] [--lmscore_dir=DIR] "
+                   "[--verify_dir=DIR [--verify_text_key=KEY] [--ngram=N] [--shingle=char|word[:k]] "
+                   "[--jagger_model=<patterns>]] [--verify_signatures] [--verify_threshold=T] "
+                   "[--prefetch=K] [--mem_budget=MB] <folder> <out_folder>\n";
+      exit(-1);
+    }
+
+    if (verify.enabled() && !use_cluster) {
+      std::cerr << "--verify_dir and --verify_signatures need --cluster\n";
+      exit(-1);
+    }
+
+    jagger::tagger tagger;
+    if (!jagger_model.empty()) {
+      tagger.read_model(jagger_model);
+      verify.shingle.tagger = &tagger;
+    }
+
+    bool ret;
+    if (use_cluster) {
+      ret = dedup_cluster_files(args[0], args[1], use_sidecar, use_parquet, keep, lmscore_dir, verify, pipe_config);
+    } else if (use_sidecar) {
+      ret = dedup_sidecar_files(args[0], args[1], use_parquet);
+    } else {
+      ret = dedup_to_files(args[0], args[1], use_parquet, pipe_config);
+    }
 
     if (ret) {
       return 0;
@@ -730,6 +4418,39 @@ int main(int argc, char **argv) {
     if (suite == "dedup") {
       std::cout << "run dedup test\n";
       return test_dedup();
+    } else if (suite == "sidecar") {
+      std::cout << "run sidecar test\n";
+      return test_sidecar();
+    } else if (suite == "parquet") {
+      std::cout << "run parquet test\n";
+      return test_parquet();
+    } else if (suite == "docid") {
+      std::cout << "run docid test\n";
+      return test_docid();
+    } else if (suite == "quantile") {
+      std::cout << "run quantile test\n";
+      return test_quantile();
+    } else if (suite == "lmscore") {
+      std::cout << "run lmscore test\n";
+      return test_lmscore();
+    } else if (suite == "aho_corasick") {
+      std::cout << "run aho_corasick test\n";
+      return test_aho_corasick();
+    } else if (suite == "clean") {
+      std::cout << "run clean test\n";
+      return test_clean();
+    } else if (suite == "nfkc") {
+      std::cout << "run nfkc test\n";
+      return test_nfkc();
+    } else if (suite == "synth") {
+      std::cout << "run synth test\n";
+      return test_synth();
+    } else if (suite == "cluster") {
+      std::cout << "run cluster test\n";
+      return test_cluster();
+    } else if (suite == "lsh") {
+      std::cout << "run lsh test\n";
+      return test_lsh();
     } else {
       std::cout << "Unknown test suite: " << suite << "\n";
     }
@@ -0,0 +1,196 @@
+// SPDX-License-Identifier: Apache 2.0
+
+#include "nfkc-normalize.hh"
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define NFKC_USE_SSE2
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define NFKC_USE_NEON
+#endif
+
+#include "utf8proc.h"
+
+namespace nfkc {
+
+namespace {
+
+// Codepoints covered by the quick check table(BMP + SMP, which includes
+// Emoji). Others go to the slow path.
+constexpr uint32_t kQCTableSize = 0x20000;
+
+constexpr utf8proc_option_t kNFKCOptions = utf8proc_option_t(
+    UTF8PROC_STABLE | UTF8PROC_COMPOSE | UTF8PROC_COMPAT);
+
+// Hangul jamo which compose with the preceding syllable.
+inline bool is_hangul_vt(int32_t cp) {
+  return ((cp >= 0x1161) && (cp <= 0x1175)) || ((cp >= 0x11a8) && (cp <= 0x11c2));
+}
+
+//
+// 1 = NFKC_QC=Yes for the codepoint(conservatively):
+//  - combining class is 0(no reordering)
+//  - cannot compose with the preceding character
+//  - NFKC(cp) == cp
+//
+// This is stricter than the Unicode NFKC_QC property(Maybe => No),
+// which is fine for a fast path.
+//
+struct QCTable {
+  std::vector<uint64_t> bits;
+
+  QCTable() : bits(kQCTableSize / 64, 0) {
+    int32_t buf[32];
+    for (int32_t cp = 0; cp < int32_t(kQCTableSize); cp++) {
+      const utf8proc_property_t *prop = utf8proc_get_property(cp);
+      if (prop->category == UTF8PROC_CATEGORY_CN) continue;  // unassigned
+      if (prop->category == UTF8PROC_CATEGORY_CS) continue;  // surrogate
+      if (prop->combining_class != 0) continue;
+      if ((prop->comb_index != UINT16_MAX) && (prop->comb_index >= 0x8000)) continue;
+      if (is_hangul_vt(cp)) continue;
+
+      int last_boundclass = 0;
+      utf8proc_ssize_t n = utf8proc_decompose_char(cp, buf, 32, kNFKCOptions, &last_boundclass);
+      if (n <= 0 || n > 32) continue;
+      n = utf8proc_normalize_utf32(buf, n, kNFKCOptions);
+      if ((n == 1) && (buf[0] == cp)) {
+        bits[uint32_t(cp) / 64] |= (1ull << (uint32_t(cp) % 64));
+      }
+    }
+  }
+
+  bool test(uint32_t cp) const {
+    return (cp < kQCTableSize) && ((bits[cp / 64] >> (cp % 64)) & 1);
+  }
+};
+
+const QCTable &qc_table() {
+  static const QCTable table;  // thread-safe init since C++11
+  return table;
+}
+
+// Returns the number of leading ASCII bytes(1..0x7f) in [p, end).
+// NUL is treated as non-ASCII so that it goes to the utf8proc path.
+inline size_t skip_ascii(const uint8_t *p, const uint8_t *end) {
+  const uint8_t *s = p;
+#if defined(NFKC_USE_SSE2)
+  const __m128i zero = _mm_setzero_si128();
+  while ((end - p) >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    // MSB set(>= 0x80) or NUL
+    int mask = _mm_movemask_epi8(v) | _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+    if (mask) {
+      return size_t(p - s) + size_t(__builtin_ctz(uint32_t(mask)));
+    }
+    p += 16;
+  }
+#elif defined(NFKC_USE_NEON)
+  while ((end - p) >= 16) {
+    uint8x16_t v = vld1q_u8(p);
+    // 0x01 <= v <= 0x7f
+    uint8x16_t bad = vorrq_u8(vcgeq_u8(v, vdupq_n_u8(0x80)), vceqq_u8(v, vdupq_n_u8(0)));
+    if (vmaxvq_u8(bad)) {
+      break;
+    }
+    p += 16;
+  }
+#else
+  while ((end - p) >= 8) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    // any MSB set, or any zero byte
+    if ((v & 0x8080808080808080ull) ||
+        ((v - 0x0101010101010101ull) & ~v & 0x8080808080808080ull)) {
+      break;
+    }
+    p += 8;
+  }
+#endif
+  while ((p < end) && (*p != 0) && (*p < 0x80)) {
+    p++;
+  }
+  return size_t(p - s);
+}
+
+}  // namespace
+
+bool is_nfkc_quick(std::string_view s) {
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(s.data());
+  const uint8_t *end = p + s.size();
+  const QCTable &table = qc_table();
+
+  while (p < end) {
+    p += skip_ascii(p, end);
+    if (p == end) {
+      break;
+    }
+
+    utf8proc_int32_t cp;
+    utf8proc_ssize_t len = utf8proc_iterate(p, end - p, &cp);
+    if ((len <= 0) || (cp == 0)) {
+      return false;
+    }
+
+    // common Japanese ranges first: hiragana, katakana, CJK unified ideographs.
+    // (all of them are NFKC_QC=Yes)
+    bool yes = ((cp >= 0x3041) && (cp <= 0x3096)) ||
+               ((cp >= 0x30a1) && (cp <= 0x30fa)) ||
+               ((cp >= 0x4e00) && (cp <= 0x9fff)) || table.test(uint32_t(cp));
+    if (!yes) {
+      return false;
+    }
+
+    p += len;
+  }
+
+  return true;
+}
+
+std::string_view Normalizer::normalize(std::string_view s) {
+  if (is_nfkc_quick(s)) {
+    _n_fast++;
+    return s;
+  }
+
+  _n_slow++;
+
+  const utf8proc_uint8_t *str = reinterpret_cast<const utf8proc_uint8_t *>(s.data());
+
+  // NFKC expands at most 18x(U+FDFA), but usually much less. Grow on demand.
+  if (_work.size() < s.size() + 1) {
+    _work.resize(s.size() + 1);
+  }
+
+  utf8proc_ssize_t n;
+  for (;;) {
+    n = utf8proc_decompose(str, utf8proc_ssize_t(s.size()), _work.data(),
+                           utf8proc_ssize_t(_work.size()), kNFKCOptions);
+    if (n < 0) {
+      return std::string_view();
+    }
+    if (size_t(n) <= _work.size()) {
+      break;
+    }
+    _work.resize(size_t(n));
+  }
+
+  // utf8proc_reencode() composes and writes UTF-8 in-place into `_work`.
+  n = utf8proc_reencode(_work.data(), n, kNFKCOptions);
+  if (n < 0) {
+    return std::string_view();
+  }
+
+  _out.assign(reinterpret_cast<const char *>(_work.data()), size_t(n));
+
+  return _out;
+}
+
+std::string normalize(const std::string &s) {
+  Normalizer normalizer;
+  return std::string(normalizer.normalize(s));
+}
+
+} // namespace nfkc
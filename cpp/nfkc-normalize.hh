@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: Apache 2.0
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace nfkc {
+
+///
+/// Quick check whether UTF-8 string `s` is already in NFKC form.
+///
+/// Conservative: `true` means NFKC(s) == s. `false` means "maybe not"(the
+/// string may still be NFKC). Invalid UTF-8 and codepoints beyond U+1FFFF
+/// always report `false`.
+///
+/// ASCII runs are skipped with SIMD(SSE2/NEON) or 8-byte SWAR. Other
+/// codepoints are tested against a NFKC_QC-like bit table built from
+/// utf8proc on first use.
+///
+bool is_nfkc_quick(std::string_view s);
+
+///
+/// NFKC normalizer with reusable work buffers.
+/// Use one instance per thread.
+///
+class Normalizer {
+ public:
+  ///
+  /// Normalize UTF-8 string `s`.
+  ///
+  /// Returns `s` itself when the quick check passes(no copy). Otherwise
+  /// returns a view to the internal buffer, which is valid until the next
+  /// call of normalize().
+  /// Returns an empty view when `s` is not a valid UTF-8 string.
+  ///
+  std::string_view normalize(std::string_view s);
+
+  // statistics
+  uint64_t n_fast() const { return _n_fast; }
+  uint64_t n_slow() const { return _n_slow; }
+
+ private:
+  std::vector<int32_t> _work;  // decomposed codepoints, reencoded in-place.
+  std::string _out;
+  uint64_t _n_fast{0};
+  uint64_t _n_slow{0};
+};
+
+///
+/// Convenient function. Equivalent to utf8proc_NFKC() but skips
+/// normalization for already-normalized text.
+/// Returns empty string when failed to normalize.
+///
+std::string normalize(const std::string &s);
+
+} // namespace nfkc
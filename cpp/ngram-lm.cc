@@ -0,0 +1,459 @@
+// SPDX-License-Identifier: Apache 2.0
+
+#include "ngram-lm.hh"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "MurmurHash3.h"
+
+namespace ngramlm {
+
+namespace {
+
+constexpr char kMagic[8] = {'N', 'G', 'L', 'M', 'P', 'R', 'B', '\0'};
+constexpr uint32_t kVersion = 1;
+
+// KenLM substitutes this when the ARPA file lacks <unk>.
+constexpr float kDefaultUnkProb = -100.0f;
+
+inline uint64_t hash_word(std::string_view w) {
+  uint64_t h[2];
+  MurmurHash3_x64_128(w.data(), int(w.size()), /* seed */0, h);
+  return h[0];
+}
+
+// n-gram key = fold from the newest word to the oldest.
+// key(w) = hash(w), key(v w) = combine(key(w), hash(v))
+inline uint64_t combine(uint64_t key, uint64_t prev) {
+  return (key * 8978948897894561157ull) ^ ((prev + 1) * 17894857484156487943ull);
+}
+
+// 0 is reserved for empty slots.
+inline uint64_t fix_key(uint64_t key) {
+  return key ? key : 1;
+}
+
+inline uint64_t slot_of(uint64_t key, uint64_t capacity) {
+  // keys are already hashed; mix high bits in to be safe with linear probing.
+  return (key ^ (key >> 32)) & (capacity - 1);
+}
+
+uint64_t table_capacity(uint64_t count) {
+  // load factor <= 2/3
+  uint64_t cap = 16;
+  while (cap < count + count / 2 + 1) {
+    cap <<= 1;
+  }
+  return cap;
+}
+
+bool stat_file(const std::string &fn, uint64_t &size, int64_t &mtime) {
+  struct stat st;
+  if (::stat(fn.c_str(), &st) != 0) {
+    return false;
+  }
+  size = uint64_t(st.st_size);
+  mtime = int64_t(st.st_mtime);
+  return true;
+}
+
+bool map_file(const std::string &fn, void *&addr, size_t &nbytes) {
+  int fd = ::open(fn.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+    ::close(fd);
+    return false;
+  }
+  nbytes = size_t(st.st_size);
+  addr = ::mmap(nullptr, nbytes, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    addr = nullptr;
+    return false;
+  }
+  return true;
+}
+
+bool ends_with(const std::string &s, const char *suffix) {
+  size_t n = strlen(suffix);
+  return (s.size() >= n) && (s.compare(s.size() - n, n, suffix) == 0);
+}
+
+inline bool is_space(char c) {
+  return (c == ' ') || (c == '\t') || (c == '\r');
+}
+
+// split by spaces/tabs.
+void split_fields(std::string_view line, std::vector<std::string_view> &fields) {
+  fields.clear();
+  size_t i = 0;
+  while (i < line.size()) {
+    while ((i < line.size()) && is_space(line[i])) i++;
+    size_t s = i;
+    while ((i < line.size()) && !is_space(line[i])) i++;
+    if (i > s) {
+      fields.push_back(line.substr(s, i - s));
+    }
+  }
+}
+
+bool read_header(const std::string &fn, ProbingHeader &h) {
+  FILE *fp = fopen(fn.c_str(), "rb");
+  if (!fp) {
+    return false;
+  }
+  bool ok = (fread(&h, sizeof(h), 1, fp) == 1);
+  fclose(fp);
+  return ok && (memcmp(h.magic, kMagic, 8) == 0) && (h.version == kVersion) &&
+         (h.order > 0) && (h.order <= kMaxOrder);
+}
+
+} // namespace
+
+Model::~Model() {
+  if (_addr) {
+    ::munmap(_addr, _nbytes);
+  }
+}
+
+bool Model::compile_arpa(const std::string &arpa_filename, const std::string &out_filename) {
+  void *addr = nullptr;
+  size_t nbytes = 0;
+  if (!map_file(arpa_filename, addr, nbytes)) {
+    std::cerr << "Failed to open ARPA file: " << arpa_filename << "\n";
+    return false;
+  }
+
+  std::string_view data(reinterpret_cast<const char *>(addr), nbytes);
+
+  ProbingHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kMagic, 8);
+  header.version = kVersion;
+  header.unk_prob = kDefaultUnkProb;
+
+  int64_t mtime = 0;
+  stat_file(arpa_filename, header.source_size, mtime);
+  header.source_mtime = mtime;
+
+  std::vector<std::vector<Entry>> tables;
+  std::vector<std::string_view> fields;
+  uint64_t inserted[kMaxOrder] = {};
+
+  const uint64_t unk_hash = hash_word("<unk>");
+  bool has_unk = false;
+
+  // 0: before \data\, 1: in \data\, n + 1: in \n-grams:
+  uint32_t section = 0;
+  bool ok = true;
+
+  size_t pos = 0;
+  while (ok && (pos < data.size())) {
+    size_t e = data.find('\n', pos);
+    if (e == std::string_view::npos) e = data.size();
+    std::string_view line = data.substr(pos, e - pos);
+    pos = e + 1;
+
+    while (!line.empty() && is_space(line.back())) line.remove_suffix(1);
+    if (line.empty()) {
+      continue;
+    }
+
+    if (line == "\\data\\") {
+      section = 1;
+      continue;
+    }
+    if (line == "\\end\\") {
+      break;
+    }
+    if (line[0] == '\\') {
+      // "\N-grams:"
+      uint32_t n = uint32_t(std::atoi(std::string(line.substr(1)).c_str()));
+      if ((n == 0) || (n > header.order)) {
+        std::cerr << "Invalid ARPA section: " << line << "\n";
+        ok = false;
+        break;
+      }
+      section = n + 1;
+      continue;
+    }
+
+    if (section == 0) {
+      continue;
+    } else if (section == 1) {
+      // "ngram N=count"
+      if (line.compare(0, 6, "ngram ") != 0) {
+        continue;
+      }
+      std::string s(line.substr(6));
+      size_t eq = s.find('=');
+      if (eq == std::string::npos) {
+        ok = false;
+        break;
+      }
+      uint32_t n = uint32_t(std::atoi(s.substr(0, eq).c_str()));
+      uint64_t count = uint64_t(std::strtoull(s.c_str() + eq + 1, nullptr, 10));
+      if ((n == 0) || (n > kMaxOrder)) {
+        std::cerr << "n-gram order " << n << " is not supported(max " << kMaxOrder << ")\n";
+        ok = false;
+        break;
+      }
+      header.order = (std::max)(header.order, n);
+      header.counts[n - 1] = count;
+      header.capacity[n - 1] = table_capacity(count);
+      if (tables.size() < n) {
+        tables.resize(n);
+      }
+      tables[n - 1].assign(header.capacity[n - 1], Entry{0, 0.0f, 0.0f});
+      continue;
+    }
+
+    const uint32_t n = section - 1;
+    split_fields(line, fields);
+    if ((fields.size() != n + 1) && (fields.size() != n + 2)) {
+      std::cerr << "Invalid " << n << "-gram line: " << line << "\n";
+      ok = false;
+      break;
+    }
+
+    Entry entry;
+    entry.prob = std::strtof(std::string(fields[0]).c_str(), nullptr);
+    entry.backoff = (fields.size() == n + 2) ? std::strtof(std::string(fields[n + 1]).c_str(), nullptr) : 0.0f;
+
+    uint64_t key = hash_word(fields[n]);
+    for (uint32_t k = n - 1; k >= 1; k--) {
+      key = combine(key, hash_word(fields[k]));
+    }
+    entry.key = fix_key(key);
+
+    if ((n == 1) && (key == unk_hash)) {
+      has_unk = true;
+      header.unk_prob = entry.prob;
+    }
+
+    if (inserted[n - 1] >= header.counts[n - 1]) {
+      std::cerr << "# of " << n << "-grams exceeds the count in \\data\\ section.\n";
+      ok = false;
+      break;
+    }
+    inserted[n - 1]++;
+
+    std::vector<Entry> &table = tables[n - 1];
+    uint64_t cap = table.size();
+    for (uint64_t s = slot_of(entry.key, cap);; s = (s + 1) & (cap - 1)) {
+      if (table[s].key == 0 || table[s].key == entry.key) {
+        table[s] = entry;
+        break;
+      }
+    }
+  }
+
+  ::munmap(addr, nbytes);
+
+  if (!ok) {
+    return false;
+  }
+
+  if (header.order == 0) {
+    std::cerr << "No \\data\\ section in ARPA file: " << arpa_filename << "\n";
+    return false;
+  }
+
+  if (!has_unk) {
+    std::cerr << "The ARPA file is missing <unk>. Substituting log10 probability " << kDefaultUnkProb << "\n";
+  }
+
+  // write to temporary file then rename.
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".tmp.%ld", long(::getpid()));
+  const std::string tmp_fn = out_filename + suffix;
+
+  FILE *fp = fopen(tmp_fn.c_str(), "wb");
+  if (!fp) {
+    std::cerr << "Failed to open file: " << tmp_fn << "\n";
+    return false;
+  }
+
+  ok = (fwrite(&header, sizeof(header), 1, fp) == 1);
+  for (size_t n = 0; ok && (n < tables.size()); n++) {
+    ok = (fwrite(tables[n].data(), sizeof(Entry), tables[n].size(), fp) == tables[n].size());
+  }
+  ok = ok && (fflush(fp) == 0) && (::fsync(::fileno(fp)) == 0);
+  fclose(fp);
+
+  if (!ok || (std::rename(tmp_fn.c_str(), out_filename.c_str()) != 0)) {
+    std::cerr << "Failed to write file: " << out_filename << "\n";
+    ::unlink(tmp_fn.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+bool Model::load(const std::string &filename) {
+  std::string bin_filename = filename;
+
+  if (!ends_with(filename, ".probing")) {
+    // ARPA. reuse compiled table when it is up to date.
+    bin_filename = filename + ".probing";
+
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    if (!stat_file(filename, size, mtime)) {
+      std::cerr << "File not found: " << filename << "\n";
+      return false;
+    }
+
+    ProbingHeader h;
+    if (!read_header(bin_filename, h) || (h.source_size != size) || (h.source_mtime != mtime)) {
+      std::cout << "compiling " << filename << " into " << bin_filename << "\n";
+      if (!compile_arpa(filename, bin_filename)) {
+        return false;
+      }
+    }
+  }
+
+  if (!map_file(bin_filename, _addr, _nbytes)) {
+    std::cerr << "Failed to mmap: " << bin_filename << "\n";
+    return false;
+  }
+
+  if (_nbytes < sizeof(ProbingHeader)) {
+    std::cerr << "Invalid model file: " << bin_filename << "\n";
+    return false;
+  }
+
+  _header = reinterpret_cast<const ProbingHeader *>(_addr);
+  if ((memcmp(_header->magic, kMagic, 8) != 0) || (_header->version != kVersion) ||
+      (_header->order == 0) || (_header->order > kMaxOrder)) {
+    std::cerr << "Invalid model file: " << bin_filename << "\n";
+    _header = nullptr;
+    return false;
+  }
+
+  size_t offset = sizeof(ProbingHeader);
+  for (uint32_t n = 0; n < _header->order; n++) {
+    _tables[n] = reinterpret_cast<const Entry *>(reinterpret_cast<const uint8_t *>(_addr) + offset);
+    offset += sizeof(Entry) * _header->capacity[n];
+  }
+
+  if (offset != _nbytes) {
+    std::cerr << "Model file size mismatch: " << bin_filename << "\n";
+    _header = nullptr;
+    return false;
+  }
+
+  _bos = hash_word("<s>");
+  _eos = hash_word("</s>");
+  _unk = hash_word("<unk>");
+
+  return true;
+}
+
+const Entry *Model::find(uint32_t n, uint64_t key) const {
+  const Entry *table = _tables[n - 1];
+  const uint64_t cap = _header->capacity[n - 1];
+  key = fix_key(key);
+  for (uint64_t s = slot_of(key, cap);; s = (s + 1) & (cap - 1)) {
+    if (table[s].key == key) {
+      return &table[s];
+    }
+    if (table[s].key == 0) {
+      return nullptr;
+    }
+  }
+}
+
+uint64_t Model::word_index(std::string_view word) const {
+  uint64_t h = hash_word(word);
+  return find(1, h) ? h : _unk;
+}
+
+float Model::score_word(const uint64_t *ctx, size_t nctx, uint64_t w) const {
+  const size_t max_ctx = (std::min)(nctx, size_t(_header->order - 1));
+
+  // longest n-gram (ctx[nctx - m + 1..], w) in the model.
+  const Entry *e = find(1, w);
+  float prob = e ? e->prob : _header->unk_prob;
+
+  size_t m = 1;
+  uint64_t key = w;
+  for (; m <= max_ctx; m++) {
+    key = combine(key, ctx[nctx - m]);
+    const Entry *e_ = find(uint32_t(m + 1), key);
+    if (!e_) {
+      break;
+    }
+    prob = e_->prob;
+  }
+
+  // back off through the histories longer than the matched one.
+  // history of length j = ctx[nctx - j..]
+  uint64_t hkey = 0;
+  for (size_t j = 1; j <= max_ctx; j++) {
+    hkey = (j == 1) ? ctx[nctx - 1] : combine(hkey, ctx[nctx - j]);
+    if (j < m) {
+      continue;
+    }
+    const Entry *h = find(uint32_t(j), hkey);
+    if (!h) {
+      break;
+    }
+    prob += h->backoff;
+  }
+
+  return prob;
+}
+
+float Model::score(const std::vector<std::string_view> &words, bool bos, bool eos) const {
+  if (!_header) {
+    return 0.0f;
+  }
+
+  // keep up to (order - 1) words of context.
+  uint64_t ctx[kMaxOrder * 2];
+  size_t nctx = 0;
+  const size_t max_ctx = _header->order - 1;
+
+  auto push = [&](uint64_t w) {
+    if (max_ctx == 0) {
+      return;
+    }
+    if (nctx == kMaxOrder * 2) {
+      memmove(ctx, ctx + (nctx - max_ctx), sizeof(uint64_t) * max_ctx);
+      nctx = max_ctx;
+    }
+    ctx[nctx++] = w;
+  };
+
+  if (bos) {
+    push(_bos);
+  }
+
+  float total = 0.0f;
+  for (const auto &word : words) {
+    uint64_t w = word_index(word);
+    total += score_word(ctx, nctx, w);
+    push(w);
+  }
+
+  if (eos) {
+    total += score_word(ctx, nctx, _eos);
+  }
+
+  return total;
+}
+
+} // namespace ngramlm
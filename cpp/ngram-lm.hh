@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: Apache 2.0
+//
+// Backoff n-gram language model scorer, compatible with KenLM's
+// `Model.score(sentence, bos=True, eos=True)` for ARPA models.
+//
+// ARPA files are compiled once into a probing hash table file
+// (`<model>.arpa.probing`) which is then mmap'ed and shared by all threads.
+//
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ngramlm {
+
+constexpr uint32_t kMaxOrder = 8;
+
+// Probing table entry. key == 0 means empty slot.
+struct Entry {
+  uint64_t key;
+  float prob;     // log10
+  float backoff;  // log10
+};
+
+struct ProbingHeader {
+  char magic[8];  // "NGLMPRB\0"
+  uint32_t version;
+  uint32_t order;
+  uint64_t counts[kMaxOrder];     // # of n-grams per order
+  uint64_t capacity[kMaxOrder];   // # of slots per order(power of 2)
+  uint64_t source_size;           // ARPA file size
+  int64_t source_mtime;           // ARPA file mtime
+  float unk_prob;
+  uint32_t pad;
+};
+
+class Model {
+ public:
+  Model() = default;
+  ~Model();
+  Model(const Model &) = delete;
+  Model &operator=(const Model &) = delete;
+
+  ///
+  /// Load model.
+  ///
+  /// `filename` is an ARPA file or a compiled probing file(*.probing).
+  /// For ARPA, `<filename>.probing` is used when it is up to date, and
+  /// compiled otherwise.
+  ///
+  bool load(const std::string &filename);
+
+  ///
+  /// Compile ARPA file into probing table file `out_filename`.
+  /// The file is written to a temporary file then renamed.
+  ///
+  static bool compile_arpa(const std::string &arpa_filename, const std::string &out_filename);
+
+  uint32_t order() const { return _header ? _header->order : 0; }
+
+  ///
+  /// log10 probability of the sentence(space-separated words are given as
+  /// `words`). Same as KenLM's Model.score(sentence, bos, eos).
+  ///
+  float score(const std::vector<std::string_view> &words, bool bos = true, bool eos = true) const;
+
+  ///
+  /// Word hash, or the hash of <unk> for out-of-vocabulary words.
+  ///
+  uint64_t word_index(std::string_view word) const;
+
+  ///
+  /// log10 p(w | ctx). `ctx` is ordered oldest to newest.
+  ///
+  float score_word(const uint64_t *ctx, size_t nctx, uint64_t w) const;
+
+ private:
+  const Entry *find(uint32_t n, uint64_t key) const;
+
+  void *_addr{nullptr};
+  size_t _nbytes{0};
+  const ProbingHeader *_header{nullptr};
+  const Entry *_tables[kMaxOrder]{};
+  uint64_t _bos{0};
+  uint64_t _eos{0};
+  uint64_t _unk{0};
+};
+
+///
+/// Perplexity as in 04_lm_scoring/scoring_task.py: 10^(-log_score / length)
+/// where length counts (# of words + 1) per sentence(for </s>).
+///
+inline double perplexity(double log_score, uint64_t length) {
+  return std::pow(10.0, -log_score / double(length));
+}
+
+} // namespace ngramlm
@@ -0,0 +1,290 @@
+// SPDX-License-Identifier: Apache 2.0
+
+#include "parquet-sink.hh"
+
+#include <unordered_map>
+#include <vector>
+
+#include "simdjson.h"
+#include "stage-stats.hh"
+#include "./zstd.h"
+
+#define MINPQ_NO_GZIP
+#include "../sandbox/parquet/minparquet_writer.h"
+
+namespace pqsink {
+
+namespace {
+
+enum class Kind { Null, Bool, Int, Double, String, Json };
+
+struct Column
+{
+  std::string name;
+  Kind kind{Kind::Null};
+  bool large{false};  // has integer >= 2^63
+};
+
+Kind value_kind(simdjson::ondemand::value &v, bool &large) {
+  simdjson::ondemand::json_type t;
+  if (v.type().get(t)) {
+    return Kind::Json;
+  }
+  switch (t) {
+    case simdjson::ondemand::json_type::null: return Kind::Null;
+    case simdjson::ondemand::json_type::boolean: return Kind::Bool;
+    case simdjson::ondemand::json_type::string: return Kind::String;
+    case simdjson::ondemand::json_type::number: {
+      simdjson::ondemand::number_type nt;
+      if (v.get_number_type().get(nt)) {
+        return Kind::Json;
+      }
+      if (nt == simdjson::ondemand::number_type::signed_integer) {
+        return Kind::Int;
+      } else if (nt == simdjson::ondemand::number_type::unsigned_integer) {
+        large = true;
+        return Kind::Int;
+      } else if (nt == simdjson::ondemand::number_type::floating_point_number) {
+        return Kind::Double;
+      }
+      return Kind::Json;  // big integer
+    }
+    default: return Kind::Json;  // object, array
+  }
+}
+
+Kind merge_kind(Kind a, Kind b) {
+  if (a == Kind::Null) return b;
+  if (b == Kind::Null || a == b) return a;
+  if ((a == Kind::Int && b == Kind::Double) || (a == Kind::Double && b == Kind::Int)) return Kind::Double;
+  return Kind::Json;
+}
+
+// Raw JSON text of `v`(object/array: whole value, others: the token).
+bool raw_json(simdjson::ondemand::value &v, std::string_view &raw) {
+  simdjson::ondemand::json_type t;
+  if (v.type().get(t)) {
+    return false;
+  }
+  if (t == simdjson::ondemand::json_type::object) {
+    simdjson::ondemand::object obj;
+    return !v.get_object().get(obj) && !obj.raw_json().get(raw);
+  } else if (t == simdjson::ondemand::json_type::array) {
+    simdjson::ondemand::array arr;
+    return !v.get_array().get(arr) && !arr.raw_json().get(raw);
+  }
+  raw = v.raw_json_token();
+  while (!raw.empty() && (raw.back() == ' ' || raw.back() == '\t' || raw.back() == '\r')) {
+    raw.remove_suffix(1);
+  }
+  return true;
+}
+
+bool write_value(minpq::ParquetWriter &writer, size_t col, const Column &c, simdjson::ondemand::value &v) {
+  bool large = false;
+  if (value_kind(v, large) == Kind::Null) {
+    return writer.write_null(col);
+  }
+
+  switch (c.kind) {
+    case Kind::Bool: {
+      bool b;
+      return !v.get_bool().get(b) && writer.write_bool(col, b);
+    }
+    case Kind::Int: {
+      if (c.large) {
+        uint64_t u;
+        return !v.get_uint64().get(u) && writer.write_int64(col, int64_t(u));
+      }
+      int64_t i;
+      return !v.get_int64().get(i) && writer.write_int64(col, i);
+    }
+    case Kind::Double: {
+      double d;
+      return !v.get_double().get(d) && writer.write_double(col, d);
+    }
+    case Kind::String: {
+      std::string_view s;
+      return !v.get_string().get(s) && writer.write_string(col, s);
+    }
+    default: {
+      std::string_view raw;
+      return raw_json(v, raw) && writer.write_string(col, raw);
+    }
+  }
+}
+
+} // namespace
+
+std::string replace_ext(const std::string &jsonl_filename) {
+  std::string s = jsonl_filename;
+  for (const char *ext : {".zstd", ".zst", ".jsonl"}) {
+    const std::string e(ext);
+    if ((s.size() >= e.size()) && (s.compare(s.size() - e.size(), e.size(), e) == 0)) {
+      s.resize(s.size() - e.size());
+    }
+  }
+  return s + kExt;
+}
+
+bool write_jsonl(std::string &jsonl, const std::string &filename, const Options &options,
+                 std::string *err) {
+  stagestats::ScopedTimer timer(stagestats::Stage::Serialize);
+
+  const size_t data_size = jsonl.size();
+  stagestats::add_bytes(stagestats::Stage::Serialize, data_size, 0);
+  jsonl.append(simdjson::SIMDJSON_PADDING, ' ');
+
+  // lines(offset, length). Empty lines are skipped.
+  std::vector<std::pair<size_t, size_t>> lines;
+  for (size_t s = 0; s < data_size;) {
+    size_t e = jsonl.find('\n', s);
+    if ((e == std::string::npos) || (e > data_size)) {
+      e = data_size;
+    }
+    if (e > s) {
+      lines.emplace_back(s, e - s);
+    }
+    s = e + 1;
+  }
+
+  simdjson::ondemand::parser parser;
+  simdjson::ondemand::document doc;
+  simdjson::ondemand::object obj;
+
+  auto iterate = [&](size_t k) -> bool {
+    const size_t offset = lines[k].first;
+    if (parser.iterate(jsonl.data() + offset, lines[k].second, jsonl.size() - offset).get(doc) ||
+        doc.get_object().get(obj)) {
+      if (err) {
+        (*err) += "Invalid JSON object at line " + std::to_string(k) + "\n";
+      }
+      return false;
+    }
+    return true;
+  };
+
+  stagestats::add_records(stagestats::Stage::Serialize, lines.size());
+
+  // Pass 1: schema
+  std::vector<Column> columns;
+  std::unordered_map<std::string, size_t> column_index;
+  for (size_t k = 0; k < lines.size(); k++) {
+    if (!iterate(k)) {
+      return false;
+    }
+    for (auto field : obj) {
+      std::string_view key;
+      simdjson::ondemand::value v;
+      if (field.unescaped_key().get(key) || field.value().get(v)) {
+        if (err) {
+          (*err) += "Invalid JSON field at line " + std::to_string(k) + "\n";
+        }
+        return false;
+      }
+      auto it = column_index.find(std::string(key));
+      if (it == column_index.end()) {
+        it = column_index.emplace(std::string(key), columns.size()).first;
+        columns.push_back(Column{std::string(key)});
+      }
+      bool large = false;
+      Kind kind = value_kind(v, large);
+      Column &c = columns[it->second];
+      c.kind = merge_kind(c.kind, kind);
+      c.large |= large;
+    }
+  }
+
+  std::vector<minpq::ColumnSpec> schema;
+  for (const auto &c : columns) {
+    minpq::ColumnSpec spec;
+    spec.name = c.name;
+    switch (c.kind) {
+      case Kind::Bool: spec.type = minpq::Type::BOOLEAN; break;
+      case Kind::Int:
+        spec.type = minpq::Type::INT64;
+        if (c.large) {
+          spec.converted_type = minpq::ConvertedType::UINT_64;
+        }
+        break;
+      case Kind::Double: spec.type = minpq::Type::DOUBLE; break;
+      case Kind::Json:
+        spec.type = minpq::Type::BYTE_ARRAY;
+        spec.converted_type = minpq::ConvertedType::JSON;
+        break;
+      default:  // string or all null
+        spec.type = minpq::Type::BYTE_ARRAY;
+        spec.converted_type = minpq::ConvertedType::UTF8;
+        break;
+    }
+    schema.push_back(spec);
+  }
+  if (schema.empty()) {
+    // No documents(or no keys): a single all-null column keeps the file valid.
+    schema.push_back({"text", minpq::Type::BYTE_ARRAY, true, minpq::ConvertedType::UTF8});
+  }
+
+  minpq::WriterOptions wopts;
+  wopts.row_group_size = size_t(options.row_group_size);
+  wopts.compression_level = options.comp_level;
+  wopts.dictionary = options.dictionary;
+  wopts.created_by = "cpp_proc";
+
+  minpq::ParquetWriter writer;
+  if (!writer.open(filename, schema, wopts)) {
+    if (err) {
+      (*err) += writer.error() + "\n";
+    }
+    return false;
+  }
+
+  // Pass 2: values
+  std::vector<uint8_t> seen(schema.size());
+  for (size_t k = 0; k < lines.size(); k++) {
+    if (!iterate(k)) {
+      return false;
+    }
+    std::fill(seen.begin(), seen.end(), 0);
+    for (auto field : obj) {
+      std::string_view key;
+      simdjson::ondemand::value v;
+      if (field.unescaped_key().get(key) || field.value().get(v)) {
+        return false;
+      }
+      size_t col = column_index[std::string(key)];
+      if (seen[col]) {
+        continue;  // duplicated key: first one wins.
+      }
+      seen[col] = 1;
+      if (!write_value(writer, col, columns[col], v)) {
+        if (err) {
+          (*err) += "Failed to write `" + columns[col].name + "` at line " + std::to_string(k) + ": " +
+                    writer.error() + "\n";
+        }
+        return false;
+      }
+    }
+    for (size_t col = 0; col < seen.size(); col++) {
+      if (!seen[col] && !writer.write_null(col)) {
+        return false;
+      }
+    }
+    if (!writer.end_row()) {
+      if (err) {
+        (*err) += writer.error() + "\n";
+      }
+      return false;
+    }
+  }
+
+  if (!writer.close()) {
+    if (err) {
+      (*err) += writer.error() + "\n";
+    }
+    return false;
+  }
+
+  return true;
+}
+
+} // namespace pqsink
@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: Apache 2.0
+//
+// Parquet output for the C++ stages(beauty bins, dedup results).
+//
+// A block of JSONL lines is written as one Parquet file with
+// sandbox/parquet/minparquet_writer.h. Columns are the top-level keys of the
+// documents(in order of first appearance) and their types are inferred from
+// the values:
+//
+//   string -> BYTE_ARRAY(UTF8), integer -> INT64(UINT_64 for values >= 2^63),
+//   float(or float + integer) -> DOUBLE, bool -> BOOLEAN,
+//   object/array/mixed types -> BYTE_ARRAY(JSON) with the raw JSON text.
+//
+// Missing keys and `null` are stored as null. Pages are dictionary encoded
+// when values repeat and compressed with zstd.
+//
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace pqsink {
+
+constexpr const char *kExt = ".parquet";
+
+struct Options
+{
+  uint64_t row_group_size{128 * 1024};  // rows per row group
+  int comp_level{3};                    // zstd level of pages
+  bool dictionary{true};
+};
+
+///
+/// `<stem>.parquet` for a JSONL filename(strips .zst/.zstd and .jsonl)
+///
+std::string replace_ext(const std::string &jsonl_filename);
+
+///
+/// Write JSONL lines in `jsonl`('\n' separated) to Parquet file `filename`.
+/// SIMDJSON_PADDING bytes are appended to `jsonl`.
+///
+bool write_jsonl(std::string &jsonl, const std::string &filename, const Options &options,
+                 std::string *err);
+
+} // namespace pqsink
@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: Apache 2.0
+
+#include "parquet-source.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include "./zstd.h"
+#include "stage-stats.hh"
+#include "task-pool.hh"
+
+// HF datasets use snappy or zstd.
+#define MINPQ_NO_GZIP
+#include "../sandbox/parquet/minparquet.h"
+
+namespace pqsource {
+
+namespace {
+
+// Name of the first codec of column `col` which minparquet is built without
+// (GZIP, see MINPQ_NO_GZIP above), or nullptr. Without this check such
+// chunks only fail with a generic "Decompression failed".
+const char *unsupported_codec(const minpq::ParquetReader &reader, size_t col) {
+  const minpq::FileMetaData *meta = reader.metadata();
+  if (!meta) {
+    return nullptr;
+  }
+  for (const auto &rg : meta->row_groups) {
+    if ((col < rg.columns.size()) && rg.columns[col].meta_data &&
+        (rg.columns[col].meta_data->codec == minpq::CompressionCodec::GZIP)) {
+      return "GZIP";
+    }
+  }
+  return nullptr;
+}
+
+} // namespace
+
+bool load_text_column(const std::string &filename, const std::string &text_key, TextColumn &dst,
+                      std::string *err) {
+  minpq::ParquetReader reader;
+  if (!reader.open(filename)) {
+    if (err) {
+      (*err) += reader.error() + "\n";
+    }
+    return false;
+  }
+
+  int64_t text_col = reader.find_column(text_key);
+  if ((text_col < 0) || (reader.column_type(size_t(text_col)) != minpq::Type::BYTE_ARRAY)) {
+    if (err) {
+      (*err) += "BYTE_ARRAY column `" + text_key + "` not found: " + filename + "\n";
+    }
+    return false;
+  }
+
+  int64_t id_col = reader.find_column("doc_id");
+  if ((id_col >= 0) && (reader.column_type(size_t(id_col)) != minpq::Type::INT64)) {
+    id_col = -1;
+  }
+
+  for (const int64_t col : {text_col, id_col}) {
+    if (col < 0) {
+      continue;
+    }
+    if (const char *codec = unsupported_codec(reader, size_t(col))) {
+      if (err) {
+        const std::string name(reader.column_name(size_t(col)));
+        (*err) += std::string(codec) + " codec not supported(column `" + name + "`): " + filename + "\n";
+      }
+      return false;
+    }
+  }
+
+  const size_t n_groups = reader.num_row_groups();
+
+  // row offset of each row group.
+  std::vector<size_t> row_begin(n_groups + 1, 0);
+  for (size_t g = 0; g < n_groups; g++) {
+    row_begin[g + 1] = row_begin[g] + size_t(reader.num_rows_in_group(g));
+  }
+  const size_t n_rows = row_begin[n_groups];
+
+  dst.rows.assign(n_rows, std::string_view());
+  dst.ids.assign((id_col >= 0) ? n_rows : 0, 0);
+  dst.chunks.assign(n_groups, std::vector<uint8_t>());
+
+  std::vector<std::string> group_errors(n_groups);
+  std::atomic<bool> has_ids(id_col >= 0);
+
+  taskpool::parallel_for(n_groups, [&](uint64_t begin, uint64_t end, uint32_t) {
+    stagestats::ScopedTimer timer(stagestats::Stage::Read);
+    stagestats::add_records(stagestats::Stage::Read, row_begin[end] - row_begin[begin]);
+
+    for (uint64_t g = begin; g < end; g++) {
+      const size_t num_rows = row_begin[g + 1] - row_begin[g];
+
+      std::optional<minpq::ByteArrayColumn> text =
+          reader.read_byte_array_column(g, size_t(text_col), group_errors[g]);
+      if (!text) {
+        continue;
+      }
+      if (text->size() != num_rows) {
+        group_errors[g] = "# of values mismatch";
+        continue;
+      }
+      for (size_t r = 0; r < num_rows; r++) {
+        dst.rows[row_begin[g] + r] = text->value(r);
+      }
+      stagestats::add_bytes(stagestats::Stage::Read, 0, text->data.size());
+      stagestats::add_alloc(stagestats::Stage::Read, text->data.capacity());
+      dst.chunks[g] = std::move(text->data);  // views stay valid(heap buffer is moved)
+
+      if (!has_ids) {
+        continue;
+      }
+      std::string id_err;
+      std::optional<minpq::ColumnData> ids = reader.read_column(g, size_t(id_col), id_err);
+      bool has_null = ids && std::count(ids->def_levels.begin(), ids->def_levels.end(), int16_t(0));
+      if (!ids || has_null || (ids->data.size() != num_rows * sizeof(uint64_t))) {
+        has_ids = false;
+        continue;
+      }
+      memcpy(dst.ids.data() + row_begin[g], ids->data.data(), ids->data.size());
+    }
+  });
+
+  for (size_t g = 0; g < n_groups; g++) {
+    if (!group_errors[g].empty()) {
+      if (err) {
+        (*err) += filename + ": row group " + std::to_string(g) + ": " + group_errors[g] + "\n";
+      }
+      return false;
+    }
+  }
+
+  if (!has_ids) {
+    dst.ids.clear();
+  }
+
+  return true;
+}
+
+} // namespace pqsource
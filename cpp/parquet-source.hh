@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: Apache 2.0
+//
+// Parquet record source(HF datasets) for the C++ stages.
+//
+// Only the text column(and `doc_id`, when present) is decoded with
+// sandbox/parquet/minparquet.h, one row group per task. Texts of a row group
+// are decoded into one contiguous buffer(minpq::ByteArrayColumn) and rows are
+// handed out as string_views into it, so no Parquet -> JSONL.zst conversion
+// pass(and no per-document std::string) is needed.
+//
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace pqsource {
+
+constexpr const char *kExt = ".parquet";
+
+inline bool is_parquet(const std::string &filename) {
+  const std::string ext(kExt);
+  return (filename.size() >= ext.size()) &&
+         (filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0);
+}
+
+struct TextColumn
+{
+  std::vector<std::string_view> rows;  // text of row i. null => empty.
+  std::vector<uint64_t> ids;           // `doc_id` column, or empty when absent.
+
+  // decoded column chunks(one per row group). `rows` points into these.
+  std::vector<std::vector<uint8_t>> chunks;
+};
+
+///
+/// Read column `text_key` of Parquet file `filename` into `dst`.
+/// Row groups are decoded in parallel on the task pool(task-pool.hh).
+///
+bool load_text_column(const std::string &filename, const std::string &text_key, TextColumn &dst,
+                      std::string *err);
+
+} // namespace pqsource
@@ -0,0 +1,195 @@
+// SPDX-License-Identifier: Apache 2.0
+//
+// KLL streaming quantile sketch.
+//
+// Karnin, Lang, Liberty. "Optimal Quantile Approximation in Streams", 2016.
+// Memory is O(k log(n / k)) regardless of the number of inserted values.
+// Rank error is about 1.65 / k(k = 200: ~1%) with high probability.
+//
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace quantile {
+
+class KLLSketch {
+ public:
+  ///
+  /// @param[in] k Accuracy parameter(size of the top level compactor)
+  /// @param[in] seed Seed for compaction coin flips(deterministic output for
+  /// the same input order).
+  ///
+  explicit KLLSketch(uint32_t k = 200, uint64_t seed = 0x9e3779b97f4a7c15ull)
+      : _k(k), _rng(seed ? seed : 1) {
+    _levels.emplace_back();
+  }
+
+  void insert(double x) {
+    _levels[0].push_back(x);
+    _n++;
+    _size++;
+    if (_size >= _max_size) {
+      compress();
+    }
+    _min = std::min(_min, x);
+    _max = std::max(_max, x);
+  }
+
+  ///
+  /// Merge other sketch(e.g. from other threads).
+  ///
+  void merge(const KLLSketch &other) {
+    while (_levels.size() < other._levels.size()) {
+      _levels.emplace_back();
+    }
+    for (size_t h = 0; h < other._levels.size(); h++) {
+      _levels[h].insert(_levels[h].end(), other._levels[h].begin(), other._levels[h].end());
+    }
+    _n += other._n;
+    _min = std::min(_min, other._min);
+    _max = std::max(_max, other._max);
+    update_size();
+    while (_size >= _max_size) {
+      compress();
+    }
+  }
+
+  uint64_t count() const { return _n; }
+  double min() const { return _min; }
+  double max() const { return _max; }
+
+  ///
+  /// Approximate q-quantile(0 <= q <= 1).
+  /// q = 0 and q = 1 return the exact min and max.
+  ///
+  double quantile(double q) const {
+    std::vector<double> qs{q};
+    return quantiles(qs)[0];
+  }
+
+  ///
+  /// Approximate quantiles for sorted `qs`.
+  ///
+  std::vector<double> quantiles(const std::vector<double> &qs) const {
+    std::vector<double> ret(qs.size(), 0.0);
+    if (_n == 0) {
+      return ret;
+    }
+
+    // (value, weight)
+    std::vector<std::pair<double, uint64_t>> items;
+    items.reserve(_size);
+    for (size_t h = 0; h < _levels.size(); h++) {
+      for (double v : _levels[h]) {
+        items.emplace_back(v, uint64_t(1) << h);
+      }
+    }
+    std::sort(items.begin(), items.end());
+
+    uint64_t total = 0;
+    for (const auto &it : items) {
+      total += it.second;
+    }
+
+    size_t idx = 0;
+    uint64_t cum = 0;
+    for (size_t i = 0; i < qs.size(); i++) {
+      if (qs[i] <= 0.0) {
+        ret[i] = _min;
+        continue;
+      }
+      if (qs[i] >= 1.0) {
+        ret[i] = _max;
+        continue;
+      }
+      const double target = qs[i] * double(total);
+      while ((idx < items.size()) && (double(cum + items[idx].second) < target)) {
+        cum += items[idx].second;
+        idx++;
+      }
+      ret[i] = items[std::min(idx, items.size() - 1)].first;
+    }
+
+    return ret;
+  }
+
+ private:
+  uint32_t capacity(size_t h) const {
+    // k * (2/3)^(depth), at least 2.
+    const size_t depth = _levels.size() - h - 1;
+    return std::max(2u, uint32_t(std::ceil(double(_k) * std::pow(2.0 / 3.0, double(depth)))));
+  }
+
+  void update_size() {
+    _size = 0;
+    _max_size = 0;
+    for (size_t h = 0; h < _levels.size(); h++) {
+      _size += _levels[h].size();
+      _max_size += capacity(h);
+    }
+  }
+
+  uint64_t next_random() {
+    // xorshift64
+    _rng ^= _rng << 13;
+    _rng ^= _rng >> 7;
+    _rng ^= _rng << 17;
+    return _rng;
+  }
+
+  void compress() {
+    for (size_t h = 0; h < _levels.size(); h++) {
+      if (_levels[h].size() < capacity(h)) {
+        continue;
+      }
+
+      if (h + 1 >= _levels.size()) {
+        _levels.emplace_back();
+      }
+
+      std::vector<double> &cur = _levels[h];
+      std::sort(cur.begin(), cur.end());
+
+      // keep one item when the size is odd.
+      double leftover = 0.0;
+      const bool odd = (cur.size() % 2) == 1;
+      if (odd) {
+        leftover = cur.back();
+        cur.pop_back();
+      }
+
+      // promote every other item(random offset) with doubled weight.
+      const size_t offset = size_t(next_random() & 1);
+      std::vector<double> &up = _levels[h + 1];
+      for (size_t i = offset; i < cur.size(); i += 2) {
+        up.push_back(cur[i]);
+      }
+
+      cur.clear();
+      if (odd) {
+        cur.push_back(leftover);
+      }
+
+      update_size();
+      if (_size < _max_size) {
+        break;
+      }
+    }
+  }
+
+  uint32_t _k;
+  uint64_t _rng;
+  uint64_t _n{0};
+  size_t _size{0};
+  size_t _max_size{0};
+  double _min{std::numeric_limits<double>::infinity()};
+  double _max{-std::numeric_limits<double>::infinity()};
+  std::vector<std::vector<double>> _levels;
+};
+
+} // namespace quantile
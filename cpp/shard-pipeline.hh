@@ -0,0 +1,142 @@
+// SPDX-License-Identifier: Apache 2.0
+//
+// Bounded load -> process -> store pipeline over the shards(files) of a stage.
+//
+// `load`(read + decompress + decode) of the next `prefetch` shards and
+// `store`(encode + compress + write) of up to `write_behind` finished shards
+// run as tasks on the task pool(task-pool.hh) while the calling thread
+// processes shards in order. `process` may use taskpool::parallel_for(), and
+// the calling thread runs load/store tasks while it waits, so I/O of shard
+// k + 1 overlaps compute of shard k.
+//
+// Backpressure: no shard is prefetched while the loaded shards hold more than
+// `mem_budget` bytes(as reported by `load`). The shard to process next is
+// always loaded, so the pipeline makes progress with any budget.
+//
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+
+#include "task-pool.hh"
+
+namespace shardpipe {
+
+struct Config
+{
+  uint32_t prefetch{2};      // # of shards loaded ahead of the one being processed
+  uint32_t write_behind{2};  // # of processed shards being stored concurrently(>= 1)
+  uint64_t mem_budget{0};    // bytes of loaded shards in flight. 0 = unlimited
+};
+
+template<typename Shard>
+struct Stages
+{
+  ///
+  /// Load shard `idx` into `shard`. Runs as a task(concurrently with the
+  /// other stages). Set `bytes` to the memory held by the shard.
+  ///
+  std::function<bool(size_t idx, Shard &shard, uint64_t &bytes)> load;
+
+  ///
+  /// Process shard `idx` on the calling thread. Called in shard order.
+  ///
+  std::function<bool(size_t idx, Shard &shard)> process;
+
+  ///
+  /// Store shard `idx`. Runs as a task. `shard` is released afterwards.
+  ///
+  std::function<bool(size_t idx, Shard &shard)> store;
+};
+
+///
+/// Run `stages` over shards [0, n). Stops at the first failure and returns false.
+///
+template<typename Shard>
+bool run(size_t n, const Config &config, const Stages<Shard> &stages) {
+  struct Slot
+  {
+    Shard shard;
+    uint64_t bytes{0};
+    bool ok{true};
+    enki::TaskSet load;
+    enki::TaskSet store;
+  };
+
+  enki::TaskScheduler &ts = taskpool::scheduler();
+
+  std::deque<std::unique_ptr<Slot>> loading;  // in shard order. front = next to process
+  std::deque<std::unique_ptr<Slot>> storing;
+  std::atomic<uint64_t> loaded_bytes(0);
+  size_t next_load = 0;
+  bool ok = true;
+
+  auto launch_load = [&]() {
+    const size_t idx = next_load++;
+    loading.emplace_back(new Slot());
+    Slot *slot = loading.back().get();
+    slot->load.m_Function = [slot, idx, &stages, &loaded_bytes](enki::TaskSetPartition, uint32_t) {
+      slot->ok = stages.load(idx, slot->shard, slot->bytes);
+      loaded_bytes += slot->bytes;
+    };
+    ts.AddTaskSetToPipe(&slot->load);
+  };
+
+  auto wait_store = [&]() {
+    Slot &slot = *storing.front();
+    ts.WaitforTask(&slot.store);
+    ok &= slot.ok;
+    storing.pop_front();
+  };
+
+  const size_t write_behind = (std::max)(1u, config.write_behind);
+
+  for (size_t idx = 0; (idx < n) && ok; idx++) {
+    // prefetch
+    while ((next_load < n) && (next_load <= idx + config.prefetch)) {
+      if ((next_load > idx) && config.mem_budget && (loaded_bytes >= config.mem_budget)) {
+        break;
+      }
+      launch_load();
+    }
+
+    std::unique_ptr<Slot> slot = std::move(loading.front());
+    loading.pop_front();
+    ts.WaitforTask(&slot->load);
+
+    if (!slot->ok || !stages.process(idx, slot->shard)) {
+      loaded_bytes -= slot->bytes;
+      ok = false;
+      break;
+    }
+
+    // write-behind
+    while (storing.size() >= write_behind) {
+      wait_store();
+    }
+    Slot *s = slot.get();
+    s->store.m_Function = [s, idx, &stages, &loaded_bytes](enki::TaskSetPartition, uint32_t) {
+      s->ok = stages.store(idx, s->shard);
+      s->shard = Shard();
+      loaded_bytes -= s->bytes;
+    };
+    ts.AddTaskSetToPipe(&s->store);
+    storing.push_back(std::move(slot));
+  }
+
+  // prefetched shards after a failure
+  for (auto &slot : loading) {
+    ts.WaitforTask(&slot->load);
+  }
+  while (!storing.empty()) {
+    wait_store();
+  }
+
+  return ok;
+}
+
+} // namespace shardpipe
@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: Apache 2.0
+
+#include "sidecar.hh"
+
+#include <algorithm>
+#include <cstring>
+
+#include "stage-stats.hh"
+
+namespace sidecar {
+
+std::string filename(const std::string &basedir, const std::string &shard_filename,
+                     const std::string &stage) {
+  std::string dst = basedir;
+  if (!dst.empty() && (dst.back() != '/')) {
+    dst += "/";
+  }
+  return dst + shard_filename + "." + stage + kExt;
+}
+
+bool Writer::save(const std::string &filename, std::string *err) const {
+  stagestats::ScopedTimer timer(stagestats::Stage::Write);
+
+  std::vector<size_t> order(_columns.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+    return _columns[a].elem_bytes > _columns[b].elem_bytes;
+  });
+
+  safetensors::safetensors_t st;
+
+  size_t total = 0;
+  for (const Column &col : _columns) {
+    total += col.data.size();
+  }
+  st.storage.resize(total);
+
+  size_t offset = 0;
+  for (size_t i : order) {
+    const Column &col = _columns[i];
+
+    safetensors::tensor_t tensor;
+    tensor.dtype = col.dtype;
+    tensor.data_offsets[0] = offset;
+    tensor.data_offsets[1] = offset + col.data.size();
+    tensor.shape.push_back(size_t(_n_rows));
+    if (col.width != 1) {
+      tensor.shape.push_back(col.width);
+    }
+
+    if (col.data.size()) {
+      memcpy(st.storage.data() + offset, col.data.data(), col.data.size());
+    }
+    offset += col.data.size();
+
+    st.tensors.insert(col.name, tensor);
+  }
+
+  st.metadata.insert("n_rows", std::to_string(_n_rows));
+  for (const auto &kv : _metadata) {
+    st.metadata.insert(kv.first, kv.second);
+  }
+
+  stagestats::add_bytes(stagestats::Stage::Write, total, total);
+  stagestats::add_records(stagestats::Stage::Write, _n_rows);
+
+  std::string warn;
+  return safetensors::save_to_file(st, filename, &warn, err);
+}
+
+bool Reader::open(const std::string &filename, std::string *err) {
+  std::string warn;
+  if (!safetensors::mmap_from_file(filename, &_st, &warn, err)) {
+    return false;
+  }
+
+  std::string n_rows;
+  if (!_st.metadata.at("n_rows", &n_rows)) {
+    if (err) {
+      (*err) += "`n_rows` not found in metadata: " + filename + "\n";
+    }
+    return false;
+  }
+  _n_rows = uint64_t(std::stoull(n_rows));
+
+  return true;
+}
+
+std::string Reader::metadata(const std::string &key) const {
+  std::string value;
+  _st.metadata.at(key, &value);
+  return value;
+}
+
+const uint8_t *Reader::column_ptr(const std::string &name, safetensors::dtype dtype, size_t *width) const {
+  safetensors::tensor_t tensor;
+  if (!_st.tensors.at(name, &tensor) || (tensor.dtype != dtype) || tensor.shape.empty() ||
+      (tensor.shape[0] != _n_rows)) {
+    return nullptr;
+  }
+
+  if (width) {
+    (*width) = (tensor.shape.size() > 1) ? tensor.shape[1] : 1;
+  }
+
+  const uint8_t *base = _st.mmaped ? _st.databuffer_addr : _st.storage.data();
+  return base + tensor.data_offsets[0];
+}
+
+} // namespace sidecar
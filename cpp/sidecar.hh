@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: Apache 2.0
+//
+// Columnar side-car files.
+//
+// A stage writes only the columns it computes(minhashes, duplicate flags,
+// lm_score, ...) to `<shard filename>.<stage>.safetensors` next to its
+// output, instead of re-serializing the whole JSONL shard. Row i of every
+// column is the i-th document(line) of the source shard. Each column is a
+// safetensors tensor of shape [n_rows] or [n_rows, width]. `doc_id` is
+// stored as a uint64 column when the source documents have one.
+//
+// Files are mmap'ed on read.
+//
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "safetensors.hh"
+
+namespace sidecar {
+
+constexpr const char *kExt = ".safetensors";
+
+///
+/// `<basedir>/<shard_filename>.<stage>.safetensors`
+///
+std::string filename(const std::string &basedir, const std::string &shard_filename,
+                     const std::string &stage);
+
+template <typename T>
+struct DTypeTraits;
+
+template <>
+struct DTypeTraits<uint8_t> {
+  static constexpr safetensors::dtype value = safetensors::dtype::kUINT8;
+};
+template <>
+struct DTypeTraits<uint32_t> {
+  static constexpr safetensors::dtype value = safetensors::dtype::kUINT32;
+};
+template <>
+struct DTypeTraits<uint64_t> {
+  static constexpr safetensors::dtype value = safetensors::dtype::kUINT64;
+};
+template <>
+struct DTypeTraits<float> {
+  static constexpr safetensors::dtype value = safetensors::dtype::kFLOAT32;
+};
+template <>
+struct DTypeTraits<double> {
+  static constexpr safetensors::dtype value = safetensors::dtype::kFLOAT64;
+};
+
+class Writer {
+ public:
+  explicit Writer(uint64_t n_rows) : _n_rows(n_rows) {}
+
+  ///
+  /// Add column `name` of `n_rows * width` values(row major).
+  ///
+  template <typename T>
+  void add(const std::string &name, const T *values, size_t width = 1) {
+    Column col;
+    col.name = name;
+    col.dtype = DTypeTraits<T>::value;
+    col.elem_bytes = sizeof(T);
+    col.width = width;
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(values);
+    col.data.assign(p, p + _n_rows * width * sizeof(T));
+    _columns.push_back(std::move(col));
+  }
+
+  void set_metadata(const std::string &key, const std::string &value) {
+    _metadata.emplace_back(key, value);
+  }
+
+  ///
+  /// Write safetensors file. Columns are laid out by element size(largest
+  /// first) so every column is naturally aligned.
+  ///
+  bool save(const std::string &filename, std::string *err) const;
+
+ private:
+  struct Column {
+    std::string name;
+    safetensors::dtype dtype;
+    size_t elem_bytes;
+    size_t width;
+    std::vector<uint8_t> data;
+  };
+
+  uint64_t _n_rows;
+  std::vector<Column> _columns;
+  std::vector<std::pair<std::string, std::string>> _metadata;
+};
+
+class Reader {
+ public:
+  ///
+  /// mmap side-car file.
+  ///
+  bool open(const std::string &filename, std::string *err);
+
+  uint64_t num_rows() const { return _n_rows; }
+
+  bool has(const std::string &name) const { return _st.tensors.count(name); }
+
+  ///
+  /// Pointer to column `name`(row major), or nullptr when the column does
+  /// not exist or its dtype is not T. `width` receives the # of values per
+  /// row.
+  ///
+  template <typename T>
+  const T *column(const std::string &name, size_t *width = nullptr) const {
+    return reinterpret_cast<const T *>(column_ptr(name, DTypeTraits<T>::value, width));
+  }
+
+  ///
+  /// Metadata value, or empty string.
+  ///
+  std::string metadata(const std::string &key) const;
+
+ private:
+  const uint8_t *column_ptr(const std::string &name, safetensors::dtype dtype, size_t *width) const;
+
+  safetensors::safetensors_t _st;
+  uint64_t _n_rows{0};
+};
+
+} // namespace sidecar
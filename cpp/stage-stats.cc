@@ -0,0 +1,243 @@
+// SPDX-License-Identifier: Apache 2.0
+
+#include "stage-stats.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+namespace stagestats {
+
+namespace {
+
+constexpr size_t kNumStages = size_t(Stage::Count);
+constexpr size_t kNumThreadTimes = size_t(ThreadTime::Count);
+constexpr uint32_t kMaxThreads = 256;
+
+struct Counters
+{
+  std::atomic<uint64_t> ns{0};
+  std::atomic<uint64_t> calls{0};
+  std::atomic<uint64_t> bytes_in{0};
+  std::atomic<uint64_t> bytes_out{0};
+  std::atomic<uint64_t> records{0};
+  std::atomic<uint64_t> drops{0};
+  std::atomic<uint64_t> alloc_bytes{0};
+};
+
+Counters g_stages[kNumStages];
+std::atomic<uint64_t> g_thread_ns[kMaxThreads][kNumThreadTimes];
+std::atomic<uint32_t> g_num_threads{0};
+
+std::mutex g_run_mutex;
+std::string g_command;
+uint64_t g_start_ns = now_ns();
+std::string g_exit_filename;
+
+inline void add(std::atomic<uint64_t> &counter, uint64_t v) {
+  counter.fetch_add(v, std::memory_order_relaxed);
+}
+
+inline uint64_t get(const std::atomic<uint64_t> &counter) {
+  return counter.load(std::memory_order_relaxed);
+}
+
+std::string escape(const std::string &s) {
+  std::string dst;
+  for (char c : s) {
+    if ((c == '"') || (c == '\\')) {
+      dst += '\\';
+      dst += c;
+    } else if (uint8_t(c) < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", unsigned(uint8_t(c)));
+      dst += buf;
+    } else {
+      dst += c;
+    }
+  }
+  return dst;
+}
+
+void write_at_exit() {
+  std::string err;
+  if (!write_json(g_exit_filename, &err)) {
+    fprintf(stderr, "%s", err.c_str());
+  }
+}
+
+} // namespace
+
+const char *name(Stage stage) {
+  switch (stage) {
+    case Stage::Read: return "read";
+    case Stage::Decompress: return "decompress";
+    case Stage::Parse: return "parse";
+    case Stage::Tokenize: return "tokenize";
+    case Stage::Ngram: return "ngram";
+    case Stage::Hash: return "hash";
+    case Stage::Filter: return "filter";
+    case Stage::Dedup: return "dedup";
+    case Stage::SuffixArray: return "suffix_array";
+    case Stage::Serialize: return "serialize";
+    case Stage::Compress: return "compress";
+    case Stage::Write: return "write";
+    default: return "unknown";
+  }
+}
+
+uint64_t peak_rss_bytes() {
+#if !defined(_WIN32)
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(__APPLE__)
+    return uint64_t(usage.ru_maxrss);  // bytes
+#else
+    return uint64_t(usage.ru_maxrss) * 1024ull;  // KB
+#endif
+  }
+#endif
+  return 0;
+}
+
+void add_time(Stage stage, uint64_t ns, uint64_t calls) {
+  Counters &c = g_stages[size_t(stage)];
+  add(c.ns, ns);
+  add(c.calls, calls);
+}
+
+void add_bytes(Stage stage, uint64_t bytes_in, uint64_t bytes_out) {
+  Counters &c = g_stages[size_t(stage)];
+  add(c.bytes_in, bytes_in);
+  add(c.bytes_out, bytes_out);
+}
+
+void add_records(Stage stage, uint64_t records, uint64_t drops) {
+  Counters &c = g_stages[size_t(stage)];
+  add(c.records, records);
+  add(c.drops, drops);
+}
+
+void add_alloc(Stage stage, uint64_t bytes) {
+  add(g_stages[size_t(stage)].alloc_bytes, bytes);
+}
+
+void add_thread_time(uint32_t thread, ThreadTime kind, uint64_t ns) {
+  if (thread >= kMaxThreads) {
+    return;
+  }
+  add(g_thread_ns[thread][size_t(kind)], ns);
+
+  uint32_t n = g_num_threads.load(std::memory_order_relaxed);
+  while ((n <= thread) && !g_num_threads.compare_exchange_weak(n, thread + 1, std::memory_order_relaxed)) {
+  }
+}
+
+void begin_run(const std::string &command) {
+  std::lock_guard<std::mutex> lock(g_run_mutex);
+  g_command = command;
+  g_start_ns = now_ns();
+}
+
+std::string to_json() {
+  std::string command;
+  uint64_t start_ns;
+  {
+    std::lock_guard<std::mutex> lock(g_run_mutex);
+    command = g_command;
+    start_ns = g_start_ns;
+  }
+
+  const double wall_sec = double(now_ns() - start_ns) * 1e-9;
+
+  char buf[512];
+  std::string s = "{\n";
+  s += "  \"command\": \"" + escape(command) + "\",\n";
+  snprintf(buf, sizeof(buf), "  \"wall_sec\": %.6f,\n  \"peak_rss_bytes\": %llu,\n", wall_sec,
+           (unsigned long long)peak_rss_bytes());
+  s += buf;
+
+  s += "  \"stages\": {";
+  bool first = true;
+  for (size_t i = 0; i < kNumStages; i++) {
+    const Counters &c = g_stages[i];
+    const uint64_t calls = get(c.calls);
+    const uint64_t records = get(c.records);
+    const uint64_t bytes_in = get(c.bytes_in);
+    if ((calls == 0) && (records == 0) && (bytes_in == 0)) {
+      continue;  // stage not used in this run.
+    }
+
+    const double sec = double(get(c.ns)) * 1e-9;
+    // throughput over the thread-seconds of the stage(output bytes for
+    // stages which only produce data, e.g. serialize).
+    const uint64_t bytes = (std::max)(bytes_in, get(c.bytes_out));
+    const double mb_per_sec = (sec > 0.0) ? double(bytes) / (1024.0 * 1024.0) / sec : 0.0;
+    const double records_per_sec = (sec > 0.0) ? double(records) / sec : 0.0;
+
+    snprintf(buf, sizeof(buf),
+             "%s\n    \"%s\": {\"sec\": %.6f, \"calls\": %llu, \"bytes_in\": %llu, \"bytes_out\": %llu, "
+             "\"records\": %llu, \"drops\": %llu, \"alloc_bytes\": %llu, \"mb_per_sec\": %.3f, "
+             "\"records_per_sec\": %.1f}",
+             first ? "" : ",", name(Stage(i)), sec, (unsigned long long)calls, (unsigned long long)bytes_in,
+             (unsigned long long)get(c.bytes_out), (unsigned long long)records,
+             (unsigned long long)get(c.drops), (unsigned long long)get(c.alloc_bytes), mb_per_sec,
+             records_per_sec);
+    s += buf;
+    first = false;
+  }
+  s += first ? "}" : "\n  }";
+
+  const uint32_t num_threads = g_num_threads.load(std::memory_order_relaxed);
+  if (num_threads) {
+    s += ",\n  \"threads\": [";
+    for (uint32_t t = 0; t < num_threads; t++) {
+      snprintf(buf, sizeof(buf), "%s\n    {\"idle_sec\": %.6f, \"wait_sec\": %.6f}", t ? "," : "",
+               double(get(g_thread_ns[t][size_t(ThreadTime::Idle)])) * 1e-9,
+               double(get(g_thread_ns[t][size_t(ThreadTime::Wait)])) * 1e-9);
+      s += buf;
+    }
+    s += "\n  ]";
+  }
+
+  s += "\n}\n";
+  return s;
+}
+
+bool write_json(const std::string &filename, std::string *err) {
+  const std::string s = to_json();
+
+  if (filename == "-") {
+    fwrite(s.data(), 1, s.size(), stdout);
+    fflush(stdout);
+    return true;
+  }
+
+  FILE *fp = fopen(filename.c_str(), "wb");
+  if (!fp) {
+    if (err) {
+      (*err) += "Failed to open stats file: " + filename + "\n";
+    }
+    return false;
+  }
+  const bool ok = (fwrite(s.data(), 1, s.size(), fp) == s.size());
+  fclose(fp);
+  if (!ok && err) {
+    (*err) += "Failed to write stats file: " + filename + "\n";
+  }
+  return ok;
+}
+
+void write_json_at_exit(const std::string &filename) {
+  static std::once_flag flag;
+  g_exit_filename = filename;
+  std::call_once(flag, []() { std::atexit(write_at_exit); });
+}
+
+} // namespace stagestats
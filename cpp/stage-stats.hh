@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: Apache 2.0
+//
+// Per-stage timing and throughput counters.
+//
+// Each stage(decompress, JSON parse, n-gram, hash, dedup, serialize,
+// compress, ...) has process-wide counters: time, # of timed sections, bytes
+// in/out, records, dropped records and bytes of large buffers allocated.
+// Counters are relaxed atomics, so update them per file or per
+// parallel_for() range, not per character.
+//
+// Time is summed over threads(thread-seconds), so a stage run by N threads
+// for 1 sec reports N sec. `wall_sec` of the summary is the elapsed time of
+// the run.
+//
+// to_json() renders the counters as one JSON object(the per-run summary, see
+// `--stats=<file.json>` of cpp_proc, build_sa and fuzzy_dedup). With
+// add_thread_time()(fed by enkiTS ProfilerCallbacks, see task-pool.hh) it
+// also reports how long each task thread was idle or waiting.
+//
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace stagestats {
+
+enum class Stage : uint32_t
+{
+  Read,         // file read(+ page decode for Parquet)
+  Decompress,   // zstd decode
+  Parse,        // JSON parse
+  Tokenize,     // word segmentation/tokenization
+  Ngram,        // n-gram shingles, n-gram LM scoring
+  Hash,         // minhash
+  Filter,       // document/line filters
+  Dedup,        // near-dup detection
+  SuffixArray,  // suffix array construction
+  Serialize,    // JSON/columnar encode
+  Compress,     // zstd encode(+ write)
+  Write,        // file write
+  Count
+};
+
+const char *name(Stage stage);
+
+enum class ThreadTime : uint32_t
+{
+  Idle,  // suspended, waiting for new tasks
+  Wait,  // suspended, waiting for a task to complete
+  Count
+};
+
+inline uint64_t now_ns() {
+  return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now().time_since_epoch())
+                      .count());
+}
+
+///
+/// Peak resident set size of the process so far(0 when unknown).
+///
+uint64_t peak_rss_bytes();
+
+void add_time(Stage stage, uint64_t ns, uint64_t calls = 1);
+void add_bytes(Stage stage, uint64_t bytes_in, uint64_t bytes_out);
+void add_records(Stage stage, uint64_t records, uint64_t drops = 0);
+void add_alloc(Stage stage, uint64_t bytes);
+
+///
+/// Time spent by task thread `thread`(see ProfilerCallbacks in TaskScheduler.h).
+///
+void add_thread_time(uint32_t thread, ThreadTime kind, uint64_t ns);
+
+///
+/// Add the lifetime of the timer to `stage`.
+///
+class ScopedTimer
+{
+ public:
+  explicit ScopedTimer(Stage stage) : _stage(stage), _start(now_ns()) {}
+  ~ScopedTimer() { add_time(_stage, now_ns() - _start); }
+
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+ private:
+  Stage _stage;
+  uint64_t _start;
+};
+
+///
+/// Name of the run(e.g. `cpp_proc minhash`) and the start of `wall_sec`.
+///
+void begin_run(const std::string &command);
+
+///
+/// Summary of the run so far as a JSON object.
+///
+std::string to_json();
+
+///
+/// Write to_json() to `filename`("-" = stdout).
+///
+bool write_json(const std::string &filename, std::string *err = nullptr);
+
+///
+/// write_json(filename) when the process exits(return from main() or exit()).
+///
+void write_json_at_exit(const std::string &filename);
+
+} // namespace stagestats
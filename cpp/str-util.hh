@@ -246,6 +246,8 @@ struct NGram {
 // Build N-gram
 //
 // vector of (utf-8 char x N)
+// Text with less than N chars gives one N-gram of all its chars(empty text
+// gives none).
 //
 template<uint32_t N>
 inline std::vector<NGram<N>> build_ngram(
@@ -255,7 +257,13 @@ inline std::vector<NGram<N>> build_ngram(
   std::vector<std::string> utf8_chars = to_utf8_chars(str);
 
   if (utf8_chars.size() < N) {
-    // empty
+    if (!utf8_chars.empty()) {
+      NGram<N> gram;
+      for (const auto &c : utf8_chars) {
+        gram.add_utf8_char(c.c_str());
+      }
+      ret.emplace_back(std::move(gram));
+    }
     return ret;
   }
 
@@ -0,0 +1,266 @@
+// SPDX-License-Identifier: Apache 2.0
+
+#include "synth-corpus.hh"
+
+namespace synthcorpus {
+
+namespace {
+
+// splitmix64
+class Rng
+{
+ public:
+  explicit Rng(uint64_t seed) : _s(seed) {}
+
+  uint64_t next() {
+    uint64_t z = (_s += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+  // [0, n)
+  uint64_t uniform(uint64_t n) { return n ? (next() % n) : 0; }
+
+  // [0, 1)
+  double real() { return double(next() >> 11) * (1.0 / 9007199254740992.0); }
+
+  bool chance(double p) { return real() < p; }
+
+ private:
+  uint64_t _s;
+};
+
+void append_utf8(uint32_t cp, std::string &dst) {
+  if (cp < 0x80) {
+    dst += char(cp);
+  } else if (cp < 0x800) {
+    dst += char(0xc0 | (cp >> 6));
+    dst += char(0x80 | (cp & 0x3f));
+  } else {
+    dst += char(0xe0 | (cp >> 12));
+    dst += char(0x80 | ((cp >> 6) & 0x3f));
+    dst += char(0x80 | (cp & 0x3f));
+  }
+}
+
+// Split UTF-8 string into characters(no validation: input is generated here).
+std::vector<std::string> utf8_chars(const std::string &s) {
+  std::vector<std::string> dst;
+  for (size_t i = 0; i < s.size();) {
+    const uint8_t c = uint8_t(s[i]);
+    size_t len = (c < 0x80) ? 1 : ((c >> 5) == 0x6) ? 2 : ((c >> 4) == 0xe) ? 3 : 4;
+    dst.push_back(s.substr(i, len));
+    i += len;
+  }
+  return dst;
+}
+
+const char *kKanji =
+    "日本人大年中出本見行生事自分時間上前後言手気思方合同国会社長地者物"
+    "体月今新学話高場問題家子女男目名電車先外来作使通入食書読聞明開発表"
+    "部業化理情報世界全意味実現在最近東京都市内経済政治記録調査研究教育";
+
+const char *kParticles[] = {"は", "が", "を", "に", "の", "で", "と", "も", "から", "まで"};
+
+const char *kEndings[] = {"です。", "ます。", "でした。", "ました。", "だ。", "である。", "ですか？",
+                          "ません。", "ましょう！", "と思います。"};
+
+// Full-width, so they do not trip the ASCII filter of short documents.
+const char *kBoilerplate[] = {
+    "ホーム＞ニュース＞記事一覧",
+    "（Ｃ）株式会社サンプル　無断転載を禁じます",
+    "ログイン｜新規登録｜お問い合わせ",
+    "この記事をシェアする",
+    "関連記事",
+    "前のページ　次のページ",
+    "カテゴリー：未分類",
+};
+
+class Vocabulary
+{
+ public:
+  explicit Vocabulary(Rng &rng) {
+    const std::vector<std::string> kanji = utf8_chars(kKanji);
+
+    auto hiragana = [&rng]() { return uint32_t(0x3042 + rng.uniform(0x3093 - 0x3042)); };
+    auto katakana = [&rng]() { return uint32_t(0x30a2 + rng.uniform(0x30f3 - 0x30a2)); };
+
+    constexpr size_t kNumWords = 4000;
+    for (size_t i = 0; i < kNumWords; i++) {
+      std::string w;
+      switch (rng.uniform(4)) {
+        case 0:  // kanji compound
+          w = kanji[rng.uniform(kanji.size())] + kanji[rng.uniform(kanji.size())];
+          break;
+        case 1:  // kanji + okurigana
+          w = kanji[rng.uniform(kanji.size())];
+          for (uint64_t k = 0, n = 1 + rng.uniform(2); k < n; k++) {
+            append_utf8(hiragana(), w);
+          }
+          break;
+        case 2:  // katakana loanword
+          for (uint64_t k = 0, n = 3 + rng.uniform(3); k < n; k++) {
+            append_utf8(katakana(), w);
+          }
+          break;
+        default:  // hiragana
+          for (uint64_t k = 0, n = 2 + rng.uniform(2); k < n; k++) {
+            append_utf8(hiragana(), w);
+          }
+          break;
+      }
+      _words.push_back(w);
+    }
+  }
+
+  // Skewed to the head of the list(frequent words).
+  const std::string &word(Rng &rng) const {
+    double u = rng.real();
+    return _words[size_t(u * u * u * double(_words.size()))];
+  }
+
+ private:
+  std::vector<std::string> _words;
+};
+
+std::string make_sentence(const Vocabulary &vocab, Rng &rng) {
+  std::string s;
+  const uint64_t n = 3 + rng.uniform(8);
+  for (uint64_t i = 0; i < n; i++) {
+    s += vocab.word(rng);
+    if (i + 1 < n) {
+      s += kParticles[rng.uniform(sizeof(kParticles) / sizeof(kParticles[0]))];
+      if (rng.chance(0.15)) {
+        s += "、";
+      }
+    }
+  }
+  s += kEndings[rng.uniform(sizeof(kEndings) / sizeof(kEndings[0]))];
+  return s;
+}
+
+std::string make_document(const Config &config, const Vocabulary &vocab, Rng &rng) {
+  // # of characters in [mean / 2, mean * 3 / 2)
+  const uint64_t target = config.mean_chars / 2 + rng.uniform(config.mean_chars + 1);
+
+  std::vector<std::string> lines;
+  uint64_t n_chars = 0;
+  while (n_chars < target) {
+    std::string line;
+    for (uint64_t k = 0, n = 1 + rng.uniform(3); k < n; k++) {
+      line += make_sentence(vocab, rng);
+    }
+    n_chars += line.size() / 3;  // almost all characters are 3 bytes.
+    lines.push_back(line);
+  }
+
+  if (rng.chance(config.boilerplate_rate)) {
+    const size_t nb = sizeof(kBoilerplate) / sizeof(kBoilerplate[0]);
+    lines.insert(lines.begin(), kBoilerplate[rng.uniform(nb)]);
+    lines.push_back(kBoilerplate[rng.uniform(nb)]);
+  }
+
+  std::string text;
+  for (size_t i = 0; i < lines.size(); i++) {
+    if (i) {
+      text += "\n";
+    }
+    text += lines[i];
+  }
+  return text;
+}
+
+// Substitute, insert or delete characters(except '\n') with `rate`.
+std::string edit_document(const std::string &text, double rate, Rng &rng) {
+  std::string dst;
+  for (const std::string &c : utf8_chars(text)) {
+    if ((c == "\n") || !rng.chance(rate)) {
+      dst += c;
+      continue;
+    }
+    switch (rng.uniform(3)) {
+      case 0:  // substitute
+        append_utf8(uint32_t(0x3042 + rng.uniform(0x3093 - 0x3042)), dst);
+        break;
+      case 1:  // insert
+        dst += c;
+        append_utf8(uint32_t(0x3042 + rng.uniform(0x3093 - 0x3042)), dst);
+        break;
+      default:  // delete
+        break;
+    }
+  }
+  return dst;
+}
+
+} // namespace
+
+const char *doc_kind_name(DocKind kind) {
+  switch (kind) {
+    case kOriginal: return "original";
+    case kExactDup: return "exact_dup";
+    case kNearDup: return "near_dup";
+    default: return "unknown";
+  }
+}
+
+std::vector<Document> generate(const Config &config) {
+  Rng rng(config.seed);
+  const Vocabulary vocab(rng);
+
+  std::vector<Document> docs(config.num_docs);
+  std::vector<uint64_t> originals;
+
+  for (uint64_t i = 0; i < config.num_docs; i++) {
+    Document &doc = docs[i];
+
+    if (!originals.empty() && rng.chance(config.dup_rate)) {
+      doc.source = originals[rng.uniform(originals.size())];
+      if (rng.chance(config.exact_ratio)) {
+        doc.kind = kExactDup;
+        doc.text = docs[doc.source].text;
+      } else {
+        doc.kind = kNearDup;
+        doc.text = edit_document(docs[doc.source].text, config.edit_rate, rng);
+      }
+      continue;
+    }
+
+    doc.kind = kOriginal;
+    doc.source = i;
+    doc.text = make_document(config, vocab, rng);
+    originals.push_back(i);
+  }
+
+  return docs;
+}
+
+double Score::recall() const {
+  const uint64_t n = n_dups[kExactDup] + n_dups[kNearDup];
+  return n ? double(n_flagged[kExactDup] + n_flagged[kNearDup]) / double(n) : 1.0;
+}
+
+double Score::precision() const {
+  const uint64_t tp = n_flagged[kExactDup] + n_flagged[kNearDup];
+  const uint64_t n = tp + n_flagged[kOriginal];
+  return n ? double(tp) / double(n) : 1.0;
+}
+
+double Score::recall(DocKind kind) const {
+  return n_dups[kind] ? double(n_flagged[kind]) / double(n_dups[kind]) : 1.0;
+}
+
+Score evaluate(const std::vector<Document> &docs, const std::vector<uint8_t> &flagged) {
+  Score score;
+  score.n_docs = docs.size();
+  for (size_t i = 0; i < docs.size(); i++) {
+    score.n_dups[docs[i].kind]++;
+    if ((i < flagged.size()) && flagged[i]) {
+      score.n_flagged[docs[i].kind]++;
+    }
+  }
+  return score;
+}
+
+} // namespace synthcorpus
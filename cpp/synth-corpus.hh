@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: Apache 2.0
+//
+// Deterministic synthetic Japanese-like corpus for benchmarks.
+//
+// Documents are lines of sentences built from a fixed vocabulary of kanji
+// compounds, kanji + okurigana, katakana and hiragana words joined with
+// particles and sentence-final endings(です。, ます。, ...), so they pass the
+// 03_clean_step1 filters. On top of that:
+//
+// - exact duplicates: verbatim copy of an earlier document.
+// - near duplicates: copy of an earlier document with per-character edits
+//   (substitute/insert/delete) at `edit_rate`.
+// - boilerplate: navigation/copyright lines without sentence-final
+//   punctuation, which the line filter of `clean` removes.
+//
+// The output only depends on Config(own PRNG, no std distributions), so the
+// same config gives the same corpus on every platform.
+//
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace synthcorpus {
+
+struct Config
+{
+  uint64_t num_docs{20000};
+  uint32_t mean_chars{600};       // mean # of characters of an original document
+  double dup_rate{0.2};           // fraction of documents copied from an earlier one
+  double exact_ratio{0.5};        // fraction of the copies which are exact(others: near-dups)
+  double edit_rate{0.02};         // per-character edit probability of near-dups
+  double boilerplate_rate{0.3};   // fraction of documents with boilerplate lines
+  uint64_t seed{1};
+};
+
+enum DocKind {
+  kOriginal = 0,
+  kExactDup,
+  kNearDup,
+  kNumDocKinds
+};
+
+const char *doc_kind_name(DocKind kind);
+
+struct Document
+{
+  std::string text;
+  DocKind kind{kOriginal};
+  uint64_t source{0};  // index of the copied document(own index for originals)
+};
+
+///
+/// Generate `config.num_docs` documents. Copies always refer to an earlier
+/// original, so documents processed in order see the original first.
+///
+std::vector<Document> generate(const Config &config);
+
+///
+/// Dedup quality against the ground truth. `flagged[i]` is true when
+/// document i was reported as a duplicate.
+///
+struct Score
+{
+  uint64_t n_docs{0};
+  uint64_t n_dups[kNumDocKinds]{};     // ground truth per kind([kOriginal] = originals)
+  uint64_t n_flagged[kNumDocKinds]{};  // flagged per kind([kOriginal] = false positives)
+
+  double recall() const;     // flagged copies / copies
+  double precision() const;  // flagged copies / flagged
+  double recall(DocKind kind) const;
+};
+
+Score evaluate(const std::vector<Document> &docs, const std::vector<uint8_t> &flagged);
+
+} // namespace synthcorpus
@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: Apache 2.0
+
+#include "task-pool.hh"
+
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+#include "stage-stats.hh"
+
+namespace taskpool {
+
+namespace {
+
+enki::TaskScheduler g_scheduler;
+std::once_flag g_init_flag;
+
+// Start time of the current idle/wait period of this thread. Only suspended
+// periods are counted(WaitforTask runs other tasks until it suspends).
+thread_local uint64_t t_idle_start = 0;
+thread_local uint64_t t_wait_start = 0;
+
+void idle_start(uint32_t) { t_idle_start = stagestats::now_ns(); }
+void idle_stop(uint32_t thread) {
+  stagestats::add_thread_time(thread, stagestats::ThreadTime::Idle, stagestats::now_ns() - t_idle_start);
+}
+void wait_start(uint32_t) { t_wait_start = stagestats::now_ns(); }
+void wait_stop(uint32_t thread) {
+  stagestats::add_thread_time(thread, stagestats::ThreadTime::Wait, stagestats::now_ns() - t_wait_start);
+}
+
+} // namespace
+
+void init(uint32_t nthreads, bool profile) {
+  std::call_once(g_init_flag, [nthreads, profile]() {
+    enki::TaskSchedulerConfig config;
+    config.numTaskThreadsToCreate =
+        (nthreads ? nthreads : (std::max)(1u, std::thread::hardware_concurrency())) - 1;
+    if (profile) {
+      config.profilerCallbacks.waitForNewTaskSuspendStart = idle_start;
+      config.profilerCallbacks.waitForNewTaskSuspendStop = idle_stop;
+      config.profilerCallbacks.waitForTaskCompleteSuspendStart = wait_start;
+      config.profilerCallbacks.waitForTaskCompleteSuspendStop = wait_stop;
+    }
+    g_scheduler.Initialize(config);
+  });
+}
+
+enki::TaskScheduler &scheduler() {
+  init();
+  return g_scheduler;
+}
+
+uint32_t num_threads() {
+  return scheduler().GetNumTaskThreads();
+}
+
+void parallel_for(uint64_t n, const RangeFunction &fn, uint32_t min_range) {
+  enki::TaskScheduler &ts = scheduler();
+
+  if (ts.GetThreadNum() == enki::NO_THREAD_NUM) {
+    // Not a task thread(see task-pool.hh). Run serially.
+    if (n > 0) {
+      fn(0, n, 0);
+    }
+    return;
+  }
+
+  // enkiTS set size is 32bit.
+  constexpr uint64_t kMaxSetSize = (std::numeric_limits<uint32_t>::max)();
+
+  for (uint64_t base = 0; base < n; base += kMaxSetSize) {
+    uint32_t size = uint32_t((std::min)(n - base, kMaxSetSize));
+
+    enki::TaskSet task(size, [&fn, base](enki::TaskSetPartition range, uint32_t thread_num) {
+      fn(base + range.start, base + range.end, thread_num);
+    });
+    task.m_MinRange = (std::max)(1u, min_range);
+
+    ts.AddTaskSetToPipe(&task);
+    ts.WaitforTask(&task);
+  }
+}
+
+} // namespace taskpool
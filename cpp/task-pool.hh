@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: Apache 2.0
+//
+// Process-wide work-stealing task scheduler(vendored enkiTS, TaskScheduler.h).
+//
+// All parallel loops of cpp_proc run on one long-lived enki::TaskScheduler
+// instead of spawning and joining std::threads per file. Stages of a shard
+// (e.g. decode -> process -> encode) can be chained as enki task sets with
+// enki::Dependency, so the next shard's I/O overlaps the current shard's
+// compute.
+//
+// The pool is created on first use by the calling thread(which becomes task
+// thread 0), so call `init()` from the main thread before spawning other
+// threads. parallel_for() must be called from that thread or from a task.
+//
+// With `profile`, enkiTS ProfilerCallbacks record how long each thread was
+// idle or waiting for tasks(see stage-stats.hh).
+//
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+#include "TaskScheduler.h"
+
+namespace taskpool {
+
+///
+/// Create the scheduler with `nthreads` threads in total(0 = # of cores).
+/// No-op when already created.
+///
+void init(uint32_t nthreads = 0, bool profile = false);
+
+///
+/// The process-wide scheduler(created by init() on first use).
+///
+enki::TaskScheduler &scheduler();
+
+///
+/// # of task threads. Thread numbers passed to tasks are < num_threads(),
+/// so it can be used to size per-thread scratch/statistics.
+///
+uint32_t num_threads();
+
+///
+/// fn(begin, end, thread_num) over partitions of [0, n).
+///
+using RangeFunction = std::function<void(uint64_t begin, uint64_t end, uint32_t thread_num)>;
+
+///
+/// Run `fn` over [0, n) on the scheduler and wait for it. The calling thread
+/// runs tasks while waiting, so nested parallel_for() from a task is fine.
+/// `min_range` is the minimum # of items per partition(grain size).
+///
+void parallel_for(uint64_t n, const RangeFunction &fn, uint32_t min_range = 1);
+
+} // namespace taskpool
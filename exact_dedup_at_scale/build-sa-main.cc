@@ -9,6 +9,7 @@
 
 #include "ghc/filesystem.hpp"
 
+#include "doc-id.hh"
 #include "exact-dedup.hh"
 
 //
@@ -27,6 +28,7 @@
 
 #include "common.h"  // from zstd example
 #include "pbar.hpp"
+#include "stage-stats.hh"
 
 //
 #define SAFETENSORS_CPP_IMPLEMENTATION
@@ -62,7 +64,10 @@ static bool zstd_compress_to_file(const void *buf, const size_t size,
 
 static bool zstd_compress_to_memory(const void *buf, const size_t size,
                                     std::vector<uint8_t> &mem) {
+  stagestats::ScopedTimer timer(stagestats::Stage::Compress);
+
   size_t cBuffSize = ZSTD_compressBound(size);
+  stagestats::add_alloc(stagestats::Stage::Compress, cBuffSize);
 
   /* Compress.
    * If you are doing many compressions, you may want to reuse the context.
@@ -75,6 +80,7 @@ static bool zstd_compress_to_memory(const void *buf, const size_t size,
   CHECK_ZSTD(cSize);
 
   printf("\nzstd compress: %6u -> %7u \n", (unsigned)size, (unsigned)cSize);
+  stagestats::add_bytes(stagestats::Stage::Compress, size, cSize);
 
   mem.resize(cSize);
   memcpy(mem.data(), cBuff, cSize);
@@ -125,12 +131,21 @@ bool saveSuffixArray(const std::string &filename, const uint8_t *addr,
   return true;
 }
 
+//
+// `doc_ids` and `doc_offsets`(offset of each document in the suffix array
+// input: bytes, or token ids when `is_tokenized`) are stored as uint64
+// tensors so that suffix array positions can be mapped back to stable
+// document ids(see doc-id.hh). The unit is recorded in `offset_unit`
+// metadata.
+//
 bool saveSuffixArraySafetensor(const std::string &input_filename,
                                const std::string &vocab_filename,
                                bool is_tokenized,
                                bool use_codepoint,
                                const std::string &st_filename,
-                               const uint8_t *addr, const size_t bytes) {
+                               const uint8_t *addr, const size_t bytes,
+                               const std::vector<uint64_t> &doc_ids,
+                               const std::vector<uint64_t> &doc_offsets) {
 
   std::vector<uint8_t> sa;
 
@@ -144,10 +159,21 @@ bool saveSuffixArraySafetensor(const std::string &input_filename,
 
   safetensors::safetensors_t st;
 
-  st.storage.resize(sa.size());
-  memcpy(st.storage.data(), sa.data(), sa.size());
+  // uint64 tensors first to keep them 8-byte aligned(safetensors does not
+  // allow gaps between tensors).
+  size_t ids_offset = 0;
+  size_t offsets_offset = ids_offset + doc_ids.size() * sizeof(uint64_t);
+  size_t sa_offset = offsets_offset + doc_offsets.size() * sizeof(uint64_t);
+
+  st.storage.resize(sa_offset + sa.size());
+  memcpy(st.storage.data() + sa_offset, sa.data(), sa.size());
+  if (doc_ids.size()) {
+    memcpy(st.storage.data() + ids_offset, doc_ids.data(), doc_ids.size() * sizeof(uint64_t));
+  }
+  if (doc_offsets.size()) {
+    memcpy(st.storage.data() + offsets_offset, doc_offsets.data(), doc_offsets.size() * sizeof(uint64_t));
+  }
 
-  size_t sa_offset = 0;
   safetensors::tensor_t tensor;
   tensor.dtype = safetensors::dtype::kUINT8;
   tensor.data_offsets[0] = sa_offset;
@@ -155,11 +181,28 @@ bool saveSuffixArraySafetensor(const std::string &input_filename,
   tensor.shape.resize(1);
   tensor.shape[0] = sa.size();
 
+  safetensors::tensor_t ids_tensor;
+  ids_tensor.dtype = safetensors::dtype::kUINT64;
+  ids_tensor.data_offsets[0] = ids_offset;
+  ids_tensor.data_offsets[1] = offsets_offset;
+  ids_tensor.shape.resize(1);
+  ids_tensor.shape[0] = doc_ids.size();
+  st.tensors.insert("doc_ids", ids_tensor);
+
+  safetensors::tensor_t offsets_tensor;
+  offsets_tensor.dtype = safetensors::dtype::kUINT64;
+  offsets_tensor.data_offsets[0] = offsets_offset;
+  offsets_tensor.data_offsets[1] = sa_offset;
+  offsets_tensor.shape.resize(1);
+  offsets_tensor.shape[0] = doc_offsets.size();
+  st.tensors.insert("doc_offsets", offsets_tensor);
+
   st.tensors.insert("suffix_array", tensor);
 
   st.metadata.insert("input_filename", input_filename);
   st.metadata.insert("compression", "zstd");
   st.metadata.insert("tokenized", is_tokenized ? "true" : "false");
+  st.metadata.insert("offset_unit", is_tokenized ? "token" : "byte");
   if (is_tokenized) {
     st.metadata.insert("use_codepoint", use_codepoint ? "true" : "false");
   }
@@ -168,7 +211,10 @@ bool saveSuffixArraySafetensor(const std::string &input_filename,
   }
 
   std::string warn, err;
+  uint64_t write_start = stagestats::now_ns();
   ret = safetensors::save_to_file(st, st_filename, &warn, &err);
+  stagestats::add_time(stagestats::Stage::Write, stagestats::now_ns() - write_start);
+  stagestats::add_bytes(stagestats::Stage::Write, st.storage.size(), st.storage.size());
 
   if (warn.size()) {
     std::cout << "SaveToSafetensors WARN: " << warn << "\n";
@@ -278,6 +324,8 @@ static std::string zstd_decompress_stream(const char *fname) {
 }
 
 static std::string zstd_decompress(const char *fname) {
+  stagestats::ScopedTimer timer(stagestats::Stage::Decompress);
+
   size_t cSize;
   void *const cBuff = mallocAndLoadFile_orDie(fname, &cSize);
 
@@ -294,10 +342,14 @@ static std::string zstd_decompress(const char *fname) {
   if (rSize == ZSTD_CONTENTSIZE_UNKNOWN) {
     // Use streaming API
     free(cBuff);
-    return zstd_decompress_stream(fname);
+    std::string buf = zstd_decompress_stream(fname);
+    stagestats::add_bytes(stagestats::Stage::Decompress, cSize, buf.size());
+    stagestats::add_alloc(stagestats::Stage::Decompress, buf.size());
+    return buf;
   }
 
   void *const rBuff = malloc_orDie((size_t)rSize);
+  stagestats::add_alloc(stagestats::Stage::Decompress, cSize + rSize);
 
   /* Decompress.
    * If you are doing many decompressions, you may want to reuse the context
@@ -314,6 +366,7 @@ static std::string zstd_decompress(const char *fname) {
 
   // assume decoded data is utf-8 string.
   std::string buf(reinterpret_cast<const char *>(rBuff), dSize);
+  stagestats::add_bytes(stagestats::Stage::Decompress, cSize, dSize);
 
   free(rBuff);
   free(cBuff);
@@ -322,6 +375,14 @@ static std::string zstd_decompress(const char *fname) {
 }
 
 std::vector<nlohmann::json> decode_jsonl(std::vector<std::string> &&json_strs) {
+  stagestats::ScopedTimer timer(stagestats::Stage::Parse);
+  uint64_t bytes = 0;
+  for (const auto &s : json_strs) {
+    bytes += s.size();
+  }
+  stagestats::add_bytes(stagestats::Stage::Parse, bytes, 0);
+  stagestats::add_records(stagestats::Stage::Parse, json_strs.size());
+
   uint32_t nthreads = cpu_count();
 
   std::vector<std::thread> workers;
@@ -384,11 +445,25 @@ static std::vector<nlohmann::json> load_jsonl_zstd(
   return jsonl;
 }
 
+//
+// `doc_ids` receives `doc_id` of each document(line index when the document
+// has no id) and `doc_offsets` the byte offset of each document in the
+// returned buffer.
+//
 std::vector<uint8_t> flatten_texts(const std::vector<nlohmann::json> &js,
-                                   const std::string &text_key) {
+                                   const std::string &text_key,
+                                   std::vector<uint64_t> &doc_ids,
+                                   std::vector<uint64_t> &doc_offsets) {
   std::vector<uint8_t> dst;
 
-  for (const auto &j : js) {
+  doc_ids.clear();
+  doc_offsets.clear();
+
+  for (size_t i = 0; i < js.size(); i++) {
+    const auto &j = js[i];
+    doc_ids.push_back(j.value(docid::kKey, uint64_t(i)));
+    doc_offsets.push_back(dst.size());
+
     std::string text = j[text_key];
     dst.insert(dst.end(), text.begin(), text.end());
 
@@ -401,6 +476,9 @@ std::vector<uint8_t> flatten_texts(const std::vector<nlohmann::json> &js,
 
 std::vector<int32_t> compute_suffix_array_bytes(
     const std::vector<uint8_t> &bytes) {
+  stagestats::ScopedTimer timer(stagestats::Stage::SuffixArray);
+  stagestats::add_bytes(stagestats::Stage::SuffixArray, bytes.size(), bytes.size() * sizeof(int32_t));
+  stagestats::add_alloc(stagestats::Stage::SuffixArray, bytes.size() * sizeof(int32_t));
   if (bytes.size() > std::numeric_limits<int32_t>::max()) {
     fprintf(stderr, "Input must be 2GB or less.\n");
     exit(-1);
@@ -416,6 +494,10 @@ std::vector<int32_t> compute_suffix_array_bytes(
 }
 
 std::vector<int> compute_suffix_array_u16(const std::vector<uint16_t> &tokens) {
+  stagestats::ScopedTimer timer(stagestats::Stage::SuffixArray);
+  stagestats::add_bytes(stagestats::Stage::SuffixArray, tokens.size() * sizeof(uint16_t),
+                        tokens.size() * sizeof(int32_t));
+  stagestats::add_alloc(stagestats::Stage::SuffixArray, tokens.size() * sizeof(int32_t));
   if (tokens.size() > std::numeric_limits<int32_t>::max()) {
     fprintf(stderr, "Input must be 2GB or less tokens.\n");
     exit(-1);
@@ -496,6 +578,7 @@ void print_help() {
   std::cout << "--text_key(-k)       : Specify JSON key for text data(default `text`)\n";
   std::cout << "--codepoint(-c)      : Use codepoint representation of UTF-8 character(faster tokenization).\n";
   std::cout << "--test(-s)           : Do tests.\n";
+  std::cout << "--stats(-j) FILE     : Write time/bytes/records of each stage(JSON) to FILE(`-` = stdout) at exit.\n";
   std::cout << "--help(-h)           : Print this help\n";
 }
 
@@ -508,11 +591,13 @@ int main(int argc, char **argv) {
                                      {"vocab", 'b', OPTPARSE_REQUIRED},
                                      {"zcomp_level", 'z', OPTPARSE_REQUIRED},
                                      {"test", 's', OPTPARSE_NONE},
+                                     {"stats", 'j', OPTPARSE_REQUIRED},
                                      {"help", 'h', OPTPARSE_NONE},
                                      {0}};
 
   int zcomp_level = 9;
   bool do_test{false};
+  std::string stats_filename;
 
   // default: Read a file.
   std::string indir;
@@ -551,6 +636,9 @@ int main(int argc, char **argv) {
       case 's':
         do_test = true;
         break;
+      case 'j':
+        stats_filename = options.optarg;
+        break;
       case 'z':
         // zstd itself supports level up to 22, but 15+ requires not prectical to use since it comsumes lots of time for compression
         zcomp_level = (std::max)(1, (std::min)(15, std::atoi(options.optarg)));
@@ -570,6 +658,11 @@ int main(int argc, char **argv) {
     filename = std::string(input_file_arg);
   }
 
+  if (!stats_filename.empty()) {
+    stagestats::begin_run(std::string("build_sa ") + filename);
+    stagestats::write_json_at_exit(stats_filename);
+  }
+
   fs::path outdir_path(outdir);
 
   if (!fs::exists(outdir_path)) {
@@ -586,7 +679,9 @@ int main(int argc, char **argv) {
   bar.init();
 
   std::vector<nlohmann::json> js = load_jsonl_zstd(filename);
-  std::vector<uint8_t> texts = flatten_texts(js, text_key);
+  std::vector<uint64_t> doc_ids;
+  std::vector<uint64_t> doc_offsets;
+  std::vector<uint8_t> texts = flatten_texts(js, text_key, doc_ids, doc_offsets);
 
   std::vector<int32_t> sa;
 
@@ -600,23 +695,35 @@ int main(int argc, char **argv) {
     }
     out_filename += "-tokenized";
 
-    std::vector<int> input_ids;
     std::string s(texts.begin(), texts.begin() + texts.size());
-    if (!tokenizer->encode(s, input_ids)) {
-      fprintf(stderr, "tokenize failed.\n");
-      exit(-1);
-    }
-
     std::vector<uint16_t> input_ids_u16;
-    input_ids_u16.resize(input_ids.size());
+    {
+      stagestats::ScopedTimer timer(stagestats::Stage::Tokenize);
+
+      // Tokenize each document(with its delimiter) separately so that no
+      // token spans two documents, and turn `doc_offsets` into token offsets.
+      std::vector<int> input_ids;
+      for (size_t i = 0; i < doc_offsets.size(); i++) {
+        const size_t begin = doc_offsets[i];
+        const size_t end = (i + 1 < doc_offsets.size()) ? doc_offsets[i + 1] : s.size();
+        doc_offsets[i] = input_ids_u16.size();
+
+        input_ids.clear();
+        if (!tokenizer->encode(s.substr(begin, end - begin), input_ids)) {
+          fprintf(stderr, "tokenize failed.\n");
+          exit(-1);
+        }
 
-    for (size_t i = 0; i < input_ids.size(); i++) {
-      if ((input_ids[i] < 0) ||
-          (input_ids[i] > (std::numeric_limits<uint16_t>::max)())) {
-        fprintf(stderr, "token id must be in range [0, 65535]\n");
-        exit(-1);
+        for (const int id : input_ids) {
+          if ((id < 0) || (id > (std::numeric_limits<uint16_t>::max)())) {
+            fprintf(stderr, "token id must be in range [0, 65535]\n");
+            exit(-1);
+          }
+          input_ids_u16.push_back(uint16_t(id));
+        }
       }
-      input_ids_u16[i] = uint16_t(input_ids[i]);
+      stagestats::add_bytes(stagestats::Stage::Tokenize, s.size(), input_ids_u16.size() * sizeof(uint16_t));
+      stagestats::add_records(stagestats::Stage::Tokenize, js.size());
     }
 
     if (do_test) {
@@ -645,7 +752,7 @@ int main(int argc, char **argv) {
   fs::path out_filepath = outdir_path / fs::path(out_filename);
   if (!saveSuffixArraySafetensor(out_filepath, vocab_json_filename, tokenize, use_codepoint, out_filename,
                        reinterpret_cast<const uint8_t *>(sa.data()),
-                       sa.size() * sizeof(int32_t))) {
+                       sa.size() * sizeof(int32_t), doc_ids, doc_offsets)) {
     fprintf(stderr, "Failed to save suffix array.");
     exit(-1);
   }
@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <cstdint>
+#include <limits>
 #include <set>
 #include <unordered_set>
 #include <vector>
@@ -243,98 +244,185 @@ static uint32_t cpu_count() {
   return (std::max)(1u, std::thread::hardware_concurrency());
 }
 
-// FNV1-32 hash
-inline uint32_t FNV32(const uint8_t *addr, const size_t nbytes) {
-  constexpr uint32_t kPrime = 0x01000193;
-  constexpr uint32_t kOffsetBasis = 0x811c9dc5;
+bool build_dedup_id_map(
+  const std::map<std::string, int> &str_to_id_map,
+  const std::string &placeholder_str,
+  std::vector<uint16_t> &id_map,
+  std::string &err) {
 
-  uint32_t hash = kOffsetBasis;
+  constexpr size_t kNumIds = size_t((std::numeric_limits<uint16_t>::max)()) + 1;
 
-  for (size_t i = 0; i < nbytes; i++) {
-    hash = (hash & kPrime) ^ addr[i];
+  id_map.resize(kNumIds);
+  for (size_t i = 0; i < kNumIds; i++) {
+    id_map[i] = uint16_t(i);
   }
 
-  return hash;
+  const std::unordered_set<std::string> digits = jpnormalizer::get_digits();
+  const std::unordered_set<std::string> puncts = jpnormalizer::get_unicode_puncts();
+  const std::unordered_set<std::string> spaces = {" ", "\t", "\n", "\r", "\u3000"};
 
-}
+  // placeholder string -> canonical id
+  std::map<std::string, int> placeholder_ids;
 
-bool num_to_placeholder(
-  const std::map<std::string, int> &str_to_id_map,
-  const std::string &placeholder_str,
-  std::map<std::string, int> &dst) {
+  for (const auto &it : str_to_id_map) {
+    if ((it.second <= 0) || (size_t(it.second) >= kNumIds)) {
+      err += "Vocab ID must be in range [1, 65535]: " + std::to_string(it.second) + "\n";
+      return false;
+    }
+    if (it.first.empty()) {
+      continue;
+    }
 
-  dst = str_to_id_map;
+    std::vector<std::string> u8_chars = strutil::to_utf8_chars(it.first);
 
-  std::unordered_set<int> ids;
-  for (const auto &it : str_to_id_map) {
-    ids.insert(it.second);
-  }
+    bool has_digit{false};
+    bool all_drop{true};
+    std::string filtered_str;
 
-  std::unordered_set<int> available_ids;
-  // find available ids
-  // 0 ~ 257 is reserved
-  for (size_t i = 258; i < (std::numeric_limits<uint16_t>::max)(); i++) {
-    if (ids.count(i)) {
-      continue;
+    for (const auto &c : u8_chars) {
+      if (digits.count(c)) {
+        filtered_str += placeholder_str;
+        has_digit = true;
+        all_drop = false;
+      } else {
+        filtered_str += c;
+        if (!puncts.count(c) && !spaces.count(c)) {
+          all_drop = false;
+        }
+      }
     }
 
-    available_ids.insert(i);
+    if (all_drop) {
+      id_map[size_t(it.second)] = kDedupDropId;
+    } else if (has_digit) {
+      auto pit = placeholder_ids.find(filtered_str);
+      if (pit == placeholder_ids.end()) {
+        auto vit = str_to_id_map.find(filtered_str);
+        // use the id of the placeholder string itself(e.g. "000") when it is in the vocab.
+        int canonical_id = (vit != str_to_id_map.end()) ? vit->second : it.second;
+        pit = placeholder_ids.emplace(filtered_str, canonical_id).first;
+      }
+      id_map[size_t(it.second)] = uint16_t(pit->second);
+    }
   }
 
-  if (available_ids.empty()) {
-    std::cerr << "vocab does not have unused id.\n";
-    return false;
-  }
+  return true;
+}
 
-  std::unordered_set<std::string> digits = jpnormalizer::get_digits();
+size_t apply_dedup_id_map(
+  const std::vector<uint16_t> &id_map,
+  const int *ids,
+  size_t n,
+  uint16_t *dst) {
 
-  for (const auto &it : str_to_id_map) {
-    std::vector<std::string> u8_chars = strutil::to_utf8_chars(it.first);
+  const uint16_t *table = id_map.data();
 
-    std::vector<std::string> filtered_chars;
+  // Branchless compaction: always store, advance only when kept.
+  size_t n_out = 0;
+  for (size_t i = 0; i < n; i++) {
+    const uint16_t c = table[uint16_t(ids[i])];
+    dst[n_out] = c;
+    n_out += (c != kDedupDropId);
+  }
 
-    bool filtered{false};
+  return n_out;
+}
 
-    for (const auto &c : u8_chars) {
+namespace {
 
-      if (digits.count(c)) {
-        filtered_chars.emplace_back(placeholder_str);
-        filtered = true;
-      } else {
-        filtered_chars.emplace_back(c);
-      }
+// splitmix64
+inline uint64_t splitmix64(uint64_t x) {
+  uint64_t z = x + 0x9e3779b97f4a7c15ull;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
 
-    }
+// multiply-xorshift mix of a packed shingle.
+inline uint64_t mix_shingle(uint64_t x) {
+  x ^= x >> 32;
+  x *= 0xd6e8feb86659fd93ull;
+  x ^= x >> 32;
+  return x;
+}
 
-    if (filtered) {
-      std::string filtered_str;
-      for (size_t i = 0; i < filtered_chars.size(); i++) {
-        filtered_str += filtered_chars[i];
-      }
+} // namespace
 
-      int filtered_str_id{-1};
+bool pack_token_shingles(const std::vector<uint16_t> &ids,
+                         uint32_t ngram,
+                         std::vector<uint64_t> &shingles) {
 
-      if (!dst.count(filtered_str)) {
-        // Add filtered string(e.g. "000")
-        if (available_ids.empty()) {
-          std::cerr << "No vocab id available to assign.\n";
-          return false;
-        }
+  shingles.clear();
 
-        // pop first element.
-        auto it = available_ids.erase(available_ids.cbegin());
-        filtered_str_id = *it;
-        dst[filtered_str] = filtered_str_id;
-      } else {
-        // filtered string already exists in vocab dict.
-        filtered_str_id = dst.at(filtered_str);
-      }
+  if ((ngram == 0) || (ngram > kMaxPackedNgram)) {
+    return false;
+  }
 
-      dst[it.first] = filtered_str_id;
+  if (ids.empty()) {
+    return true;
+  }
+
+  if (ids.size() < ngram) {
+    uint64_t x = 0;
+    for (size_t i = 0; i < ids.size(); i++) {
+      x = (x << 16) | ids[i];
     }
+    shingles.push_back(mix_shingle(x));
+    return true;
+  }
+
+  const uint64_t mask = (ngram == kMaxPackedNgram) ? ~0ull : ((1ull << (16 * ngram)) - 1);
 
+  shingles.resize(ids.size() - ngram + 1);
+
+  uint64_t x = 0;
+  for (size_t i = 0; i < ngram - 1; i++) {
+    x = (x << 16) | ids[i];
   }
 
+  for (size_t i = ngram - 1; i < ids.size(); i++) {
+    x = ((x << 16) | ids[i]) & mask;
+    shingles[i - (ngram - 1)] = mix_shingle(x);
+  }
 
   return true;
 }
+
+void compute_minhash_packed(const std::vector<uint64_t> &shingles,
+                            uint32_t seed_begin,
+                            uint32_t seed_end,
+                            uint32_t *dst) {
+
+  // # of seeds processed in one pass over the shingles.
+  constexpr uint32_t kBlock = 8;
+
+  const uint64_t *x = shingles.data();
+  const size_t n = shingles.size();
+
+  for (uint32_t s0 = seed_begin; s0 < seed_end; s0 += kBlock) {
+    uint64_t a[kBlock];
+    uint64_t b[kBlock];
+    uint32_t m[kBlock];
+
+    for (uint32_t k = 0; k < kBlock; k++) {
+      a[k] = splitmix64(2ull * (s0 + k)) | 1ull;  // odd multiplier
+      b[k] = splitmix64(2ull * (s0 + k) + 1ull);
+      m[k] = (std::numeric_limits<uint32_t>::max)();
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      const uint64_t h = x[i];
+      for (uint32_t k = 0; k < kBlock; k++) {
+        const uint32_t v = uint32_t((a[k] * h + b[k]) >> 32);
+        m[k] = (v < m[k]) ? v : m[k];
+      }
+    }
+
+    // (a * x + b) >> 32 can be UINT32_MAX; keep it for empty documents.
+    constexpr uint32_t kMaxHash = (std::numeric_limits<uint32_t>::max)() - 1;
+    const uint32_t nb = (std::min)(kBlock, seed_end - s0);
+    for (uint32_t k = 0; k < nb; k++) {
+      dst[s0 - seed_begin + k] = n ? (std::min)(m[k], kMaxHash) : m[k];
+    }
+  }
+}
@@ -10,6 +10,7 @@
 
 #include "str-util.hh"
 #include "MurmurHash3.h"
+#include "xxhash.h"
 
 #if 0
 // B-byte minhash
@@ -198,28 +199,173 @@ bool sort_minhashes(
 #endif
 
 ///
-/// Modify vocab id so that a vocab which contains digit character(includes Zenkaku digit) to a vocab id whose string is all composed of placeholder character
+/// Canonical id of tokens dropped from the dedup view(vocab id 0 is not used).
 ///
+constexpr uint16_t kDedupDropId = 0;
+
 ///
-/// Example(placeholder_str = "0")
+/// Build the token id -> canonical id table of the dedup view(65536 entries,
+/// indexed by token id).
 ///
-/// Input
+/// - A token containing digit characters(includes Zenkaku digits) maps to
+///   the token whose string has the digits replaced with `placeholder_str`,
+///   or to one representative token of that string when it is not in the
+///   vocab.
+/// - A token composed only of punctuation and whitespace maps to
+///   kDedupDropId.
+/// - Other tokens map to themselves.
 ///
-/// "012" -> 1000
-/// "125" -> 2000
+/// Example(placeholder_str = "0")
 ///
-/// =>
+/// "000" -> 3000, "012" -> 1000, "125" -> 2000
 ///
-/// "000" -> 3000
-/// "012" -> 3000
-/// "125" -> 3000
+/// =>
 ///
+/// id_map[3000] = id_map[1000] = id_map[2000] = 3000
 ///
-
-bool num_to_placeholder(
+bool build_dedup_id_map(
   const std::map<std::string, int> &str_to_id_map,
   const std::string &placeholder_str,
-  std::map<std::string, int> &dst);
+  std::vector<uint16_t> &id_map /* out */,
+  std::string &err);
+
+///
+/// Apply `id_map` to `n` token ids(one gather per id) and drop kDedupDropId.
+/// `dst` must have room for `n` ids.
+///
+/// @return # of ids written to `dst`.
+///
+size_t apply_dedup_id_map(
+  const std::vector<uint16_t> &id_map,
+  const int *ids,
+  size_t n,
+  uint16_t *dst);
+
+// FNV-1a 32bit hash
+inline uint32_t FNV32(const uint8_t *addr, const size_t nbytes) {
+  constexpr uint32_t kPrime = 0x01000193;
+  constexpr uint32_t kOffsetBasis = 0x811c9dc5;
+
+  uint32_t hash = kOffsetBasis;
+
+  for (size_t i = 0; i < nbytes; i++) {
+    hash = (hash ^ addr[i]) * kPrime;
+  }
+
+  return hash;
+}
+
+// FNV-1a 64bit hash
+inline uint64_t FNV64(const uint8_t *addr, const size_t nbytes) {
+  constexpr uint64_t kPrime = 0x00000100000001b3ull;
+  constexpr uint64_t kOffsetBasis = 0xcbf29ce484222325ull;
+
+  uint64_t hash = kOffsetBasis;
+
+  for (size_t i = 0; i < nbytes; i++) {
+    hash = (hash ^ addr[i]) * kPrime;
+  }
+
+  return hash;
+}
+
+///
+/// 64-bit hash functions of shingle bytes. Pass one as the template
+/// parameter of hash_token_shingles()(and compute_minhash_tokenized()).
+///
+struct FNV1aHash
+{
+  static const char *name() { return "fnv1a64"; }
+
+  static uint64_t hash(const void *data, size_t nbytes) {
+    return FNV64(reinterpret_cast<const uint8_t *>(data), nbytes);
+  }
+};
+
+// xxHash 0.6(vendored xxhash.c has no XXH3 yet)
+struct XXH64Hash
+{
+  static const char *name() { return "xxh64"; }
+
+  static uint64_t hash(const void *data, size_t nbytes) {
+    return uint64_t(XXH64(data, nbytes, /* seed */0));
+  }
+};
+
+struct Murmur3Hash
+{
+  static const char *name() { return "murmur3"; }
+
+  static uint64_t hash(const void *data, size_t nbytes) {
+    uint64_t h[2];
+    MurmurHash3_x64_128(data, int(nbytes), /* seed */0, reinterpret_cast<void *>(h));
+    return h[0];
+  }
+};
+
+///
+/// Hash the bytes of each n-gram of token ids with `Hasher`(any n). A text
+/// with less than `ngram` ids gives a single shingle of all ids.
+///
+template<class Hasher = XXH64Hash>
+bool hash_token_shingles(const std::vector<uint16_t> &ids,
+                         uint32_t ngram,
+                         std::vector<uint64_t> &shingles /* out */) {
+
+  shingles.clear();
+
+  if (ngram == 0) {
+    return false;
+  }
+
+  if (ids.empty()) {
+    return true;
+  }
+
+  if (ids.size() < ngram) {
+    shingles.push_back(Hasher::hash(ids.data(), sizeof(uint16_t) * ids.size()));
+    return true;
+  }
+
+  shingles.resize(ids.size() - ngram + 1);
+  for (size_t i = 0; i < shingles.size(); i++) {
+    shingles[i] = Hasher::hash(ids.data() + i, sizeof(uint16_t) * ngram);
+  }
+
+  return true;
+}
+
+///
+/// Max n of token id n-grams packed into a 64-bit shingle(4 x 16-bit ids).
+///
+constexpr uint32_t kMaxPackedNgram = 4;
+
+///
+/// Pack each n-gram(n <= kMaxPackedNgram) of token ids into a 64-bit word by
+/// shifting ids in 16 bits each, then hash it with one 64-bit mix. A text
+/// with less than `ngram` ids gives a single shingle of all ids.
+///
+/// @return false when `ngram` is 0 or larger than kMaxPackedNgram.
+///
+bool pack_token_shingles(const std::vector<uint16_t> &ids,
+                         uint32_t ngram,
+                         std::vector<uint64_t> &shingles /* out */);
+
+///
+/// MinHash of 64-bit shingle hashes(see pack_token_shingles and
+/// hash_token_shingles) for seeds [seed_begin, seed_end), stored to
+/// `dst[seed - seed_begin]`.
+///
+/// Each seed is a multiply-shift hash `(a * x + b) >> 32` of the mixed
+/// shingle(a, b: derived from the seed), so a hash costs one multiply and
+/// seeds are processed in blocks over the contiguous shingle array.
+/// Minimums are clamped to UINT32_MAX - 1, so UINT32_MAX only comes from an
+/// empty `shingles`(the empty-document signature).
+///
+void compute_minhash_packed(const std::vector<uint64_t> &shingles,
+                            uint32_t seed_begin,
+                            uint32_t seed_end,
+                            uint32_t *dst);
 
 #if 0
 ///
@@ -1,6 +1,9 @@
+#include <atomic>
 #include <cstdlib>
 #include <cstdio>
 #include <future>
+#include <limits>
+#include <thread>
 #include <unordered_map>
 #include <inttypes.h>
 
@@ -23,6 +26,7 @@
 
 #include "common.h"  // from zstd example
 #include "pbar.hpp"
+#include "stage-stats.hh"
 
 //
 #define SAFETENSORS_CPP_IMPLEMENTATION
@@ -63,7 +67,10 @@ static bool zstd_compress_to_file(const void *buf, const size_t size,
 
 static bool zstd_compress_to_memory(const void *buf, const size_t size,
                                     std::vector<uint8_t> &mem) {
+  stagestats::ScopedTimer timer(stagestats::Stage::Compress);
+
   size_t cBuffSize = ZSTD_compressBound(size);
+  stagestats::add_alloc(stagestats::Stage::Compress, cBuffSize);
 
   /* Compress.
    * If you are doing many compressions, you may want to reuse the context.
@@ -76,6 +83,7 @@ static bool zstd_compress_to_memory(const void *buf, const size_t size,
   CHECK_ZSTD(cSize);
 
   printf("\nzstd compress: %6u -> %7u \n", (unsigned)size, (unsigned)cSize);
+  stagestats::add_bytes(stagestats::Stage::Compress, size, cSize);
 
   mem.resize(cSize);
   memcpy(mem.data(), cBuff, cSize);
@@ -85,16 +93,212 @@ static bool zstd_compress_to_memory(const void *buf, const size_t size,
   return true;
 }
 
+static uint32_t cpu_count() {
+  return (std::max)(1u, std::thread::hardware_concurrency());
+}
+
+// Progressive minhash configs(b = 20 bands of r rows).
+// Level 0 is computed for all documents. Level k + 1 is only computed for
+// documents whose band key collided with another document at level k: a pair
+// of documents whose bands collide with r = 450 almost surely collides with
+// r = 10, so the cheap pass filters out most documents before the 800/9000
+// hash passes.
+constexpr uint32_t kNumBands = 20;
+constexpr uint32_t kNumLevels = 3;
+constexpr uint32_t kProgressiveRows[kNumLevels] = {10, 40, 450};
+
+///
+/// MinHash signature of token id n-gram shingles.
+///
+/// Computes `dst[seed - seed_begin]` for seeds [seed_begin, seed_end), so the
+/// signature of a lower level can be extended to a higher level without
+/// recomputing its hashes. A document with less than `ngram` tokens has one
+/// shingle of all tokens. An empty document has the signature of all
+/// UINT32_MAX.
+///
+/// n <= kMaxPackedNgram packs ids into 64-bit shingles(pack_token_shingles).
+/// Larger n hashes the bytes of each shingle once with `Hasher`. Then each
+/// seed is a multiply-shift of the 64-bit shingle(compute_minhash_packed).
+///
+template<class Hasher = XXH64Hash>
 bool compute_minhash_tokenized(
-  const nanotokenizer::CedarTrieTokenizer &tokenizer,
-  const std::string &str,
-  uint32_t r,
-  uint32_t b) {
+  const std::vector<uint16_t> &ids,
+  uint32_t ngram,
+  uint32_t seed_begin,
+  uint32_t seed_end,
+  uint32_t *dst) {
+
+  if ((ngram == 0) || (seed_begin > seed_end)) {
+    return false;
+  }
+
+  static thread_local std::vector<uint64_t> shingles;
+
+  bool ret;
+  if (ngram <= kMaxPackedNgram) {
+    ret = pack_token_shingles(ids, ngram, shingles);
+  } else {
+    ret = hash_token_shingles<Hasher>(ids, ngram, shingles);
+  }
+
+  if (!ret) {
+    return false;
+  }
 
+  compute_minhash_packed(shingles, seed_begin, seed_end, dst);
 
   return true;
 }
 
+///
+/// Micro-benchmark and collision check of `Hasher` on the shingles of
+/// tokenized documents.
+///
+/// 64-bit hashes of distinct shingles must not collide. Collisions of the
+/// lower 32 bits must be close to the birthday bound k(k-1)/2^33.
+///
+template<class Hasher>
+static bool test_shingle_hash(const std::vector<std::vector<uint16_t>> &docs,
+                              uint32_t ngram) {
+
+  // micro-benchmark: best of 3
+  std::vector<uint64_t> shingles;
+  uint64_t n_shingles = 0;
+  uint64_t checksum = 0;
+  uint64_t best_ns = (std::numeric_limits<uint64_t>::max)();
+  for (int rep = 0; rep < 3; rep++) {
+    n_shingles = 0;
+    uint64_t start = stagestats::now_ns();
+    for (const auto &ids : docs) {
+      hash_token_shingles<Hasher>(ids, ngram, shingles);
+      n_shingles += shingles.size();
+      for (const uint64_t h : shingles) {
+        checksum += h;
+      }
+    }
+    best_ns = (std::min)(best_ns, stagestats::now_ns() - start);
+  }
+
+  // collisions of distinct shingles
+  std::unordered_set<std::string> distinct;
+  for (const auto &ids : docs) {
+    if (ids.empty()) {
+      continue;
+    }
+    const size_t n = (ids.size() < ngram) ? 1 : (ids.size() - ngram + 1);
+    const size_t len = (std::min)(size_t(ngram), ids.size());
+    for (size_t i = 0; i < n; i++) {
+      distinct.emplace(reinterpret_cast<const char *>(ids.data() + i), sizeof(uint16_t) * len);
+    }
+  }
+
+  std::unordered_set<uint64_t> hashes64;
+  std::unordered_set<uint32_t> hashes32;
+  for (const auto &s : distinct) {
+    const uint64_t h = Hasher::hash(s.data(), s.size());
+    hashes64.insert(h);
+    hashes32.insert(uint32_t(h));
+  }
+
+  const double k = double(distinct.size());
+  const double expected32 = k * (k - 1.0) / 8589934592.0;
+  const uint64_t collisions64 = distinct.size() - hashes64.size();
+  const uint64_t collisions32 = distinct.size() - hashes32.size();
+
+  const double ns = double(best_ns) / double((std::max)(n_shingles, uint64_t(1)));
+  const double mb_per_sec = (best_ns > 0) ? double(n_shingles * ngram * sizeof(uint16_t)) / (1024.0 * 1024.0) / (double(best_ns) * 1e-9) : 0.0;
+
+  const bool ok = (collisions64 == 0) && (double(collisions32) <= 4.0 * expected32 + 4.0);
+
+  printf("%-8s %7.2f ns/shingle %9.1f MB/s  distinct %8llu  collisions(64bit) %llu  collisions(32bit) %llu(expected %.1f)  %s  [%016llx]\n",
+         Hasher::name(), ns, mb_per_sec, (unsigned long long)distinct.size(),
+         (unsigned long long)collisions64, (unsigned long long)collisions32,
+         expected32, ok ? "OK" : "FAIL", (unsigned long long)checksum);
+
+  return ok;
+}
+
+///
+/// Find documents which share a band key with another document.
+///
+/// `hashes` are signatures of `num_docs` documents(b * r hashes each). Each
+/// band of r hashes is hashed to a 64-bit key. `collided[i]` is set when
+/// document i shares a key with any other document(candidate for the next
+/// level), `duplicated[i]` when it shares a key with an earlier document.
+///
+/// Documents with `excluded[i]` set(no shingle, e.g. nothing is left after
+/// apply_dedup_id_map) are skipped: their all-UINT32_MAX signatures would
+/// otherwise collide with each other.
+///
+static void find_band_collisions(const std::vector<uint32_t> &hashes,
+                                 size_t num_docs, uint32_t b, uint32_t r,
+                                 const std::vector<uint8_t> &excluded,
+                                 std::vector<uint8_t> &collided,
+                                 std::vector<uint8_t> &duplicated) {
+  stagestats::ScopedTimer timer(stagestats::Stage::Dedup);
+
+  const size_t sig_len = size_t(b) * size_t(r);
+
+  collided.assign(num_docs, 0);
+  duplicated.assign(num_docs, 0);
+
+  const uint32_t nthreads = (std::min)(cpu_count(), b);
+
+  std::vector<std::vector<uint8_t>> thread_collided(nthreads);
+  std::vector<std::vector<uint8_t>> thread_duplicated(nthreads);
+
+  std::vector<std::thread> workers;
+  std::atomic<uint32_t> band_idx(0);
+
+  for (uint32_t t = 0; t < nthreads; t++) {
+    workers.emplace_back(std::thread([&, t]() {
+      std::vector<uint8_t> &c_flags = thread_collided[t];
+      std::vector<uint8_t> &d_flags = thread_duplicated[t];
+      c_flags.assign(num_docs, 0);
+      d_flags.assign(num_docs, 0);
+
+      // band key -> first document which has the key.
+      std::unordered_map<uint64_t, uint32_t> first_doc;
+      first_doc.reserve(num_docs);
+
+      uint32_t band;
+      while ((band = (band_idx++)) < b) {
+        first_doc.clear();
+
+        for (size_t i = 0; i < num_docs; i++) {
+          if (excluded[i]) {
+            continue;
+          }
+
+          uint64_t key[2];
+          MurmurHash3_x64_128(reinterpret_cast<const void *>(hashes.data() + i * sig_len + band * r),
+                              int(r * sizeof(uint32_t)), band, reinterpret_cast<void *>(key));
+
+          auto it = first_doc.find(key[0]);
+          if (it == first_doc.end()) {
+            first_doc.emplace(key[0], uint32_t(i));
+          } else {
+            c_flags[it->second] = 1;
+            c_flags[i] = 1;
+            d_flags[i] = 1;
+          }
+        }
+      }
+    }));
+  }
+
+  for (auto &th : workers) {
+    th.join();
+  }
+
+  for (uint32_t t = 0; t < nthreads; t++) {
+    for (size_t i = 0; i < num_docs; i++) {
+      collided[i] |= thread_collided[t][i];
+      duplicated[i] |= thread_duplicated[t][i];
+    }
+  }
+}
+
 // 32bit hash
 bool saveMinhashAsSafetensor(const std::string &input_filename,
                              const std::string &vocab_filename,
@@ -203,7 +407,10 @@ bool saveMinhashAsSafetensor(const std::string &input_filename,
   }
 
   std::string warn, err;
+  uint64_t write_start = stagestats::now_ns();
   bool ret = safetensors::save_to_file(st, st_filename, &warn, &err);
+  stagestats::add_time(stagestats::Stage::Write, stagestats::now_ns() - write_start);
+  stagestats::add_bytes(stagestats::Stage::Write, st.storage.size(), st.storage.size());
 
   if (warn.size()) {
     std::cout << "SaveToSafetensors WARN: " << warn << "\n";
@@ -217,10 +424,6 @@ bool saveMinhashAsSafetensor(const std::string &input_filename,
   return true;
 }
 
-static uint32_t cpu_count() {
-  return (std::max)(1u, std::thread::hardware_concurrency());
-}
-
 constexpr size_t kMaxSize =
     1024ull * 1024ull * 1024ull * 128ull;  // up to 128GB when uncompressed.
 
@@ -309,6 +512,8 @@ static std::string zstd_decompress_stream(const char *fname) {
 }
 
 static std::string zstd_decompress(const char *fname) {
+  stagestats::ScopedTimer timer(stagestats::Stage::Decompress);
+
   size_t cSize;
   void *const cBuff = mallocAndLoadFile_orDie(fname, &cSize);
 
@@ -325,10 +530,14 @@ static std::string zstd_decompress(const char *fname) {
   if (rSize == ZSTD_CONTENTSIZE_UNKNOWN) {
     // Use streaming API
     free(cBuff);
-    return zstd_decompress_stream(fname);
+    std::string buf = zstd_decompress_stream(fname);
+    stagestats::add_bytes(stagestats::Stage::Decompress, cSize, buf.size());
+    stagestats::add_alloc(stagestats::Stage::Decompress, buf.size());
+    return buf;
   }
 
   void *const rBuff = malloc_orDie((size_t)rSize);
+  stagestats::add_alloc(stagestats::Stage::Decompress, cSize + rSize);
 
   /* Decompress.
    * If you are doing many decompressions, you may want to reuse the context
@@ -345,6 +554,7 @@ static std::string zstd_decompress(const char *fname) {
 
   // assume decoded data is utf-8 string.
   std::string buf(reinterpret_cast<const char *>(rBuff), dSize);
+  stagestats::add_bytes(stagestats::Stage::Decompress, cSize, dSize);
 
   free(rBuff);
   free(cBuff);
@@ -353,6 +563,14 @@ static std::string zstd_decompress(const char *fname) {
 }
 
 std::vector<nlohmann::json> decode_jsonl(std::vector<std::string> &&json_strs) {
+  stagestats::ScopedTimer timer(stagestats::Stage::Parse);
+  uint64_t bytes = 0;
+  for (const auto &s : json_strs) {
+    bytes += s.size();
+  }
+  stagestats::add_bytes(stagestats::Stage::Parse, bytes, 0);
+  stagestats::add_records(stagestats::Stage::Parse, json_strs.size());
+
   uint32_t nthreads = cpu_count();
 
   std::vector<std::thread> workers;
@@ -452,9 +670,13 @@ bool build_tokenizer(nanotokenizer::CedarTrieTokenizer &tok,
   return true;
 }
 
+///
+/// Tokenizer with the unmodified vocab + token id -> canonical id table of the
+/// dedup view(see build_dedup_id_map).
+///
 bool build_tokenizer_for_dedup(/* inout */nanotokenizer::CedarTrieTokenizer &tok,
                       const std::string &vocab_filename,
-                      /* out */std::unordered_set<uint16_t> &punct_table,
+                      /* out */std::vector<uint16_t> &id_map,
                       const std::string &placeholder_str = "0") {
   std::ifstream ifs(vocab_filename);
 
@@ -467,33 +689,17 @@ bool build_tokenizer_for_dedup(/* inout */nanotokenizer::CedarTrieTokenizer &tok
     str_to_id_map[it.key()] = int(it.value());
   }
 
-  std::map<std::string, int> filtered_str_to_id_map;
-  num_to_placeholder(str_to_id_map, placeholder_str, filtered_str_to_id_map);
-
-  // dbg
-  for (const auto &it: filtered_str_to_id_map) {
-    std::cout << it.first << ":" << it.second << "\n";
-  }
-
   std::string err;
-  if (!tok.load_vocab(filtered_str_to_id_map, err)) {
+  if (!tok.load_vocab(str_to_id_map, err)) {
     fprintf(stderr, "Failed to setup Tokenizer: %s", err.c_str());
     return false;
   }
 
-  std::unordered_set<std::string> punct_strs = jpnormalizer::get_unicode_puncts();
-
-  // Build table of tokenized punctuation string
-  for (const auto &p : punct_strs) {
-    int id = tok.id_from_str(p);
-    if (id > 0) {
-      punct_table.insert(uint16_t(id));
-    } else {
-      std::cout << "Punctuation `" << p << "` is not present in vocab. Ignore this.\n";
-    }
+  if (!build_dedup_id_map(str_to_id_map, placeholder_str, id_map, err)) {
+    fprintf(stderr, "Failed to build dedup id map: %s", err.c_str());
+    return false;
   }
 
-
   return true;
 }
 
@@ -506,12 +712,13 @@ void print_help() {
   std::cout << "--directory(-d) DIR  : Process files in the directory instead of a file\n";
   std::cout << "--outdir(-o) DIR     : Output directory\n";
   std::cout << "--hashconfig(-g)     : 0: b=20 r=450(9000 hashes. Jaccard 0.8), 1: b=20 r=40(800 hashes. Jaccard 0.9), 2: b=20 r=10(200 hashes. Jaccard 0.96)\n";
-  std::cout << "--ngram(-n)          : n for N-gram(max 32). default 5.\n";
+  std::cout << "--ngram(-n)          : n for N-gram of token ids(max 32). default 4. n <= 4 hashes 64-bit packed shingles(fast).\n";
   std::cout << "--vocab(-b) FILENAME : Specify Vocab JSON file for tokenization\n";
   std::cout << "--codepoint(-c)      : Use codepoint representation of UTF-8 character(faster tokenization).\n";
   std::cout << "--zcomp_level(-z)    : Compression level for ZSTD compression. default 9\n";
   std::cout << "--text_key(-k)       : Specify JSON key for text data(default `text`)\n";
-  std::cout << "--test(-s)           : Do tests.\n";
+  std::cout << "--test(-s)           : Benchmark and check collisions of shingle hashes(fnv1a64, xxh64, murmur3) on the input, then exit.\n";
+  std::cout << "--stats(-j) FILE     : Write time/bytes/records of each stage(JSON) to FILE(`-` = stdout) at exit.\n";
   std::cout << "--help(-h)           : Print this help\n";
 }
 
@@ -528,12 +735,14 @@ int main(int argc, char **argv) {
                                      {"ngram", 'n', OPTPARSE_REQUIRED},
                                      {"ngram", 'n', OPTPARSE_REQUIRED},
                                      {"test", 's', OPTPARSE_NONE},
+                                     {"stats", 'j', OPTPARSE_REQUIRED},
                                      {"help", 'h', OPTPARSE_NONE},
                                      {0}};
 
-  int ngram = 5;
+  int ngram = 4;
   int zcomp_level = 9;
   bool do_test{false};
+  std::string stats_filename;
   int hashconfig = 0; // default: 9000 hashes
   std::string num_placeholder_str = "0";
 
@@ -584,6 +793,9 @@ int main(int argc, char **argv) {
       case 's':
         do_test = true;
         break;
+      case 'j':
+        stats_filename = options.optarg;
+        break;
       case 'z':
         // zstd itself supports level up to 22, but 15+ requires not prectical to use since it comsumes lots of time for compression
         zcomp_level = (std::max)(1, (std::min)(15, std::atoi(options.optarg)));
@@ -603,6 +815,11 @@ int main(int argc, char **argv) {
     filename = std::string(input_file_arg);
   }
 
+  if (!stats_filename.empty()) {
+    stagestats::begin_run(std::string("fuzzy_dedup ") + filename);
+    stagestats::write_json_at_exit(stats_filename);
+  }
+
   fs::path outdir_path(outdir);
 
   if (!fs::exists(outdir_path)) {
@@ -612,63 +829,210 @@ int main(int argc, char **argv) {
     }
   }
 
-  int total = 1;
+  // hashconfig 0: r=450, 1: r=40, 2: r=10
+  const uint32_t final_level = kNumLevels - 1 - uint32_t(hashconfig);
+
+  int total = int(final_level) + 2;  // tokenize + levels
   pbar::pbar bar(total, /* ncols */ 100, "[Task]");
 
   bar.enable_recalc_console_width(1);
   bar.init();
 
   std::vector<nlohmann::json> js = load_jsonl_zstd(filename);
-  std::vector<uint8_t> texts = flatten_texts(js, text_key);
-
-  std::vector<int32_t> sa;
-
-  std::string out_filename = "output-sa";
 
   std::unique_ptr<nanotokenizer::CedarTrieTokenizer> tokenizer(new nanotokenizer::CedarTrieTokenizer(use_codepoint));
 
-  std::unordered_set<uint16_t> punct_table;
-  if (!build_tokenizer_for_dedup(*tokenizer, vocab_json_filename, punct_table, num_placeholder_str)) {
+  std::vector<uint16_t> dedup_id_map;
+  if (!build_tokenizer_for_dedup(*tokenizer, vocab_json_filename, dedup_id_map, num_placeholder_str)) {
     exit(-1);
   }
-  out_filename += "-tokenized";
 
-  std::vector<int> input_ids;
-  std::string s(texts.begin(), texts.begin() + texts.size());
-  if (!tokenizer->encode(s, input_ids)) {
-    fprintf(stderr, "tokenize failed.\n");
-    exit(-1);
-  }
+  const size_t num_docs = js.size();
 
-  std::vector<uint16_t> input_ids_u16;
-  input_ids_u16.resize(input_ids.size());
+  // Tokenize each document.
+  std::vector<std::vector<uint16_t>> doc_ids(num_docs);
+  {
+    stagestats::ScopedTimer timer(stagestats::Stage::Tokenize);
+
+    std::vector<std::thread> workers;
+    std::atomic<uint64_t> i(0ull);
+    std::atomic<uint64_t> text_bytes(0ull);
+    std::atomic<bool> failed(false);
+
+    for (uint32_t t = 0; t < cpu_count(); t++) {
+      workers.emplace_back(std::thread([&]() {
+        uint64_t idx;
+        std::vector<int> input_ids;
+
+        while ((idx = (i++)) < num_docs) {
+          // find(): operator[] would insert a missing key into the shared json.
+          const nlohmann::json &j = js[idx];
+          const auto it = j.find(text_key);
+          if ((it == j.end()) || !it->is_string()) {
+            fprintf(stderr, "`%s` string not found. document %d\n", text_key.c_str(), int(idx));
+            failed = true;
+            continue;
+          }
+          const std::string &text = it->get_ref<const std::string &>();
+          text_bytes += text.size();
+
+          if (!tokenizer->encode(text, input_ids)) {
+            fprintf(stderr, "tokenize failed. document %d\n", int(idx));
+            failed = true;
+            continue;
+          }
+
+          // digits -> placeholder, drop punctuation/whitespace.
+          std::vector<uint16_t> &ids = doc_ids[idx];
+          ids.resize(input_ids.size());
+          ids.resize(apply_dedup_id_map(dedup_id_map, input_ids.data(), input_ids.size(), ids.data()));
+        }
+      }));
+    }
 
-  for (size_t i = 0; i < input_ids.size(); i++) {
-    if ((input_ids[i] < 0) ||
-        (input_ids[i] > (std::numeric_limits<uint16_t>::max)())) {
-      fprintf(stderr, "token id must be in range [0, 65535]\n");
+    for (auto &th : workers) {
+      th.join();
+    }
+
+    if (failed) {
       exit(-1);
     }
-    input_ids_u16[i] = uint16_t(input_ids[i]);
+
+    uint64_t n_ids = 0;
+    for (const auto &ids : doc_ids) {
+      n_ids += ids.size();
+    }
+    stagestats::add_bytes(stagestats::Stage::Tokenize, text_bytes, n_ids * sizeof(uint16_t));
+    stagestats::add_records(stagestats::Stage::Tokenize, num_docs);
   }
+  ++bar;
 
-  //if (do_test) {
-  //  test_tokenize(*tokenizer, s, input_ids_u16);
-  //}
+  if (do_test) {
+    printf("\nshingle hash test(%d-gram of token ids, %d documents)\n", ngram, int(num_docs));
+    bool ok = true;
+    ok &= test_shingle_hash<FNV1aHash>(doc_ids, uint32_t(ngram));
+    ok &= test_shingle_hash<XXH64Hash>(doc_ids, uint32_t(ngram));
+    ok &= test_shingle_hash<Murmur3Hash>(doc_ids, uint32_t(ngram));
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
 
+  // foo.jsonl.zst -> foo
+  std::string stem = fs::path(filename).filename().string();
+  for (const std::string ext : {".zst", ".jsonl"}) {
+    if ((stem.size() > ext.size()) && (stem.compare(stem.size() - ext.size(), ext.size(), ext) == 0)) {
+      stem.erase(stem.size() - ext.size());
+    }
+  }
 
-#if 0
-  out_filename += ".safetensors";
-  fs::path out_filepath = outdir_path / fs::path(out_filename);
-  if (!saveSuffixArraySafetensor(out_filepath, vocab_json_filename, tokenize, use_codepoint, out_filename,
-                       reinterpret_cast<const uint8_t *>(sa.data()),
-                       sa.size() * sizeof(int32_t))) {
-    fprintf(stderr, "Failed to save suffix array.");
-    exit(-1);
+  // documents processed at the current level(index into `js`)
+  std::vector<int> level_docs(num_docs);
+  for (size_t i = 0; i < num_docs; i++) {
+    level_docs[i] = int(i);
   }
-#endif
 
-  ++bar;
+  // signatures of `level_docs` at the previous level.
+  std::vector<uint32_t> prev_hashes;
+  uint32_t prev_sig_len = 0;
+
+  std::vector<uint8_t> duplicated;
+
+  for (uint32_t level = 0; level <= final_level; level++) {
+    const uint32_t r = kProgressiveRows[level];
+    const uint32_t sig_len = kNumBands * r;
+    const size_t n = level_docs.size();
+
+    std::vector<uint32_t> hashes(n * size_t(sig_len));
+    {
+      stagestats::ScopedTimer timer(stagestats::Stage::Hash);
+
+      std::vector<std::thread> workers;
+      std::atomic<uint64_t> i(0ull);
+      std::atomic<bool> failed(false);
+
+      for (uint32_t t = 0; t < cpu_count(); t++) {
+        workers.emplace_back(std::thread([&]() {
+          uint64_t idx;
+
+          while ((idx = (i++)) < n) {
+            uint32_t *sig = hashes.data() + idx * sig_len;
+
+            // reuse hashes of the previous level.
+            if (prev_sig_len) {
+              memcpy(sig, prev_hashes.data() + idx * prev_sig_len, sizeof(uint32_t) * prev_sig_len);
+            }
+
+            if (!compute_minhash_tokenized(doc_ids[size_t(level_docs[idx])], uint32_t(ngram),
+                                           prev_sig_len, sig_len, sig + prev_sig_len)) {
+              fprintf(stderr, "minhash failed. document %d\n", level_docs[idx]);
+              failed = true;
+            }
+          }
+        }));
+      }
+
+      for (auto &th : workers) {
+        th.join();
+      }
+
+      if (failed) {
+        exit(-1);
+      }
+
+      stagestats::add_records(stagestats::Stage::Hash, n);
+      stagestats::add_alloc(stagestats::Stage::Hash, hashes.size() * sizeof(uint32_t));
+    }
+
+    std::vector<uint8_t> excluded(n);
+    for (size_t i = 0; i < n; i++) {
+      excluded[i] = doc_ids[size_t(level_docs[i])].empty();
+    }
+
+    std::vector<uint8_t> collided;
+    find_band_collisions(hashes, n, kNumBands, r, excluded, collided, duplicated);
+
+    uint64_t n_collided = 0;
+    uint64_t n_duplicated = 0;
+    for (size_t i = 0; i < n; i++) {
+      n_collided += collided[i];
+      n_duplicated += duplicated[i];
+    }
+    stagestats::add_records(stagestats::Stage::Dedup, n, n_duplicated);
+
+    std::string st_filename = stem + "-minhash-b" + std::to_string(kNumBands) + "-r" + std::to_string(r) + ".safetensors";
+    fs::path st_filepath = outdir_path / fs::path(st_filename);
+    saveMinhashAsSafetensor(filename, vocab_json_filename, /* is_tokenized */true, use_codepoint,
+                            st_filepath.string(), level_docs, duplicated,
+                            int(kNumBands), int(r), hashes);
+
+    std::cout << "\nlevel " << level << "(b=" << kNumBands << " r=" << r << "): "
+              << n << " documents, " << n_collided << " candidates, "
+              << n_duplicated << " duplicates -> " << st_filepath.string() << "\n";
+
+    ++bar;
+
+    if (level == final_level) {
+      break;
+    }
+
+    // Escalate colliding documents to the next level.
+    std::vector<int> next_docs;
+    std::vector<uint32_t> next_hashes;
+    for (size_t i = 0; i < n; i++) {
+      if (collided[i]) {
+        next_docs.push_back(level_docs[i]);
+        next_hashes.insert(next_hashes.end(), hashes.begin() + i * sig_len, hashes.begin() + (i + 1) * sig_len);
+      }
+    }
+
+    level_docs = std::move(next_docs);
+    prev_hashes = std::move(next_hashes);
+    prev_sig_len = sig_len;
+
+    if (level_docs.empty()) {
+      // No candidates: remaining levels have nothing to do.
+      break;
+    }
+  }
 
   std::cout << std::flush;
 }
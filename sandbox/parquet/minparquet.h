@@ -9,6 +9,7 @@
 // Configuration (define before including):
 //   #define MINPQ_NO_GZIP    - Disable GZIP decompression
 //   #define MINPQ_NO_ZSTD    - Disable ZSTD decompression
+//   #define MINPQ_NO_MMAP    - Read the whole file instead of mmap'ing it
 
 #ifndef MINPARQUET_H_
 #define MINPARQUET_H_
@@ -24,6 +25,14 @@
 #include <algorithm>
 #include <unordered_map>
 
+#if !defined(MINPQ_NO_MMAP) && !defined(_WIN32)
+#define MINPQ_USE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 // Forward declarations for compression libraries
 #ifndef MINPQ_NO_GZIP
 extern "C" {
@@ -896,7 +905,7 @@ private:
     bool is_literal_;
     size_t literal_pos_;
     int buffer_pos_;
-    uint8_t current_byte_;
+    uint8_t current_byte_ = 0;
 };
 
 // ============================================================================
@@ -933,6 +942,18 @@ public:
         return true;
     }
 
+    // Zero-copy variant: `value` points into the decoder's input.
+    bool read_byte_array(std::string_view& value) {
+        if (pos_ + 4 > size_) return false;
+        uint32_t len;
+        std::memcpy(&len, data_ + pos_, 4);
+        pos_ += 4;
+        if (pos_ + len > size_) return false;
+        value = std::string_view(reinterpret_cast<const char*>(data_ + pos_), len);
+        pos_ += len;
+        return true;
+    }
+
     bool read_byte_array(std::vector<uint8_t>& value) {
         if (pos_ + 4 > size_) return false;
         uint32_t len;
@@ -1238,337 +1259,408 @@ struct ColumnData {
     std::vector<uint8_t> data;
     std::vector<int16_t> def_levels;
     std::vector<int16_t> rep_levels;
-    size_t num_values;
+    size_t num_values = 0;
     Type type;
     std::optional<int32_t> type_length;
 };
 
-// ============================================================================
-// ParquetReader
-// ============================================================================
-
-class ParquetReader {
-public:
-    ParquetReader() = default;
-
-    bool open(const std::string& filename) {
-        std::ifstream file(filename, std::ios::binary | std::ios::ate);
-        if (!file) {
-            error_ = "Failed to open file: " + filename;
-            return false;
-        }
-
-        size_t file_size = static_cast<size_t>(file.tellg());
-        file.seekg(0, std::ios::beg);
-
-        data_.resize(file_size);
-        if (!file.read(reinterpret_cast<char*>(data_.data()), file_size)) {
-            error_ = "Failed to read file";
-            return false;
-        }
-
-        return parse();
-    }
-
-    bool open(const uint8_t* data, size_t size) {
-        data_.assign(data, data + size);
-        return parse();
-    }
-
-    size_t num_row_groups() const {
-        return metadata_ ? metadata_->row_groups.size() : 0;
-    }
+// Arrow-style BYTE_ARRAY column: values are stored back to back in one
+// buffer and value i is data[offsets[i], offsets[i + 1]). Null values are
+// empty and have valid[i] == 0. No per-value allocation.
+struct ByteArrayColumn {
+    std::vector<uint8_t> data;
+    std::vector<uint64_t> offsets{0};
+    std::vector<uint8_t> valid;
 
-    size_t num_columns() const {
-        if (!metadata_ || metadata_->row_groups.empty()) return 0;
-        return metadata_->row_groups[0].columns.size();
-    }
+    size_t size() const { return offsets.size() - 1; }
 
-    int64_t num_rows() const {
-        return metadata_ ? metadata_->num_rows : 0;
-    }
+    bool is_null(size_t i) const { return !valid[i]; }
 
-    int64_t num_rows_in_group(size_t row_group) const {
-        if (!metadata_ || row_group >= metadata_->row_groups.size()) return 0;
-        return metadata_->row_groups[row_group].num_rows;
+    std::string_view value(size_t i) const {
+        return std::string_view(reinterpret_cast<const char*>(data.data()) + offsets[i],
+                                static_cast<size_t>(offsets[i + 1] - offsets[i]));
     }
 
-    std::string_view column_name(size_t col) const {
-        if (!metadata_) return "";
-        // Schema element 0 is root, column elements start at 1
-        size_t schema_idx = col + 1;
-        if (schema_idx >= metadata_->schema.size()) return "";
-        return metadata_->schema[schema_idx].name;
+    void clear() {
+        data.clear();
+        offsets.assign(1, 0);
+        valid.clear();
     }
+};
 
-    std::optional<Type> column_type(size_t col) const {
-        if (!metadata_) return std::nullopt;
-        size_t schema_idx = col + 1;
-        if (schema_idx >= metadata_->schema.size()) return std::nullopt;
-        return metadata_->schema[schema_idx].type;
-    }
+// ============================================================================
+// ColumnChunkReader
+// ============================================================================
 
-    const SchemaElement* column_schema(size_t col) const {
-        if (!metadata_) return nullptr;
-        size_t schema_idx = col + 1;
-        if (schema_idx >= metadata_->schema.size()) return nullptr;
-        return &metadata_->schema[schema_idx];
-    }
+// Page-by-page reader of one column chunk. Pages are decompressed one at a
+// time into a reused buffer (uncompressed pages are decoded in place), so
+// only the bytes of this chunk are touched. Dictionary pages are consumed
+// internally.
+class ColumnChunkReader {
+public:
+    ColumnChunkReader(const uint8_t* chunk, size_t chunk_size,
+                      const ColumnMetaData& meta,
+                      int max_def_level, int max_rep_level,
+                      std::optional<int32_t> type_length)
+        : chunk_(chunk), chunk_size_(chunk_size), pos_(0), meta_(meta),
+          max_def_level_(max_def_level), max_rep_level_(max_rep_level),
+          type_length_(type_length) {}
+
+    Type type() const { return meta_.type; }
+
+    // Decode the next data page into `page` (previous contents are cleared).
+    // Returns false at the end of the chunk or on error (error() is set).
+    bool next_page(ColumnData& page) {
+        page.data.clear();
+        page.def_levels.clear();
+        page.rep_levels.clear();
+        page.num_values = 0;
+        page.type = meta_.type;
+        page.type_length = type_length_;
+        return decode_next_page(page);
+    }
+
+    // Decode all remaining pages, appending to `result`.
+    bool read_all(ColumnData& result) {
+        result.type = meta_.type;
+        result.type_length = type_length_;
+        while (decode_next_page(result)) {}
+        return error_.empty();
+    }
+
+    // Decode the next data page of a BYTE_ARRAY column into one view per
+    // row (null => empty view, valid[i] == 0). Views point into the page
+    // buffer, the mmap'ed file or the dictionary page, and stay valid until
+    // the next call.
+    bool next_page_views(std::vector<std::string_view>& values,
+                         std::vector<uint8_t>* valid = nullptr) {
+        values.clear();
+        if (valid) valid->clear();
+        if (meta_.type != Type::BYTE_ARRAY) {
+            error_ = "Not a BYTE_ARRAY column";
+            return false;
+        }
 
-    const std::vector<SchemaElement>& schema() const {
-        static std::vector<SchemaElement> empty;
-        return metadata_ ? metadata_->schema : empty;
-    }
+        const uint8_t* page_ptr;
+        size_t page_size;
+        PageHeader header;
+        if (!next_data_page(page_ptr, page_size, header)) {
+            return false;
+        }
 
-    const FileMetaData* metadata() const {
-        return metadata_ ? &*metadata_ : nullptr;
+        def_levels_.clear();
+        rep_levels_.clear();
+        PageValues page;
+        if (!decode_levels(page_ptr, page_size, header, def_levels_, rep_levels_, page) ||
+            !decode_byte_array_views(page, def_levels_, values, valid)) {
+            error_ = "Failed to decode data page";
+            return false;
+        }
+        return true;
     }
 
-    std::optional<ColumnData> read_column(size_t row_group, size_t column) {
-        if (!metadata_) {
-            error_ = "No metadata loaded";
-            return std::nullopt;
+    // Decode all remaining pages of a BYTE_ARRAY column, appending to `result`.
+    bool read_byte_array(ByteArrayColumn& result) {
+        if (result.offsets.empty()) result.offsets.push_back(0);
+        if (meta_.total_uncompressed_size > 0) {
+            result.data.reserve(result.data.size() + static_cast<size_t>(meta_.total_uncompressed_size));
         }
-        if (row_group >= metadata_->row_groups.size()) {
-            error_ = "Row group out of range";
-            return std::nullopt;
-        }
-        const auto& rg = metadata_->row_groups[row_group];
-        if (column >= rg.columns.size()) {
-            error_ = "Column out of range";
-            return std::nullopt;
+        if (meta_.num_values > 0) {
+            result.offsets.reserve(result.offsets.size() + static_cast<size_t>(meta_.num_values));
+            result.valid.reserve(result.valid.size() + static_cast<size_t>(meta_.num_values));
         }
 
-        const auto& cc = rg.columns[column];
-        if (!cc.meta_data) {
-            error_ = "Missing column metadata";
-            return std::nullopt;
+        std::vector<std::string_view> values;
+        std::vector<uint8_t> valid;
+        while (next_page_views(values, &valid)) {
+            for (std::string_view v : values) {
+                const uint8_t* p = reinterpret_cast<const uint8_t*>(v.data());
+                result.data.insert(result.data.end(), p, p + v.size());
+                result.offsets.push_back(result.data.size());
+            }
+            result.valid.insert(result.valid.end(), valid.begin(), valid.end());
         }
-
-        return read_column_chunk(cc, column);
-    }
-
-    // Typed convenience readers
-    std::optional<std::vector<int32_t>> read_int32_column(size_t rg, size_t col) {
-        auto data = read_column(rg, col);
-        if (!data || data->type != Type::INT32) return std::nullopt;
-        return decode_values<int32_t>(*data);
-    }
-
-    std::optional<std::vector<int64_t>> read_int64_column(size_t rg, size_t col) {
-        auto data = read_column(rg, col);
-        if (!data || data->type != Type::INT64) return std::nullopt;
-        return decode_values<int64_t>(*data);
-    }
-
-    std::optional<std::vector<float>> read_float_column(size_t rg, size_t col) {
-        auto data = read_column(rg, col);
-        if (!data || data->type != Type::FLOAT) return std::nullopt;
-        return decode_values<float>(*data);
-    }
-
-    std::optional<std::vector<double>> read_double_column(size_t rg, size_t col) {
-        auto data = read_column(rg, col);
-        if (!data || data->type != Type::DOUBLE) return std::nullopt;
-        return decode_values<double>(*data);
+        return error_.empty();
     }
 
-    std::optional<std::vector<std::string>> read_string_column(size_t rg, size_t col) {
-        auto data = read_column(rg, col);
-        if (!data || data->type != Type::BYTE_ARRAY) return std::nullopt;
-        return decode_byte_array_values(*data);
-    }
-
-    std::optional<std::vector<bool>> read_bool_column(size_t rg, size_t col) {
-        auto data = read_column(rg, col);
-        if (!data || data->type != Type::BOOLEAN) return std::nullopt;
-        return decode_bool_values(*data);
-    }
+    bool at_end() const { return pos_ >= chunk_size_; }
 
     const std::string& error() const { return error_; }
 
 private:
-    bool parse() {
-        if (data_.size() < 12) {
-            error_ = "File too small";
-            return false;
-        }
-
-        // Check magic bytes at start and end
-        if (std::memcmp(data_.data(), "PAR1", 4) != 0) {
-            error_ = "Invalid magic at start";
-            return false;
-        }
-        if (std::memcmp(data_.data() + data_.size() - 4, "PAR1", 4) != 0) {
-            error_ = "Invalid magic at end";
-            return false;
-        }
-
-        // Read metadata length (4 bytes before final magic)
-        uint32_t metadata_len;
-        std::memcpy(&metadata_len, data_.data() + data_.size() - 8, 4);
-
-        if (metadata_len + 8 > data_.size()) {
-            error_ = "Invalid metadata length";
+    // Non-null values of a data page after its levels.
+    struct PageValues {
+        const uint8_t* ptr = nullptr;
+        size_t size = 0;
+        Encoding encoding = Encoding::PLAIN;
+        size_t num_values = 0;
+    };
+
+    // Decode the next data page and append its values to `result`.
+    bool decode_next_page(ColumnData& result) {
+        const uint8_t* page_ptr;
+        size_t page_size;
+        PageHeader header;
+        if (!next_data_page(page_ptr, page_size, header)) {
             return false;
         }
-
-        // Parse metadata
-        const uint8_t* metadata_start = data_.data() + data_.size() - 8 - metadata_len;
-        metadata_ = MetadataParser::parse(metadata_start, metadata_len);
-        if (!metadata_) {
-            error_ = "Failed to parse metadata";
+        if (!process_data_page(page_ptr, page_size, header, result)) {
+            error_ = "Failed to decode data page";
             return false;
         }
-
         return true;
     }
 
-    std::optional<ColumnData> read_column_chunk(const ColumnChunk& cc, size_t col_idx) {
-        const auto& meta = *cc.meta_data;
-        ColumnData result;
-        result.type = meta.type;
-
-        // Get type length for fixed-length byte arrays
-        const auto* schema = column_schema(col_idx);
-        if (schema && schema->type_length) {
-            result.type_length = *schema->type_length;
-        }
-
-        // Calculate max definition/repetition levels
-        int max_def_level = 0;
-        int max_rep_level = 0;
-        if (schema) {
-            // Simple heuristic: if optional, max_def = 1
-            if (schema->repetition_type == FieldRepetitionType::OPTIONAL) {
-                max_def_level = 1;
-            }
-            if (schema->repetition_type == FieldRepetitionType::REPEATED) {
-                max_rep_level = 1;
-            }
-        }
-
-        // Determine start offset
-        int64_t offset = meta.dictionary_page_offset.value_or(meta.data_page_offset);
-        int64_t end_offset = offset + meta.total_compressed_size;
-
-        // Dictionary for dictionary encoding
-        std::vector<uint8_t> dictionary_data;
-        size_t dict_num_values = 0;
-
-        // Read pages
-        size_t pos = static_cast<size_t>(offset);
-        while (pos < static_cast<size_t>(end_offset) && pos < data_.size()) {
+    // Advance to the next data page (dictionary pages are stored, index
+    // pages skipped) and return its decompressed bytes.
+    bool next_data_page(const uint8_t*& page_ptr, size_t& page_size, PageHeader& header) {
+        while (pos_ < chunk_size_) {
             size_t header_size;
-            auto page_header = PageHeaderParser::parse(data_.data() + pos,
-                                                       data_.size() - pos,
+            auto page_header = PageHeaderParser::parse(chunk_ + pos_,
+                                                       chunk_size_ - pos_,
                                                        header_size);
             if (!page_header) {
                 error_ = "Failed to parse page header";
-                return std::nullopt;
+                return false;
             }
 
-            pos += header_size;
+            pos_ += header_size;
 
-            // Get compressed data
             size_t compressed_size = static_cast<size_t>(page_header->compressed_page_size);
             size_t uncompressed_size = static_cast<size_t>(page_header->uncompressed_page_size);
 
-            if (pos + compressed_size > data_.size()) {
+            if (pos_ + compressed_size > chunk_size_) {
                 error_ = "Page data out of bounds";
-                return std::nullopt;
+                return false;
             }
 
-            // Decompress if needed
-            std::vector<uint8_t> page_data;
-            if (meta.codec == CompressionCodec::UNCOMPRESSED ||
-                compressed_size == uncompressed_size) {
-                page_data.assign(data_.data() + pos, data_.data() + pos + compressed_size);
-            } else {
-                page_data.resize(uncompressed_size);
-                if (!Decompressor::decompress(meta.codec,
-                                             data_.data() + pos, compressed_size,
-                                             page_data.data(), uncompressed_size)) {
-                    error_ = "Decompression failed";
-                    return std::nullopt;
+            const uint8_t* src = chunk_ + pos_;
+            pos_ += compressed_size;
+
+            // DATA_PAGE_V2 stores levels uncompressed in front of the values.
+            size_t levels_size = 0;
+            bool compressed = (meta_.codec != CompressionCodec::UNCOMPRESSED);
+            if (page_header->type == PageType::DATA_PAGE_V2 && page_header->data_page_header_v2) {
+                const auto& v2 = *page_header->data_page_header_v2;
+                levels_size = static_cast<size_t>(v2.repetition_levels_byte_length) +
+                              static_cast<size_t>(v2.definition_levels_byte_length);
+                if (v2.is_compressed && !*v2.is_compressed) compressed = false;
+                if (levels_size > compressed_size || levels_size > uncompressed_size) {
+                    error_ = "Invalid level lengths";
+                    return false;
                 }
             }
 
-            pos += compressed_size;
+            page_ptr = src;
+            page_size = compressed_size;
+            if (compressed && compressed_size != uncompressed_size) {
+                page_buf_.resize(uncompressed_size);
+                std::memcpy(page_buf_.data(), src, levels_size);
+                if (!Decompressor::decompress(meta_.codec,
+                                             src + levels_size, compressed_size - levels_size,
+                                             page_buf_.data() + levels_size,
+                                             uncompressed_size - levels_size)) {
+                    error_ = "Decompression failed";
+                    return false;
+                }
+                page_ptr = page_buf_.data();
+                page_size = uncompressed_size;
+            }
 
-            // Process page based on type
             if (page_header->type == PageType::DICTIONARY_PAGE) {
                 if (page_header->dictionary_page_header) {
-                    dict_num_values = static_cast<size_t>(
+                    dict_num_values_ = static_cast<size_t>(
                         page_header->dictionary_page_header->num_values);
                 }
-                dictionary_data = std::move(page_data);
+                dictionary_.assign(page_ptr, page_ptr + page_size);
+                if (meta_.type == Type::BYTE_ARRAY && !index_dictionary()) {
+                    error_ = "Failed to decode dictionary page";
+                    return false;
+                }
             } else if (page_header->type == PageType::DATA_PAGE ||
                        page_header->type == PageType::DATA_PAGE_V2) {
-                if (!process_data_page(page_data, *page_header, meta,
-                                      dictionary_data, dict_num_values,
-                                      max_def_level, max_rep_level,
-                                      result)) {
-                    return std::nullopt;
-                }
+                header = std::move(*page_header);
+                return true;
             }
         }
 
-        return result;
+        return false;
+    }
+
+    // Views of the BYTE_ARRAY dictionary values (no per-value allocation).
+    bool index_dictionary() {
+        dict_views_.clear();
+        dict_views_.reserve(dict_num_values_);
+        PlainDecoder decoder(dictionary_.data(), dictionary_.size());
+        for (size_t i = 0; i < dict_num_values_; i++) {
+            std::string_view v;
+            if (!decoder.read_byte_array(v)) return false;
+            dict_views_.push_back(v);
+        }
+        return true;
     }
 
-    bool process_data_page(const std::vector<uint8_t>& page_data,
+    bool process_data_page(const uint8_t* page_ptr, size_t page_size,
                           const PageHeader& header,
-                          const ColumnMetaData& meta,
-                          const std::vector<uint8_t>& dictionary_data,
-                          size_t dict_num_values,
-                          int max_def_level,
-                          int max_rep_level,
-                          ColumnData& result) {
-        const uint8_t* ptr = page_data.data();
-        size_t remaining = page_data.size();
-        int32_t num_values = 0;
-        Encoding encoding = Encoding::PLAIN;
+                          ColumnData& result) const {
+        PageValues page;
+        if (!decode_levels(page_ptr, page_size, header,
+                           result.def_levels, result.rep_levels, page)) {
+            return false;
+        }
 
-        if (header.type == PageType::DATA_PAGE_V2 && header.data_page_header_v2) {
-            // DATA_PAGE V2: levels stored uncompressed at the start with explicit lengths
-            num_values = header.data_page_header_v2->num_values;
-            encoding = header.data_page_header_v2->encoding;
+        const uint8_t* ptr = page.ptr;
+        size_t remaining = page.size;
+        const Encoding encoding = page.encoding;
+        const size_t actual_values = page.num_values;
 
-            int32_t rep_len = header.data_page_header_v2->repetition_levels_byte_length;
-            int32_t def_len = header.data_page_header_v2->definition_levels_byte_length;
+        // Decode values
+        if (encoding == Encoding::PLAIN_DICTIONARY || encoding == Encoding::RLE_DICTIONARY) {
+            // Dictionary encoding
+            if (remaining < 1) return false;
+            int bit_width = *ptr++;
+            remaining--;
 
-            if (max_rep_level > 0 && rep_len > 0) {
-                int bit_width = bit_width_for_max(max_rep_level);
-                RleBitPackingDecoder rep_decoder(ptr, rep_len, bit_width);
-                for (int i = 0; i < num_values; i++) {
-                    int32_t level;
-                    if (rep_decoder.get_next(level)) {
-                        result.rep_levels.push_back(static_cast<int16_t>(level));
-                    }
+            RleBitPackingDecoder idx_decoder(ptr, remaining, bit_width);
+            std::vector<int32_t> indices;
+            for (size_t i = 0; i < actual_values; i++) {
+                int32_t idx;
+                if (idx_decoder.get_next(idx)) {
+                    indices.push_back(idx);
                 }
-                ptr += rep_len;
-                remaining -= rep_len;
             }
 
-            if (max_def_level > 0 && def_len > 0) {
-                int bit_width = bit_width_for_max(max_def_level);
-                RleBitPackingDecoder def_decoder(ptr, def_len, bit_width);
-                for (int i = 0; i < num_values; i++) {
-                    int32_t level;
-                    if (def_decoder.get_next(level)) {
-                        result.def_levels.push_back(static_cast<int16_t>(level));
-                    }
-                }
-                ptr += def_len;
-                remaining -= def_len;
+            // Decode dictionary values
+            decode_dictionary(meta_.type, dictionary_, dict_num_values_,
+                            indices, result);
+        } else if (encoding == Encoding::PLAIN && meta_.type == Type::BOOLEAN) {
+            // Plain booleans are bit-packed (LSB first); expand to one byte per value
+            if (remaining * 8 < actual_values) return false;
+            for (size_t i = 0; i < actual_values; i++) {
+                result.data.push_back((ptr[i / 8] >> (i % 8)) & 1);
             }
-        } else if (header.type == PageType::DATA_PAGE && header.data_page_header) {
-            // DATA_PAGE V1: levels prefixed with 4-byte length
-            num_values = header.data_page_header->num_values;
-            encoding = header.data_page_header->encoding;
+        } else if (encoding == Encoding::PLAIN) {
+            // Plain encoding - just copy raw bytes
+            size_t old_size = result.data.size();
+            result.data.resize(old_size + remaining);
+            std::memcpy(result.data.data() + old_size, ptr, remaining);
+        } else if (encoding == Encoding::RLE && meta_.type == Type::BOOLEAN) {
+            // Boolean RLE encoding
+            if (remaining < 4) return false;
+            uint32_t rle_len;
+            std::memcpy(&rle_len, ptr, 4);
+            ptr += 4;
+            remaining -= 4;
 
-            if (max_rep_level > 0) {
+            RleBitPackingDecoder bool_decoder(ptr, std::min(remaining, static_cast<size_t>(rle_len)), 1);
+            for (size_t i = 0; i < actual_values; i++) {
+                int32_t val;
+                if (bool_decoder.get_next(val)) {
+                    result.data.push_back(val ? 1 : 0);
+                }
+            }
+        }
+
+        result.num_values += actual_values;
+        return true;
+    }
+
+    // One view per row of a BYTE_ARRAY data page (PLAIN or dictionary).
+    bool decode_byte_array_views(const PageValues& page,
+                                 const std::vector<int16_t>& def_levels,
+                                 std::vector<std::string_view>& values,
+                                 std::vector<uint8_t>* valid) const {
+        const bool has_levels = !def_levels.empty();
+        const size_t num_rows = has_levels ? def_levels.size() : page.num_values;
+        values.reserve(values.size() + num_rows);
+        if (valid) valid->reserve(valid->size() + num_rows);
+
+        if (page.encoding == Encoding::PLAIN) {
+            PlainDecoder decoder(page.ptr, page.size);
+            for (size_t r = 0; r < num_rows; r++) {
+                const bool present = !has_levels || def_levels[r] == max_def_level_;
+                std::string_view v;
+                if (present && !decoder.read_byte_array(v)) return false;
+                values.push_back(v);
+                if (valid) valid->push_back(present ? 1 : 0);
+            }
+        } else if (page.encoding == Encoding::PLAIN_DICTIONARY ||
+                   page.encoding == Encoding::RLE_DICTIONARY) {
+            if (page.size < 1) return false;
+            int bit_width = page.ptr[0];
+            RleBitPackingDecoder idx_decoder(page.ptr + 1, page.size - 1, bit_width);
+            for (size_t r = 0; r < num_rows; r++) {
+                const bool present = !has_levels || def_levels[r] == max_def_level_;
+                std::string_view v;
+                if (present) {
+                    int32_t idx;
+                    if (!idx_decoder.get_next(idx) || idx < 0 ||
+                        static_cast<size_t>(idx) >= dict_views_.size()) {
+                        return false;
+                    }
+                    v = dict_views_[idx];
+                }
+                values.push_back(v);
+                if (valid) valid->push_back(present ? 1 : 0);
+            }
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    // Decode repetition/definition levels of a data page (appended to
+    // `def_levels`/`rep_levels`) and locate its values.
+    bool decode_levels(const uint8_t* page_ptr, size_t page_size,
+                       const PageHeader& header,
+                       std::vector<int16_t>& def_levels,
+                       std::vector<int16_t>& rep_levels,
+                       PageValues& values) const {
+        const uint8_t* ptr = page_ptr;
+        size_t remaining = page_size;
+        int32_t num_values = 0;
+        Encoding encoding = Encoding::PLAIN;
+        const size_t def_levels_begin = def_levels.size();
+
+        if (header.type == PageType::DATA_PAGE_V2 && header.data_page_header_v2) {
+            // DATA_PAGE V2: levels stored uncompressed at the start with explicit lengths
+            num_values = header.data_page_header_v2->num_values;
+            encoding = header.data_page_header_v2->encoding;
+
+            int32_t rep_len = header.data_page_header_v2->repetition_levels_byte_length;
+            int32_t def_len = header.data_page_header_v2->definition_levels_byte_length;
+
+            if (max_rep_level_ > 0 && rep_len > 0) {
+                int bit_width = bit_width_for_max(max_rep_level_);
+                RleBitPackingDecoder rep_decoder(ptr, rep_len, bit_width);
+                for (int i = 0; i < num_values; i++) {
+                    int32_t level;
+                    if (rep_decoder.get_next(level)) {
+                        rep_levels.push_back(static_cast<int16_t>(level));
+                    }
+                }
+                ptr += rep_len;
+                remaining -= rep_len;
+            }
+
+            if (max_def_level_ > 0 && def_len > 0) {
+                int bit_width = bit_width_for_max(max_def_level_);
+                RleBitPackingDecoder def_decoder(ptr, def_len, bit_width);
+                for (int i = 0; i < num_values; i++) {
+                    int32_t level;
+                    if (def_decoder.get_next(level)) {
+                        def_levels.push_back(static_cast<int16_t>(level));
+                    }
+                }
+                ptr += def_len;
+                remaining -= def_len;
+            }
+        } else if (header.type == PageType::DATA_PAGE && header.data_page_header) {
+            // DATA_PAGE V1: levels prefixed with 4-byte length
+            num_values = header.data_page_header->num_values;
+            encoding = header.data_page_header->encoding;
+
+            if (max_rep_level_ > 0) {
                 if (remaining < 4) return false;
                 uint32_t rep_len;
                 std::memcpy(&rep_len, ptr, 4);
@@ -1576,19 +1668,19 @@ private:
                 remaining -= 4;
 
                 if (remaining < rep_len) return false;
-                int bit_width = bit_width_for_max(max_rep_level);
+                int bit_width = bit_width_for_max(max_rep_level_);
                 RleBitPackingDecoder rep_decoder(ptr, rep_len, bit_width);
                 for (int i = 0; i < num_values; i++) {
                     int32_t level;
                     if (rep_decoder.get_next(level)) {
-                        result.rep_levels.push_back(static_cast<int16_t>(level));
+                        rep_levels.push_back(static_cast<int16_t>(level));
                     }
                 }
                 ptr += rep_len;
                 remaining -= rep_len;
             }
 
-            if (max_def_level > 0) {
+            if (max_def_level_ > 0) {
                 if (remaining < 4) return false;
                 uint32_t def_len;
                 std::memcpy(&def_len, ptr, 4);
@@ -1596,12 +1688,12 @@ private:
                 remaining -= 4;
 
                 if (remaining < def_len) return false;
-                int bit_width = bit_width_for_max(max_def_level);
+                int bit_width = bit_width_for_max(max_def_level_);
                 RleBitPackingDecoder def_decoder(ptr, def_len, bit_width);
                 for (int i = 0; i < num_values; i++) {
                     int32_t level;
                     if (def_decoder.get_next(level)) {
-                        result.def_levels.push_back(static_cast<int16_t>(level));
+                        def_levels.push_back(static_cast<int16_t>(level));
                     }
                 }
                 ptr += def_len;
@@ -1609,57 +1701,19 @@ private:
             }
         }
 
-        // Count actual values (non-null)
+        // Count actual values (non-null) in this page
         size_t actual_values = num_values;
-        if (!result.def_levels.empty()) {
+        if (def_levels.size() > def_levels_begin) {
             actual_values = 0;
-            for (auto dl : result.def_levels) {
-                if (dl == max_def_level) actual_values++;
+            for (size_t i = def_levels_begin; i < def_levels.size(); i++) {
+                if (def_levels[i] == max_def_level_) actual_values++;
             }
         }
 
-        // Decode values
-        if (encoding == Encoding::PLAIN_DICTIONARY || encoding == Encoding::RLE_DICTIONARY) {
-            // Dictionary encoding
-            if (remaining < 1) return false;
-            int bit_width = *ptr++;
-            remaining--;
-
-            RleBitPackingDecoder idx_decoder(ptr, remaining, bit_width);
-            std::vector<int32_t> indices;
-            for (size_t i = 0; i < actual_values; i++) {
-                int32_t idx;
-                if (idx_decoder.get_next(idx)) {
-                    indices.push_back(idx);
-                }
-            }
-
-            // Decode dictionary values
-            decode_dictionary(meta.type, dictionary_data, dict_num_values,
-                            indices, result);
-        } else if (encoding == Encoding::PLAIN) {
-            // Plain encoding - just copy raw bytes
-            size_t old_size = result.data.size();
-            result.data.resize(old_size + remaining);
-            std::memcpy(result.data.data() + old_size, ptr, remaining);
-        } else if (encoding == Encoding::RLE && meta.type == Type::BOOLEAN) {
-            // Boolean RLE encoding
-            if (remaining < 4) return false;
-            uint32_t rle_len;
-            std::memcpy(&rle_len, ptr, 4);
-            ptr += 4;
-            remaining -= 4;
-
-            RleBitPackingDecoder bool_decoder(ptr, std::min(remaining, static_cast<size_t>(rle_len)), 1);
-            for (size_t i = 0; i < actual_values; i++) {
-                int32_t val;
-                if (bool_decoder.get_next(val)) {
-                    result.data.push_back(val ? 1 : 0);
-                }
-            }
-        }
-
-        result.num_values += actual_values;
+        values.ptr = ptr;
+        values.size = remaining;
+        values.encoding = encoding;
+        values.num_values = actual_values;
         return true;
     }
 
@@ -1667,7 +1721,7 @@ private:
                           const std::vector<uint8_t>& dict_data,
                           size_t dict_num_values,
                           const std::vector<int32_t>& indices,
-                          ColumnData& result) {
+                          ColumnData& result) const {
         PlainDecoder dict_decoder(dict_data.data(), dict_data.size());
 
         switch (type) {
@@ -1732,13 +1786,9 @@ private:
                 break;
             }
             case Type::BYTE_ARRAY: {
-                std::vector<std::string> dict_values(dict_num_values);
-                for (size_t i = 0; i < dict_num_values; i++) {
-                    dict_decoder.read_byte_array(dict_values[i]);
-                }
                 for (int32_t idx : indices) {
-                    if (idx >= 0 && static_cast<size_t>(idx) < dict_values.size()) {
-                        const auto& val = dict_values[idx];
+                    if (idx >= 0 && static_cast<size_t>(idx) < dict_views_.size()) {
+                        std::string_view val = dict_views_[idx];
                         uint32_t len = static_cast<uint32_t>(val.size());
                         size_t old_size = result.data.size();
                         result.data.resize(old_size + 4 + len);
@@ -1753,6 +1803,380 @@ private:
         }
     }
 
+    static int bit_width_for_max(int max_value) {
+        if (max_value <= 0) return 0;
+        int width = 0;
+        while ((1 << width) <= max_value) width++;
+        return width;
+    }
+
+    const uint8_t* chunk_;
+    size_t chunk_size_;
+    size_t pos_;
+    ColumnMetaData meta_;
+    int max_def_level_;
+    int max_rep_level_;
+    std::optional<int32_t> type_length_;
+
+    std::vector<uint8_t> page_buf_;
+    std::vector<uint8_t> dictionary_;
+    std::vector<std::string_view> dict_views_;  // BYTE_ARRAY dictionary values
+    size_t dict_num_values_ = 0;
+    std::vector<int16_t> def_levels_;  // scratch for next_page_views()
+    std::vector<int16_t> rep_levels_;
+    std::string error_;
+};
+
+// ============================================================================
+// ParquetReader
+// ============================================================================
+
+class ParquetReader {
+public:
+    ParquetReader() = default;
+    ~ParquetReader() { close(); }
+
+    ParquetReader(const ParquetReader&) = delete;
+    ParquetReader& operator=(const ParquetReader&) = delete;
+
+    // Open a Parquet file. The file is mmap'ed (unless MINPQ_NO_MMAP) and
+    // only the footer is parsed; column chunks are paged in when read.
+    bool open(const std::string& filename) {
+        close();
+
+#ifdef MINPQ_USE_MMAP
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            error_ = "Failed to open file: " + filename;
+            return false;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            error_ = "Failed to stat file: " + filename;
+            return false;
+        }
+        size_t file_size = static_cast<size_t>(st.st_size);
+        if (file_size == 0) {
+            ::close(fd);
+            error_ = "File too small";
+            return false;
+        }
+        void* addr = ::mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED) {
+            error_ = "Failed to mmap file: " + filename;
+            return false;
+        }
+        // Columns are read selectively; readahead is requested per chunk.
+        ::madvise(addr, file_size, MADV_RANDOM);
+
+        map_addr_ = addr;
+        map_size_ = file_size;
+        data_ = static_cast<const uint8_t*>(addr);
+        size_ = file_size;
+#else
+        std::ifstream file(filename, std::ios::binary | std::ios::ate);
+        if (!file) {
+            error_ = "Failed to open file: " + filename;
+            return false;
+        }
+
+        size_t file_size = static_cast<size_t>(file.tellg());
+        file.seekg(0, std::ios::beg);
+
+        buffer_.resize(file_size);
+        if (!file.read(reinterpret_cast<char*>(buffer_.data()), file_size)) {
+            error_ = "Failed to read file";
+            return false;
+        }
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+#endif
+
+        return parse();
+    }
+
+    // Open an in-memory Parquet file. `data` is not copied and must outlive
+    // the reader.
+    bool open(const uint8_t* data, size_t size) {
+        close();
+        data_ = data;
+        size_ = size;
+        return parse();
+    }
+
+    void close() {
+#ifdef MINPQ_USE_MMAP
+        if (map_addr_) {
+            ::munmap(map_addr_, map_size_);
+            map_addr_ = nullptr;
+            map_size_ = 0;
+        }
+#endif
+        buffer_.clear();
+        data_ = nullptr;
+        size_ = 0;
+        metadata_.reset();
+    }
+    size_t num_row_groups() const {
+        return metadata_ ? metadata_->row_groups.size() : 0;
+    }
+
+    size_t num_columns() const {
+        if (!metadata_ || metadata_->row_groups.empty()) return 0;
+        return metadata_->row_groups[0].columns.size();
+    }
+
+    int64_t num_rows() const {
+        return metadata_ ? metadata_->num_rows : 0;
+    }
+
+    int64_t num_rows_in_group(size_t row_group) const {
+        if (!metadata_ || row_group >= metadata_->row_groups.size()) return 0;
+        return metadata_->row_groups[row_group].num_rows;
+    }
+
+    std::string_view column_name(size_t col) const {
+        if (!metadata_) return "";
+        // Schema element 0 is root, column elements start at 1
+        size_t schema_idx = col + 1;
+        if (schema_idx >= metadata_->schema.size()) return "";
+        return metadata_->schema[schema_idx].name;
+    }
+
+    std::optional<Type> column_type(size_t col) const {
+        if (!metadata_) return std::nullopt;
+        size_t schema_idx = col + 1;
+        if (schema_idx >= metadata_->schema.size()) return std::nullopt;
+        return metadata_->schema[schema_idx].type;
+    }
+
+    const SchemaElement* column_schema(size_t col) const {
+        if (!metadata_) return nullptr;
+        size_t schema_idx = col + 1;
+        if (schema_idx >= metadata_->schema.size()) return nullptr;
+        return &metadata_->schema[schema_idx];
+    }
+
+    const std::vector<SchemaElement>& schema() const {
+        static std::vector<SchemaElement> empty;
+        return metadata_ ? metadata_->schema : empty;
+    }
+
+    const FileMetaData* metadata() const {
+        return metadata_ ? &*metadata_ : nullptr;
+    }
+
+    std::optional<ColumnData> read_column(size_t row_group, size_t column) {
+        return read_column(row_group, column, error_);
+    }
+
+    // Const variant which reports errors to `err` instead of error().
+    // Safe to call from multiple threads (e.g. one row group per thread).
+    std::optional<ColumnData> read_column(size_t row_group, size_t column,
+                                          std::string& err) const {
+        if (!metadata_) {
+            err = "No metadata loaded";
+            return std::nullopt;
+        }
+        if (row_group >= metadata_->row_groups.size()) {
+            err = "Row group out of range";
+            return std::nullopt;
+        }
+        const auto& rg = metadata_->row_groups[row_group];
+        if (column >= rg.columns.size()) {
+            err = "Column out of range";
+            return std::nullopt;
+        }
+
+        const auto& cc = rg.columns[column];
+        if (!cc.meta_data) {
+            err = "Missing column metadata";
+            return std::nullopt;
+        }
+
+        auto chunk = column_chunk(row_group, column, err);
+        if (!chunk) return std::nullopt;
+
+        ColumnData result;
+        if (!chunk->read_all(result)) {
+            err = chunk->error();
+            return std::nullopt;
+        }
+        return result;
+    }
+
+    // Page-level reader of one column chunk. Only the byte range of the
+    // chunk is accessed. The reader must outlive the returned object.
+    std::optional<ColumnChunkReader> column_chunk(size_t row_group, size_t column,
+                                                  std::string& err) const {
+        if (!metadata_) {
+            err = "No metadata loaded";
+            return std::nullopt;
+        }
+        if (row_group >= metadata_->row_groups.size()) {
+            err = "Row group out of range";
+            return std::nullopt;
+        }
+        const auto& rg = metadata_->row_groups[row_group];
+        if (column >= rg.columns.size()) {
+            err = "Column out of range";
+            return std::nullopt;
+        }
+
+        const auto& cc = rg.columns[column];
+        if (!cc.meta_data) {
+            err = "Missing column metadata";
+            return std::nullopt;
+        }
+        const auto& meta = *cc.meta_data;
+
+        // Calculate max definition/repetition levels
+        int max_def_level = 0;
+        int max_rep_level = 0;
+        std::optional<int32_t> type_length;
+        if (const auto* schema = column_schema(column)) {
+            // Simple heuristic: if optional, max_def = 1
+            if (schema->repetition_type == FieldRepetitionType::OPTIONAL) {
+                max_def_level = 1;
+            }
+            if (schema->repetition_type == FieldRepetitionType::REPEATED) {
+                max_rep_level = 1;
+            }
+            type_length = schema->type_length;
+        }
+
+        // Chunk starts at the dictionary page, if any
+        int64_t offset = meta.dictionary_page_offset.value_or(meta.data_page_offset);
+        int64_t end_offset = offset + meta.total_compressed_size;
+        if (offset < 0 || static_cast<size_t>(offset) > size_) {
+            err = "Column chunk out of bounds";
+            return std::nullopt;
+        }
+        size_t begin = static_cast<size_t>(offset);
+        size_t end = std::min(static_cast<size_t>(end_offset), size_);
+
+#ifdef MINPQ_USE_MMAP
+        if (map_addr_ && end > begin) {
+            static const size_t page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+            size_t aligned = begin & ~(page_size - 1);
+            ::madvise(static_cast<uint8_t*>(map_addr_) + aligned, end - aligned, MADV_WILLNEED);
+        }
+#endif
+
+        return ColumnChunkReader(data_ + begin, end - begin, meta,
+                                 max_def_level, max_rep_level, type_length);
+    }
+
+    // Column index of top-level column `name`, or -1.
+    int64_t find_column(std::string_view name) const {
+        for (size_t col = 0; col < num_columns(); col++) {
+            if (column_name(col) == name) return static_cast<int64_t>(col);
+        }
+        return -1;
+    }
+
+    // Typed convenience readers
+    std::optional<std::vector<int32_t>> read_int32_column(size_t rg, size_t col) {
+        auto data = read_column(rg, col);
+        if (!data || data->type != Type::INT32) return std::nullopt;
+        return decode_values<int32_t>(*data);
+    }
+
+    std::optional<std::vector<int64_t>> read_int64_column(size_t rg, size_t col) {
+        auto data = read_column(rg, col);
+        if (!data || data->type != Type::INT64) return std::nullopt;
+        return decode_values<int64_t>(*data);
+    }
+
+    std::optional<std::vector<float>> read_float_column(size_t rg, size_t col) {
+        auto data = read_column(rg, col);
+        if (!data || data->type != Type::FLOAT) return std::nullopt;
+        return decode_values<float>(*data);
+    }
+
+    std::optional<std::vector<double>> read_double_column(size_t rg, size_t col) {
+        auto data = read_column(rg, col);
+        if (!data || data->type != Type::DOUBLE) return std::nullopt;
+        return decode_values<double>(*data);
+    }
+
+    std::optional<std::vector<std::string>> read_string_column(size_t rg, size_t col) {
+        auto data = read_byte_array_column(rg, col, error_);
+        if (!data) return std::nullopt;
+        std::vector<std::string> result;
+        result.reserve(data->size());
+        for (size_t i = 0; i < data->size(); i++) {
+            result.emplace_back(data->value(i));
+        }
+        return result;
+    }
+
+    // BYTE_ARRAY column as one buffer + offsets (see ByteArrayColumn).
+    // Safe to call from multiple threads.
+    std::optional<ByteArrayColumn> read_byte_array_column(size_t row_group, size_t column,
+                                                          std::string& err) const {
+        auto chunk = column_chunk(row_group, column, err);
+        if (!chunk) return std::nullopt;
+        if (chunk->type() != Type::BYTE_ARRAY) {
+            err = "Not a BYTE_ARRAY column";
+            return std::nullopt;
+        }
+
+        ByteArrayColumn result;
+        if (!chunk->read_byte_array(result)) {
+            err = chunk->error();
+            return std::nullopt;
+        }
+        return result;
+    }
+
+    std::optional<std::vector<bool>> read_bool_column(size_t rg, size_t col) {
+        auto data = read_column(rg, col);
+        if (!data || data->type != Type::BOOLEAN) return std::nullopt;
+        return decode_bool_values(*data);
+    }
+
+    const std::string& error() const { return error_; }
+
+private:
+    bool parse() {
+        if (size_ < 12) {
+            error_ = "File too small";
+            return false;
+        }
+
+        // Check magic bytes at start and end
+        if (std::memcmp(data_, "PAR1", 4) != 0) {
+            error_ = "Invalid magic at start";
+            return false;
+        }
+        if (std::memcmp(data_ + size_ - 4, "PAR1", 4) != 0) {
+            error_ = "Invalid magic at end";
+            return false;
+        }
+
+        // Read metadata length (4 bytes before final magic)
+        uint32_t metadata_len;
+        std::memcpy(&metadata_len, data_ + size_ - 8, 4);
+
+        if (metadata_len + 8 > size_) {
+            error_ = "Invalid metadata length";
+            return false;
+        }
+
+        // Parse metadata
+        const uint8_t* metadata_start = data_ + size_ - 8 - metadata_len;
+        metadata_ = MetadataParser::parse(metadata_start, metadata_len);
+        if (!metadata_) {
+            error_ = "Failed to parse metadata";
+            return false;
+        }
+
+        return true;
+    }
+
     template<typename T>
     std::vector<T> decode_values(const ColumnData& data) {
         std::vector<T> result;
@@ -1764,17 +2188,6 @@ private:
         return result;
     }
 
-    std::vector<std::string> decode_byte_array_values(const ColumnData& data) {
-        std::vector<std::string> result;
-        PlainDecoder decoder(data.data.data(), data.data.size());
-        std::string val;
-        while (decoder.read_byte_array(val)) {
-            result.push_back(std::move(val));
-            val.clear();
-        }
-        return result;
-    }
-
     std::vector<bool> decode_bool_values(const ColumnData& data) {
         std::vector<bool> result;
         for (uint8_t b : data.data) {
@@ -1783,14 +2196,11 @@ private:
         return result;
     }
 
-    static int bit_width_for_max(int max_value) {
-        if (max_value <= 0) return 0;
-        int width = 0;
-        while ((1 << width) <= max_value) width++;
-        return width;
-    }
-
-    std::vector<uint8_t> data_;
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    std::vector<uint8_t> buffer_;  // file contents when not mmap'ed
+    void* map_addr_ = nullptr;
+    size_t map_size_ = 0;
     std::optional<FileMetaData> metadata_;
     std::string error_;
 };
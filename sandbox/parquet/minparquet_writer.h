@@ -0,0 +1,815 @@
+// SPDX-License-Identifier: MIT
+// minparquet_writer.h - Minimal streaming Apache Parquet writer in C++17
+// Companion of minparquet.h (shares its enums)
+//
+// Flat schema of INT32/INT64/FLOAT/DOUBLE/BOOLEAN/BYTE_ARRAY columns.
+// Rows are buffered until `row_group_size` rows, then each column chunk is
+// written as an optional dictionary page + DATA_PAGE(V1) pages of about
+// `page_size` bytes. Column chunk statistics(null_count, min/max) are stored
+// in the footer.
+//
+// Usage:
+//   minpq::ParquetWriter writer;
+//   writer.open("out.parquet", {{"text", minpq::Type::BYTE_ARRAY, true, minpq::ConvertedType::UTF8},
+//                               {"score", minpq::Type::DOUBLE}});
+//   writer.write_string(0, "hello");
+//   writer.write_double(1, 0.5);
+//   writer.end_row();
+//   writer.close();
+//
+// Configuration (define before including):
+//   #define MINPQ_NO_ZSTD    - Disable ZSTD compression
+
+#ifndef MINPARQUET_WRITER_H_
+#define MINPARQUET_WRITER_H_
+
+#include <cmath>
+#include <fstream>
+#include <unordered_map>
+
+#include "minparquet.h"
+
+#ifndef MINPQ_NO_ZSTD
+extern "C" {
+    size_t ZSTD_compressBound(size_t srcSize);
+    size_t ZSTD_compress(void* dst, size_t dstCapacity,
+                         const void* src, size_t srcSize,
+                         int compressionLevel);
+}
+#endif
+
+namespace minpq {
+
+// ============================================================================
+// Thrift Compact Protocol Encoder
+// ============================================================================
+
+class ThriftEncoder {
+public:
+    // Compact protocol type ids
+    static constexpr uint8_t kTrue = 1;
+    static constexpr uint8_t kFalse = 2;
+    static constexpr uint8_t kI32 = 5;
+    static constexpr uint8_t kI64 = 6;
+    static constexpr uint8_t kBinary = 8;
+    static constexpr uint8_t kList = 9;
+    static constexpr uint8_t kStruct = 12;
+
+    explicit ThriftEncoder(std::vector<uint8_t>& out) : out_(out) {}
+
+    void begin_struct() {
+        stack_.push_back(last_field_id_);
+        last_field_id_ = 0;
+    }
+
+    void end_struct() {
+        out_.push_back(0);  // STOP
+        last_field_id_ = stack_.back();
+        stack_.pop_back();
+    }
+
+    void field_i32(int16_t id, int32_t v) { field_header(id, kI32); write_i32(v); }
+    void field_i64(int16_t id, int64_t v) { field_header(id, kI64); write_zigzag(v); }
+    void field_bool(int16_t id, bool v) { field_header(id, v ? kTrue : kFalse); }
+
+    void field_binary(int16_t id, const void* data, size_t size) {
+        field_header(id, kBinary);
+        write_binary(data, size);
+    }
+
+    void field_string(int16_t id, std::string_view s) { field_binary(id, s.data(), s.size()); }
+
+    // Begin a nested struct field; close with end_struct().
+    void field_struct(int16_t id) {
+        field_header(id, kStruct);
+        begin_struct();
+    }
+
+    // Begin a list field; write `size` elements right after.
+    void field_list(int16_t id, uint8_t elem_type, size_t size) {
+        field_header(id, kList);
+        if (size < 15) {
+            out_.push_back(static_cast<uint8_t>((size << 4) | elem_type));
+        } else {
+            out_.push_back(static_cast<uint8_t>(0xF0 | elem_type));
+            write_varint(size);
+        }
+    }
+
+    void write_i32(int32_t v) { write_zigzag(v); }
+
+    void write_binary(const void* data, size_t size) {
+        write_varint(size);
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        out_.insert(out_.end(), p, p + size);
+    }
+
+    void write_varint(uint64_t v) {
+        while (v >= 0x80) {
+            out_.push_back(static_cast<uint8_t>(v | 0x80));
+            v >>= 7;
+        }
+        out_.push_back(static_cast<uint8_t>(v));
+    }
+
+    void write_zigzag(int64_t v) {
+        write_varint((static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63));
+    }
+
+private:
+    void field_header(int16_t id, uint8_t type) {
+        int delta = id - last_field_id_;
+        if (delta > 0 && delta <= 15) {
+            out_.push_back(static_cast<uint8_t>((delta << 4) | type));
+        } else {
+            out_.push_back(type);
+            write_zigzag(id);
+        }
+        last_field_id_ = id;
+    }
+
+    std::vector<uint8_t>& out_;
+    std::vector<int16_t> stack_;
+    int16_t last_field_id_ = 0;
+};
+
+// ============================================================================
+// RLE/Bit-Packing Hybrid Encoder
+// ============================================================================
+
+class RleBitPackingEncoder {
+public:
+    // Append the RLE/bit-packed encoding of `values` to `out`. Runs of 8 or
+    // more equal values are RLE encoded, the rest is bit-packed in groups of 8.
+    static void encode(const uint32_t* values, size_t n, int bit_width,
+                       std::vector<uint8_t>& out) {
+        const size_t value_bytes = static_cast<size_t>((bit_width + 7) / 8);
+
+        size_t i = 0;
+        while (i < n) {
+            size_t run = run_length(values, n, i);
+            if (run >= 8) {
+                write_varint(static_cast<uint64_t>(run) << 1, out);
+                for (size_t b = 0; b < value_bytes; b++) {
+                    out.push_back(static_cast<uint8_t>(values[i] >> (8 * b)));
+                }
+                i += run;
+                continue;
+            }
+
+            // Literal groups of 8 until the next long run. Only the last
+            // group of the stream is padded.
+            size_t begin = i;
+            do {
+                i += 8;
+            } while (i < n && run_length(values, n, i) < 8);
+            size_t end = std::min(i, n);
+            size_t groups = (end - begin + 7) / 8;
+
+            write_varint((static_cast<uint64_t>(groups) << 1) | 1, out);
+
+            uint64_t acc = 0;
+            int acc_bits = 0;
+            for (size_t k = 0; k < groups * 8; k++) {
+                uint64_t v = (begin + k < end) ? values[begin + k] : 0;
+                acc |= v << acc_bits;
+                acc_bits += bit_width;
+                while (acc_bits >= 8) {
+                    out.push_back(static_cast<uint8_t>(acc));
+                    acc >>= 8;
+                    acc_bits -= 8;
+                }
+            }
+            // groups * 8 * bit_width is a multiple of 8, so nothing is left.
+            i = end;
+        }
+    }
+
+    static int bit_width(uint32_t max_value) {
+        int width = 0;
+        while (width < 32 && (uint64_t(1) << width) <= max_value) width++;
+        return width;
+    }
+
+private:
+    static size_t run_length(const uint32_t* values, size_t n, size_t i) {
+        size_t j = i + 1;
+        while (j < n && values[j] == values[i]) j++;
+        return j - i;
+    }
+
+    static void write_varint(uint64_t v, std::vector<uint8_t>& out) {
+        while (v >= 0x80) {
+            out.push_back(static_cast<uint8_t>(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(v));
+    }
+};
+
+// ============================================================================
+// ParquetWriter
+// ============================================================================
+
+struct ColumnSpec {
+    std::string name;
+    Type type;
+    bool optional = true;
+    ConvertedType converted_type = ConvertedType::NONE;  // e.g. UTF8 for text
+};
+
+struct WriterOptions {
+    size_t row_group_size = 128 * 1024;  // rows per row group
+    size_t page_size = 1024 * 1024;      // target uncompressed bytes per data page
+#ifndef MINPQ_NO_ZSTD
+    CompressionCodec codec = CompressionCodec::ZSTD;
+#else
+    CompressionCodec codec = CompressionCodec::UNCOMPRESSED;
+#endif
+    int compression_level = 3;
+    bool dictionary = true;                     // dictionary-encode chunks with repeated values
+    size_t dictionary_page_size = 1024 * 1024;  // larger dictionaries fall back to PLAIN
+    size_t max_statistics_size = 4096;          // longer BYTE_ARRAY min/max are omitted
+    std::string created_by = "minparquet";
+};
+
+class ParquetWriter {
+public:
+    ParquetWriter() = default;
+    ~ParquetWriter() { close(); }
+
+    ParquetWriter(const ParquetWriter&) = delete;
+    ParquetWriter& operator=(const ParquetWriter&) = delete;
+
+    bool open(const std::string& filename, const std::vector<ColumnSpec>& schema,
+              const WriterOptions& options = WriterOptions()) {
+        if (file_.is_open()) close();
+
+        if (schema.empty()) {
+            error_ = "Empty schema";
+            return false;
+        }
+        if (options.codec != CompressionCodec::UNCOMPRESSED
+#ifndef MINPQ_NO_ZSTD
+            && options.codec != CompressionCodec::ZSTD
+#endif
+        ) {
+            error_ = "Unsupported compression codec";
+            return false;
+        }
+
+        file_.open(filename, std::ios::binary | std::ios::trunc);
+        if (!file_) {
+            error_ = "Failed to open file: " + filename;
+            return false;
+        }
+
+        schema_ = schema;
+        options_ = options;
+        if (options_.row_group_size == 0) options_.row_group_size = 1;
+        columns_.assign(schema_.size(), ColumnBuffer());
+        row_groups_.clear();
+        key_value_metadata_.clear();
+        num_rows_ = 0;
+        rows_in_group_ = 0;
+        failed_ = false;
+
+        return write_bytes("PAR1", 4);
+    }
+
+    // Stored in the footer's key_value_metadata.
+    void set_metadata(const std::string& key, const std::string& value) {
+        key_value_metadata_.emplace_back(key, value);
+    }
+
+    size_t num_columns() const { return schema_.size(); }
+
+    // Column index of `name`, or -1.
+    int64_t find_column(std::string_view name) const {
+        for (size_t i = 0; i < schema_.size(); i++) {
+            if (schema_[i].name == name) return static_cast<int64_t>(i);
+        }
+        return -1;
+    }
+
+    // Set the value of column `col` in the current row. Exactly one value
+    // (or null) per column and row.
+    bool write_string(size_t col, std::string_view v) {
+        if (!check(col, Type::BYTE_ARRAY)) return false;
+        auto& c = columns_[col];
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(v.data());
+        c.data.insert(c.data.end(), p, p + v.size());
+        c.offsets.push_back(c.data.size());
+        c.defined.push_back(1);
+        return true;
+    }
+
+    bool write_int32(size_t col, int32_t v) { return write_fixed(col, Type::INT32, &v, sizeof(v)); }
+    bool write_int64(size_t col, int64_t v) { return write_fixed(col, Type::INT64, &v, sizeof(v)); }
+    bool write_float(size_t col, float v) { return write_fixed(col, Type::FLOAT, &v, sizeof(v)); }
+    bool write_double(size_t col, double v) { return write_fixed(col, Type::DOUBLE, &v, sizeof(v)); }
+
+    bool write_bool(size_t col, bool v) {
+        uint8_t b = v ? 1 : 0;
+        return write_fixed(col, Type::BOOLEAN, &b, 1);
+    }
+
+    bool write_null(size_t col) {
+        if (col >= columns_.size()) {
+            error_ = "Column out of range";
+            return false;
+        }
+        if (!schema_[col].optional) {
+            error_ = "Null value for required column: " + schema_[col].name;
+            return false;
+        }
+        columns_[col].defined.push_back(0);
+        columns_[col].num_nulls++;
+        return true;
+    }
+
+    // Finish the current row. Writes a row group every `row_group_size` rows.
+    bool end_row() {
+        if (failed_) return false;
+        for (size_t i = 0; i < columns_.size(); i++) {
+            if (columns_[i].defined.size() != rows_in_group_ + 1) {
+                error_ = "Column `" + schema_[i].name + "` must have exactly one value per row";
+                failed_ = true;
+                return false;
+            }
+        }
+        rows_in_group_++;
+        num_rows_++;
+        if (rows_in_group_ >= options_.row_group_size) {
+            return flush_row_group();
+        }
+        return true;
+    }
+
+    // Write the remaining rows and the footer.
+    bool close() {
+        if (!file_.is_open()) return !failed_;
+
+        bool ok = !failed_;
+        if (ok && rows_in_group_ > 0) ok = flush_row_group();
+        if (ok) ok = write_footer();
+
+        file_.close();
+        if (ok && !file_) {
+            error_ = "Failed to write file";
+            ok = false;
+        }
+        failed_ = !ok;
+        return ok;
+    }
+
+    int64_t num_rows() const { return num_rows_; }
+
+    const std::string& error() const { return error_; }
+
+private:
+    struct ColumnBuffer {
+        // Non-null values. BYTE_ARRAY: value i is data[offsets[i], offsets[i + 1]),
+        // other types: PLAIN little-endian values(BOOLEAN: one byte per value).
+        std::vector<uint8_t> data;
+        std::vector<uint64_t> offsets{0};
+        std::vector<uint8_t> defined;  // definition level per row
+        size_t num_nulls = 0;
+    };
+
+    struct ChunkMeta {
+        Type type;
+        std::vector<Encoding> encodings;
+        std::string path;
+        int64_t num_values = 0;
+        int64_t total_uncompressed_size = 0;
+        int64_t total_compressed_size = 0;
+        int64_t data_page_offset = 0;
+        std::optional<int64_t> dictionary_page_offset;
+        int64_t null_count = 0;
+        std::optional<std::string> min_value;
+        std::optional<std::string> max_value;
+    };
+
+    struct RowGroupMeta {
+        std::vector<ChunkMeta> columns;
+        int64_t num_rows = 0;
+        int64_t total_byte_size = 0;
+        int64_t total_compressed_size = 0;
+        int64_t file_offset = 0;
+    };
+
+    bool check(size_t col, Type type) {
+        if (col >= columns_.size()) {
+            error_ = "Column out of range";
+            return false;
+        }
+        if (schema_[col].type != type) {
+            error_ = "Type mismatch for column: " + schema_[col].name;
+            return false;
+        }
+        return true;
+    }
+
+    bool write_fixed(size_t col, Type type, const void* v, size_t size) {
+        if (!check(col, type)) return false;
+        auto& c = columns_[col];
+        const uint8_t* p = static_cast<const uint8_t*>(v);
+        c.data.insert(c.data.end(), p, p + size);
+        c.defined.push_back(1);
+        return true;
+    }
+
+    static size_t fixed_size(Type type) {
+        switch (type) {
+            case Type::BOOLEAN: return 1;
+            case Type::INT32: case Type::FLOAT: return 4;
+            case Type::INT64: case Type::DOUBLE: return 8;
+            default: return 0;
+        }
+    }
+
+    // Non-null value i as raw bytes
+    static std::string_view value_at(const ColumnBuffer& c, Type type, size_t i) {
+        const char* base = reinterpret_cast<const char*>(c.data.data());
+        if (type == Type::BYTE_ARRAY) {
+            return std::string_view(base + c.offsets[i],
+                                    static_cast<size_t>(c.offsets[i + 1] - c.offsets[i]));
+        }
+        size_t size = fixed_size(type);
+        return std::string_view(base + i * size, size);
+    }
+
+    static size_t num_non_null(const ColumnBuffer& c, Type type) {
+        if (type == Type::BYTE_ARRAY) return c.offsets.size() - 1;
+        return c.data.size() / fixed_size(type);
+    }
+
+    // min/max in the column's sort order(signed ints unless UINT_*, floats
+    // without NaN, unsigned bytes for BYTE_ARRAY and BOOLEAN).
+    static bool less(Type type, bool is_unsigned, std::string_view a, std::string_view b) {
+        if (is_unsigned && type == Type::INT32) { uint32_t x, y; std::memcpy(&x, a.data(), 4); std::memcpy(&y, b.data(), 4); return x < y; }
+        if (is_unsigned && type == Type::INT64) { uint64_t x, y; std::memcpy(&x, a.data(), 8); std::memcpy(&y, b.data(), 8); return x < y; }
+        switch (type) {
+            case Type::INT32: { int32_t x, y; std::memcpy(&x, a.data(), 4); std::memcpy(&y, b.data(), 4); return x < y; }
+            case Type::INT64: { int64_t x, y; std::memcpy(&x, a.data(), 8); std::memcpy(&y, b.data(), 8); return x < y; }
+            case Type::FLOAT: { float x, y; std::memcpy(&x, a.data(), 4); std::memcpy(&y, b.data(), 4); return x < y; }
+            case Type::DOUBLE: { double x, y; std::memcpy(&x, a.data(), 8); std::memcpy(&y, b.data(), 8); return x < y; }
+            default: return a < b;
+        }
+    }
+
+    static bool is_nan(Type type, std::string_view v) {
+        if (type == Type::FLOAT) { float x; std::memcpy(&x, v.data(), 4); return std::isnan(x); }
+        if (type == Type::DOUBLE) { double x; std::memcpy(&x, v.data(), 8); return std::isnan(x); }
+        return false;
+    }
+
+    void compute_statistics(const ColumnBuffer& c, const ColumnSpec& spec, ChunkMeta& meta) const {
+        const Type type = spec.type;
+        const bool is_unsigned = spec.converted_type == ConvertedType::UINT_8 ||
+                                 spec.converted_type == ConvertedType::UINT_16 ||
+                                 spec.converted_type == ConvertedType::UINT_32 ||
+                                 spec.converted_type == ConvertedType::UINT_64;
+        meta.null_count = static_cast<int64_t>(c.num_nulls);
+
+        std::optional<std::string_view> lo, hi;
+        const size_t n = num_non_null(c, type);
+        for (size_t i = 0; i < n; i++) {
+            std::string_view v = value_at(c, type, i);
+            if (is_nan(type, v)) continue;
+            if (!lo || less(type, is_unsigned, v, *lo)) lo = v;
+            if (!hi || less(type, is_unsigned, *hi, v)) hi = v;
+        }
+        if (!lo) return;
+        if (type == Type::BYTE_ARRAY &&
+            (lo->size() > options_.max_statistics_size || hi->size() > options_.max_statistics_size)) {
+            return;
+        }
+        meta.min_value = std::string(*lo);
+        meta.max_value = std::string(*hi);
+    }
+
+    // Append a PLAIN encoded value
+    static void append_plain(Type type, std::string_view v, std::vector<uint8_t>& out) {
+        if (type == Type::BYTE_ARRAY) {
+            uint32_t len = static_cast<uint32_t>(v.size());
+            const uint8_t* p = reinterpret_cast<const uint8_t*>(&len);
+            out.insert(out.end(), p, p + 4);
+        }
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(v.data());
+        out.insert(out.end(), p, p + v.size());
+    }
+
+    bool compress(const std::vector<uint8_t>& src, std::vector<uint8_t>& dst) {
+#ifndef MINPQ_NO_ZSTD
+        if (options_.codec == CompressionCodec::ZSTD) {
+            dst.resize(ZSTD_compressBound(src.size()));
+            size_t n = ZSTD_compress(dst.data(), dst.size(), src.data(), src.size(),
+                                     options_.compression_level);
+            if (ZSTD_isError(n)) {
+                error_ = "ZSTD compression failed";
+                return false;
+            }
+            dst.resize(n);
+            return true;
+        }
+#endif
+        dst = src;
+        return true;
+    }
+
+    // Compress `body` and write it with its page header.
+    bool write_page(PageType type, const std::vector<uint8_t>& body,
+                    int32_t num_values, Encoding encoding, ChunkMeta& meta) {
+        if (!compress(body, page_compressed_)) return false;
+
+        page_header_.clear();
+        ThriftEncoder enc(page_header_);
+        enc.begin_struct();
+        enc.field_i32(1, static_cast<int32_t>(type));
+        enc.field_i32(2, static_cast<int32_t>(body.size()));
+        enc.field_i32(3, static_cast<int32_t>(page_compressed_.size()));
+        if (type == PageType::DICTIONARY_PAGE) {
+            enc.field_struct(7);
+            enc.field_i32(1, num_values);
+            enc.field_i32(2, static_cast<int32_t>(encoding));
+            enc.end_struct();
+        } else {
+            enc.field_struct(5);
+            enc.field_i32(1, num_values);
+            enc.field_i32(2, static_cast<int32_t>(encoding));
+            enc.field_i32(3, static_cast<int32_t>(Encoding::RLE));
+            enc.field_i32(4, static_cast<int32_t>(Encoding::RLE));
+            enc.end_struct();
+        }
+        enc.end_struct();
+
+        meta.total_uncompressed_size += static_cast<int64_t>(page_header_.size() + body.size());
+        meta.total_compressed_size += static_cast<int64_t>(page_header_.size() + page_compressed_.size());
+
+        return write_bytes(page_header_.data(), page_header_.size()) &&
+               write_bytes(page_compressed_.data(), page_compressed_.size());
+    }
+
+    bool write_column_chunk(size_t col, ChunkMeta& meta) {
+        const ColumnSpec& spec = schema_[col];
+        const ColumnBuffer& c = columns_[col];
+        const Type type = spec.type;
+        const size_t n = num_non_null(c, type);
+
+        meta.type = type;
+        meta.path = spec.name;
+        meta.num_values = static_cast<int64_t>(c.defined.size());
+        compute_statistics(c, spec, meta);
+
+        // Dictionary encode when values repeat and the dictionary is small.
+        std::vector<uint32_t> indices;
+        std::vector<std::string_view> dict_values;
+        bool use_dictionary = options_.dictionary && type != Type::BOOLEAN && n > 0;
+        if (use_dictionary) {
+            std::unordered_map<std::string_view, uint32_t> dict;
+            size_t dict_bytes = 0;
+            indices.reserve(n);
+            for (size_t i = 0; i < n && use_dictionary; i++) {
+                std::string_view v = value_at(c, type, i);
+                auto it = dict.find(v);
+                if (it == dict.end()) {
+                    it = dict.emplace(v, static_cast<uint32_t>(dict_values.size())).first;
+                    dict_values.push_back(v);
+                    dict_bytes += v.size() + (type == Type::BYTE_ARRAY ? 4 : 0);
+                    use_dictionary = dict_bytes <= options_.dictionary_page_size;
+                }
+                indices.push_back(it->second);
+            }
+            // No gain when (almost) all values are distinct.
+            use_dictionary = use_dictionary && dict_values.size() * 2 <= n;
+        }
+
+        std::vector<uint8_t> body;
+
+        if (use_dictionary) {
+            meta.dictionary_page_offset = offset_;
+            for (std::string_view v : dict_values) append_plain(type, v, body);
+            if (!write_page(PageType::DICTIONARY_PAGE, body,
+                            static_cast<int32_t>(dict_values.size()), Encoding::PLAIN, meta)) {
+                return false;
+            }
+            meta.encodings = {Encoding::PLAIN, Encoding::RLE, Encoding::RLE_DICTIONARY};
+        } else {
+            meta.encodings = {Encoding::PLAIN, Encoding::RLE};
+        }
+        meta.data_page_offset = offset_;
+
+        const int index_bit_width = use_dictionary
+            ? std::max(1, RleBitPackingEncoder::bit_width(static_cast<uint32_t>(dict_values.size() - 1)))
+            : 0;
+        const size_t fixed = fixed_size(type);
+
+        std::vector<uint32_t> levels;
+        size_t row = 0;
+        size_t value = 0;  // index of the next non-null value
+        const size_t num_rows = c.defined.size();
+        while (row < num_rows || (row == 0 && num_rows == 0)) {
+            // Rows of this page: about `page_size` bytes of values.
+            size_t row_end = row;
+            size_t value_end = value;
+            size_t bytes = 0;
+            while (row_end < num_rows && (bytes < options_.page_size || row_end == row)) {
+                if (c.defined[row_end]) {
+                    if (use_dictionary) {
+                        bytes += static_cast<size_t>(index_bit_width + 7) / 8;
+                    } else if (type == Type::BYTE_ARRAY) {
+                        bytes += 4 + value_at(c, type, value_end).size();
+                    } else {
+                        bytes += fixed;
+                    }
+                    value_end++;
+                }
+                row_end++;
+            }
+
+            body.clear();
+            if (spec.optional) {
+                levels.assign(c.defined.begin() + static_cast<std::ptrdiff_t>(row),
+                              c.defined.begin() + static_cast<std::ptrdiff_t>(row_end));
+                size_t len_pos = body.size();
+                body.resize(len_pos + 4);
+                RleBitPackingEncoder::encode(levels.data(), levels.size(), 1, body);
+                uint32_t len = static_cast<uint32_t>(body.size() - len_pos - 4);
+                std::memcpy(body.data() + len_pos, &len, 4);
+            }
+
+            Encoding encoding = Encoding::PLAIN;
+            if (use_dictionary) {
+                encoding = Encoding::RLE_DICTIONARY;
+                body.push_back(static_cast<uint8_t>(index_bit_width));
+                RleBitPackingEncoder::encode(indices.data() + value, value_end - value,
+                                             index_bit_width, body);
+            } else if (type == Type::BOOLEAN) {
+                // PLAIN booleans are bit-packed, LSB first
+                size_t base = body.size();
+                body.resize(base + (value_end - value + 7) / 8, 0);
+                for (size_t i = value; i < value_end; i++) {
+                    if (c.data[i]) body[base + (i - value) / 8] |= static_cast<uint8_t>(1u << ((i - value) % 8));
+                }
+            } else {
+                for (size_t i = value; i < value_end; i++) {
+                    append_plain(type, value_at(c, type, i), body);
+                }
+            }
+
+            if (!write_page(PageType::DATA_PAGE, body,
+                            static_cast<int32_t>(row_end - row), encoding, meta)) {
+                return false;
+            }
+
+            row = row_end;
+            value = value_end;
+            if (num_rows == 0) break;
+        }
+
+        return true;
+    }
+
+    bool flush_row_group() {
+        RowGroupMeta rg;
+        rg.num_rows = static_cast<int64_t>(rows_in_group_);
+        rg.file_offset = offset_;
+
+        for (size_t col = 0; col < columns_.size(); col++) {
+            ChunkMeta meta;
+            if (!write_column_chunk(col, meta)) {
+                failed_ = true;
+                return false;
+            }
+            rg.total_byte_size += meta.total_uncompressed_size;
+            rg.total_compressed_size += meta.total_compressed_size;
+            rg.columns.push_back(std::move(meta));
+            columns_[col] = ColumnBuffer();
+        }
+
+        row_groups_.push_back(std::move(rg));
+        rows_in_group_ = 0;
+        return true;
+    }
+
+    bool write_footer() {
+        std::vector<uint8_t> footer;
+        ThriftEncoder enc(footer);
+        enc.begin_struct();
+        enc.field_i32(1, 1);  // version
+
+        // schema: root + one leaf per column
+        enc.field_list(2, ThriftEncoder::kStruct, schema_.size() + 1);
+        enc.begin_struct();
+        enc.field_string(4, "schema");
+        enc.field_i32(5, static_cast<int32_t>(schema_.size()));
+        enc.end_struct();
+        for (const auto& spec : schema_) {
+            enc.begin_struct();
+            enc.field_i32(1, static_cast<int32_t>(spec.type));
+            enc.field_i32(3, static_cast<int32_t>(spec.optional ? FieldRepetitionType::OPTIONAL
+                                                                : FieldRepetitionType::REQUIRED));
+            enc.field_string(4, spec.name);
+            if (spec.converted_type != ConvertedType::NONE) {
+                enc.field_i32(6, static_cast<int32_t>(spec.converted_type));
+            }
+            enc.end_struct();
+        }
+
+        enc.field_i64(3, num_rows_);
+
+        enc.field_list(4, ThriftEncoder::kStruct, row_groups_.size());
+        for (size_t g = 0; g < row_groups_.size(); g++) {
+            const auto& rg = row_groups_[g];
+            enc.begin_struct();
+            enc.field_list(1, ThriftEncoder::kStruct, rg.columns.size());
+            for (const auto& cm : rg.columns) {
+                enc.begin_struct();  // ColumnChunk
+                enc.field_i64(2, cm.dictionary_page_offset.value_or(cm.data_page_offset));
+                enc.field_struct(3);  // ColumnMetaData
+                enc.field_i32(1, static_cast<int32_t>(cm.type));
+                enc.field_list(2, ThriftEncoder::kI32, cm.encodings.size());
+                for (Encoding e : cm.encodings) enc.write_i32(static_cast<int32_t>(e));
+                enc.field_list(3, ThriftEncoder::kBinary, 1);
+                enc.write_binary(cm.path.data(), cm.path.size());
+                enc.field_i32(4, static_cast<int32_t>(options_.codec));
+                enc.field_i64(5, cm.num_values);
+                enc.field_i64(6, cm.total_uncompressed_size);
+                enc.field_i64(7, cm.total_compressed_size);
+                enc.field_i64(9, cm.data_page_offset);
+                if (cm.dictionary_page_offset) enc.field_i64(11, *cm.dictionary_page_offset);
+                enc.field_struct(12);  // Statistics
+                enc.field_i64(3, cm.null_count);
+                if (cm.max_value) enc.field_string(5, *cm.max_value);
+                if (cm.min_value) enc.field_string(6, *cm.min_value);
+                enc.end_struct();
+                enc.end_struct();
+                enc.end_struct();
+            }
+            enc.field_i64(2, rg.total_byte_size);
+            enc.field_i64(3, rg.num_rows);
+            enc.field_i64(5, rg.file_offset);
+            enc.field_i64(6, rg.total_compressed_size);
+            enc.field_i32(7, static_cast<int32_t>(g));  // ordinal (i16)
+            enc.end_struct();
+        }
+
+        if (!key_value_metadata_.empty()) {
+            enc.field_list(5, ThriftEncoder::kStruct, key_value_metadata_.size());
+            for (const auto& kv : key_value_metadata_) {
+                enc.begin_struct();
+                enc.field_string(1, kv.first);
+                enc.field_string(2, kv.second);
+                enc.end_struct();
+            }
+        }
+        enc.field_string(6, options_.created_by);
+
+        // column_orders: TYPE_ORDER for every column, so readers trust min_value/max_value
+        enc.field_list(7, ThriftEncoder::kStruct, schema_.size());
+        for (size_t i = 0; i < schema_.size(); i++) {
+            enc.begin_struct();
+            enc.field_struct(1);  // TypeDefinedOrder
+            enc.end_struct();
+            enc.end_struct();
+        }
+        enc.end_struct();
+
+        uint32_t len = static_cast<uint32_t>(footer.size());
+        return write_bytes(footer.data(), footer.size()) &&
+               write_bytes(&len, 4) &&
+               write_bytes("PAR1", 4);
+    }
+
+    bool write_bytes(const void* data, size_t size) {
+        file_.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+        if (!file_) {
+            error_ = "Failed to write file";
+            failed_ = true;
+            return false;
+        }
+        offset_ += static_cast<int64_t>(size);
+        return true;
+    }
+
+    std::ofstream file_;
+    std::vector<ColumnSpec> schema_;
+    WriterOptions options_;
+    std::vector<ColumnBuffer> columns_;
+    std::vector<RowGroupMeta> row_groups_;
+    std::vector<std::pair<std::string, std::string>> key_value_metadata_;
+    int64_t num_rows_ = 0;
+    size_t rows_in_group_ = 0;
+    int64_t offset_ = 0;
+    bool failed_ = false;
+
+    std::vector<uint8_t> page_header_;
+    std::vector<uint8_t> page_compressed_;
+    std::string error_;
+};
+
+} // namespace minpq
+
+#endif // MINPARQUET_WRITER_H_
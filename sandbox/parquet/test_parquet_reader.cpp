@@ -127,6 +127,32 @@ int main(int argc, char* argv[]) {
         std::cout << "Row Group " << rg << ": " << reader.num_rows_in_group(rg) << " rows\n";
     }
 
+    // Iterate data pages of each column chunk in the first row group
+    if (reader.num_row_groups() > 0) {
+        std::cout << "\n=== Pages (row group 0) ===\n";
+        for (size_t col = 0; col < reader.num_columns(); col++) {
+            std::string err;
+            auto chunk = reader.column_chunk(0, col, err);
+            if (!chunk) {
+                std::cout << "  " << reader.column_name(col) << ": " << err << "\n";
+                continue;
+            }
+            minpq::ColumnData page;
+            size_t num_pages = 0;
+            size_t num_values = 0;
+            while (chunk->next_page(page)) {
+                num_pages++;
+                num_values += page.num_values;
+            }
+            std::cout << "  " << reader.column_name(col) << ": " << num_pages << " pages, "
+                      << num_values << " values";
+            if (!chunk->error().empty()) {
+                std::cout << " (" << chunk->error() << ")";
+            }
+            std::cout << "\n";
+        }
+    }
+
     // Print some data
     std::cout << "\n=== Data (first " << max_rows << " rows) ===\n";
 